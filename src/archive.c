@@ -0,0 +1,177 @@
+#include "archive.h"
+#include "log.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// 命令行缓冲区大小；路径都不超过MAX_PATH，压缩参数来自config.ini，放不下的命令拒绝执行（见FormatCmd）
+#define ARCHIVE_CMD_SIZE 4096
+
+// 列表文件的写缓冲区大小（字节）
+#define ARCHIVE_LIST_BUF_SIZE (64 * 1024)
+
+static int FlushList(HANDLE hFile, const BYTE* buf, DWORD bytes) {
+  DWORD written = 0;
+  return WriteFile(hFile, buf, bytes, &written, NULL) && written == bytes;
+}
+
+int Archive_WriteList(const wchar_t* list_path, const wchar_t* const* items, DWORD count) {
+  HANDLE hFile = CreateFileW(list_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    XNSIS_LOG(L"CreateFileW failed: %s, error=%lu", list_path, GetLastError());
+    return 0;
+  }
+  BYTE* buf = (BYTE*)malloc(ARCHIVE_LIST_BUF_SIZE);
+  int ok = buf != NULL;
+  DWORD used = 0;
+  for (DWORD i = 0; i < count && ok; ++i) {
+    // 路径分隔符换成本平台的，7z按本平台的约定解析列表中的路径
+    wchar_t line[MAX_PATH * 2 + 2];
+    size_t len = wcslen(items[i]);
+    if (len > MAX_PATH * 2) {
+      XNSIS_LOG(L"List item too long: %s", items[i]);
+      free(buf);
+      CloseHandle(hFile);
+      return 0;
+    }
+    for (size_t k = 0; k < len; ++k) line[k] = items[i][k] == L'\\' ? PLATFORM_PATH_SEP : items[i][k];
+    line[len++] = L'\r';
+    line[len++] = L'\n';
+    DWORD bytes = (DWORD)(Platform_Utf16Length(line, len) * 2);
+    if (used + bytes > ARCHIVE_LIST_BUF_SIZE) {
+      ok = FlushList(hFile, buf, used);
+      used = 0;
+    }
+    if (ok) used += (DWORD)(Platform_ToUtf16LE(buf + used, line, len) * 2);
+  }
+  if (ok && used) ok = FlushList(hFile, buf, used);
+  if (!ok) XNSIS_LOG(L"Write list failed: %s, error=%lu", list_path, GetLastError());
+  free(buf);
+  CloseHandle(hFile);
+  return ok;
+}
+
+// 格式化7z命令到cmd（ARCHIVE_CMD_SIZE个字符）。放不下时返回0：截断的命令可能少了归档名或开关，
+// 执行它会写错文件或解压不全，不如直接失败
+static int FormatCmd(wchar_t* cmd, const wchar_t* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = _vsnwprintf_s(cmd, ARCHIVE_CMD_SIZE, _TRUNCATE, fmt, args);
+  va_end(args);
+  if (n < 0) {
+    XNSIS_LOG_ERROR(L"7z command longer than %d characters, not run: %.200s...", ARCHIVE_CMD_SIZE - 1, cmd);
+    SetLastError(ERROR_INSUFFICIENT_BUFFER);
+    return 0;
+  }
+  return 1;
+}
+
+static int Run(const ArchiveBackend* backend, const wchar_t* cmd, const wchar_t* work_dir) {
+  if (!backend || !backend->run) {
+    XNSIS_LOG(L"No archive backend for: %s", cmd);
+    return 0;
+  }
+  return backend->run(backend, cmd, work_dir);
+}
+
+static int RunStream(const ArchiveBackend* backend, const wchar_t* cmd, const void* input, size_t input_size,
+  Archive_OutputCallback output, void* output_arg) {
+  if (!backend || !backend->run_stream) {
+    XNSIS_LOG_ERROR(L"Archive backend %s does not support stdin/stdout streams: %s", backend ? backend->name : L"(none)", cmd);
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return 0;
+  }
+  return backend->run_stream(backend, cmd, input, input_size, output, output_arg);
+}
+
+int Archive_Create(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param,
+  const wchar_t* work_dir, const wchar_t* list_path) {
+  wchar_t cmd[ARCHIVE_CMD_SIZE];
+  if (!FormatCmd(cmd, L"a %s -scsUTF-16LE \"%s\" @\"%s\"", param, archive, list_path)) return 0;
+  return Run(backend, cmd, work_dir);
+}
+
+int Archive_AddDir(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param, const wchar_t* dir) {
+  wchar_t cmd[ARCHIVE_CMD_SIZE];
+  if (!FormatCmd(cmd, L"a %s \"%s\" \"%s\\*\"", param, archive, dir)) return 0;
+  return Run(backend, cmd, NULL);
+}
+
+int Archive_AddBuffer(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param,
+  const wchar_t* name, const void* data, size_t size) {
+  wchar_t cmd[ARCHIVE_CMD_SIZE];
+  // 7z按-si后的名字在归档中建项；空数据也要给出非NULL的input，子进程才会读到EOF而不是空设备
+  static const BYTE empty = 0;
+  if (!FormatCmd(cmd, L"a %s \"%s\" \"-si%s\"", param, archive, name)) return 0;
+  return RunStream(backend, cmd, size ? data : &empty, size, NULL, NULL);
+}
+
+// 解析7z参数中的大小（如64m、256M、1g、4096k，无单位为字节）
+static ULONGLONG ParseSizeParam(const wchar_t* p) {
+  ULONGLONG value = 0;
+  while (*p >= L'0' && *p <= L'9') value = value * 10 + (*p++ - L'0');
+  switch (*p) {
+  case L'k': case L'K': return value << 10;
+  case L'm': case L'M': return value << 20;
+  case L'g': case L'G': return value << 30;
+  default: return value;
+  }
+}
+
+// LZMA编码器约为字典大小的11.5倍（bt4匹配器），LZMA2多线程时每两个线程一个编码器。
+// 未指定字典时按-mx级别取7-Zip的默认值
+ULONGLONG Archive_EstimateEncoderMemory(const wchar_t* param) {
+  ULONGLONG dict = 0;
+  DWORD level = 5, threads = 1;
+  const wchar_t* p;
+  if ((p = wcsstr(param, L"-mx")) != NULL) {
+    p += 3;
+    if (*p == L'=') ++p;
+    if (*p >= L'0' && *p <= L'9') level = *p - L'0';
+  }
+  if ((p = wcsstr(param, L"-md=")) != NULL) dict = ParseSizeParam(p + 4);
+  else if ((p = wcsstr(param, L":d=")) != NULL) dict = ParseSizeParam(p + 3);
+  if ((p = wcsstr(param, L"-mmt=")) != NULL && p[5] >= L'0' && p[5] <= L'9') threads = (DWORD)wcstoul(p + 5, NULL, 10);
+  if (dict == 0) dict = level >= 9 ? (64ull << 20) : level >= 7 ? (32ull << 20) : level >= 5 ? (16ull << 20) : (1ull << 20);
+  ULONGLONG encoders = 1;
+  if (wcsstr(param, L"lzma2") || wcsstr(param, L"LZMA2")) encoders = threads > 2 ? (threads + 1) / 2 : 1;
+  return encoders * (dict * 23 / 2 + (16ull << 20));
+}
+
+int Archive_Extract(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* out_dir,
+  const wchar_t* list_path, const wchar_t* switches) {
+  wchar_t cmd[ARCHIVE_CMD_SIZE];
+  int ok;
+  if (list_path) {
+    ok = FormatCmd(cmd, L"x \"%s\" -o\"%s\" %s -scsUTF-16LE @\"%s\"", archive, out_dir, switches ? switches : L"", list_path);
+  }
+  else {
+    ok = FormatCmd(cmd, L"x \"%s\" -o\"%s\" %s", archive, out_dir, switches ? switches : L"");
+  }
+  return ok && Run(backend, cmd, NULL);
+}
+
+typedef struct {
+  Archive_ItemCallback cb;
+  void* arg;
+  DWORD index;
+} ItemOutput;
+
+static int ForwardItemOutput(void* arg, const void* data, size_t size) {
+  ItemOutput* out = (ItemOutput*)arg;
+  return out->cb(out->arg, out->index, data, size);
+}
+
+int Archive_ExtractItems(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* const* items, DWORD count,
+  Archive_ItemCallback cb, void* cb_arg) {
+  // -so把所有匹配项的数据首尾相接写到stdout，分不出边界，所以每项单独执行一条命令
+  ItemOutput out = { cb, cb_arg, 0 };
+  for (DWORD i = 0; i < count; ++i) {
+    wchar_t cmd[ARCHIVE_CMD_SIZE];
+    out.index = i;
+    if (!FormatCmd(cmd, L"x \"%s\" -so \"%s\"", archive, items[i])) return 0;
+    if (!RunStream(backend, cmd, NULL, 0, ForwardItemOutput, &out)) return 0;
+    if (!cb(cb_arg, i, NULL, 0)) return 0;
+  }
+  return 1;
+}
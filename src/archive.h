@@ -0,0 +1,61 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 7z的原始输出（-so）按到达顺序分段交给它；返回0中止命令
+  typedef int (*Archive_OutputCallback)(void* arg, const void* data, size_t size);
+
+  // 归档后端：打包端和安装端都通过它调用7-Zip，命令采用7z命令行语法（不含程序名）。
+  // 进程内后端直接调用链接进来的7-Zip，省去每次创建进程、启动7z的开销；
+  // 外部进程后端由调用方提供（打包端经ProcessExecutor启动7z.exe），作为没有链接7-Zip时的回退
+  typedef struct ArchiveBackend {
+    const wchar_t* name;
+    // 执行一条7z命令，work_dir为NULL时使用当前目录；成功返回1。进程内后端不切换进程的当前目录，不支持work_dir
+    int (*run)(const struct ArchiveBackend* backend, const wchar_t* args, const wchar_t* work_dir);
+    // 执行一条读stdin（-si）或写stdout（-so）的7z命令：input非NULL时作为stdin，output非NULL时接收stdout。
+    // 为NULL表示不支持：链接进来的7-Zip的标准输入输出是进程级的，进程内后端不提供
+    int (*run_stream)(const struct ArchiveBackend* backend, const wchar_t* args, const void* input, size_t input_size,
+      Archive_OutputCallback output, void* output_arg);
+    void* user;
+  } ArchiveBackend;
+
+  // Archive_ExtractItems逐项回调：index为项在items中的下标，数据分段到达，每项结束时以data为NULL、size为0回调一次；返回0中止
+  typedef int (*Archive_ItemCallback)(void* arg, DWORD index, const void* data, size_t size);
+
+  // 进程内后端，只在链接了nsis7z的模块中可用（archive_inproc.c）
+  const ArchiveBackend* Archive_InProcessBackend(void);
+  // 链接进来的7-Zip能否并发调用；为0时Archive_InProcessEnter/Leave使所有调用逐个执行
+  int Archive_InProcessReentrant(void);
+  // 调用链接进来的7-Zip的其他入口（如nsis7z的Extract7z）前后调用，与进程内后端的命令互斥
+  void Archive_InProcessEnter(void);
+  void Archive_InProcessLeave(void);
+
+  // 写7z列表文件（UTF-16LE，每行一项，配合-scsUTF-16LE使用）
+  int Archive_WriteList(const wchar_t* list_path, const wchar_t* const* items, DWORD count);
+
+  // 按列表文件创建或追加归档，列表中的路径相对于work_dir，也是归档名；backend须支持work_dir
+  int Archive_Create(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param,
+    const wchar_t* work_dir, const wchar_t* list_path);
+  // 把目录下的所有内容加入归档，归档名相对于该目录
+  int Archive_AddDir(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param, const wchar_t* dir);
+  // 把内存中的数据以name为归档名加入归档（7z -si），不经过文件；backend须支持run_stream
+  int Archive_AddBuffer(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* param,
+    const wchar_t* name, const void* data, size_t size);
+
+  // 按7z压缩参数（-mx、-md或:d=、-mmt、lzma2）粗略估计一个7z压缩进程的峰值内存（字节）
+  ULONGLONG Archive_EstimateEncoderMemory(const wchar_t* param);
+
+  // 解压到out_dir：list_path为NULL时解压全部，否则只解压列表中的项（归档中没有的项跳过）。
+  // switches为附加参数，如L"-aoa -y"
+  int Archive_Extract(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* out_dir,
+    const wchar_t* list_path, const wchar_t* switches);
+  // 依次把items中的项解压到内存（7z -so，每项一条命令）交给cb，不写文件；归档中没有的项得到空数据。backend须支持run_stream
+  int Archive_ExtractItems(const ArchiveBackend* backend, const wchar_t* archive, const wchar_t* const* items, DWORD count,
+    Archive_ItemCallback cb, void* cb_arg);
+
+#ifdef __cplusplus
+}
+#endif
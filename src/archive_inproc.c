@@ -0,0 +1,69 @@
+#include "archive.h"
+#include "log.h"
+#include <stdlib.h>
+#include <wchar.h>
+#ifdef DBG_SOLUTION
+#include"fake.h"
+#else
+#include "../../../Contrib/7-Zip/Contrib/nsis7z/CPP/7zip/UI/Console/Console7zMain.h"
+#endif
+
+// 链接进来的7-Zip入口（命令行入口和nsis7z的Extract7z）使用进程级的全局状态（标准输出/错误流、
+// 中断处理、进度回调），未确认可重入之前所有调用互斥执行。确认后可在构建时定义XNSIS_INPROC_7Z_REENTRANT。
+// DBG_SOLUTION（含POSIX构建）链接的是fake.cpp中的替身，每次调用都启动独立的7z进程，没有共享状态，不需要互斥
+#if defined(DBG_SOLUTION) && !defined(XNSIS_INPROC_7Z_REENTRANT)
+#define XNSIS_INPROC_7Z_REENTRANT
+#endif
+static SRWLOCK g_7z_lock = SRWLOCK_INIT;
+
+int Archive_InProcessReentrant(void) {
+#ifdef XNSIS_INPROC_7Z_REENTRANT
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void Archive_InProcessEnter(void) {
+#ifndef XNSIS_INPROC_7Z_REENTRANT
+  AcquireSRWLockExclusive(&g_7z_lock);
+#endif
+}
+
+void Archive_InProcessLeave(void) {
+#ifndef XNSIS_INPROC_7Z_REENTRANT
+  ReleaseSRWLockExclusive(&g_7z_lock);
+#endif
+}
+
+// 进程内的7-Zip没有工作目录参数。切换进程的当前目录会影响其他线程对相对路径的解析，
+// 所以不支持work_dir，需要工作目录的命令由调用方交给外部进程后端
+static int RunInProcess(const ArchiveBackend* backend, const wchar_t* args, const wchar_t* work_dir) {
+  (void)backend;
+  if (work_dir) {
+    XNSIS_LOG_ERROR(L"In-process 7z does not support a working directory: %s", work_dir);
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return 0;
+  }
+  // 按命令的实际长度分配，不截断
+  size_t size = wcslen(args) + 4;
+  wchar_t* cmd = (wchar_t*)malloc(size * sizeof(wchar_t));
+  if (!cmd) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return 0;
+  }
+  _snwprintf_s(cmd, size, _TRUNCATE, L"7z %s", args);
+  Archive_InProcessEnter();
+  int failed = Main2CustomNoExcept(1, (char**)cmd);
+  Archive_InProcessLeave();
+  if (failed) XNSIS_LOG(L"7z failed (in-process): %s", cmd);
+  free(cmd);
+  return !failed;
+}
+
+// 不提供run_stream：7-Zip的命令行入口从进程的标准输入输出读写-si/-so的数据
+static const ArchiveBackend g_inproc_backend = { L"inproc", RunInProcess, NULL, NULL };
+
+const ArchiveBackend* Archive_InProcessBackend(void) {
+  return &g_inproc_backend;
+}
@@ -0,0 +1,64 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_CHUNK  (64 * 1024)
+#define ARENA_MAX_CHUNK  (4 * 1024 * 1024)
+#define ARENA_ALIGN(n)   (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+struct ArenaChunk {
+  ArenaChunk* next;
+  size_t used;
+  size_t size;
+};
+
+void Arena_Init(Arena* arena) {
+  memset(arena, 0, sizeof(Arena));
+}
+
+void Arena_Free(Arena* arena) {
+  ArenaChunk* chunk = arena->head;
+  while (chunk) {
+    ArenaChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  memset(arena, 0, sizeof(Arena));
+}
+
+void* Arena_Alloc(Arena* arena, size_t size) {
+  size = ARENA_ALIGN(size ? size : 1);
+  ArenaChunk* chunk = arena->head;
+  if (!chunk || chunk->size - chunk->used < size) {
+    // 块大小逐次翻倍，超大的分配单独占一块
+    size_t chunk_size = arena->next_chunk_size ? arena->next_chunk_size : ARENA_MIN_CHUNK;
+    if (chunk_size < ARENA_MAX_CHUNK) arena->next_chunk_size = chunk_size * 2;
+    if (chunk_size < size) chunk_size = size;
+    size_t header = ARENA_ALIGN(sizeof(ArenaChunk));
+    ArenaChunk* new_chunk = (ArenaChunk*)malloc(header + chunk_size);
+    if (!new_chunk) return NULL;
+    new_chunk->used = header;
+    new_chunk->size = header + chunk_size;
+    arena->allocated += new_chunk->size;
+    // 当前块剩余空间比新块多时（单独分配的大块），把新块挂在后面，继续使用当前块
+    if (chunk && chunk->size - chunk->used > chunk_size - size) {
+      new_chunk->next = chunk->next;
+      chunk->next = new_chunk;
+    }
+    else {
+      new_chunk->next = chunk;
+      arena->head = new_chunk;
+    }
+    chunk = new_chunk;
+  }
+  void* p = (BYTE*)chunk + chunk->used;
+  chunk->used += size;
+  return p;
+}
+
+wchar_t* Arena_StrDup(Arena* arena, const wchar_t* str) {
+  size_t bytes = (wcslen(str) + 1) * sizeof(wchar_t);
+  wchar_t* copy = (wchar_t*)Arena_Alloc(arena, bytes);
+  if (copy) memcpy(copy, str, bytes);
+  return copy;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct ArenaChunk ArenaChunk;
+
+  // 线性分配器：只能整体释放；全零即为可用的空arena
+  typedef struct {
+    ArenaChunk* head;
+    size_t next_chunk_size;
+    size_t allocated;   // 已分配的总字节数（含块头）
+  } Arena;
+
+  void Arena_Init(Arena* arena);
+  // 释放所有分配，arena恢复为空
+  void Arena_Free(Arena* arena);
+  // 分配size字节，按指针大小对齐；失败返回NULL
+  void* Arena_Alloc(Arena* arena, size_t size);
+  // 复制字符串，失败返回NULL
+  wchar_t* Arena_StrDup(Arena* arena, const wchar_t* str);
+
+#ifdef __cplusplus
+}
+#endif
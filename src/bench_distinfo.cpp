@@ -0,0 +1,175 @@
+// distinfo基准：构造大量条目（AddFile耗时、DistInfo_Free耗时），比较v2与v3的保存、加载耗时和加载后的内存占用，
+// 以及各校验算法的吞吐
+// 用法：bench_distinfo [条目数，默认1000000] [重复次数，默认5]
+#include "distinfo.h"
+#include "platform.h"
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace {
+  double NowSeconds() {
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+  }
+
+#ifdef _WIN32
+  // 私有提交内存：v3映射的文件页不计入，v2复制出的字符串计入
+  SIZE_T PrivateBytes() {
+    PROCESS_MEMORY_COUNTERS_EX pmc = { sizeof(pmc) };
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc));
+    return pmc.PrivateUsage;
+  }
+
+  SIZE_T WorkingSet() {
+    PROCESS_MEMORY_COUNTERS_EX pmc = { sizeof(pmc) };
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc));
+    return pmc.WorkingSetSize;
+  }
+#else
+  // /proc/self/statm：resident为常驻页数，shared为其中文件映射的页数；
+  // 常驻减去共享即匿名私有页，与Windows的私有提交一样不计v3映射的文件页
+  bool ReadStatm(SIZE_T* resident, SIZE_T* shared) {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return false;
+    unsigned long size = 0, res = 0, shr = 0;
+    bool ok = fscanf(f, "%lu %lu %lu", &size, &res, &shr) == 3;
+    fclose(f);
+    long page = sysconf(_SC_PAGESIZE);
+    *resident = (SIZE_T)res * (SIZE_T)page;
+    *shared = (SIZE_T)shr * (SIZE_T)page;
+    return ok;
+  }
+
+  SIZE_T PrivateBytes() {
+    SIZE_T resident = 0, shared = 0;
+    return ReadStatm(&resident, &shared) ? resident - shared : 0;
+  }
+
+  SIZE_T WorkingSet() {
+    SIZE_T resident = 0, shared = 0;
+    return ReadStatm(&resident, &shared) ? resident : 0;
+  }
+#endif
+
+  // 各校验算法对64MB缓冲区的吞吐，取最好的一次
+  void BenchHashes(int repeat) {
+    const size_t size = 64 * 1024 * 1024;
+    std::vector<BYTE> data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = (BYTE)(i * 2654435761u >> 13);
+    BYTE digest[HASH_MAX_DIGEST_SIZE];
+    for (DWORD alg = 0; alg < HASH_ALG_COUNT; ++alg) {
+      double best = 1e30;
+      for (int r = 0; r < repeat; ++r) {
+        double t0 = NowSeconds();
+        Hash_Buffer(alg, data.data(), size, digest);
+        double t = NowSeconds() - t0;
+        if (t < best) best = t;
+      }
+      printf("hash %ls: %.0f MB/s\n", Hash_AlgName(alg), size / 1048576.0 / best);
+    }
+  }
+
+  const DWORD kDirCount = 4;
+
+  // 模拟真实安装包：多个fake目录，路径有较深的公共前缀，少量路径在多个目录中重复
+  std::vector<std::wstring> MakePaths(DWORD entries) {
+    std::vector<std::wstring> paths(entries);
+    wchar_t path[MAX_PATH];
+    for (DWORD i = 0; i < entries; ++i) {
+      DWORD shared = (i % 16 == 0) ? i / 16 : i;
+      swprintf(path, MAX_PATH, L"app\\module%lu\\res\\sub%lu\\file_%lu.dat",
+        (unsigned long)(shared % 97), (unsigned long)(shared % 13), (unsigned long)shared);
+      paths[i] = path;
+    }
+    return paths;
+  }
+
+  // 只计AddFakeDir/AddFile本身的耗时，路径提前生成
+  double BuildInfo(InstallDistInfo* info, const std::vector<std::wstring>& paths) {
+    memset(info, 0, sizeof(InstallDistInfo));
+    double t0 = NowSeconds();
+    for (DWORD i = 0; i < kDirCount; ++i) {
+      DistInfo_AddFakeDir(info, (L"$" + std::to_wstring(i + 1)).c_str());
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+      DistInfo_AddFile(info, (int)(i % kDirCount), paths[i].c_str());
+    }
+    double elapsed = NowSeconds() - t0;
+    DistInfo_AddPlugin(info, L"app\\module1\\plugin.dll", L"-mx9");
+    DistInfo_SetInstall7zName(info, L"install_12345.7z");
+    return elapsed;
+  }
+
+  DWORD TouchAll(const InstallDistInfo* info) {
+    // 访问所有字符串，让映射的页面真正读入
+    DWORD sum = 0;
+    for (DWORD i = 0; i < info->dir_count; ++i) {
+      for (DWORD j = 0; j < info->dirs[i].file_count; ++j) sum += info->dirs[i].file_list[j][0];
+    }
+    return sum;
+  }
+
+  void BenchVersion(const InstallDistInfo* info, DWORD version, int repeat) {
+    wchar_t path[MAX_PATH];
+    swprintf(path, MAX_PATH, L"bench_v%lu.distinfo", (unsigned long)version);
+    double t0 = NowSeconds();
+    if (!DistInfo_SaveVersion(info, path, version)) {
+      printf("v%lu: save failed\n", (unsigned long)version);
+      return;
+    }
+    double save_time = NowSeconds() - t0;
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    GetFileAttributesExW(path, GetFileExInfoStandard, &attr);
+    double best = 1e30;
+    SIZE_T private_delta = 0, ws_delta = 0;
+    for (int r = 0; r < repeat; ++r) {
+      InstallDistInfo loaded;
+      SIZE_T private_before = PrivateBytes(), ws_before = WorkingSet();
+      t0 = NowSeconds();
+      if (!DistInfo_Load(&loaded, path)) {
+        printf("v%lu: load failed\n", (unsigned long)version);
+        return;
+      }
+      TouchAll(&loaded);
+      double t = NowSeconds() - t0;
+      if (t < best) best = t;
+      private_delta = PrivateBytes() - private_before;
+      ws_delta = WorkingSet() - ws_before;
+      DistInfo_Free(&loaded);
+    }
+    printf("v%lu: file=%.1f MB save=%.3f s load(best of %d)=%.3f s private=+%.1f MB working_set=+%.1f MB\n",
+      (unsigned long)version, attr.nFileSizeLow / 1048576.0, save_time, repeat, best,
+      private_delta / 1048576.0, ws_delta / 1048576.0);
+    DeleteFileW(path);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  DWORD entries = argc > 1 ? (DWORD)strtoul(argv[1], NULL, 10) : 1000000;
+  int repeat = argc > 2 ? atoi(argv[2]) : 5;
+  BenchHashes(repeat);
+  std::vector<std::wstring> paths = MakePaths(entries);
+
+  InstallDistInfo info;
+  SIZE_T private_before = PrivateBytes();
+  double add_time = BuildInfo(&info, paths);
+  SIZE_T build_private = PrivateBytes() - private_before;
+  printf("entries=%lu AddFile=%.3f s (%.1f ns/call) private=+%.1f MB\n", (unsigned long)entries, add_time,
+    entries ? add_time * 1e9 / entries : 0.0, build_private / 1048576.0);
+  BenchVersion(&info, DISTINFO_VERSION_2, repeat);
+  BenchVersion(&info, DISTINFO_VERSION_3, repeat);
+  double t0 = NowSeconds();
+  DistInfo_Free(&info);
+  printf("DistInfo_Free=%.3f s\n", NowSeconds() - t0);
+  return 0;
+}
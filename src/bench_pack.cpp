@@ -0,0 +1,502 @@
+// 打包/安装基准：按参数生成合成的源目录树（文件数、大小分布、目录深度、重复内容比例、可压缩程度），
+// 依次计时AddSrcFile、GenerateInstall7z、InstallContext_Init、ExtractInstall7z、SetCurrentRealOutDir，
+// 另有distinfo保存/加载的微基准。结果每项一行JSON（JSON Lines），带--label（如提交号）以便跨提交比较。
+// 按DBG_SOLUTION构建，7z调用经PATH中的7z完成，可在Linux上对本地7z运行。
+// 用法：bench_pack [--files=2000] [--size-dist=lognormal|uniform|fixed] [--mean-size=65536] [--max-size=8388608]
+//   [--depth=4] [--fanout=8] [--dup=0.1] [--compress=0.5] [--fake-dirs=2] [--seed=1] [--repeat=3]
+//   [--param="-t7z -mx=3 -mmt=on"] [--config=config.ini] [--streaming] [--distinfo-entries=200000]
+//   [--work=bench_work] [--out=results.jsonl] [--label=xxx] [--log=error|warn|info|debug] [--keep]
+#include "pack.h"
+#include "install.h"
+#include "log.h"
+#include "platform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+  struct BenchOptions {
+    uint32_t files = 2000;
+    std::string size_dist = "lognormal";
+    uint64_t mean_size = 64 * 1024;
+    uint64_t max_size = 8 * 1024 * 1024;
+    uint32_t depth = 4;
+    uint32_t fanout = 8;
+    double dup = 0.1;        // 内容与之前某个文件相同的比例
+    double compress = 0.5;   // 每块中可压缩（重复文本）部分的比例，其余为随机数据
+    uint32_t fake_dirs = 2;
+    uint64_t seed = 1;
+    int repeat = 3;
+    std::string param = "-t7z -mx=3 -mmt=on";
+    std::string config;      // 指定时直接用作config.ini，忽略param
+    std::string config_content;
+    bool streaming = false;
+    uint32_t distinfo_entries = 200000;
+    std::string work = "bench_work";
+    std::string out;         // 为空时输出到stdout
+    std::string label;
+    std::string log = "error";
+    bool keep = false;
+  };
+
+  double NowSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  std::wstring Widen(const std::string& s) {
+    int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, NULL, 0);
+    std::wstring w(len > 0 ? len : 1, L'\0');
+    if (len > 0) MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, &w[0], len);
+    w.resize(wcslen(w.c_str()));
+    return w;
+  }
+
+  // 防止访问字符串的循环被优化掉
+  volatile DWORD g_touch_sink;
+
+  // splitmix64，同样的种子在各平台生成同样的目录树
+  struct Rng {
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed) {}
+    uint64_t Next() {
+      uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+    double Uniform() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+  };
+
+  // 合成文件：path为相对于src目录的路径，content_seed相同的文件内容相同
+  struct SynthFile {
+    std::wstring path;
+    uint32_t fake_idx;
+    uint64_t size;
+    uint64_t content_seed;
+    bool dup;
+  };
+
+  uint64_t DrawSize(const BenchOptions& opt, Rng& rng) {
+    double size;
+    if (opt.size_dist == "fixed") {
+      size = (double)opt.mean_size;
+    }
+    else if (opt.size_dist == "uniform") {
+      size = rng.Uniform() * 2.0 * (double)opt.mean_size;
+    }
+    else {
+      // 对数正态，sigma=1.5：大量小文件加少量大文件，均值为mean_size
+      const double sigma = 1.5;
+      double u1 = rng.Uniform(), u2 = rng.Uniform();
+      double normal = std::sqrt(-2.0 * std::log(u1 > 0 ? u1 : 1e-300)) * std::cos(6.283185307179586 * u2);
+      size = std::exp(std::log((double)opt.mean_size) - sigma * sigma / 2 + sigma * normal);
+    }
+    return (std::min)((uint64_t)size, opt.max_size);
+  }
+
+  std::vector<SynthFile> PlanTree(const BenchOptions& opt) {
+    Rng rng(opt.seed);
+    std::vector<SynthFile> files;
+    files.reserve(opt.files);
+    for (uint32_t i = 0; i < opt.files; ++i) {
+      SynthFile f;
+      f.fake_idx = i % opt.fake_dirs;
+      f.path = L"fake" + std::to_wstring(f.fake_idx);
+      uint32_t depth = opt.depth ? (uint32_t)(rng.Next() % (opt.depth + 1)) : 0;
+      for (uint32_t d = 0; d < depth; ++d) f.path += L"\\d" + std::to_wstring(d) + L"_" + std::to_wstring(rng.Next() % opt.fanout);
+      f.path += L"\\f" + std::to_wstring(i) + L".bin";
+      f.dup = i > 0 && rng.Uniform() < opt.dup;
+      if (f.dup) {
+        const SynthFile& src = files[rng.Next() % i];
+        f.size = src.size;
+        f.content_seed = src.content_seed;
+      }
+      else {
+        f.size = DrawSize(opt, rng);
+        f.content_seed = rng.Next();
+      }
+      files.push_back(f);
+    }
+    return files;
+  }
+
+  bool MakeDirs(const std::wstring& path) {
+    for (size_t pos = path.find(L'\\'); pos != std::wstring::npos; pos = path.find(L'\\', pos + 1)) {
+      CreateDirectoryW(path.substr(0, pos).c_str(), NULL);
+    }
+    return CreateDirectoryW(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+  }
+
+  bool RemoveTree(const std::wstring& path) {
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileW((path + L"\\*").c_str(), &fd);
+    if (hFind != INVALID_HANDLE_VALUE) {
+      do {
+        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+        std::wstring sub = path + L"\\" + fd.cFileName;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) RemoveTree(sub);
+        else DeleteFileW(sub.c_str());
+      } while (FindNextFileW(hFind, &fd));
+      FindClose(hFind);
+    }
+    return RemoveDirectoryW(path.c_str()) || GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND;
+  }
+
+  // 每4KB块的前compress部分为重复的文本，其余为随机数据
+  void FillContent(std::vector<BYTE>& buf, uint64_t offset, Rng& rng, double compress) {
+    static const char kText[] = "xnsis synthetic payload: the quick brown fox jumps over the lazy dog. ";
+    const size_t block = 4096;
+    const size_t text_len = (size_t)(block * compress);
+    for (size_t i = 0; i < buf.size(); i += block) {
+      size_t n = (std::min)(block, buf.size() - i);
+      size_t j = 0;
+      for (; j < n && j < text_len; ++j) buf[i + j] = (BYTE)kText[(offset + i + j) % (sizeof(kText) - 1)];
+      for (; j < n; j += 8) {
+        uint64_t r = rng.Next();
+        memcpy(&buf[i + j], &r, (std::min)((size_t)8, n - j));
+      }
+    }
+  }
+
+  bool WriteSynthFile(const std::wstring& root, const SynthFile& f, double compress) {
+    std::wstring path = root + L"\\" + f.path;
+    if (!MakeDirs(path.substr(0, path.rfind(L'\\')))) return false;
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+    Rng rng(f.content_seed);
+    std::vector<BYTE> buf;
+    bool ok = true;
+    for (uint64_t offset = 0; offset < f.size && ok; offset += buf.size()) {
+      buf.resize((size_t)(std::min)((uint64_t)1 << 20, f.size - offset));
+      FillContent(buf, offset, rng, compress);
+      DWORD written = 0;
+      ok = WriteFile(hFile, buf.data(), (DWORD)buf.size(), &written, NULL) && written == buf.size();
+    }
+    CloseHandle(hFile);
+    return ok;
+  }
+
+  uint64_t FileSize(const std::wstring& path) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fad)) return 0;
+    return ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  }
+
+  std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      if ((unsigned char)c < 0x20) {
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        out += esc;
+      }
+      else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+
+  // 各项计时，按首次出现的顺序输出
+  class Results {
+  public:
+    void Add(const std::string& metric, double seconds) {
+      for (auto& item : items_) {
+        if (item.first == metric) {
+          item.second.push_back(seconds);
+          return;
+        }
+      }
+      items_.emplace_back(metric, std::vector<double>(1, seconds));
+    }
+    const std::vector<std::pair<std::string, std::vector<double>>>& Items() const { return items_; }
+
+  private:
+    std::vector<std::pair<std::string, std::vector<double>>> items_;
+  };
+
+  class JsonOut {
+  public:
+    JsonOut(FILE* file, const std::string& label) : file_(file), label_(label) {}
+    void Config(const BenchOptions& opt, uint64_t total_bytes, uint64_t unique_bytes) {
+      fprintf(file_, "{\"suite\":\"xnsis-bench\",\"label\":%s,\"record\":\"config\",\"files\":%u,\"size_dist\":%s,"
+        "\"mean_size\":%llu,\"max_size\":%llu,\"depth\":%u,\"fanout\":%u,\"dup\":%.3f,\"compress\":%.3f,"
+        "\"fake_dirs\":%u,\"seed\":%llu,\"repeat\":%d,\"param\":%s,\"streaming\":%s,"
+        "\"total_bytes\":%llu,\"unique_bytes\":%llu}\n",
+        JsonString(label_).c_str(), opt.files, JsonString(opt.size_dist).c_str(), (unsigned long long)opt.mean_size,
+        (unsigned long long)opt.max_size, opt.depth, opt.fanout, opt.dup, opt.compress, opt.fake_dirs,
+        (unsigned long long)opt.seed, opt.repeat, JsonString(opt.config.empty() ? opt.param : "config:" + opt.config).c_str(),
+        opt.streaming ? "true" : "false", (unsigned long long)total_bytes, (unsigned long long)unique_bytes);
+    }
+    // 单个数值，如归档大小
+    void Value(const std::string& metric, const char* unit, double value) {
+      fprintf(file_, "{\"suite\":\"xnsis-bench\",\"label\":%s,\"record\":\"value\",\"metric\":%s,\"unit\":\"%s\",\"value\":%.0f}\n",
+        JsonString(label_).c_str(), JsonString(metric).c_str(), unit, value);
+    }
+    // 多次运行的耗时：最小值、中位数和每次的原始值
+    void Timings(const Results& results) {
+      for (const auto& item : results.Items()) {
+        std::vector<double> sorted = item.second;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted.size() % 2 ? sorted[sorted.size() / 2] : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2;
+        std::string runs;
+        for (size_t i = 0; i < item.second.size(); ++i) {
+          char num[32];
+          snprintf(num, sizeof(num), "%s%.6f", i ? "," : "", item.second[i]);
+          runs += num;
+        }
+        fprintf(file_, "{\"suite\":\"xnsis-bench\",\"label\":%s,\"record\":\"timing\",\"metric\":%s,\"unit\":\"s\","
+          "\"min\":%.6f,\"median\":%.6f,\"runs\":[%s]}\n",
+          JsonString(label_).c_str(), JsonString(item.first).c_str(), sorted.front(), median, runs.c_str());
+      }
+      fflush(file_);
+    }
+
+  private:
+    FILE* file_;
+    std::string label_;
+  };
+
+  bool ReadConfig(BenchOptions& opt) {
+    FILE* in = fopen(opt.config.c_str(), "rb");
+    if (!in) return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) opt.config_content.append(buf, n);
+    fclose(in);
+    return true;
+  }
+
+  bool WriteConfigIni(const BenchOptions& opt) {
+    std::string content = opt.config.empty() ? "[compress_param]\r\n" + opt.param + "\r\n" : opt.config_content;
+    FILE* out = fopen("config.ini", "wb");
+    if (!out) return false;
+    bool ok = fwrite(content.data(), 1, content.size(), out) == content.size();
+    fclose(out);
+    return ok;
+  }
+
+  // 一次完整的打包和安装，各阶段耗时记入results
+  bool RunOnce(const BenchOptions& opt, Results& results, uint64_t& archive_bytes) {
+    RemoveTree(L"out");
+    double t0, t_begin = NowSeconds();
+    std::wstring install7z;
+    {
+      PackInstall pack;
+      t0 = NowSeconds();
+      for (uint32_t k = 0; k < opt.fake_dirs; ++k) {
+        pack.SetCurrentFakeOutDir(L"$" + std::to_wstring(k + 1));
+        if (!pack.AddSrcFile(L"src\\fake" + std::to_wstring(k), 1, std::set<std::wstring>())) {
+          fprintf(stderr, "AddSrcFile failed: fake%u\n", k);
+          return false;
+        }
+      }
+      results.Add("pack.AddSrcFile", NowSeconds() - t0);
+      int build_compress = 0;
+      t0 = NowSeconds();
+      if (!pack.GenerateInstall7z(nullptr, build_compress)) {
+        fprintf(stderr, "GenerateInstall7z failed\n");
+        return false;
+      }
+      results.Add("pack.GenerateInstall7z", NowSeconds() - t0);
+      install7z = pack.GetInstall7zPath();
+      // 分片与install.7z同目录，名为install_xxx_k.7z
+      archive_bytes = FileSize(install7z);
+      std::wstring stem = install7z.substr(0, install7z.size() - 3);
+      for (int k = 1; GetFileAttributesW((stem + L"_" + std::to_wstring(k) + L".7z").c_str()) != INVALID_FILE_ATTRIBUTES; ++k) {
+        archive_bytes += FileSize(stem + L"_" + std::to_wstring(k) + L".7z");
+      }
+      t0 = NowSeconds();
+    }
+    results.Add("pack.Cleanup", NowSeconds() - t0);
+    results.Add("pack.Total", NowSeconds() - t_begin);
+
+    t_begin = NowSeconds();
+    InstallContext ctx = InstallContext{};
+    t0 = NowSeconds();
+    if (!InstallContext_Init(&ctx, g_dist_info_name)) {
+      // 失败时也已分配了部分状态（如distinfo），同样需要释放
+      fprintf(stderr, "InstallContext_Init failed\n");
+      InstallContext_Free(&ctx);
+      return false;
+    }
+    results.Add("install.InstallContext_Init", NowSeconds() - t0);
+    ctx.streaming = opt.streaming;
+    bool ok = true;
+    auto set_real_dirs = [&]() {
+      double start = NowSeconds();
+      for (uint32_t k = 0; k < opt.fake_dirs && ok; ++k) {
+        ok = SetCurrentRealOutDir(&ctx, (L"out\\fake" + std::to_wstring(k)).c_str()) != 0;
+      }
+      results.Add("install.SetCurrentRealOutDir", NowSeconds() - start);
+    };
+    // 流式安装先登记real_dir，普通安装先解压再分发
+    if (opt.streaming) set_real_dirs();
+    t0 = NowSeconds();
+    ok = ok && ExtractInstall7z(&ctx, install7z.c_str());
+    results.Add("install.ExtractInstall7z", NowSeconds() - t0);
+    if (ok && !opt.streaming) set_real_dirs();
+    t0 = NowSeconds();
+    InstallContext_Free(&ctx);
+    results.Add("install.InstallContext_Free", NowSeconds() - t0);
+    results.Add("install.Total", NowSeconds() - t_begin);
+    DeleteFileW(g_dist_info_name);
+    if (!ok) fprintf(stderr, "install failed\n");
+    return ok;
+  }
+
+  // distinfo微基准：与bench_distinfo相同的路径分布，计时保存、加载（访问全部字符串）和释放
+  void BenchDistInfo(const BenchOptions& opt, Results& results, JsonOut& out) {
+    const DWORD dir_count = 4;
+    std::vector<std::wstring> paths(opt.distinfo_entries);
+    wchar_t path[MAX_PATH];
+    for (DWORD i = 0; i < opt.distinfo_entries; ++i) {
+      DWORD shared = (i % 16 == 0) ? i / 16 : i;
+      _snwprintf_s(path, MAX_PATH, _TRUNCATE, L"app\\module%lu\\res\\sub%lu\\file_%lu.dat", shared % 97, shared % 13, shared);
+      paths[i] = path;
+    }
+    const wchar_t* file = L"bench.distinfo";
+    for (int r = 0; r < opt.repeat; ++r) {
+      InstallDistInfo info;
+      memset(&info, 0, sizeof(info));
+      double t0 = NowSeconds();
+      for (DWORD i = 0; i < dir_count; ++i) DistInfo_AddFakeDir(&info, (L"$" + std::to_wstring(i + 1)).c_str());
+      for (size_t i = 0; i < paths.size(); ++i) DistInfo_AddFile(&info, (int)(i % dir_count), paths[i].c_str());
+      DistInfo_SetInstall7zName(&info, L"install_12345.7z");
+      results.Add("distinfo.AddFile", NowSeconds() - t0);
+      t0 = NowSeconds();
+      if (!DistInfo_Save(&info, file)) {
+        fprintf(stderr, "DistInfo_Save failed\n");
+        DistInfo_Free(&info);
+        return;
+      }
+      results.Add("distinfo.Save", NowSeconds() - t0);
+      DistInfo_Free(&info);
+
+      InstallDistInfo loaded;
+      t0 = NowSeconds();
+      if (!DistInfo_Load(&loaded, file)) {
+        fprintf(stderr, "DistInfo_Load failed\n");
+        return;
+      }
+      DWORD sum = 0;
+      for (DWORD i = 0; i < loaded.dir_count; ++i) {
+        for (DWORD j = 0; j < loaded.dirs[i].file_count; ++j) sum += loaded.dirs[i].file_list[j][0];
+      }
+      results.Add("distinfo.Load", NowSeconds() - t0);
+      g_touch_sink = sum;
+      t0 = NowSeconds();
+      DistInfo_Free(&loaded);
+      results.Add("distinfo.Free", NowSeconds() - t0);
+    }
+    out.Value("distinfo.FileBytes", "bytes", (double)FileSize(file));
+    out.Value("distinfo.Entries", "count", (double)opt.distinfo_entries);
+    DeleteFileW(file);
+  }
+
+  bool ParseArgs(int argc, char* argv[], BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      size_t eq = arg.find('=');
+      std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+      if (key == "--files") opt.files = (uint32_t)strtoul(value.c_str(), NULL, 10);
+      else if (key == "--size-dist") opt.size_dist = value;
+      else if (key == "--mean-size") opt.mean_size = strtoull(value.c_str(), NULL, 10);
+      else if (key == "--max-size") opt.max_size = strtoull(value.c_str(), NULL, 10);
+      else if (key == "--depth") opt.depth = (uint32_t)strtoul(value.c_str(), NULL, 10);
+      else if (key == "--fanout") opt.fanout = (std::max)(1u, (uint32_t)strtoul(value.c_str(), NULL, 10));
+      else if (key == "--dup") opt.dup = atof(value.c_str());
+      else if (key == "--compress") opt.compress = (std::min)(1.0, (std::max)(0.0, atof(value.c_str())));
+      else if (key == "--fake-dirs") opt.fake_dirs = (std::max)(1u, (uint32_t)strtoul(value.c_str(), NULL, 10));
+      else if (key == "--seed") opt.seed = strtoull(value.c_str(), NULL, 10);
+      else if (key == "--repeat") opt.repeat = (std::max)(1, atoi(value.c_str()));
+      else if (key == "--param") opt.param = value;
+      else if (key == "--config") opt.config = value;
+      else if (key == "--streaming") opt.streaming = true;
+      else if (key == "--distinfo-entries") opt.distinfo_entries = (uint32_t)strtoul(value.c_str(), NULL, 10);
+      else if (key == "--work") opt.work = value;
+      else if (key == "--out") opt.out = value;
+      else if (key == "--label") opt.label = value;
+      else if (key == "--log") opt.log = value;
+      else if (key == "--keep") opt.keep = true;
+      else {
+        fprintf(stderr, "unknown option: %s\n", arg.c_str());
+        return false;
+      }
+    }
+    if (opt.size_dist != "lognormal" && opt.size_dist != "uniform" && opt.size_dist != "fixed") {
+      fprintf(stderr, "unknown size distribution: %s\n", opt.size_dist.c_str());
+      return false;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  BenchOptions opt;
+  if (!ParseArgs(argc, argv, opt)) return 2;
+  static const char* levels[] = { "error", "warn", "info", "debug" };
+  for (int i = 0; i < 4; ++i) {
+    if (opt.log == levels[i]) XNSIS_LogSetLevel(i);
+  }
+  // 结果文件和config在进入工作目录前按当前目录打开，结果以追加方式写入，便于累积多次提交的数据
+  FILE* out_file = stdout;
+  if (!opt.out.empty()) {
+    out_file = fopen(opt.out.c_str(), "ab");
+    if (!out_file) {
+      fprintf(stderr, "cannot open %s\n", opt.out.c_str());
+      return 2;
+    }
+  }
+  if (!opt.config.empty() && !ReadConfig(opt)) {
+    fprintf(stderr, "cannot read %s\n", opt.config.c_str());
+    return 2;
+  }
+  std::wstring work = Widen(opt.work);
+  wchar_t old_dir[MAX_PATH] = { 0 };
+  GetCurrentDirectoryW(MAX_PATH, old_dir);
+  RemoveTree(work);
+  if (!MakeDirs(work) || !SetCurrentDirectoryW(work.c_str()) || !WriteConfigIni(opt)) {
+    fprintf(stderr, "cannot prepare work dir %s\n", opt.work.c_str());
+    return 2;
+  }
+
+  JsonOut out(out_file, opt.label);
+  Results results;
+  std::vector<SynthFile> files = PlanTree(opt);
+  uint64_t total_bytes = 0, unique_bytes = 0;
+  double t0 = NowSeconds();
+  for (const auto& f : files) {
+    if (!WriteSynthFile(L"src", f, opt.compress)) {
+      fprintf(stderr, "failed to write src\\%ls\n", f.path.c_str());
+      return 1;
+    }
+    total_bytes += f.size;
+    if (!f.dup) unique_bytes += f.size;
+  }
+  out.Config(opt, total_bytes, unique_bytes);
+  out.Value("generate.Seconds", "s", NowSeconds() - t0);
+
+  int ret = 0;
+  uint64_t archive_bytes = 0;
+  for (int r = 0; r < opt.repeat && ret == 0; ++r) {
+    if (!RunOnce(opt, results, archive_bytes)) ret = 1;
+  }
+  if (ret == 0) out.Value("pack.ArchiveBytes", "bytes", (double)archive_bytes);
+  if (ret == 0 && opt.distinfo_entries) BenchDistInfo(opt, results, out);
+  out.Timings(results);
+  XNSIS_LogShutdown();
+
+  SetCurrentDirectoryW(old_dir);
+  if (!opt.keep) RemoveTree(work);
+  if (out_file != stdout) fclose(out_file);
+  return ret;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# POSIX（Linux/macOS）下构建：只支持DBG_SOLUTION（不依赖NSIS源码），产物为xnsis（main.cpp）、bench_pack、bench_distinfo和自检测试test_xnsis。
+# 7z调用走PATH中的7z（p7zip或7-Zip的7zz，需命名为7z）。
+# 用法：sh build_posix.sh [输出目录，默认build_posix]；可用CC、CXX、CFLAGS、CXXFLAGS覆盖编译器和选项
+set -e
+cd "$(dirname "$0")"
+OUT=${1:-build_posix}
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+CFLAGS=${CFLAGS:--O2}
+CXXFLAGS=${CXXFLAGS:--O2}
+DEFS="-DDBG_SOLUTION"
+mkdir -p "$OUT"
+
+COMMON=""
+for f in *.c; do
+  o="$OUT/${f%.c}.o"
+  $CC -std=gnu11 $CFLAGS $DEFS -c "$f" -o "$o"
+  COMMON="$COMMON $o"
+done
+for f in pack.cpp procexec.cpp workpool.cpp fake.cpp; do
+  o="$OUT/${f%.cpp}.o"
+  $CXX -std=c++17 $CXXFLAGS $DEFS -c "$f" -o "$o"
+  COMMON="$COMMON $o"
+done
+for f in main.cpp bench_pack.cpp bench_distinfo.cpp test_main.cpp; do
+  $CXX -std=c++17 $CXXFLAGS $DEFS -c "$f" -o "$OUT/${f%.cpp}.o"
+done
+
+$CXX -o "$OUT/xnsis" "$OUT/main.o" $COMMON -lpthread
+$CXX -o "$OUT/bench_pack" "$OUT/bench_pack.o" $COMMON -lpthread
+$CXX -o "$OUT/bench_distinfo" "$OUT/bench_distinfo.o" $COMMON -lpthread
+$CXX -o "$OUT/test_xnsis" "$OUT/test_main.o" $COMMON -lpthread
+echo "built $OUT/xnsis $OUT/bench_pack $OUT/bench_distinfo $OUT/test_xnsis"
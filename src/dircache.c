@@ -0,0 +1,128 @@
+#include "dircache.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+void DirCache_Init(DirCache* cache) {
+  PathMap_Init(&cache->dirs);
+  InitializeCriticalSection(&cache->lock);
+  cache->created = 0;
+  cache->hits = 0;
+}
+
+void DirCache_Free(DirCache* cache) {
+  PathMap_Free(&cache->dirs);
+  DeleteCriticalSection(&cache->lock);
+}
+
+static wchar_t* LastSeparator(wchar_t* path) {
+  wchar_t* last = NULL;
+  for (wchar_t* p = path; *p; ++p) {
+    if (*p == L'\\' || *p == L'/') last = p;
+  }
+  return last;
+}
+
+// 先直接创建，只有上级目录不存在时才递归处理上级目录，已存在的目录只需一次系统调用
+static int EnsureLocked(DirCache* cache, wchar_t* path) {
+  if (PathMap_Find(&cache->dirs, path)) {
+    cache->hits++;
+    return 1;
+  }
+  if (CreateDirectoryW(path, NULL)) {
+    cache->created++;
+  }
+  else {
+    DWORD err = GetLastError();
+    if (err == ERROR_PATH_NOT_FOUND) {
+      wchar_t* last = LastSeparator(path);
+      if (!last || last == path) {
+        XNSIS_LOG(L"CreateDirectoryW failed: %s, error=%lu", path, err);
+        return 0;
+      }
+      wchar_t sep = *last;
+      *last = 0;
+      int ok = EnsureLocked(cache, path);
+      *last = sep;
+      if (!ok) {
+        XNSIS_LOG(L"Failed to create parent directory: %s", path);
+        return 0;
+      }
+      if (!CreateDirectoryW(path, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        XNSIS_LOG(L"CreateDirectoryW failed: %s, error=%lu", path, GetLastError());
+        return 0;
+      }
+      cache->created++;
+    }
+    else {
+      // 盘符根目录等不能创建的路径，存在即可；同名的是文件时ERROR_ALREADY_EXISTS也不算成功
+      DWORD attr = GetFileAttributesW(path);
+      if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+        XNSIS_LOG(L"CreateDirectoryW failed: %s, error=%lu", path, err);
+        return 0;
+      }
+    }
+  }
+  return PathMap_Insert(&cache->dirs, path, NULL) != NULL;
+}
+
+int DirCache_Ensure(DirCache* cache, const wchar_t* dir) {
+  size_t len = wcslen(dir);
+  while (len > 0 && (dir[len - 1] == L'\\' || dir[len - 1] == L'/')) --len;
+  if (len == 0) return 1;
+  wchar_t* path = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
+  if (!path) return 0;
+  memcpy(path, dir, len * sizeof(wchar_t));
+  path[len] = 0;
+  EnterCriticalSection(&cache->lock);
+  int ok = EnsureLocked(cache, path);
+  LeaveCriticalSection(&cache->lock);
+  free(path);
+  return ok;
+}
+
+int DirCache_EnsureParent(DirCache* cache, const wchar_t* file_path) {
+  size_t len = wcslen(file_path);
+  wchar_t* path = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
+  if (!path) return 0;
+  memcpy(path, file_path, (len + 1) * sizeof(wchar_t));
+  wchar_t* last = LastSeparator(path);
+  int ok = 1;
+  if (last) {
+    *last = 0;
+    ok = DirCache_Ensure(cache, path);
+  }
+  free(path);
+  return ok;
+}
+
+static int CompareLength(const void* a, const void* b) {
+  size_t la = wcslen(*(const wchar_t* const*)a);
+  size_t lb = wcslen(*(const wchar_t* const*)b);
+  return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+int DirCache_EnsureAll(DirCache* cache, const wchar_t* const* dirs, DWORD count) {
+  if (count == 0) return 1;
+  const wchar_t** unique = (const wchar_t**)malloc(count * sizeof(wchar_t*));
+  if (!unique) return 0;
+  PathMap seen;
+  PathMap_Init(&seen);
+  DWORD unique_count = 0;
+  int ok = 1;
+  for (DWORD i = 0; i < count; ++i) {
+    int inserted = 0;
+    if (!PathMap_Insert(&seen, dirs[i], &inserted)) {
+      ok = 0;
+      break;
+    }
+    if (inserted) unique[unique_count++] = dirs[i];
+  }
+  qsort(unique, unique_count, sizeof(wchar_t*), CompareLength);
+  for (DWORD i = 0; i < unique_count && ok; ++i) {
+    ok = DirCache_Ensure(cache, unique[i]);
+  }
+  PathMap_Free(&seen);
+  free(unique);
+  return ok;
+}
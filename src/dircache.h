@@ -0,0 +1,28 @@
+#pragma once
+#include "platform.h"
+#include "pathmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 已确认存在的目录缓存：同一目录只创建/探测一次，可在多个线程中使用
+  typedef struct {
+    PathMap dirs;
+    CRITICAL_SECTION lock;
+    DWORD created;   // 实际创建的目录数
+    DWORD hits;      // 命中缓存的次数
+  } DirCache;
+
+  void DirCache_Init(DirCache* cache);
+  void DirCache_Free(DirCache* cache);
+  // 确保目录存在（需要时逐级创建上级目录）
+  int DirCache_Ensure(DirCache* cache, const wchar_t* dir);
+  // 确保文件所在的目录存在
+  int DirCache_EnsureParent(DirCache* cache, const wchar_t* file_path);
+  // 批量创建一组目录：去重后按路径长度排序，上级目录总是先于下级目录创建
+  int DirCache_EnsureAll(DirCache* cache, const wchar_t* const* dirs, DWORD count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,45 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <wincrypt.h>
+#include "hash.h"
+#include "arena.h"
 const wchar_t* g_dist_info_name = L"install.distinfo";
 
-// MD5计算函数
-static int CalculateMD5(const BYTE* data, DWORD data_len, BYTE* md5_out) {
-  HCRYPTPROV hProv = 0;
-  HCRYPTHASH hHash = 0;
-  DWORD hash_len = 16; // MD5 is 16 bytes
-
-  if (!CryptAcquireContextW(&hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) {
-    XNSIS_LOG(L"CryptAcquireContext failed, error=%lu", GetLastError());
-    return 0;
-  }
-
-  if (!CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash)) {
-    XNSIS_LOG(L"CryptCreateHash failed, error=%lu", GetLastError());
-    CryptReleaseContext(hProv, 0);
-    return 0;
-  }
-
-  if (!CryptHashData(hHash, data, data_len, 0)) {
-    XNSIS_LOG(L"CryptHashData failed, error=%lu", GetLastError());
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-    return 0;
-  }
-
-  if (!CryptGetHashParam(hHash, HP_HASHVAL, md5_out, &hash_len, 0)) {
-    XNSIS_LOG(L"CryptGetHashParam failed, error=%lu", GetLastError());
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-    return 0;
-  }
-
-  CryptDestroyHash(hHash);
-  CryptReleaseContext(hProv, 0);
-  return 1;
-}
-
 // 写入块头部
 static int WriteBlockHeader(BYTE** p, BYTE type, DWORD length) {
   **p = type; (*p)++;
@@ -58,50 +23,52 @@ static int ReadBlockHeader(BYTE** p, BYTE* type, DWORD* length, BYTE* end) {
   return 1;
 }
 
-int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
-  // 初始化结构
-  memset(info, 0, sizeof(InstallDistInfo));
-
-  HANDLE hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-  if (hFile == INVALID_HANDLE_VALUE) {
-    XNSIS_LOG(L"CreateFileW failed: %s, error=%lu", filename, GetLastError());
-    return 0;
-  }
-
-  LARGE_INTEGER fsize;
-  if (!GetFileSizeEx(hFile, &fsize) || fsize.QuadPart < 24) { // 至少需要8字节头部+16字节MD5
-    XNSIS_LOG(L"GetFileSizeEx failed or file too small: %s", filename);
-    CloseHandle(hFile); return 0;
-  }
+// v2的字符串：4字节长度（UTF-16单元数）+ UTF-16LE内容，无结尾NUL
+static size_t StrSizeV2(const wchar_t* s) {
+  return 4 + Platform_Utf16Length(s, wcslen(s)) * 2;
+}
 
-  DWORD size = (DWORD)fsize.QuadPart;
-  BYTE* buffer = (BYTE*)malloc(size);
-  if (!buffer) {
-    XNSIS_LOG(L"malloc buffer failed");
-    CloseHandle(hFile); return 0;
+// 写入v2字符串，normalize时把'/'替换为'\\'
+static void WriteStrV2(BYTE** p, const wchar_t* s, int normalize) {
+  DWORD units = (DWORD)Platform_ToUtf16LE(*p + 4, s, wcslen(s));
+  *(DWORD*)*p = units; (*p) += 4;
+  // '/'编码后为单个单元，代理项不会与之相等，可以直接在编码结果上替换
+  if (normalize) {
+    for (DWORD k = 0; k < units; ++k) {
+      if ((*p)[k * 2] == '/' && (*p)[k * 2 + 1] == 0) (*p)[k * 2] = '\\';
+    }
   }
+  (*p) += (size_t)units * 2;
+}
 
-  DWORD read = 0;
-  if (!ReadFile(hFile, buffer, size, &read, NULL) || read != size) {
-    XNSIS_LOG(L"ReadFile failed, error=%lu", GetLastError());
-    free(buffer); CloseHandle(hFile); return 0;
-  }
-  CloseHandle(hFile);
+// 读取v2字符串，解码到arena中
+static wchar_t* ReadStrV2(Arena* arena, BYTE** p, BYTE* end) {
+  if (*p + 4 > end) return NULL;
+  DWORD units = *(DWORD*)*p; (*p) += 4;
+  if ((size_t)(end - *p) / 2 < units) return NULL;
+  wchar_t* str = (wchar_t*)Arena_Alloc(arena, ((size_t)units + 1) * sizeof(wchar_t));
+  if (!str) return NULL;
+  Platform_FromUtf16LE(str, *p, units);
+  (*p) += (size_t)units * 2;
+  return str;
+}
 
+// 解析v2格式：长度前缀的字符串逐个复制到堆上
+static int LoadV2(InstallDistInfo* info, BYTE* buffer, DWORD size) {
   // 验证MD5
   DWORD data_len = size - 16; // 减去MD5长度
   BYTE expected_md5[16];
   memcpy(expected_md5, buffer + data_len, 16);
 
   BYTE calculated_md5[16];
-  if (!CalculateMD5(buffer, data_len, calculated_md5)) {
-    XNSIS_LOG(L"CalculateMD5 failed during verification");
-    free(buffer); return 0;
+  if (!Hash_MD5(buffer, data_len, calculated_md5)) {
+    XNSIS_LOG(L"Hash_MD5 failed during verification");
+    return 0;
   }
 
   if (memcmp(expected_md5, calculated_md5, 16) != 0) {
     XNSIS_LOG(L"MD5 verification failed - file may be corrupted");
-    free(buffer); return 0;
+    return 0;
   }
 
   BYTE* p = buffer;
@@ -110,14 +77,9 @@ int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
   // 检查magic和version
   if (p + 8 > end || memcmp(p, "XNSI", 4) != 0) {
     XNSIS_LOG(L"Magic mismatch");
-    free(buffer); return 0;
-  }
-  p += 4;
-  DWORD version = *(DWORD*)p; p += 4;
-  if (version != 2) {
-    XNSIS_LOG(L"Unsupported version: %lu", version);
-    free(buffer); return 0;
+    return 0;
   }
+  p += 8; // magic + version，已由DistInfo_Load检查
 
   // 解析各个信息块
   while (p < end) {
@@ -125,12 +87,12 @@ int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
     DWORD block_length;
     if (!ReadBlockHeader(&p, &block_type, &block_length, end)) {
       XNSIS_LOG(L"Failed to read block header");
-      free(buffer); return 0;
+      return 0;
     }
 
     if (p + block_length > end) {
       XNSIS_LOG(L"Block length exceeds file size");
-      free(buffer); return 0;
+      return 0;
     }
 
     BYTE* block_end = p + block_length;
@@ -138,41 +100,29 @@ int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
     switch (block_type) {
     case DISTINFO_BLOCK_TYPE_DIRS: {
       // 解析目录信息
-      if (p + 4 > block_end) { free(buffer); return 0; }
+      if (p + 4 > block_end) return 0;
       DWORD dir_count = *(DWORD*)p; p += 4;
 
       info->dirs = (InstallFakeDir*)calloc(dir_count, sizeof(InstallFakeDir));
-      if (!info->dirs) { free(buffer); return 0; }
+      if (!info->dirs) return 0;
       info->dir_count = dir_count;
+      info->dirs_capacity = dir_count;
 
       for (DWORD i = 0; i < dir_count; ++i) {
-        if (p + 4 > block_end) { free(buffer); return 0; }
-        DWORD len = *(DWORD*)p; p += 4;
-        if (p + len * sizeof(wchar_t) > block_end) { free(buffer); return 0; }
-
-        info->dirs[i].fake_dir = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
-        if (!info->dirs[i].fake_dir) { free(buffer); return 0; }
-        memcpy(info->dirs[i].fake_dir, p, len * sizeof(wchar_t));
-        info->dirs[i].fake_dir[len] = L'\0';
-        p += len * sizeof(wchar_t);
+        info->dirs[i].fake_dir = ReadStrV2(&info->arena, &p, block_end);
+        if (!info->dirs[i].fake_dir) return 0;
 
-        if (p + 4 > block_end) { free(buffer); return 0; }
+        if (p + 4 > block_end) return 0;
         DWORD file_count = *(DWORD*)p; p += 4;
         info->dirs[i].file_count = file_count;
 
         info->dirs[i].file_list = (wchar_t**)calloc(file_count, sizeof(wchar_t*));
-        if (!info->dirs[i].file_list) { free(buffer); return 0; }
+        if (!info->dirs[i].file_list) return 0;
+        info->dirs[i].file_capacity = file_count;
 
         for (DWORD j = 0; j < file_count; ++j) {
-          if (p + 4 > block_end) { free(buffer); return 0; }
-          DWORD plen = *(DWORD*)p; p += 4;
-          if (p + plen * sizeof(wchar_t) > block_end) { free(buffer); return 0; }
-
-          info->dirs[i].file_list[j] = (wchar_t*)malloc((plen + 1) * sizeof(wchar_t));
-          if (!info->dirs[i].file_list[j]) { free(buffer); return 0; }
-          memcpy(info->dirs[i].file_list[j], p, plen * sizeof(wchar_t));
-          info->dirs[i].file_list[j][plen] = L'\0';
-          p += plen * sizeof(wchar_t);
+          info->dirs[i].file_list[j] = ReadStrV2(&info->arena, &p, block_end);
+          if (!info->dirs[i].file_list[j]) return 0;
         }
       }
       break;
@@ -180,50 +130,45 @@ int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
 
     case DISTINFO_BLOCK_TYPE_PLUGINS: {
       // 解析插件信息
-      if (p + 4 > block_end) { free(buffer); return 0; }
+      if (p + 4 > block_end) return 0;
       DWORD plugin_count = *(DWORD*)p; p += 4;
       
       info->plugins = (InstallPlugin*)calloc(plugin_count, sizeof(InstallPlugin));
-      if (!info->plugins) { free(buffer); return 0; }
+      if (!info->plugins) return 0;
       info->plugin_count = plugin_count;
+      info->plugins_capacity = plugin_count;
       
       for (DWORD i = 0; i < plugin_count; ++i) {
         // 读取path
-        if (p + 4 > block_end) { free(buffer); return 0; }
-        DWORD path_len = *(DWORD*)p; p += 4;
-        if (p + path_len * sizeof(wchar_t) > block_end) { free(buffer); return 0; }
-        
-        info->plugins[i].path = (wchar_t*)malloc((path_len + 1) * sizeof(wchar_t));
-        if (!info->plugins[i].path) { free(buffer); return 0; }
-        memcpy(info->plugins[i].path, p, path_len * sizeof(wchar_t));
-        info->plugins[i].path[path_len] = L'\0';
-        p += path_len * sizeof(wchar_t);
+        info->plugins[i].path = ReadStrV2(&info->arena, &p, block_end);
+        if (!info->plugins[i].path) return 0;
         
         // 读取compress_param
-        if (p + 4 > block_end) { free(buffer); return 0; }
-        DWORD param_len = *(DWORD*)p; p += 4;
-        if (p + param_len * sizeof(wchar_t) > block_end) { free(buffer); return 0; }
-        
-        info->plugins[i].compress_param = (wchar_t*)malloc((param_len + 1) * sizeof(wchar_t));
-        if (!info->plugins[i].compress_param) { free(buffer); return 0; }
-        memcpy(info->plugins[i].compress_param, p, param_len * sizeof(wchar_t));
-        info->plugins[i].compress_param[param_len] = L'\0';
-        p += param_len * sizeof(wchar_t);
+        info->plugins[i].compress_param = ReadStrV2(&info->arena, &p, block_end);
+        if (!info->plugins[i].compress_param) return 0;
       }
       break;
     }
 
     case DISTINFO_BLOCK_TYPE_INSTALL7Z: {
       // 解析install.7z文件名
-      if (p + 4 > block_end) { free(buffer); return 0; }
-      DWORD name_len = *(DWORD*)p; p += 4;
-      if (p + name_len * sizeof(wchar_t) > block_end) { free(buffer); return 0; }
-      
-      info->install7z_name = (wchar_t*)malloc((name_len + 1) * sizeof(wchar_t));
-      if (!info->install7z_name) { free(buffer); return 0; }
-      memcpy(info->install7z_name, p, name_len * sizeof(wchar_t));
-      info->install7z_name[name_len] = L'\0';
-      p += name_len * sizeof(wchar_t);
+      info->install7z_name = ReadStrV2(&info->arena, &p, block_end);
+      if (!info->install7z_name) return 0;
+      break;
+    }
+
+    case DISTINFO_BLOCK_TYPE_DEDUP: {
+      // 解析重复文件引用，须位于目录信息块之后
+      if (p + 4 > block_end) return 0;
+      DWORD ref_count = *(DWORD*)p; p += 4;
+      if ((size_t)(block_end - p) < (size_t)ref_count * 16) return 0;
+      for (DWORD i = 0; i < ref_count; ++i) {
+        DWORD* ref = (DWORD*)p; p += 16;
+        if (DistInfo_SetFileBlob(info, ref[0], ref[1], ref[2], ref[3]) != 0) {
+          XNSIS_LOG(L"Invalid dedup reference: %lu/%lu -> %lu/%lu", ref[0], ref[1], ref[2], ref[3]);
+          return 0;
+        }
+      }
       break;
     }
 
@@ -235,11 +180,16 @@ int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
     }
   }
 
-  free(buffer);
   return 1;
 }
 
-int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
+// 写v2格式
+static int SaveV2(const InstallDistInfo* info, const wchar_t* filename) {
+  if (info->shard_count) {
+    XNSIS_LOG(L"v2 cannot store %lu shards", info->shard_count);
+    return 0;
+  }
+  if (info->has_file_digests) XNSIS_LOG(L"v2 has no file hash block, file digests are not saved");
   // 计算总大小（不包括MD5）
   size_t total = 8; // magic + version
 
@@ -247,12 +197,10 @@ int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
   size_t dirs_block_size = 4; // dir_count
   for (DWORD i = 0; i < info->dir_count; ++i) {
     const InstallFakeDir* dir = &info->dirs[i];
-    DWORD len = (DWORD)wcslen(dir->fake_dir);
-    dirs_block_size += 4 + len * sizeof(wchar_t); // fake_dir len + name
+    dirs_block_size += StrSizeV2(dir->fake_dir); // fake_dir len + name
     dirs_block_size += 4; // file_count
     for (DWORD j = 0; j < dir->file_count; ++j) {
-      DWORD plen = (DWORD)wcslen(dir->file_list[j]);
-      dirs_block_size += 4 + plen * sizeof(wchar_t); // arc_path len + name
+      dirs_block_size += StrSizeV2(dir->file_list[j]); // arc_path len + name
     }
   }
   total += 5 + dirs_block_size; // block header + content
@@ -261,21 +209,32 @@ int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
   size_t plugins_block_size = 4; // plugin_count
   for (DWORD i = 0; i < info->plugin_count; ++i) {
     const InstallPlugin* plugin = &info->plugins[i];
-    DWORD path_len = (DWORD)wcslen(plugin->path);
-    DWORD param_len = (DWORD)wcslen(plugin->compress_param);
-    plugins_block_size += 4 + path_len * sizeof(wchar_t); // path len + path
-    plugins_block_size += 4 + param_len * sizeof(wchar_t); // param len + param
+    plugins_block_size += StrSizeV2(plugin->path); // path len + path
+    plugins_block_size += StrSizeV2(plugin->compress_param); // param len + param
   }
   total += 5 + plugins_block_size; // block header + content
 
   // install.7z文件名块大小
   size_t install7z_block_size = 0;
   if (info->install7z_name) {
-    DWORD name_len = (DWORD)wcslen(info->install7z_name);
-    install7z_block_size = 4 + name_len * sizeof(wchar_t); // name len + name
+    install7z_block_size = StrSizeV2(info->install7z_name); // name len + name
     total += 5 + install7z_block_size; // block header + content
   }
 
+  // 重复文件引用块大小
+  DWORD dedup_count = 0;
+  for (DWORD i = 0; i < info->dir_count; ++i) {
+    if (!info->dirs[i].blob_refs) continue;
+    for (DWORD j = 0; j < info->dirs[i].file_count; ++j) {
+      if (info->dirs[i].blob_refs[j].dir_idx != DISTINFO_BLOB_SELF) ++dedup_count;
+    }
+  }
+  size_t dedup_block_size = 0;
+  if (dedup_count) {
+    dedup_block_size = 4 + (size_t)dedup_count * 16; // count + (dir, file, blob_dir, blob_file)
+    total += 5 + dedup_block_size; // block header + content
+  }
+
   // 添加MD5大小
   total += 16; // MD5 hash
 
@@ -291,42 +250,18 @@ int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
   memcpy(p, "XNSI", 4); p += 4;
   *(DWORD*)p = 2; p += 4; // version 2
 
-  // 写入目录信息块
+  // 写入目录信息块，路径中的'/'替换为'\\'
   WriteBlockHeader(&p, DISTINFO_BLOCK_TYPE_DIRS, (DWORD)dirs_block_size);
   *(DWORD*)p = info->dir_count; p += 4;
 
   for (DWORD i = 0; i < info->dir_count; ++i) {
     const InstallFakeDir* dir = &info->dirs[i];
-    DWORD len = (DWORD)wcslen(dir->fake_dir);
-    *(DWORD*)p = len; p += 4;
-
-    // 复制路径并替换/为\
-        {
-    wchar_t* fake_dir_buf = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
-    if (!fake_dir_buf) { XNSIS_LOG(L"malloc fake_dir_buf failed"); free(buffer); return 0; }
-    wcsncpy_s(fake_dir_buf, len + 1, dir->fake_dir, len);
-    for (DWORD k = 0; k < len; ++k) if (fake_dir_buf[k] == L'/') fake_dir_buf[k] = L'\\';
-    memcpy(p, fake_dir_buf, len * sizeof(wchar_t)); p += len * sizeof(wchar_t);
-    free(fake_dir_buf);
-  }
-
-  *(DWORD*)p = dir->file_count; p += 4;
-
-  for (DWORD j = 0; j < dir->file_count; ++j) {
-    DWORD plen = (DWORD)wcslen(dir->file_list[j]);
-    *(DWORD*)p = plen; p += 4;
-
-    // 复制文件路径并替换/为\
-            {
-    wchar_t* file_path_buf = (wchar_t*)malloc((plen + 1) * sizeof(wchar_t));
-    if (!file_path_buf) { XNSIS_LOG(L"malloc file_path_buf failed"); free(buffer); return 0; }
-    wcsncpy_s(file_path_buf, plen + 1, dir->file_list[j], plen);
-    for (DWORD k = 0; k < plen; ++k) if (file_path_buf[k] == L'/') file_path_buf[k] = L'\\';
-    memcpy(p, file_path_buf, plen * sizeof(wchar_t)); p += plen * sizeof(wchar_t);
-    free(file_path_buf);
-  }
-}
+    WriteStrV2(&p, dir->fake_dir, 1);
+    *(DWORD*)p = dir->file_count; p += 4;
+    for (DWORD j = 0; j < dir->file_count; ++j) {
+      WriteStrV2(&p, dir->file_list[j], 1);
     }
+  }
 
     // 写入插件信息块
     WriteBlockHeader(&p, DISTINFO_BLOCK_TYPE_PLUGINS, (DWORD)plugins_block_size);
@@ -334,47 +269,38 @@ int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
 
     for (DWORD i = 0; i < info->plugin_count; ++i) {
       const InstallPlugin* plugin = &info->plugins[i];
-      DWORD path_len = (DWORD)wcslen(plugin->path);
-      DWORD param_len = (DWORD)wcslen(plugin->compress_param);
-
-      *(DWORD*)p = path_len; p += 4;
-
-      // 复制插件路径并替换/为\
-        {
-      wchar_t* plugin_path_buf = (wchar_t*)malloc((path_len + 1) * sizeof(wchar_t));
-      if (!plugin_path_buf) { XNSIS_LOG(L"malloc plugin_path_buf failed"); free(buffer); return 0; }
-      wcsncpy_s(plugin_path_buf, path_len + 1, plugin->path, path_len);
-      for (DWORD k = 0; k < path_len; ++k) if (plugin_path_buf[k] == L'/') plugin_path_buf[k] = L'\\';
-      memcpy(p, plugin_path_buf, path_len * sizeof(wchar_t)); p += path_len * sizeof(wchar_t);
-      free(plugin_path_buf);
-    }
-
-    *(DWORD*)p = param_len; p += 4;
-    memcpy(p, plugin->compress_param, param_len * sizeof(wchar_t)); p += param_len * sizeof(wchar_t);
+      WriteStrV2(&p, plugin->path, 1);
+      WriteStrV2(&p, plugin->compress_param, 0);
     }
 
     // 写入install.7z文件名块
     if (info->install7z_name) {
         WriteBlockHeader(&p, DISTINFO_BLOCK_TYPE_INSTALL7Z, (DWORD)install7z_block_size);
-        DWORD name_len = (DWORD)wcslen(info->install7z_name);
-        *(DWORD*)p = name_len; p += 4;
-        
-        // 复制文件名并替换/为\
-        {
-            wchar_t* name_buf = (wchar_t*)malloc((name_len + 1) * sizeof(wchar_t));
-            if (!name_buf) { XNSIS_LOG(L"malloc name_buf failed"); free(buffer); return 0; }
-            wcsncpy_s(name_buf, name_len + 1, info->install7z_name, name_len);
-            for (DWORD k = 0; k < name_len; ++k) if (name_buf[k] == L'/') name_buf[k] = L'\\';
-            memcpy(p, name_buf, name_len * sizeof(wchar_t)); p += name_len * sizeof(wchar_t);
-            free(name_buf);
-        }
+        WriteStrV2(&p, info->install7z_name, 1);
     }
     
+    // 写入重复文件引用块
+    if (dedup_count) {
+      WriteBlockHeader(&p, DISTINFO_BLOCK_TYPE_DEDUP, (DWORD)dedup_block_size);
+      *(DWORD*)p = dedup_count; p += 4;
+      for (DWORD i = 0; i < info->dir_count; ++i) {
+        const InstallFakeDir* dir = &info->dirs[i];
+        if (!dir->blob_refs) continue;
+        for (DWORD j = 0; j < dir->file_count; ++j) {
+          if (dir->blob_refs[j].dir_idx == DISTINFO_BLOB_SELF) continue;
+          *(DWORD*)p = i; p += 4;
+          *(DWORD*)p = j; p += 4;
+          *(DWORD*)p = dir->blob_refs[j].dir_idx; p += 4;
+          *(DWORD*)p = dir->blob_refs[j].file_idx; p += 4;
+        }
+      }
+    }
+
     // 计算并写入MD5（不包括MD5本身）
     DWORD data_len = (DWORD)(p - buffer);
     BYTE md5_hash[16];
-    if (!CalculateMD5(buffer, data_len, md5_hash)) {
-        XNSIS_LOG(L"CalculateMD5 failed");
+    if (!Hash_MD5(buffer, data_len, md5_hash)) {
+        XNSIS_LOG(L"Hash_MD5 failed");
         free(buffer); return 0;
     }
     memcpy(p, md5_hash, 16);
@@ -398,115 +324,729 @@ int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
     return 1;
 }
 
-void DistInfo_Free(InstallDistInfo* info) {
-  if (!info) return;
+// ---------------- v3 ----------------
+// 文件头16字节：magic、version、hash_alg、保留；之后是8字节对齐的信息块，
+// 每块为1字节类型+7字节填充+8字节长度（已按8字节对齐）；最后是16字节校验值
+// （按hash_alg计算，不足16字节的摘要补0）。
+// 所有字符串（以NUL结尾、去重）集中在字符串表块中，其他块通过{偏移, 长度}引用，
+// 加载时映射整个文件，字符串指针直接指向映射内容，不逐项分配内存
+#define V3_HEADER_SIZE 16
+#define V3_BLOCK_HEADER_SIZE 16
+#define V3_TRAILER_SIZE 16
+#define V3_ALIGN(n) (((n) + 7) & ~(ULONGLONG)7)
+
+// 字符串引用：字符串表内的字节偏移和UTF-16单元数（不含结尾NUL）
+typedef struct {
+  ULONGLONG offset;
+  ULONGLONG length;
+} V3StrRef;
+
+// 构建字符串表：完全相同的字符串只存一份
+typedef struct {
+  WORD* data;        // UTF-16LE
+  size_t size;       // 已用单元数
+  size_t capacity;
+  V3StrRef* entries;
+  DWORD* hashes;
+  DWORD entry_count;
+  DWORD entry_capacity;
+  DWORD* slots;      // 开放寻址表，存entries下标+1，0为空
+  DWORD slot_count;
+} V3StrTab;
+
+static DWORD HashUnits(const WORD* s, size_t len) {
+  DWORD h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (DWORD)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
 
-  // 释放目录信息
-  if (info->dirs) {
+static void StrTab_Free(V3StrTab* tab) {
+  free(tab->data);
+  free(tab->entries);
+  free(tab->hashes);
+  free(tab->slots);
+  memset(tab, 0, sizeof(V3StrTab));
+}
+
+static int StrTab_Rehash(V3StrTab* tab, DWORD slot_count) {
+  DWORD* slots = (DWORD*)calloc(slot_count, sizeof(DWORD));
+  if (!slots) return 0;
+  for (DWORD i = 0; i < tab->entry_count; ++i) {
+    DWORD k = tab->hashes[i] & (slot_count - 1);
+    while (slots[k]) k = (k + 1) & (slot_count - 1);
+    slots[k] = i + 1;
+  }
+  free(tab->slots);
+  tab->slots = slots;
+  tab->slot_count = slot_count;
+  return 1;
+}
+
+// 添加字符串（normalize时'/'替换为'\\'），返回其引用
+static int StrTab_Add(V3StrTab* tab, const wchar_t* str, int normalize, V3StrRef* ref) {
+  size_t chars = wcslen(str);
+  size_t len = Platform_Utf16Length(str, chars);
+  if (tab->size + len + 1 > tab->capacity) {
+    size_t cap = tab->capacity ? tab->capacity : 4096;
+    while (tab->size + len + 1 > cap) cap *= 2;
+    WORD* data = (WORD*)realloc(tab->data, cap * sizeof(WORD));
+    if (!data) return 0;
+    tab->data = data;
+    tab->capacity = cap;
+  }
+  // 先写到表尾，已有相同字符串时再撤销
+  WORD* dst = tab->data + tab->size;
+  Platform_ToUtf16LE((BYTE*)dst, str, chars);
+  if (normalize) {
+    for (size_t i = 0; i < len; ++i) if (dst[i] == L'/') dst[i] = L'\\';
+  }
+  dst[len] = 0;
+  DWORD h = HashUnits(dst, len);
+  if ((tab->entry_count + 1) * 2 > tab->slot_count && !StrTab_Rehash(tab, tab->slot_count ? tab->slot_count * 2 : 1024)) return 0;
+  DWORD k = h & (tab->slot_count - 1);
+  for (; tab->slots[k]; k = (k + 1) & (tab->slot_count - 1)) {
+    DWORD e = tab->slots[k] - 1;
+    if (tab->hashes[e] == h && tab->entries[e].length == len &&
+      memcmp(tab->data + tab->entries[e].offset / sizeof(WORD), dst, len * sizeof(WORD)) == 0) {
+      *ref = tab->entries[e];
+      return 1;
+    }
+  }
+  if (tab->entry_count == tab->entry_capacity) {
+    DWORD cap = tab->entry_capacity ? tab->entry_capacity * 2 : 1024;
+    V3StrRef* entries = (V3StrRef*)realloc(tab->entries, cap * sizeof(V3StrRef));
+    if (!entries) return 0;
+    tab->entries = entries;
+    DWORD* hashes = (DWORD*)realloc(tab->hashes, cap * sizeof(DWORD));
+    if (!hashes) return 0;
+    tab->hashes = hashes;
+    tab->entry_capacity = cap;
+  }
+  ref->offset = (ULONGLONG)tab->size * sizeof(WORD);
+  ref->length = len;
+  tab->entries[tab->entry_count] = *ref;
+  tab->hashes[tab->entry_count] = h;
+  tab->slots[k] = ++tab->entry_count;
+  tab->size += len + 1;
+  return 1;
+}
+
+static BYTE* WriteBlockHeaderV3(BYTE* p, BYTE type, ULONGLONG length) {
+  memset(p, 0, V3_BLOCK_HEADER_SIZE);
+  p[0] = type;
+  *(ULONGLONG*)(p + 8) = length;
+  return p + V3_BLOCK_HEADER_SIZE;
+}
+
+static int WriteWholeFile(const wchar_t* filename, const BYTE* buffer, size_t size) {
+  HANDLE hFile = CreateFileW(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    XNSIS_LOG(L"CreateFileW failed: %s, error=%lu", filename, GetLastError());
+    return 0;
+  }
+  DWORD written = 0;
+  BOOL ok = WriteFile(hFile, buffer, (DWORD)size, &written, NULL);
+  CloseHandle(hFile);
+  if (!ok || written != (DWORD)size) {
+    XNSIS_LOG(L"WriteFile failed, error=%lu", GetLastError());
+    return 0;
+  }
+  return 1;
+}
+
+// 写v3格式
+static int SaveV3(const InstallDistInfo* info, const wchar_t* filename, DWORD hash_alg) {
+  V3StrTab tab;
+  memset(&tab, 0, sizeof(tab));
+  ULONGLONG total_files = 0;
+  for (DWORD i = 0; i < info->dir_count; ++i) total_files += info->dirs[i].file_count;
+
+  // 先把所有字符串放进字符串表，记下引用
+  V3StrRef* dir_refs = (V3StrRef*)malloc(((size_t)info->dir_count + 1) * sizeof(V3StrRef));
+  V3StrRef* file_refs = (V3StrRef*)malloc(((size_t)total_files + 1) * sizeof(V3StrRef));
+  V3StrRef* plugin_refs = (V3StrRef*)malloc(((size_t)info->plugin_count * 2 + 1) * sizeof(V3StrRef));
+  V3StrRef* shard_refs = (V3StrRef*)malloc(((size_t)info->shard_count + 1) * sizeof(V3StrRef));
+  V3StrRef name_ref = { 0, 0 };
+  BYTE* buffer = NULL;
+  int ok = dir_refs && file_refs && plugin_refs && shard_refs;
+  size_t f = 0;
+  for (DWORD i = 0; i < info->dir_count && ok; ++i) {
+    const InstallFakeDir* dir = &info->dirs[i];
+    ok = StrTab_Add(&tab, dir->fake_dir, 1, &dir_refs[i]);
+    for (DWORD j = 0; j < dir->file_count && ok; ++j) ok = StrTab_Add(&tab, dir->file_list[j], 1, &file_refs[f++]);
+  }
+  for (DWORD i = 0; i < info->plugin_count && ok; ++i) {
+    ok = StrTab_Add(&tab, info->plugins[i].path, 1, &plugin_refs[i * 2]) &&
+      StrTab_Add(&tab, info->plugins[i].compress_param, 0, &plugin_refs[i * 2 + 1]);
+  }
+  if (ok && info->install7z_name) ok = StrTab_Add(&tab, info->install7z_name, 1, &name_ref);
+  for (DWORD i = 0; i < info->shard_count && ok; ++i) ok = StrTab_Add(&tab, info->shard_names[i], 1, &shard_refs[i]);
+  if (!ok) {
+    XNSIS_LOG(L"Failed to build string table");
+    goto done;
+  }
+
+  DWORD dedup_count = 0;
+  for (DWORD i = 0; i < info->dir_count; ++i) {
+    if (!info->dirs[i].blob_refs) continue;
+    for (DWORD j = 0; j < info->dirs[i].file_count; ++j) {
+      if (info->dirs[i].blob_refs[j].dir_idx != DISTINFO_BLOB_SELF) ++dedup_count;
+    }
+  }
+
+  ULONGLONG strings_size = V3_ALIGN((ULONGLONG)tab.size * sizeof(WORD));
+  ULONGLONG dirs_size = 16 + (ULONGLONG)info->dir_count * (sizeof(V3StrRef) + 8) + total_files * sizeof(V3StrRef);
+  ULONGLONG plugins_size = 8 + (ULONGLONG)info->plugin_count * 2 * sizeof(V3StrRef);
+  ULONGLONG name_size = info->install7z_name ? sizeof(V3StrRef) : 0;
+  ULONGLONG dedup_size = dedup_count ? V3_ALIGN(8 + (ULONGLONG)dedup_count * 16) : 0;
+  ULONGLONG filehash_size = info->has_file_digests ? 16 + total_files * sizeof(InstallFileDigest) : 0;
+  ULONGLONG shards_size = info->shard_count ? 8 + (ULONGLONG)info->shard_count * sizeof(V3StrRef) : 0;
+  ULONGLONG total = V3_HEADER_SIZE + V3_BLOCK_HEADER_SIZE * 3 + strings_size + dirs_size + plugins_size + V3_TRAILER_SIZE;
+  if (name_size) total += V3_BLOCK_HEADER_SIZE + name_size;
+  if (dedup_size) total += V3_BLOCK_HEADER_SIZE + dedup_size;
+  if (filehash_size) total += V3_BLOCK_HEADER_SIZE + filehash_size;
+  if (shards_size) total += V3_BLOCK_HEADER_SIZE + shards_size;
+  if (total > 0xFFFFFFFFull) {
+    XNSIS_LOG(L"distinfo too large: %llu bytes", total);
+    ok = 0;
+    goto done;
+  }
+
+  buffer = (BYTE*)calloc(1, (size_t)total);
+  if (!buffer) {
+    XNSIS_LOG(L"malloc buffer failed");
+    ok = 0;
+    goto done;
+  }
+  BYTE* p = buffer;
+
+  // 文件头
+  memcpy(p, "XNSI", 4);
+  *(DWORD*)(p + 4) = DISTINFO_VERSION_3;
+  *(DWORD*)(p + 8) = hash_alg;
+  p += V3_HEADER_SIZE;
+
+  // 字符串表块，必须是第一个块
+  p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_STRINGS, strings_size);
+  memcpy(p, tab.data, tab.size * sizeof(WORD));
+  p += strings_size;
+
+  // 目录信息块：dir_count、total_files、目录记录{名称, 文件数}、所有文件的引用（按目录顺序）
+  p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_DIRS, dirs_size);
+  *(ULONGLONG*)p = info->dir_count; p += 8;
+  *(ULONGLONG*)p = total_files; p += 8;
+  for (DWORD i = 0; i < info->dir_count; ++i) {
+    memcpy(p, &dir_refs[i], sizeof(V3StrRef)); p += sizeof(V3StrRef);
+    *(ULONGLONG*)p = info->dirs[i].file_count; p += 8;
+  }
+  memcpy(p, file_refs, (size_t)total_files * sizeof(V3StrRef));
+  p += total_files * sizeof(V3StrRef);
+
+  // 插件信息块：plugin_count、{路径, 压缩参数}
+  p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_PLUGINS, plugins_size);
+  *(ULONGLONG*)p = info->plugin_count; p += 8;
+  memcpy(p, plugin_refs, (size_t)info->plugin_count * 2 * sizeof(V3StrRef));
+  p += (size_t)info->plugin_count * 2 * sizeof(V3StrRef);
+
+  // install.7z文件名块
+  if (name_size) {
+    p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_INSTALL7Z, name_size);
+    memcpy(p, &name_ref, sizeof(V3StrRef)); p += sizeof(V3StrRef);
+  }
+
+  // 重复文件引用块：count、(dir, file, blob_dir, blob_file)
+  if (dedup_size) {
+    BYTE* block = p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_DEDUP, dedup_size);
+    *(ULONGLONG*)p = dedup_count; p += 8;
     for (DWORD i = 0; i < info->dir_count; ++i) {
-      for (DWORD j = 0; j < info->dirs[i].file_count; ++j) {
-        free(info->dirs[i].file_list[j]);
+      const InstallFakeDir* dir = &info->dirs[i];
+      if (!dir->blob_refs) continue;
+      for (DWORD j = 0; j < dir->file_count; ++j) {
+        if (dir->blob_refs[j].dir_idx == DISTINFO_BLOB_SELF) continue;
+        DWORD* ref = (DWORD*)p; p += 16;
+        ref[0] = i;
+        ref[1] = j;
+        ref[2] = dir->blob_refs[j].dir_idx;
+        ref[3] = dir->blob_refs[j].file_idx;
       }
-      free(info->dirs[i].file_list);
-      free(info->dirs[i].fake_dir);
     }
-    free(info->dirs);
+    p = block + dedup_size;
   }
 
-  // 释放插件信息
-  if (info->plugins) {
-    for (DWORD i = 0; i < info->plugin_count; ++i) {
-      free(info->plugins[i].path);
-      free(info->plugins[i].compress_param);
+  // 逐文件哈希块：hash_alg、保留、记录数（即total_files）、按目录顺序的{大小, 摘要}
+  if (filehash_size) {
+    p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_FILEHASH, filehash_size);
+    *(DWORD*)p = info->file_hash_alg;
+    *(ULONGLONG*)(p + 8) = total_files;
+    p += 16;
+    for (DWORD i = 0; i < info->dir_count; ++i) {
+      const InstallFakeDir* dir = &info->dirs[i];
+      for (DWORD j = 0; j < dir->file_count; ++j, p += sizeof(InstallFileDigest)) {
+        if (dir->digests) memcpy(p, &dir->digests[j], sizeof(InstallFileDigest));
+        else *(ULONGLONG*)p = DISTINFO_SIZE_UNKNOWN;
+      }
     }
-    free(info->plugins);
   }
 
-  // 释放install.7z文件名
-  if (info->install7z_name) {
-    free(info->install7z_name);
+  // 分片块：shard_count、各分片文件名
+  if (shards_size) {
+    p = WriteBlockHeaderV3(p, DISTINFO_BLOCK_TYPE_SHARDS, shards_size);
+    *(ULONGLONG*)p = info->shard_count; p += 8;
+    memcpy(p, shard_refs, (size_t)info->shard_count * sizeof(V3StrRef));
+    p += (size_t)info->shard_count * sizeof(V3StrRef);
+  }
+
+  // 校验值（不包括校验值本身），calloc已把补齐部分清零
+  if (!Hash_Buffer(hash_alg, buffer, (size_t)(p - buffer), p)) {
+    XNSIS_LOG(L"Hash_Buffer failed: %s", Hash_AlgName(hash_alg));
+    ok = 0;
+    goto done;
   }
+  ok = WriteWholeFile(filename, buffer, (size_t)total);
+
+done:
+  free(buffer);
+  free(dir_refs);
+  free(file_refs);
+  free(plugin_refs);
+  free(shard_refs);
+  StrTab_Free(&tab);
+  return ok;
+}
+
+// 取字符串表中的字符串，检查范围和结尾NUL。wchar_t为UTF-16时直接指向视图，
+// 否则解码到arena中
+static wchar_t* StrAt(Arena* arena, BYTE* strings, ULONGLONG strings_size, const BYTE* ref_ptr) {
+  V3StrRef ref;
+  memcpy(&ref, ref_ptr, sizeof(ref));
+  if (ref.offset % sizeof(WORD) || ref.offset > strings_size || ref.length >= strings_size / sizeof(WORD) ||
+    (ref.length + 1) * sizeof(WORD) > strings_size - ref.offset) return NULL;
+  WORD* units = (WORD*)(strings + ref.offset);
+  if (units[ref.length] != 0) return NULL;
+#if WCHAR_MAX <= 0xFFFF
+  (void)arena;
+  return (wchar_t*)units;
+#else
+  wchar_t* str = (wchar_t*)Arena_Alloc(arena, ((size_t)ref.length + 1) * sizeof(wchar_t));
+  if (str) Platform_FromUtf16LE(str, (const BYTE*)units, (size_t)ref.length);
+  return str;
+#endif
+}
+
+// 解析v3格式：buffer为文件映射视图，加载成功后由info持有
+static int LoadV3(InstallDistInfo* info, BYTE* buffer, ULONGLONG size) {
+  if (size < V3_HEADER_SIZE + V3_TRAILER_SIZE) return 0;
+  ULONGLONG data_len = size - V3_TRAILER_SIZE;
+  DWORD hash_alg = *(DWORD*)(buffer + 8);
+  DWORD digest_size = Hash_DigestSize(hash_alg);
+  if (!digest_size) {
+    XNSIS_LOG(L"Unsupported hash algorithm: %lu", hash_alg);
+    return 0;
+  }
+  BYTE calculated[V3_TRAILER_SIZE] = { 0 };
+  if (!Hash_Buffer(hash_alg, buffer, (size_t)data_len, calculated) ||
+    memcmp(calculated, buffer + data_len, V3_TRAILER_SIZE) != 0) {
+    XNSIS_LOG(L"%s verification failed - file may be corrupted", Hash_AlgName(hash_alg));
+    return 0;
+  }
+
+  BYTE* strings = NULL;
+  ULONGLONG strings_size = 0;
+  BYTE* p = buffer + V3_HEADER_SIZE;
+  BYTE* end = buffer + data_len;
+  while (p < end) {
+    if ((ULONGLONG)(end - p) < V3_BLOCK_HEADER_SIZE) {
+      XNSIS_LOG(L"Failed to read block header");
+      return 0;
+    }
+    BYTE block_type = p[0];
+    ULONGLONG block_length = *(ULONGLONG*)(p + 8);
+    p += V3_BLOCK_HEADER_SIZE;
+    if (block_length > (ULONGLONG)(end - p) || block_length % 8) {
+      XNSIS_LOG(L"Block length exceeds file size");
+      return 0;
+    }
+    BYTE* block_end = p + block_length;
+    // 除未知块外，其他块都引用字符串表
+    if (block_type != DISTINFO_BLOCK_TYPE_STRINGS && block_type <= DISTINFO_BLOCK_TYPE_DEDUP && !strings) {
+      XNSIS_LOG(L"String table must precede block type %d", block_type);
+      return 0;
+    }
+
+    switch (block_type) {
+    case DISTINFO_BLOCK_TYPE_STRINGS:
+      strings = p;
+      strings_size = block_length;
+      break;
+
+    case DISTINFO_BLOCK_TYPE_DIRS: {
+      if (block_length < 16) return 0;
+      ULONGLONG dir_count = *(ULONGLONG*)p;
+      ULONGLONG total_files = *(ULONGLONG*)(p + 8);
+      BYTE* dir_recs = p + 16;
+      if (dir_count > block_length / 24 || total_files > block_length / sizeof(V3StrRef) ||
+        16 + dir_count * 24 + total_files * sizeof(V3StrRef) > block_length) return 0;
+      BYTE* file_recs = dir_recs + dir_count * 24;
+
+      info->dirs = (InstallFakeDir*)calloc((size_t)dir_count + 1, sizeof(InstallFakeDir));
+      if (!info->dirs) return 0;
+      info->dir_count = (DWORD)dir_count;
+      info->dirs_capacity = (DWORD)dir_count + 1;
+
+      ULONGLONG next = 0;
+      for (DWORD i = 0; i < info->dir_count; ++i) {
+        BYTE* rec = dir_recs + (size_t)i * 24;
+        ULONGLONG file_count = *(ULONGLONG*)(rec + 16);
+        info->dirs[i].fake_dir = StrAt(&info->arena, strings, strings_size, rec);
+        if (!info->dirs[i].fake_dir || file_count > total_files - next) return 0;
+        // 每个目录一个指针数组，字符串本身不复制
+        info->dirs[i].file_list = (wchar_t**)malloc(((size_t)file_count + 1) * sizeof(wchar_t*));
+        if (!info->dirs[i].file_list) return 0;
+        info->dirs[i].file_count = (DWORD)file_count;
+        info->dirs[i].file_capacity = (DWORD)file_count + 1;
+        for (DWORD j = 0; j < info->dirs[i].file_count; ++j, ++next) {
+          info->dirs[i].file_list[j] = StrAt(&info->arena, strings, strings_size, file_recs + next * sizeof(V3StrRef));
+          if (!info->dirs[i].file_list[j]) return 0;
+        }
+      }
+      break;
+    }
+
+    case DISTINFO_BLOCK_TYPE_PLUGINS: {
+      if (block_length < 8) return 0;
+      ULONGLONG plugin_count = *(ULONGLONG*)p;
+      if (plugin_count > (block_length - 8) / (2 * sizeof(V3StrRef))) return 0;
+      info->plugins = (InstallPlugin*)calloc((size_t)plugin_count + 1, sizeof(InstallPlugin));
+      if (!info->plugins) return 0;
+      info->plugin_count = (DWORD)plugin_count;
+      info->plugins_capacity = (DWORD)plugin_count + 1;
+      for (DWORD i = 0; i < info->plugin_count; ++i) {
+        BYTE* rec = p + 8 + (size_t)i * 2 * sizeof(V3StrRef);
+        info->plugins[i].path = StrAt(&info->arena, strings, strings_size, rec);
+        info->plugins[i].compress_param = StrAt(&info->arena, strings, strings_size, rec + sizeof(V3StrRef));
+        if (!info->plugins[i].path || !info->plugins[i].compress_param) return 0;
+      }
+      break;
+    }
+
+    case DISTINFO_BLOCK_TYPE_INSTALL7Z:
+      if (block_length < sizeof(V3StrRef)) return 0;
+      info->install7z_name = StrAt(&info->arena, strings, strings_size, p);
+      if (!info->install7z_name) return 0;
+      break;
+
+    case DISTINFO_BLOCK_TYPE_DEDUP: {
+      // 须位于目录信息块之后
+      if (block_length < 8) return 0;
+      ULONGLONG ref_count = *(ULONGLONG*)p;
+      if (ref_count > (block_length - 8) / 16) return 0;
+      for (ULONGLONG i = 0; i < ref_count; ++i) {
+        DWORD* ref = (DWORD*)(p + 8 + i * 16);
+        if (DistInfo_SetFileBlob(info, ref[0], ref[1], ref[2], ref[3]) != 0) {
+          XNSIS_LOG(L"Invalid dedup reference: %lu/%lu -> %lu/%lu", ref[0], ref[1], ref[2], ref[3]);
+          return 0;
+        }
+      }
+      break;
+    }
+
+    case DISTINFO_BLOCK_TYPE_FILEHASH: {
+      // 须位于目录信息块之后，记录数与文件总数一致
+      if (block_length < 16) return 0;
+      DWORD file_hash_alg = *(DWORD*)p;
+      ULONGLONG record_count = *(ULONGLONG*)(p + 8);
+      ULONGLONG total_files = 0;
+      for (DWORD i = 0; i < info->dir_count; ++i) total_files += info->dirs[i].file_count;
+      if (!Hash_DigestSize(file_hash_alg) || record_count != total_files ||
+        record_count > (block_length - 16) / sizeof(InstallFileDigest)) {
+        XNSIS_LOG(L"Invalid file hash block: alg=%lu, records=%llu, files=%llu", file_hash_alg, record_count, total_files);
+        return 0;
+      }
+      const BYTE* rec = p + 16;
+      for (DWORD i = 0; i < info->dir_count; ++i) {
+        InstallFakeDir* dir = &info->dirs[i];
+        dir->digests = (InstallFileDigest*)malloc((size_t)dir->file_capacity * sizeof(InstallFileDigest));
+        if (!dir->digests) return 0;
+        memcpy(dir->digests, rec, (size_t)dir->file_count * sizeof(InstallFileDigest));
+        rec += (size_t)dir->file_count * sizeof(InstallFileDigest);
+      }
+      info->file_hash_alg = file_hash_alg;
+      info->has_file_digests = 1;
+      break;
+    }
+
+    case DISTINFO_BLOCK_TYPE_SHARDS: {
+      if (block_length < 8) return 0;
+      ULONGLONG shard_count = *(ULONGLONG*)p;
+      if (shard_count > (block_length - 8) / sizeof(V3StrRef)) return 0;
+      info->shard_names = (wchar_t**)calloc((size_t)shard_count + 1, sizeof(wchar_t*));
+      if (!info->shard_names) return 0;
+      info->shard_count = (DWORD)shard_count;
+      info->shards_capacity = (DWORD)shard_count + 1;
+      for (DWORD i = 0; i < info->shard_count; ++i) {
+        info->shard_names[i] = StrAt(&info->arena, strings, strings_size, p + 8 + (size_t)i * sizeof(V3StrRef));
+        if (!info->shard_names[i]) return 0;
+      }
+      break;
+    }
+
+    default:
+      // 跳过未知的块类型
+      XNSIS_LOG(L"Unknown block type: %d, skipping", block_type);
+      break;
+    }
+    p = block_end;
+  }
+  return 1;
+}
+
+int DistInfo_Load(InstallDistInfo* info, const wchar_t* filename) {
+  // 初始化结构
+  memset(info, 0, sizeof(InstallDistInfo));
+
+  // 允许删除：安装时加载后立即删除distinfo文件，映射解除后文件才真正消失
+  HANDLE hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    XNSIS_LOG(L"CreateFileW failed: %s, error=%lu", filename, GetLastError());
+    return 0;
+  }
+
+  LARGE_INTEGER fsize;
+  if (!GetFileSizeEx(hFile, &fsize) || fsize.QuadPart < 24 || fsize.QuadPart > 0xFFFFFFFFll) { // 至少需要8字节头部+16字节校验值
+    XNSIS_LOG(L"GetFileSizeEx failed or file too small: %s", filename);
+    CloseHandle(hFile); return 0;
+  }
+
+  // 写时复制映射：加载出的字符串指向映射内容，即使被改写也不会影响文件
+  HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if (!hMap) {
+    XNSIS_LOG(L"CreateFileMappingW failed: %s, error=%lu", filename, GetLastError());
+    return 0;
+  }
+  BYTE* view = (BYTE*)MapViewOfFile(hMap, FILE_MAP_COPY, 0, 0, 0);
+  CloseHandle(hMap);
+  if (!view) {
+    XNSIS_LOG(L"MapViewOfFile failed: %s, error=%lu", filename, GetLastError());
+    return 0;
+  }
+
+  if (memcmp(view, "XNSI", 4) != 0) {
+    XNSIS_LOG(L"Magic mismatch");
+    UnmapViewOfFile(view);
+    return 0;
+  }
+  DWORD version = *(DWORD*)(view + 4);
+  int ok = 0;
+  if (version == DISTINFO_VERSION_2) {
+    ok = LoadV2(info, view, (DWORD)fsize.QuadPart);
+    UnmapViewOfFile(view);
+  }
+  else if (version == DISTINFO_VERSION_3) {
+    info->mapped_view = view;
+    ok = LoadV3(info, view, (ULONGLONG)fsize.QuadPart);
+  }
+  else {
+    XNSIS_LOG(L"Unsupported version: %lu", version);
+    UnmapViewOfFile(view);
+  }
+  if (!ok) DistInfo_Free(info);
+  return ok;
+}
+
+int DistInfo_SaveEx(const InstallDistInfo* info, const wchar_t* filename, DWORD version, DWORD hash_alg) {
+  if (version == DISTINFO_VERSION_2) {
+    if (hash_alg != HASH_ALG_MD5) {
+      XNSIS_LOG(L"v2 only supports md5, got %s", Hash_AlgName(hash_alg));
+      return 0;
+    }
+    return SaveV2(info, filename);
+  }
+  if (version == DISTINFO_VERSION_3) {
+    if (!Hash_DigestSize(hash_alg)) {
+      XNSIS_LOG(L"Unsupported hash algorithm: %lu", hash_alg);
+      return 0;
+    }
+    return SaveV3(info, filename, hash_alg);
+  }
+  XNSIS_LOG(L"Unsupported version: %lu", version);
+  return 0;
+}
+
+int DistInfo_SaveVersion(const InstallDistInfo* info, const wchar_t* filename, DWORD version) {
+  return DistInfo_SaveEx(info, filename, version, version == DISTINFO_VERSION_2 ? HASH_ALG_MD5 : DISTINFO_HASH_DEFAULT);
+}
+
+int DistInfo_Save(const InstallDistInfo* info, const wchar_t* filename) {
+  return DistInfo_SaveVersion(info, filename, DISTINFO_VERSION_CURRENT);
+}
+
+void DistInfo_Free(InstallDistInfo* info) {
+  if (!info) return;
+
+  // 字符串都在arena或v3映射视图中，整体释放，只需逐个释放数组
+  if (info->dirs) {
+    for (DWORD i = 0; i < info->dir_count; ++i) {
+      free(info->dirs[i].file_list);
+      free(info->dirs[i].blob_refs);
+      free(info->dirs[i].digests);
+    }
+    free(info->dirs);
+  }
+  free(info->plugins);
+  free(info->shard_names);
+  Arena_Free(&info->arena);
+  if (info->mapped_view) UnmapViewOfFile(info->mapped_view);
   
   memset(info, 0, sizeof(InstallDistInfo));
 }
 
+// 数组容量按倍数增长，保证至少能再放一个元素
+static int GrowArray(void** array, DWORD* capacity, DWORD count, size_t elem_size, DWORD initial) {
+  if (count < *capacity) return 1;
+  DWORD new_cap = *capacity ? *capacity * 2 : initial;
+  void* p = realloc(*array, (size_t)new_cap * elem_size);
+  if (!p) return 0;
+  *array = p;
+  *capacity = new_cap;
+  return 1;
+}
+
 int DistInfo_AddFakeDir(InstallDistInfo* info, const wchar_t* fake_dir) {
   if (!info || !fake_dir) return -1;
-  DWORD new_count = info->dir_count + 1;
-  InstallFakeDir* new_dirs = (InstallFakeDir*)realloc(info->dirs, new_count * sizeof(InstallFakeDir));
-  if (!new_dirs) return -1;
-  info->dirs = new_dirs;
-  InstallFakeDir* fdir = &info->dirs[new_count - 1];
-  size_t len = wcslen(fake_dir);
-  fdir->fake_dir = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
+  if (!GrowArray((void**)&info->dirs, &info->dirs_capacity, info->dir_count, sizeof(InstallFakeDir), 4)) return -1;
+  InstallFakeDir* fdir = &info->dirs[info->dir_count];
+  fdir->fake_dir = Arena_StrDup(&info->arena, fake_dir);
   if (!fdir->fake_dir) return -1;
-  wcsncpy_s(fdir->fake_dir, len + 1, fake_dir, len);
-  fdir->fake_dir[len] = 0;
   fdir->file_count = 0;
+  fdir->file_capacity = 0;
   fdir->file_list = NULL;
-  info->dir_count = new_count;
-  return (int)(new_count - 1);
+  fdir->blob_refs = NULL;
+  fdir->digests = NULL;
+  return (int)(info->dir_count++);
 }
 
 int DistInfo_AddFile(InstallDistInfo* info, int fake_dir_idx, const wchar_t* arc_path) {
   if (!info || fake_dir_idx < 0 || (DWORD)fake_dir_idx >= info->dir_count || !arc_path) return -1;
   InstallFakeDir* fdir = &info->dirs[fake_dir_idx];
-  DWORD new_count = fdir->file_count + 1;
-  wchar_t** new_list = (wchar_t**)realloc(fdir->file_list, new_count * sizeof(wchar_t*));
-  if (!new_list) return -1;
-  fdir->file_list = new_list;
-  size_t len = wcslen(arc_path);
-  fdir->file_list[fdir->file_count] = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
-  if (!fdir->file_list[fdir->file_count]) return -1;
-  wcsncpy_s(fdir->file_list[fdir->file_count], len + 1, arc_path, len);
-  fdir->file_list[fdir->file_count][len] = 0;
-  fdir->file_count = new_count;
+  if (fdir->file_count == fdir->file_capacity) {
+    DWORD new_cap = fdir->file_capacity ? fdir->file_capacity * 2 : 16;
+    wchar_t** new_list = (wchar_t**)realloc(fdir->file_list, (size_t)new_cap * sizeof(wchar_t*));
+    if (!new_list) return -1;
+    fdir->file_list = new_list;
+    // blob_refs与file_list容量一致
+    if (fdir->blob_refs) {
+      InstallBlobRef* new_refs = (InstallBlobRef*)realloc(fdir->blob_refs, (size_t)new_cap * sizeof(InstallBlobRef));
+      if (!new_refs) return -1;
+      fdir->blob_refs = new_refs;
+    }
+    if (fdir->digests) {
+      InstallFileDigest* new_digests = (InstallFileDigest*)realloc(fdir->digests, (size_t)new_cap * sizeof(InstallFileDigest));
+      if (!new_digests) return -1;
+      fdir->digests = new_digests;
+    }
+    fdir->file_capacity = new_cap;
+  }
+  wchar_t* copy = Arena_StrDup(&info->arena, arc_path);
+  if (!copy) return -1;
+  if (fdir->blob_refs) {
+    fdir->blob_refs[fdir->file_count].dir_idx = DISTINFO_BLOB_SELF;
+    fdir->blob_refs[fdir->file_count].file_idx = 0;
+  }
+  if (fdir->digests) fdir->digests[fdir->file_count].size = DISTINFO_SIZE_UNKNOWN;
+  fdir->file_list[fdir->file_count++] = copy;
   return 0;
 }
 
 int DistInfo_AddPlugin(InstallDistInfo* info, const wchar_t* path, const wchar_t* compress_param) {
   if (!info || !path || !compress_param) return -1;
-  DWORD new_count = info->plugin_count + 1;
-  InstallPlugin* new_plugins = (InstallPlugin*)realloc(info->plugins, new_count * sizeof(InstallPlugin));
-  if (!new_plugins) return -1;
-  info->plugins = new_plugins;
-  InstallPlugin* plugin = &info->plugins[new_count - 1];
-  
-  size_t path_len = wcslen(path);
-  plugin->path = (wchar_t*)malloc((path_len + 1) * sizeof(wchar_t));
-  if (!plugin->path) return -1;
-  wcsncpy_s(plugin->path, path_len + 1, path, path_len);
-  plugin->path[path_len] = 0;
-  
-  size_t param_len = wcslen(compress_param);
-  plugin->compress_param = (wchar_t*)malloc((param_len + 1) * sizeof(wchar_t));
-  if (!plugin->compress_param) {
-    free(plugin->path);
-    return -1;
-  }
-  wcsncpy_s(plugin->compress_param, param_len + 1, compress_param, param_len);
-  plugin->compress_param[param_len] = 0;
-  
-  info->plugin_count = new_count;
-  return (int)(new_count - 1);
+  if (!GrowArray((void**)&info->plugins, &info->plugins_capacity, info->plugin_count, sizeof(InstallPlugin), 4)) return -1;
+  InstallPlugin* plugin = &info->plugins[info->plugin_count];
+  plugin->path = Arena_StrDup(&info->arena, path);
+  plugin->compress_param = Arena_StrDup(&info->arena, compress_param);
+  if (!plugin->path || !plugin->compress_param) return -1;
+  return (int)(info->plugin_count++);
 }
 
 int DistInfo_SetInstall7zName(InstallDistInfo* info, const wchar_t* install7z_name) {
     if (!info || !install7z_name) return -1;
     
-    // 释放旧的名称
-    if (info->install7z_name) {
-        free(info->install7z_name);
-        info->install7z_name = NULL;
-    }
-    
-    // 分配并复制新名称
-    size_t name_len = wcslen(install7z_name);
-    info->install7z_name = (wchar_t*)malloc((name_len + 1) * sizeof(wchar_t));
-    if (!info->install7z_name) return -1;
-    
-    wcsncpy_s(info->install7z_name, name_len + 1, install7z_name, name_len);
-    info->install7z_name[name_len] = 0;
+    // 旧名称留在arena中，随DistInfo_Free一起释放
+    wchar_t* name = Arena_StrDup(&info->arena, install7z_name);
+    if (!name) return -1;
+    info->install7z_name = name;
     
     return 0;
-}
\ No newline at end of file
+}
+
+int DistInfo_AddShard(InstallDistInfo* info, const wchar_t* shard_name) {
+  if (!info || !shard_name) return -1;
+  if (!GrowArray((void**)&info->shard_names, &info->shards_capacity, info->shard_count, sizeof(wchar_t*), 4)) return -1;
+  wchar_t* name = Arena_StrDup(&info->arena, shard_name);
+  if (!name) return -1;
+  info->shard_names[info->shard_count] = name;
+  return (int)(info->shard_count++);
+}
+
+int DistInfo_SetFileBlob(InstallDistInfo* info, DWORD dir_idx, DWORD file_idx, DWORD blob_dir_idx, DWORD blob_file_idx) {
+  if (!info || dir_idx >= info->dir_count || file_idx >= info->dirs[dir_idx].file_count) return -1;
+  if (blob_dir_idx >= info->dir_count || blob_file_idx >= info->dirs[blob_dir_idx].file_count) return -1;
+  // 引用目标本身必须按自身路径存储，避免形成引用链
+  const InstallFakeDir* blob_dir = &info->dirs[blob_dir_idx];
+  if (blob_dir->blob_refs && blob_dir->blob_refs[blob_file_idx].dir_idx != DISTINFO_BLOB_SELF) return -1;
+  InstallFakeDir* fdir = &info->dirs[dir_idx];
+  if (!fdir->blob_refs) {
+    fdir->blob_refs = (InstallBlobRef*)malloc((size_t)fdir->file_capacity * sizeof(InstallBlobRef));
+    if (!fdir->blob_refs) return -1;
+    for (DWORD j = 0; j < fdir->file_count; ++j) {
+      fdir->blob_refs[j].dir_idx = DISTINFO_BLOB_SELF;
+      fdir->blob_refs[j].file_idx = 0;
+    }
+  }
+  fdir->blob_refs[file_idx].dir_idx = blob_dir_idx;
+  fdir->blob_refs[file_idx].file_idx = blob_file_idx;
+  return 0;
+}
+
+const wchar_t* DistInfo_GetBlobPath(const InstallDistInfo* info, DWORD dir_idx, DWORD file_idx) {
+  if (!info || dir_idx >= info->dir_count || file_idx >= info->dirs[dir_idx].file_count) return NULL;
+  const InstallFakeDir* fdir = &info->dirs[dir_idx];
+  if (fdir->blob_refs && fdir->blob_refs[file_idx].dir_idx != DISTINFO_BLOB_SELF) {
+    const InstallBlobRef* ref = &fdir->blob_refs[file_idx];
+    return info->dirs[ref->dir_idx].file_list[ref->file_idx];
+  }
+  return fdir->file_list[file_idx];
+}
+
+int DistInfo_SetFileDigest(InstallDistInfo* info, DWORD dir_idx, DWORD file_idx, DWORD hash_alg, ULONGLONG size, const BYTE* digest) {
+  if (!info || dir_idx >= info->dir_count || file_idx >= info->dirs[dir_idx].file_count || !digest) return -1;
+  DWORD digest_size = Hash_DigestSize(hash_alg);
+  if (!digest_size || size == DISTINFO_SIZE_UNKNOWN) return -1;
+  if (info->has_file_digests && info->file_hash_alg != hash_alg) {
+    XNSIS_LOG(L"File hash algorithm mismatch: %s, already using %s", Hash_AlgName(hash_alg), Hash_AlgName(info->file_hash_alg));
+    return -1;
+  }
+  InstallFakeDir* fdir = &info->dirs[dir_idx];
+  if (!fdir->digests) {
+    fdir->digests = (InstallFileDigest*)malloc((size_t)fdir->file_capacity * sizeof(InstallFileDigest));
+    if (!fdir->digests) return -1;
+    for (DWORD j = 0; j < fdir->file_count; ++j) fdir->digests[j].size = DISTINFO_SIZE_UNKNOWN;
+  }
+  InstallFileDigest* entry = &fdir->digests[file_idx];
+  entry->size = size;
+  memset(entry->digest, 0, sizeof(entry->digest));
+  memcpy(entry->digest, digest, digest_size);
+  info->file_hash_alg = hash_alg;
+  info->has_file_digests = 1;
+  return 0;
+}
+
+const InstallFileDigest* DistInfo_GetFileDigest(const InstallDistInfo* info, DWORD dir_idx, DWORD file_idx) {
+  if (!info || dir_idx >= info->dir_count || file_idx >= info->dirs[dir_idx].file_count) return NULL;
+  const InstallFileDigest* digests = info->dirs[dir_idx].digests;
+  if (!digests || digests[file_idx].size == DISTINFO_SIZE_UNKNOWN) return NULL;
+  return &digests[file_idx];
+}
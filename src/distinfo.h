@@ -1,5 +1,7 @@
 #pragma once
-#include <windows.h>
+#include "platform.h"
+#include "arena.h"
+#include "hash.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,14 +11,47 @@ extern "C" {
 #define DISTINFO_BLOCK_TYPE_DIRS        0x01  // 目录信息块
 #define DISTINFO_BLOCK_TYPE_PLUGINS     0x02  // 插件信息块
 #define DISTINFO_BLOCK_TYPE_INSTALL7Z   0x03  // install.7z文件名块
+#define DISTINFO_BLOCK_TYPE_DEDUP       0x04  // 重复文件引用块
+#define DISTINFO_BLOCK_TYPE_STRINGS     0x05  // 字符串表块（v3，必须是第一个块）
+#define DISTINFO_BLOCK_TYPE_FILEHASH    0x06  // 逐文件大小和内容哈希块（v3，可选）
+#define DISTINFO_BLOCK_TYPE_SHARDS      0x07  // 其余分片归档文件名块（v3，可选）
 // 可以继续添加新的块类型...
 
+  // 文件格式版本：v2为长度前缀字符串；v3为字符串表+定长引用，可直接映射加载
+#define DISTINFO_VERSION_2        2
+#define DISTINFO_VERSION_3        3
+#define DISTINFO_VERSION_CURRENT  DISTINFO_VERSION_3
+
+  // v3默认校验算法（HASH_ALG_*，记录在文件头中）；v2固定为MD5
+#define DISTINFO_HASH_DEFAULT     HASH_ALG_FAST64
+
   extern const wchar_t* g_dist_info_name;
 
+  // 文件内容在install.7z中的存储位置：dirs[dir_idx].file_list[file_idx]
+  typedef struct {
+    DWORD dir_idx;
+    DWORD file_idx;
+  } InstallBlobRef;
+
+#define DISTINFO_BLOB_SELF ((DWORD)-1)  // 文件按自身路径存储
+
+  // 打包时记录的文件大小和内容哈希，用于安装后校验
+  typedef struct {
+    ULONGLONG size;
+    BYTE digest[HASH_MAX_DIGEST_SIZE];  // 按file_hash_alg计算，不足部分补0
+  } InstallFileDigest;
+
+#define DISTINFO_SIZE_UNKNOWN ((ULONGLONG)-1)  // 未记录该文件的哈希
+
   typedef struct {
     wchar_t* fake_dir;
     DWORD file_count;
+    DWORD file_capacity;
     wchar_t** file_list;
+    // 新增：去重引用，与file_list一一对应；为NULL或dir_idx为DISTINFO_BLOB_SELF时按自身路径存储
+    InstallBlobRef* blob_refs;
+    // 逐文件哈希，与file_list一一对应；为NULL或size为DISTINFO_SIZE_UNKNOWN时未记录
+    InstallFileDigest* digests;
   } InstallFakeDir;
 
   typedef struct {
@@ -27,20 +62,39 @@ extern "C" {
   typedef struct {
     InstallFakeDir* dirs;
     DWORD dir_count;
+    DWORD dirs_capacity;
     DWORD current_index;
 
     // 新增：插件信息
     InstallPlugin* plugins;
     DWORD plugin_count;
+    DWORD plugins_capacity;
     
     // 新增：install.7z文件名（包含随机数）
     wchar_t* install7z_name;
+    // 分片打包时其余分片的文件名（install7z_name为第0个分片），与install.7z位于同一目录
+    wchar_t** shard_names;
+    DWORD shard_count;
+    DWORD shards_capacity;
+
+    // 逐文件哈希使用的算法（HASH_ALG_*），has_file_digests为0时无意义
+    DWORD file_hash_alg;
+    int has_file_digests;
+
+    // 所有字符串的存储，DistInfo_Free时整体释放
+    Arena arena;
+    // v3加载：文件的写时复制映射视图，加载出的字符串直接指向其中
+    void* mapped_view;
   } InstallDistInfo;
 
   // 反序列化distinfo文件
   int DistInfo_Load(InstallDistInfo* info, const wchar_t* path);
-  // 序列化distinfo文件
+  // 序列化distinfo文件（当前版本）
   int DistInfo_Save(const InstallDistInfo* info, const wchar_t* path);
+  // 按指定版本序列化distinfo文件
+  int DistInfo_SaveVersion(const InstallDistInfo* info, const wchar_t* path, DWORD version);
+  // 按指定版本和校验算法序列化distinfo文件，v2只支持HASH_ALG_MD5
+  int DistInfo_SaveEx(const InstallDistInfo* info, const wchar_t* path, DWORD version, DWORD hash_alg);
   // 释放distinfo相关内存
   void DistInfo_Free(InstallDistInfo* info);
   // 添加一个fake目录，返回其索引（或-1失败）
@@ -51,6 +105,16 @@ extern "C" {
   int DistInfo_AddPlugin(InstallDistInfo* info, const wchar_t* path, const wchar_t* compress_param);
   // 设置install.7z文件名
   int DistInfo_SetInstall7zName(InstallDistInfo* info, const wchar_t* install7z_name);
+  // 添加一个分片文件名（第1个及之后的分片），返回其在shard_names中的序号（或-1失败）
+  int DistInfo_AddShard(InstallDistInfo* info, const wchar_t* shard_name);
+  // 标记文件内容与另一个文件相同，只存储一份
+  int DistInfo_SetFileBlob(InstallDistInfo* info, DWORD dir_idx, DWORD file_idx, DWORD blob_dir_idx, DWORD blob_file_idx);
+  // 获取文件在install.7z中的实际存储路径
+  const wchar_t* DistInfo_GetBlobPath(const InstallDistInfo* info, DWORD dir_idx, DWORD file_idx);
+  // 记录文件的大小和内容哈希；同一个distinfo中所有文件须使用同一算法
+  int DistInfo_SetFileDigest(InstallDistInfo* info, DWORD dir_idx, DWORD file_idx, DWORD hash_alg, ULONGLONG size, const BYTE* digest);
+  // 获取文件的大小和内容哈希，未记录时返回NULL
+  const InstallFileDigest* DistInfo_GetFileDigest(const InstallDistInfo* info, DWORD dir_idx, DWORD file_idx);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,5 @@
 #pragma once
-#include <windows.h>
+#include "platform.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
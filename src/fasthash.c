@@ -0,0 +1,540 @@
+#include "hash.h"
+#include <string.h>
+
+// CRC32C与FAST64/FAST128的可移植实现，x86上按CPU能力选择SSE4.2/SSE2/AVX2，ARM64上用CRC指令和NEON
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FASTHASH_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FASTHASH_TARGET(x)
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define FASTHASH_TARGET(x) __attribute__((target(x)))
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define FASTHASH_ARM64 1
+#include <arm_neon.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(FASTHASH_ARM64)
+#define FASTHASH_64BIT 1
+#endif
+
+#define FEATURE_SSE42 1
+#define FEATURE_AVX2  2
+
+static volatile int g_features = -1;  // -1表示尚未检测；并发检测结果相同，无需加锁
+static volatile int g_simd_enabled = 1;
+
+static int DetectFeatures(void) {
+  int features = 0;
+#if defined(FASTHASH_X86)
+  unsigned int regs[4] = { 0 };
+#if defined(_MSC_VER)
+  __cpuid((int*)regs, 1);
+#else
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (regs[2] & (1u << 20)) features |= FEATURE_SSE42;
+  // AVX2还需要操作系统保存YMM寄存器（OSXSAVE且XCR0的SSE/AVX位已开启）
+  if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28))) {
+    unsigned long long xcr0;
+#if defined(_MSC_VER)
+    xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+    if ((xcr0 & 6) == 6) {
+#if defined(_MSC_VER)
+      __cpuidex((int*)regs, 7, 0);
+#else
+      __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+      if (regs[1] & (1u << 5)) features |= FEATURE_AVX2;
+    }
+  }
+#endif
+  return features;
+}
+
+static int Features(void) {
+  if (!g_simd_enabled) return 0;
+  int features = g_features;
+  if (features < 0) g_features = features = DetectFeatures();
+  return features;
+}
+
+void Hash_SetSimdEnabled(int enabled) {
+  g_simd_enabled = enabled;
+}
+
+static uint64_t Read64(const BYTE* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t Read32(const BYTE* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// ---------------- CRC32C ----------------
+
+static const uint32_t kCrc32cTable[256] = {
+  0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C, 0x26A1E7E8, 0xD4CA64EB,
+  0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B, 0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24,
+  0x105EC76F, 0xE235446C, 0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+  0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC, 0xBC267848, 0x4E4DFB4B,
+  0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A, 0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35,
+  0xAA64D611, 0x580F5512, 0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+  0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD, 0x1642AE59, 0xE4292D5A,
+  0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A, 0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595,
+  0x417B1DBC, 0xB3109EBF, 0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+  0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F, 0xED03A29B, 0x1F682198,
+  0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927, 0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38,
+  0xDBFC821C, 0x2997011F, 0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+  0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E, 0x4767748A, 0xB50CF789,
+  0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859, 0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46,
+  0x7198540D, 0x83F3D70E, 0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+  0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE, 0xDDE0EB2A, 0x2F8B6829,
+  0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C, 0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93,
+  0x082F63B7, 0xFA44E0B4, 0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+  0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B, 0xB4091BFF, 0x466298FC,
+  0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C, 0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033,
+  0xA24BB5A6, 0x502036A5, 0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+  0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975, 0x0E330A81, 0xFC588982,
+  0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D, 0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622,
+  0x38CC2A06, 0xCAA7A905, 0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+  0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8, 0xE52CC12C, 0x1747422F,
+  0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF, 0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0,
+  0xD3D3E1AB, 0x21B862A8, 0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+  0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78, 0x7FAB5E8C, 0x8DC0DD8F,
+  0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE, 0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1,
+  0x69E9F0D5, 0x9B8273D6, 0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+  0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69, 0xD5CF889D, 0x27A40B9E,
+  0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E, 0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
+};
+
+static uint32_t Crc32cScalar(uint32_t crc, const BYTE* p, size_t len) {
+  while (len--) crc = kCrc32cTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(FASTHASH_X86)
+FASTHASH_TARGET("sse4.2")
+static uint32_t Crc32cSse42(uint32_t crc, const BYTE* p, size_t len) {
+#if defined(FASTHASH_64BIT)
+  uint64_t c = crc;
+  for (; len >= 8; p += 8, len -= 8) c = _mm_crc32_u64(c, Read64(p));
+  crc = (uint32_t)c;
+#else
+  for (; len >= 4; p += 4, len -= 4) crc = _mm_crc32_u32(crc, Read32(p));
+#endif
+  for (; len; ++p, --len) crc = _mm_crc32_u8(crc, *p);
+  return crc;
+}
+#endif
+
+#if defined(FASTHASH_ARM64)
+static uint32_t Crc32cArm(uint32_t crc, const BYTE* p, size_t len) {
+  for (; len >= 8; p += 8, len -= 8) crc = __crc32cd(crc, Read64(p));
+  for (; len; ++p, --len) crc = __crc32cb(crc, *p);
+  return crc;
+}
+#endif
+
+uint32_t Hash_Crc32c(uint32_t crc, const void* data, size_t len) {
+  const BYTE* p = (const BYTE*)data;
+  crc = ~crc;
+#if defined(FASTHASH_X86)
+  if (Features() & FEATURE_SSE42) return ~Crc32cSse42(crc, p, len);
+#elif defined(FASTHASH_ARM64) && (defined(_MSC_VER) || defined(__ARM_FEATURE_CRC32))
+  if (g_simd_enabled) return ~Crc32cArm(crc, p, len);
+#endif
+  return ~Crc32cScalar(crc, p, len);
+}
+
+// ---------------- FAST64 / FAST128 ----------------
+// 结构与XXH3相同：64字节为一条带，8路64位累加器，每16条带用密钥打散一次，最后合并成64/128位；
+// 常量和短输入的处理与xxHash不同，结果不与XXH3兼容
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define STRIPE_LEN 64
+#define SECRET_SIZE 192
+#define SECRET_CONSUME_RATE 8
+#define STRIPES_PER_BLOCK ((SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE)
+#define BLOCK_LEN (STRIPE_LEN * STRIPES_PER_BLOCK)
+#define MID_SIZE_MAX 128
+
+// 固定密钥（splitmix64生成）
+static const BYTE kSecret[SECRET_SIZE] = {
+  0xf4, 0x65, 0xb9, 0xa1, 0x6a, 0x9e, 0x78, 0x6e, 0x4f, 0x45, 0x09, 0x80,
+  0x18, 0x5d, 0xc4, 0x06, 0xec, 0x81, 0x4c, 0x72, 0xa8, 0xb8, 0x8b, 0xf8,
+  0x9b, 0x74, 0xa8, 0x51, 0x6a, 0x89, 0x39, 0x1b, 0xea, 0xa2, 0x7e, 0x74,
+  0x0c, 0x9f, 0xcb, 0x53, 0xe1, 0x32, 0x45, 0x1f, 0xbe, 0x9a, 0x82, 0x2c,
+  0x3c, 0xab, 0x16, 0xc9, 0x3a, 0x13, 0x84, 0xc5, 0xc3, 0x8a, 0xc9, 0x41,
+  0x90, 0x78, 0xe5, 0x3e, 0xa6, 0xb0, 0x8c, 0x36, 0x8c, 0x48, 0xb8, 0xf3,
+  0x09, 0x3d, 0xb1, 0x3c, 0xdd, 0xec, 0x7e, 0x65, 0xf6, 0xde, 0x5b, 0x05,
+  0xe0, 0x26, 0xd3, 0xc2, 0x7b, 0xdb, 0xbb, 0xe0, 0x3f, 0xa0, 0x21, 0x86,
+  0x2f, 0xa9, 0x3a, 0x98, 0x55, 0x75, 0x1f, 0x8e, 0x19, 0x4d, 0xcc, 0x00,
+  0x16, 0x0f, 0x4e, 0xb5, 0xab, 0x80, 0x1d, 0x97, 0x97, 0x3f, 0xbb, 0x84,
+  0x55, 0x12, 0x52, 0x75, 0x5c, 0x82, 0x29, 0x7d, 0x86, 0x7f, 0x7f, 0x2b,
+  0x10, 0x17, 0xcf, 0xc3, 0x64, 0x4f, 0x91, 0x83, 0xa0, 0xe9, 0x66, 0x34,
+  0xac, 0x85, 0x44, 0x5a, 0x2b, 0x8d, 0x1a, 0xd8, 0xd7, 0x9e, 0x0b, 0x10,
+  0x2b, 0x60, 0x01, 0xdb, 0x0d, 0xf1, 0x25, 0x18, 0x92, 0x8a, 0x03, 0xa9,
+  0x6a, 0x2f, 0xca, 0x0d, 0xd9, 0xf1, 0xf5, 0xed, 0x4c, 0x63, 0xd2, 0x7b,
+  0xd6, 0x6a, 0x49, 0x54, 0x69, 0x72, 0x40, 0xf5, 0xd4, 0x01, 0x7c, 0xdd,
+};
+
+static uint64_t Mul128Fold64(uint64_t a, uint64_t b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  uint64_t hi;
+  uint64_t lo = _umul128(a, b, &hi);
+  return lo ^ hi;
+#elif defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+  uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+  uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+  uint64_t hi_hi = (a >> 32) * (b >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+  uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+  uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+  return lower ^ upper;
+#endif
+}
+
+static uint64_t Rotl64(uint64_t v, int r) {
+  return (v << r) | (v >> (64 - r));
+}
+
+static uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  h ^= h >> 32;
+  return h;
+}
+
+static uint64_t Mix16(const BYTE* in, const BYTE* secret, uint64_t seed) {
+  return Mul128Fold64(Read64(in) ^ (Read64(secret) + seed), Read64(in + 8) ^ (Read64(secret + 8) - seed));
+}
+
+// 不超过128字节的输入；seed区分64位结果和128位结果的高半部分
+static uint64_t HashShort(const BYTE* p, size_t len, const BYTE* secret, uint64_t seed) {
+  if (len > 16) {
+    uint64_t acc = len * PRIME64_1 + seed;
+    // 从两端向中间，每次处理两端各16字节
+    for (size_t i = 0; i * 32 < len - 16; ++i) {
+      acc += Mix16(p + i * 16, secret + i * 32, seed);
+      acc += Mix16(p + len - 16 - i * 16, secret + i * 32 + 16, seed);
+    }
+    return Avalanche(acc);
+  }
+  if (len > 8) {
+    uint64_t lo = Read64(p) ^ ((Read64(secret + 24) ^ Read64(secret + 32)) + seed);
+    uint64_t hi = Read64(p + len - 8) ^ ((Read64(secret + 40) ^ Read64(secret + 48)) - seed);
+    uint64_t acc = len + Rotl64(lo, 32) + hi + Mul128Fold64(lo, hi);
+    return Avalanche(acc);
+  }
+  if (len >= 4) {
+    uint64_t combined = Read32(p + len - 4) + ((uint64_t)Read32(p) << 32);
+    uint64_t keyed = combined ^ ((Read64(secret + 8) ^ Read64(secret + 16)) - seed);
+    keyed ^= Rotl64(keyed, 49) ^ Rotl64(keyed, 24);
+    keyed *= 0x9FB21C651E98DF25ULL;
+    keyed ^= (keyed >> 35) + len;
+    keyed *= 0x9FB21C651E98DF25ULL;
+    return keyed ^ (keyed >> 28);
+  }
+  if (len > 0) {
+    uint32_t combined = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) | (uint32_t)p[len - 1] | ((uint32_t)len << 8);
+    uint64_t keyed = (uint64_t)combined ^ ((Read32(secret) ^ Read32(secret + 4)) + seed);
+    return Avalanche(keyed * PRIME64_1);
+  }
+  return Avalanche(seed ^ Read64(secret + 56) ^ Read64(secret + 64));
+}
+
+// 一条带：acc[i] += (data^key)低32位*高32位，相邻一路加上原始数据
+static void AccumulateScalar(uint64_t* acc, const BYTE* in, const BYTE* secret) {
+  for (int i = 0; i < 8; ++i) {
+    uint64_t data = Read64(in + 8 * i);
+    uint64_t key = data ^ Read64(secret + 8 * i);
+    acc[i ^ 1] += data;
+    acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+  }
+}
+
+static void ScrambleScalar(uint64_t* acc, const BYTE* secret) {
+  for (int i = 0; i < 8; ++i) {
+    uint64_t a = acc[i];
+    a ^= a >> 47;
+    a ^= Read64(secret + 8 * i);
+    a *= PRIME32_1;
+    acc[i] = a;
+  }
+}
+
+#if defined(FASTHASH_X86)
+static void AccumulateSse2(uint64_t* acc, const BYTE* in, const BYTE* secret) {
+  __m128i* xacc = (__m128i*)acc;
+  for (int i = 0; i < 4; ++i) {
+    __m128i data = _mm_loadu_si128((const __m128i*)(in + 16 * i));
+    __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+    __m128i key_hi = _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1));
+    __m128i product = _mm_mul_epu32(key, key_hi);
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i a = _mm_loadu_si128(xacc + i);
+    a = _mm_add_epi64(a, _mm_add_epi64(product, swapped));
+    _mm_storeu_si128(xacc + i, a);
+  }
+}
+
+static void ScrambleSse2(uint64_t* acc, const BYTE* secret) {
+  __m128i* xacc = (__m128i*)acc;
+  const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+  for (int i = 0; i < 4; ++i) {
+    __m128i a = _mm_loadu_si128(xacc + i);
+    a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+    a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+    // 64位乘32位常数：低32位乘积 + (高32位乘积 << 32)
+    __m128i a_hi = _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+    __m128i lo = _mm_mul_epu32(a, prime);
+    __m128i hi = _mm_mul_epu32(a_hi, prime);
+    _mm_storeu_si128(xacc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+  }
+}
+
+FASTHASH_TARGET("avx2")
+static void AccumulateAvx2(uint64_t* acc, const BYTE* in, const BYTE* secret) {
+  __m256i* xacc = (__m256i*)acc;
+  for (int i = 0; i < 2; ++i) {
+    __m256i data = _mm256_loadu_si256((const __m256i*)(in + 32 * i));
+    __m256i key = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i*)(secret + 32 * i)));
+    __m256i key_hi = _mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1));
+    __m256i product = _mm256_mul_epu32(key, key_hi);
+    __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    __m256i a = _mm256_loadu_si256(xacc + i);
+    a = _mm256_add_epi64(a, _mm256_add_epi64(product, swapped));
+    _mm256_storeu_si256(xacc + i, a);
+  }
+}
+
+FASTHASH_TARGET("avx2")
+static void ScrambleAvx2(uint64_t* acc, const BYTE* secret) {
+  __m256i* xacc = (__m256i*)acc;
+  const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+  for (int i = 0; i < 2; ++i) {
+    __m256i a = _mm256_loadu_si256(xacc + i);
+    a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+    a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)(secret + 32 * i)));
+    __m256i a_hi = _mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+    __m256i lo = _mm256_mul_epu32(a, prime);
+    __m256i hi = _mm256_mul_epu32(a_hi, prime);
+    _mm256_storeu_si256(xacc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+  }
+}
+#endif
+
+#if defined(FASTHASH_ARM64)
+static void AccumulateNeon(uint64_t* acc, const BYTE* in, const BYTE* secret) {
+  for (int i = 0; i < 4; ++i) {
+    uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(in + 16 * i));
+    uint64x2_t key = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+    uint64x2_t a = vld1q_u64(acc + 2 * i);
+    a = vaddq_u64(a, vextq_u64(data, data, 1));
+    a = vmlal_u32(a, vmovn_u64(key), vshrn_n_u64(key, 32));
+    vst1q_u64(acc + 2 * i, a);
+  }
+}
+
+static void ScrambleNeon(uint64_t* acc, const BYTE* secret) {
+  const uint32x2_t prime = vdup_n_u32(PRIME32_1);
+  for (int i = 0; i < 4; ++i) {
+    uint64x2_t a = vld1q_u64(acc + 2 * i);
+    a = veorq_u64(a, vshrq_n_u64(a, 47));
+    a = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+    uint64x2_t hi = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+    vst1q_u64(acc + 2 * i, vmlal_u32(hi, vmovn_u64(a), prime));
+  }
+}
+#endif
+
+typedef void (*AccumulateFunc)(uint64_t* acc, const BYTE* in, const BYTE* secret);
+typedef void (*ScrambleFunc)(uint64_t* acc, const BYTE* secret);
+
+static void SelectLongImpl(AccumulateFunc* accumulate, ScrambleFunc* scramble) {
+  *accumulate = AccumulateScalar;
+  *scramble = ScrambleScalar;
+#if defined(FASTHASH_X86)
+  if (!g_simd_enabled) return;
+  if (Features() & FEATURE_AVX2) {
+    *accumulate = AccumulateAvx2;
+    *scramble = ScrambleAvx2;
+    return;
+  }
+#if defined(FASTHASH_64BIT)
+  // x64总是支持SSE2
+  *accumulate = AccumulateSse2;
+  *scramble = ScrambleSse2;
+#endif
+#elif defined(FASTHASH_ARM64)
+  if (!g_simd_enabled) return;
+  *accumulate = AccumulateNeon;
+  *scramble = ScrambleNeon;
+#endif
+}
+
+// 与hash.h中HashFastState的缓冲区大小一致
+typedef char CheckFastStateBuffer[(HASH_FAST_STRIPE_LEN == STRIPE_LEN && HASH_FAST_BLOCK_LEN == BLOCK_LEN) ? 1 : -1];
+
+static void InitAccs(uint64_t* acc) {
+  acc[0] = PRIME32_3; acc[1] = PRIME64_1; acc[2] = PRIME64_2; acc[3] = PRIME64_3;
+  acc[4] = PRIME64_4; acc[5] = PRIME32_2; acc[6] = PRIME64_5; acc[7] = PRIME32_1;
+}
+
+// 一个完整的块：16条带后用密钥末尾打散
+static void AccumulateBlock(uint64_t* acc, const BYTE* block, AccumulateFunc accumulate, ScrambleFunc scramble) {
+  for (size_t s = 0; s < STRIPES_PER_BLOCK; ++s) {
+    accumulate(acc, block + s * STRIPE_LEN, kSecret + s * SECRET_CONSUME_RATE);
+  }
+  scramble(acc, kSecret + SECRET_SIZE - STRIPE_LEN);
+}
+
+// 最后一个块（remain为1..BLOCK_LEN字节）：完整条带，再加上以输入末尾对齐的最后一条带
+static void AccumulateLast(uint64_t* acc, const BYTE* block, size_t remain, const BYTE* last_stripe, AccumulateFunc accumulate) {
+  size_t stripe_count = (remain - 1) / STRIPE_LEN;
+  for (size_t s = 0; s < stripe_count; ++s) {
+    accumulate(acc, block + s * STRIPE_LEN, kSecret + s * SECRET_CONSUME_RATE);
+  }
+  accumulate(acc, last_stripe, kSecret + SECRET_SIZE - STRIPE_LEN - 7);
+}
+
+// 超过128字节的输入：按条带累加到8路累加器
+static void HashLong(const BYTE* p, size_t len, uint64_t* acc) {
+  AccumulateFunc accumulate;
+  ScrambleFunc scramble;
+  SelectLongImpl(&accumulate, &scramble);
+  InitAccs(acc);
+  size_t block_count = (len - 1) / BLOCK_LEN;
+  for (size_t b = 0; b < block_count; ++b) AccumulateBlock(acc, p + b * BLOCK_LEN, accumulate, scramble);
+  AccumulateLast(acc, p + block_count * BLOCK_LEN, len - block_count * BLOCK_LEN, p + len - STRIPE_LEN, accumulate);
+}
+
+static uint64_t MergeAccs(const uint64_t* acc, const BYTE* secret, uint64_t start) {
+  uint64_t result = start;
+  for (int i = 0; i < 4; ++i) {
+    result += Mul128Fold64(acc[2 * i] ^ Read64(secret + 16 * i), acc[2 * i + 1] ^ Read64(secret + 16 * i + 8));
+  }
+  return Avalanche(result);
+}
+
+uint64_t Hash_Fast64(const void* data, size_t len) {
+  const BYTE* p = (const BYTE*)data;
+  if (len <= MID_SIZE_MAX) return HashShort(p, len, kSecret, 0);
+  uint64_t acc[8];
+  HashLong(p, len, acc);
+  return MergeAccs(acc, kSecret + 11, len * PRIME64_1);
+}
+
+void Hash_Fast128(const void* data, size_t len, uint64_t out[2]) {
+  const BYTE* p = (const BYTE*)data;
+  if (len <= MID_SIZE_MAX) {
+    out[0] = HashShort(p, len, kSecret, 0);
+    out[1] = HashShort(p, len, kSecret + 64, PRIME64_2);
+    return;
+  }
+  uint64_t acc[8];
+  HashLong(p, len, acc);
+  out[0] = MergeAccs(acc, kSecret + 11, len * PRIME64_1);
+  out[1] = MergeAccs(acc, kSecret + SECRET_SIZE - STRIPE_LEN - 11, ~(len * PRIME64_2));
+}
+
+// ---------------- 流式计算 ----------------
+// 只有确定后面还有数据时才处理缓冲满的块，最后一个块总留到Final，与一次性计算的分块方式相同；
+// 缓冲区前STRIPE_LEN字节保留上一个已处理块的末尾，供最后一条带向前回看
+
+void Hash_FastInit(HashFastState* state) {
+  InitAccs(state->acc);
+  state->total_len = 0;
+  state->buffered = 0;
+}
+
+void Hash_FastUpdate(HashFastState* state, const void* data, size_t len) {
+  const BYTE* p = (const BYTE*)data;
+  BYTE* pending = state->buffer + STRIPE_LEN;
+  state->total_len += len;
+  if (state->buffered + len <= BLOCK_LEN) {
+    memcpy(pending + state->buffered, p, len);
+    state->buffered += len;
+    return;
+  }
+  AccumulateFunc accumulate;
+  ScrambleFunc scramble;
+  SelectLongImpl(&accumulate, &scramble);
+  if (state->buffered) {
+    size_t fill = BLOCK_LEN - state->buffered;
+    memcpy(pending + state->buffered, p, fill);
+    p += fill;
+    len -= fill;
+    AccumulateBlock(state->acc, pending, accumulate, scramble);
+    memcpy(state->buffer, pending + BLOCK_LEN - STRIPE_LEN, STRIPE_LEN);
+  }
+  // 直接处理输入中的完整块，不经过缓冲区
+  if (len > BLOCK_LEN) {
+    for (; len > BLOCK_LEN; p += BLOCK_LEN, len -= BLOCK_LEN) AccumulateBlock(state->acc, p, accumulate, scramble);
+    memcpy(state->buffer, p - STRIPE_LEN, STRIPE_LEN);
+  }
+  memcpy(pending, p, len);
+  state->buffered = len;
+}
+
+// total_len超过MID_SIZE_MAX时，累加缓冲区中剩余的最后一个块
+static void FinishState(const HashFastState* state, uint64_t* acc) {
+  AccumulateFunc accumulate;
+  ScrambleFunc scramble;
+  SelectLongImpl(&accumulate, &scramble);
+  memcpy(acc, state->acc, sizeof(state->acc));
+  const BYTE* pending = state->buffer + STRIPE_LEN;
+  AccumulateLast(acc, pending, state->buffered, pending + state->buffered - STRIPE_LEN, accumulate);
+}
+
+uint64_t Hash_FastFinal64(const HashFastState* state) {
+  uint64_t len = state->total_len;
+  if (len <= MID_SIZE_MAX) return HashShort(state->buffer + STRIPE_LEN, (size_t)len, kSecret, 0);
+  uint64_t acc[8];
+  FinishState(state, acc);
+  return MergeAccs(acc, kSecret + 11, len * PRIME64_1);
+}
+
+void Hash_FastFinal128(const HashFastState* state, uint64_t out[2]) {
+  uint64_t len = state->total_len;
+  if (len <= MID_SIZE_MAX) {
+    out[0] = HashShort(state->buffer + STRIPE_LEN, (size_t)len, kSecret, 0);
+    out[1] = HashShort(state->buffer + STRIPE_LEN, (size_t)len, kSecret + 64, PRIME64_2);
+    return;
+  }
+  uint64_t acc[8];
+  FinishState(state, acc);
+  out[0] = MergeAccs(acc, kSecret + 11, len * PRIME64_1);
+  out[1] = MergeAccs(acc, kSecret + SECRET_SIZE - STRIPE_LEN - 11, ~(len * PRIME64_2));
+}
@@ -0,0 +1,177 @@
+#include "fileops.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <winioctl.h>
+#include <aclapi.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#endif
+
+#ifdef _WIN32
+int FileOps_CloneFile(const wchar_t* src, const wchar_t* dst) {
+  HANDLE hSrc = CreateFileW(src, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+  if (hSrc == INVALID_HANDLE_VALUE) return 0;
+  DWORD fs_flags = 0;
+  BY_HANDLE_FILE_INFORMATION info;
+  if (!GetVolumeInformationByHandleW(hSrc, NULL, 0, NULL, NULL, &fs_flags, NULL, 0) ||
+    !(fs_flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) || !GetFileInformationByHandle(hSrc, &info)) {
+    CloseHandle(hSrc);
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return 0;
+  }
+  wchar_t root[MAX_PATH];
+  DWORD sectors_per_cluster = 0, bytes_per_sector = 0, free_clusters = 0, total_clusters = 0;
+  if (!GetVolumePathNameW(dst, root, MAX_PATH) ||
+    !GetDiskFreeSpaceW(root, &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters)) {
+    DWORD err = GetLastError();
+    CloseHandle(hSrc);
+    SetLastError(err);
+    return 0;
+  }
+  ULONGLONG cluster = (ULONGLONG)sectors_per_cluster * bytes_per_sector;
+  HANDLE hDst = CreateFileW(dst, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hDst == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    CloseHandle(hSrc);
+    SetLastError(err);
+    return 0;
+  }
+  int ok = 1;
+  DWORD returned = 0;
+  if (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) {
+    ok = DeviceIoControl(hDst, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL) ? 1 : 0;
+  }
+  LARGE_INTEGER size;
+  size.QuadPart = ((LONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+  ok = ok && SetFilePointerEx(hDst, size, NULL, FILE_BEGIN) && SetEndOfFile(hDst);
+  // 单次克隆长度须按簇对齐且小于4GB
+  const ULONGLONG max_chunk = (0x80000000ULL / cluster) * cluster;
+  for (ULONGLONG offset = 0; ok && offset < (ULONGLONG)size.QuadPart; offset += max_chunk) {
+    ULONGLONG remain = (ULONGLONG)size.QuadPart - offset;
+    ULONGLONG chunk = remain < max_chunk ? (remain + cluster - 1) / cluster * cluster : max_chunk;
+    DUPLICATE_EXTENTS_DATA dup = { 0 };
+    dup.FileHandle = hSrc;
+    dup.SourceFileOffset.QuadPart = (LONGLONG)offset;
+    dup.TargetFileOffset.QuadPart = (LONGLONG)offset;
+    dup.ByteCount.QuadPart = (LONGLONG)chunk;
+    ok = DeviceIoControl(hDst, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &dup, sizeof(dup), NULL, 0, &returned, NULL) ? 1 : 0;
+  }
+  DWORD err = GetLastError();
+  CloseHandle(hDst);
+  CloseHandle(hSrc);
+  if (!ok) {
+    DeleteFileW(dst);
+    SetLastError(err);
+  }
+  return ok;
+}
+
+int FileOps_ResetInheritedSecurity(const wchar_t* path) {
+  // 空的非保护DACL：去掉原有的继承项，由新的上级目录重新继承
+  ACL empty_acl;
+  if (!InitializeAcl(&empty_acl, sizeof(empty_acl), ACL_REVISION)) {
+    XNSIS_LOG(L"InitializeAcl failed, error=%lu", GetLastError());
+    return 0;
+  }
+  DWORD err = SetNamedSecurityInfoW((LPWSTR)path, SE_FILE_OBJECT,
+    DACL_SECURITY_INFORMATION | UNPROTECTED_DACL_SECURITY_INFORMATION, NULL, NULL, &empty_acl, NULL);
+  if (err != ERROR_SUCCESS) {
+    XNSIS_LOG(L"SetNamedSecurityInfoW failed: %s, error=%lu", path, err);
+    return 0;
+  }
+  return 1;
+}
+#else
+// Btrfs/XFS等文件系统的reflink（FICLONE），语义与ReFS块克隆相同
+int FileOps_CloneFile(const wchar_t* src, const wchar_t* dst) {
+#ifdef FICLONE
+  char native_src[PLATFORM_NATIVE_PATH_SIZE], native_dst[PLATFORM_NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(src, native_src) || !Platform_NativePath(dst, native_dst)) return 0;
+  int src_fd = open(native_src, O_RDONLY | O_CLOEXEC);
+  if (src_fd < 0) {
+    SetLastError(Platform_ErrorFromErrno(errno));
+    return 0;
+  }
+  struct stat st;
+  int dst_fd = fstat(src_fd, &st) == 0 ? open(native_dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777) : -1;
+  if (dst_fd < 0) {
+    SetLastError(Platform_ErrorFromErrno(errno));
+    close(src_fd);
+    return 0;
+  }
+  int ok = ioctl(dst_fd, FICLONE, src_fd) == 0;
+  int err = errno;
+  close(dst_fd);
+  close(src_fd);
+  if (!ok) {
+    unlink(native_dst);
+    // 与Windows一致：文件系统不支持时返回ERROR_NOT_SUPPORTED，调用方改用硬链接或复制
+    SetLastError(err == EOPNOTSUPP || err == ENOTTY || err == EINVAL ? ERROR_NOT_SUPPORTED : Platform_ErrorFromErrno(err));
+  }
+  return ok;
+#else
+  (void)src;
+  (void)dst;
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return 0;
+#endif
+}
+
+int FileOps_ResetInheritedSecurity(const wchar_t* path) {
+  // POSIX没有继承的权限，新位置的权限只由文件本身的mode决定
+  (void)path;
+  return 1;
+}
+#endif
+
+#define COMPARE_CHUNK (1024 * 1024)
+
+static int ReadFull(HANDLE h, BYTE* buf, DWORD want, DWORD* got) {
+  *got = 0;
+  while (*got < want) {
+    DWORD n = 0;
+    if (!ReadFile(h, buf + *got, want - *got, &n, NULL)) return 0;
+    if (n == 0) break;
+    *got += n;
+  }
+  return 1;
+}
+
+int FileOps_SameContent(const wchar_t* a, const wchar_t* b) {
+  HANDLE ha = CreateFileW(a, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (ha == INVALID_HANDLE_VALUE) return -1;
+  HANDLE hb = CreateFileW(b, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hb == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    CloseHandle(ha);
+    SetLastError(err);
+    return -1;
+  }
+  BYTE* buf = (BYTE*)malloc(2 * COMPARE_CHUNK);
+  int result = buf ? 1 : -1;
+  if (!buf) SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+  while (result == 1) {
+    DWORD got_a = 0, got_b = 0;
+    if (!ReadFull(ha, buf, COMPARE_CHUNK, &got_a) || !ReadFull(hb, buf + COMPARE_CHUNK, COMPARE_CHUNK, &got_b)) {
+      result = -1;
+      break;
+    }
+    if (got_a != got_b || memcmp(buf, buf + COMPARE_CHUNK, got_a) != 0) result = 0;
+    if (got_a < COMPARE_CHUNK) break;
+  }
+  DWORD err = GetLastError();
+  free(buf);
+  CloseHandle(hb);
+  CloseHandle(ha);
+  SetLastError(err);
+  return result;
+}
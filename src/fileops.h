@@ -0,0 +1,17 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 块克隆（ReFS，或POSIX下支持reflink的文件系统）：目标文件与源文件共享数据块，直到其中一方被改写；失败时不留下目标文件
+  int FileOps_CloneFile(const wchar_t* src, const wchar_t* dst);
+  // 按新的上级目录重新计算继承的权限（移动或硬链接过来的文件仍保留原位置的权限）
+  int FileOps_ResetInheritedSecurity(const wchar_t* path);
+  // 逐字节比较两个文件的内容：相同返回1，不同返回0，读取失败返回-1（GetLastError为错误码）
+  int FileOps_SameContent(const wchar_t* a, const wchar_t* b);
+
+#ifdef __cplusplus
+}
+#endif
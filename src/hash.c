@@ -0,0 +1,269 @@
+#include "hash.h"
+#include "log.h"
+#include <string.h>
+#include <wchar.h>
+#ifdef _WIN32
+#include <wincrypt.h>
+#endif
+
+// MD5每次交给CryptHashData的长度
+#define HASH_MD5_CHUNK (1024 * 1024)
+// Hash_FileDigest每次映射的大小，须为分配粒度（64KB）的整数倍
+#define HASH_MAP_WINDOW (32 * 1024 * 1024)
+
+// MD5计算函数
+int Hash_MD5(const BYTE* data, DWORD data_len, BYTE* md5_out) {
+#ifndef _WIN32
+  HashMd5State state;
+  Hash_Md5Init(&state);
+  Hash_Md5Update(&state, data, data_len);
+  Hash_Md5Final(&state, md5_out);
+  return 1;
+#else
+  HCRYPTPROV hProv = 0;
+  HCRYPTHASH hHash = 0;
+  DWORD hash_len = 16; // MD5 is 16 bytes
+
+  if (!CryptAcquireContextW(&hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) {
+    XNSIS_LOG(L"CryptAcquireContext failed, error=%lu", GetLastError());
+    return 0;
+  }
+
+  if (!CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash)) {
+    XNSIS_LOG(L"CryptCreateHash failed, error=%lu", GetLastError());
+    CryptReleaseContext(hProv, 0);
+    return 0;
+  }
+
+  if (!CryptHashData(hHash, data, data_len, 0)) {
+    XNSIS_LOG(L"CryptHashData failed, error=%lu", GetLastError());
+    CryptDestroyHash(hHash);
+    CryptReleaseContext(hProv, 0);
+    return 0;
+  }
+
+  if (!CryptGetHashParam(hHash, HP_HASHVAL, md5_out, &hash_len, 0)) {
+    XNSIS_LOG(L"CryptGetHashParam failed, error=%lu", GetLastError());
+    CryptDestroyHash(hHash);
+    CryptReleaseContext(hProv, 0);
+    return 0;
+  }
+
+  CryptDestroyHash(hHash);
+  CryptReleaseContext(hProv, 0);
+  return 1;
+#endif
+}
+
+int Hash_File(const wchar_t* path, ContentHash* out) {
+  return Hash_FileDigest(HASH_ALG_MD5, path, NULL, out->bytes);
+}
+
+const wchar_t* Hash_AlgName(DWORD alg) {
+  switch (alg) {
+  case HASH_ALG_MD5: return L"md5";
+  case HASH_ALG_CRC32C: return L"crc32c";
+  case HASH_ALG_FAST64: return L"fast64";
+  case HASH_ALG_FAST128: return L"fast128";
+  }
+  return L"unknown";
+}
+
+DWORD Hash_AlgFromName(const wchar_t* name) {
+  for (DWORD alg = 0; alg < HASH_ALG_COUNT; ++alg) {
+    if (_wcsicmp(name, Hash_AlgName(alg)) == 0) return alg;
+  }
+  return HASH_ALG_COUNT;
+}
+
+DWORD Hash_DigestSize(DWORD alg) {
+  switch (alg) {
+  case HASH_ALG_MD5: return 16;
+  case HASH_ALG_CRC32C: return 4;
+  case HASH_ALG_FAST64: return 8;
+  case HASH_ALG_FAST128: return 16;
+  }
+  return 0;
+}
+
+int Hash_Buffer(DWORD alg, const BYTE* data, size_t data_len, BYTE* digest_out) {
+  switch (alg) {
+  case HASH_ALG_MD5:
+    if (data_len > MAXDWORD) {
+      XNSIS_LOG(L"MD5 input too large: %llu bytes", (ULONGLONG)data_len);
+      return 0;
+    }
+    return Hash_MD5(data, (DWORD)data_len, digest_out);
+  case HASH_ALG_CRC32C: {
+    uint32_t crc = Hash_Crc32c(0, data, data_len);
+    memcpy(digest_out, &crc, sizeof(crc));
+    return 1;
+  }
+  case HASH_ALG_FAST64: {
+    uint64_t h = Hash_Fast64(data, data_len);
+    memcpy(digest_out, &h, sizeof(h));
+    return 1;
+  }
+  case HASH_ALG_FAST128: {
+    uint64_t h[2];
+    Hash_Fast128(data, data_len, h);
+    memcpy(digest_out, h, sizeof(h));
+    return 1;
+  }
+  }
+  XNSIS_LOG(L"unknown hash algorithm: %lu", alg);
+  return 0;
+}
+
+int Hash_Init(HashState* state, DWORD alg) {
+  memset(state, 0, sizeof(HashState));
+  state->alg = alg;
+  switch (alg) {
+  case HASH_ALG_MD5: {
+#ifndef _WIN32
+    Hash_Md5Init(&state->md5);
+    return 1;
+#else
+    HCRYPTPROV hProv = 0;
+    HCRYPTHASH hHash = 0;
+    if (!CryptAcquireContextW(&hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) {
+      XNSIS_LOG(L"CryptAcquireContext failed, error=%lu", GetLastError());
+      return 0;
+    }
+    if (!CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash)) {
+      XNSIS_LOG(L"CryptCreateHash failed, error=%lu", GetLastError());
+      CryptReleaseContext(hProv, 0);
+      return 0;
+    }
+    state->crypt_prov = (ULONG_PTR)hProv;
+    state->crypt_hash = (ULONG_PTR)hHash;
+    return 1;
+#endif
+  }
+  case HASH_ALG_CRC32C:
+    return 1;
+  case HASH_ALG_FAST64:
+  case HASH_ALG_FAST128:
+    Hash_FastInit(&state->fast);
+    return 1;
+  }
+  XNSIS_LOG(L"unknown hash algorithm: %lu", alg);
+  return 0;
+}
+
+int Hash_Update(HashState* state, const BYTE* data, size_t data_len) {
+  switch (state->alg) {
+  case HASH_ALG_MD5:
+#ifndef _WIN32
+    Hash_Md5Update(&state->md5, data, data_len);
+    return 1;
+#else
+    while (data_len) {
+      DWORD chunk = data_len > HASH_MD5_CHUNK ? HASH_MD5_CHUNK : (DWORD)data_len;
+      if (!CryptHashData((HCRYPTHASH)state->crypt_hash, data, chunk, 0)) {
+        XNSIS_LOG(L"CryptHashData failed, error=%lu", GetLastError());
+        return 0;
+      }
+      data += chunk;
+      data_len -= chunk;
+    }
+    return 1;
+#endif
+  case HASH_ALG_CRC32C:
+    state->crc = Hash_Crc32c(state->crc, data, data_len);
+    return 1;
+  case HASH_ALG_FAST64:
+  case HASH_ALG_FAST128:
+    Hash_FastUpdate(&state->fast, data, data_len);
+    return 1;
+  }
+  return 0;
+}
+
+int Hash_Final(HashState* state, BYTE* digest_out) {
+  int ok = 1;
+  switch (state->alg) {
+  case HASH_ALG_MD5:
+#ifndef _WIN32
+    if (digest_out) Hash_Md5Final(&state->md5, digest_out);
+#else
+    if (digest_out) {
+      DWORD hash_len = 16;
+      if (!CryptGetHashParam((HCRYPTHASH)state->crypt_hash, HP_HASHVAL, digest_out, &hash_len, 0)) {
+        XNSIS_LOG(L"CryptGetHashParam failed, error=%lu", GetLastError());
+        ok = 0;
+      }
+    }
+    if (state->crypt_hash) CryptDestroyHash((HCRYPTHASH)state->crypt_hash);
+    if (state->crypt_prov) CryptReleaseContext((HCRYPTPROV)state->crypt_prov, 0);
+    state->crypt_hash = 0;
+    state->crypt_prov = 0;
+#endif
+    break;
+  case HASH_ALG_CRC32C:
+    if (digest_out) memcpy(digest_out, &state->crc, sizeof(state->crc));
+    break;
+  case HASH_ALG_FAST64:
+    if (digest_out) {
+      uint64_t h = Hash_FastFinal64(&state->fast);
+      memcpy(digest_out, &h, sizeof(h));
+    }
+    break;
+  case HASH_ALG_FAST128:
+    if (digest_out) {
+      uint64_t h[2];
+      Hash_FastFinal128(&state->fast, h);
+      memcpy(digest_out, h, sizeof(h));
+    }
+    break;
+  default:
+    ok = 0;
+    break;
+  }
+  return ok;
+}
+
+int Hash_FileDigest(DWORD alg, const wchar_t* path, ULONGLONG* size_out, BYTE* digest_out) {
+  HANDLE hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    XNSIS_LOG(L"CreateFileW failed: %s, error=%lu", path, GetLastError());
+    return 0;
+  }
+  LARGE_INTEGER fsize;
+  if (!GetFileSizeEx(hFile, &fsize)) {
+    XNSIS_LOG(L"GetFileSizeEx failed: %s, error=%lu", path, GetLastError());
+    CloseHandle(hFile);
+    return 0;
+  }
+  HashState state;
+  if (!Hash_Init(&state, alg)) {
+    CloseHandle(hFile);
+    return 0;
+  }
+  ULONGLONG size = (ULONGLONG)fsize.QuadPart;
+  int ok = 1;
+  // 空文件不能创建映射
+  if (size) {
+    HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!hMap) {
+      XNSIS_LOG(L"CreateFileMappingW failed: %s, error=%lu", path, GetLastError());
+      ok = 0;
+    }
+    for (ULONGLONG offset = 0; ok && offset < size; offset += HASH_MAP_WINDOW) {
+      size_t window = size - offset > HASH_MAP_WINDOW ? HASH_MAP_WINDOW : (size_t)(size - offset);
+      const BYTE* view = (const BYTE*)MapViewOfFile(hMap, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, window);
+      if (!view) {
+        XNSIS_LOG(L"MapViewOfFile failed: %s, offset=%llu, error=%lu", path, offset, GetLastError());
+        ok = 0;
+        break;
+      }
+      ok = Hash_Update(&state, view, window);
+      UnmapViewOfFile(view);
+    }
+    if (hMap) CloseHandle(hMap);
+  }
+  CloseHandle(hFile);
+  if (!Hash_Final(&state, ok ? digest_out : NULL)) ok = 0;
+  if (ok && size_out) *size_out = size;
+  return ok;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "platform.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTENT_HASH_SIZE 16
+
+  // 文件内容哈希
+  typedef struct {
+    BYTE bytes[CONTENT_HASH_SIZE];
+  } ContentHash;
+
+  // 计算缓冲区的MD5
+  int Hash_MD5(const BYTE* data, DWORD data_len, BYTE* md5_out);
+  // 流式读取文件并计算内容哈希
+  int Hash_File(const wchar_t* path, ContentHash* out);
+
+  // 完整性校验算法，数值写入distinfo文件头，不能改变
+#define HASH_ALG_MD5     0  // MD5（Windows下用CryptoAPI），v2格式固定使用
+#define HASH_ALG_CRC32C  1  // CRC32C，SSE4.2/ARMv8 CRC指令加速
+#define HASH_ALG_FAST64  2  // XXH3结构的64位哈希，SSE2/AVX2/NEON加速
+#define HASH_ALG_FAST128 3  // 同上，128位输出
+#define HASH_ALG_COUNT   4
+#define HASH_MAX_DIGEST_SIZE 16
+
+  // 算法名称，用于日志；未知算法返回L"unknown"
+  const wchar_t* Hash_AlgName(DWORD alg);
+  // 按名称（不区分大小写）查找算法，未知名称返回HASH_ALG_COUNT
+  DWORD Hash_AlgFromName(const wchar_t* name);
+  // 摘要字节数，未知算法返回0
+  DWORD Hash_DigestSize(DWORD alg);
+  // 按alg计算data的摘要，写入Hash_DigestSize(alg)字节（整数按小端序）
+  int Hash_Buffer(DWORD alg, const BYTE* data, size_t data_len, BYTE* digest_out);
+
+  // 以下由fasthash.c实现，不依赖CryptoAPI
+  // crc传入上一段的结果可以分段计算，首段传0
+  uint32_t Hash_Crc32c(uint32_t crc, const void* data, size_t len);
+  uint64_t Hash_Fast64(const void* data, size_t len);
+  void Hash_Fast128(const void* data, size_t len, uint64_t out[2]);
+  // 关闭后全部走标量实现，用于与SIMD实现比对结果
+  void Hash_SetSimdEnabled(int enabled);
+
+  // FAST64/FAST128流式计算，结果与一次性计算相同
+#define HASH_FAST_STRIPE_LEN 64
+#define HASH_FAST_BLOCK_LEN  1024
+  typedef struct {
+    uint64_t acc[8];
+    uint64_t total_len;
+    size_t buffered;  // buffer中前HASH_FAST_STRIPE_LEN字节之后待处理的字节数
+    BYTE buffer[HASH_FAST_STRIPE_LEN + HASH_FAST_BLOCK_LEN];
+  } HashFastState;
+  void Hash_FastInit(HashFastState* state);
+  void Hash_FastUpdate(HashFastState* state, const void* data, size_t len);
+  uint64_t Hash_FastFinal64(const HashFastState* state);
+  void Hash_FastFinal128(const HashFastState* state, uint64_t out[2]);
+
+  // MD5的可移植实现（md5.c），没有CryptoAPI的平台使用
+  typedef struct {
+    uint32_t state[4];
+    uint64_t total_len;
+    BYTE buffer[64];
+  } HashMd5State;
+  void Hash_Md5Init(HashMd5State* state);
+  void Hash_Md5Update(HashMd5State* state, const void* data, size_t len);
+  void Hash_Md5Final(HashMd5State* state, BYTE out[16]);
+
+  // 任意算法的流式计算；Hash_Init成功后必须调用Hash_Final释放资源
+  typedef struct {
+    DWORD alg;
+    uint32_t crc;
+#ifdef _WIN32
+    ULONG_PTR crypt_prov;  // HCRYPTPROV，仅MD5使用
+    ULONG_PTR crypt_hash;  // HCRYPTHASH，仅MD5使用
+#else
+    HashMd5State md5;
+#endif
+    HashFastState fast;
+  } HashState;
+  int Hash_Init(HashState* state, DWORD alg);
+  int Hash_Update(HashState* state, const BYTE* data, size_t data_len);
+  // digest_out为NULL时只释放资源
+  int Hash_Final(HashState* state, BYTE* digest_out);
+
+  // 按alg计算文件摘要并返回文件大小；文件分段映射，32位进程也能处理大文件
+  int Hash_FileDigest(DWORD alg, const wchar_t* path, ULONGLONG* size_out, BYTE* digest_out);
+
+#ifdef __cplusplus
+}
+#endif
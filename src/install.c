@@ -1,5 +1,10 @@
 #include "install.h"
 #include "log.h"
+#include "fileops.h"
+#include "taskpool.h"
+#include "dircache.h"
+#include "archive.h"
+#include "trace.h"
 #include <wchar.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,31 +12,9 @@
 #ifdef DBG_SOLUTION
 #include"fake.h"
 #else
-#include "../../../Contrib/7-Zip/Contrib/nsis7z/CPP/7zip/UI/Console/Console7zMain.h"
 #include "../../../Contrib/7-Zip/Contrib/nsis7z/CPP/7zip/UI/NSIS/Extract7z.h"
 #endif
 
-// 递归创建目录
-static int CreateDirRecursiveW(const wchar_t* path) {
-  if (GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES)
-    return 1;
-  wchar_t parent[MAX_PATH];
-  wcsncpy_s(parent, MAX_PATH, path, _TRUNCATE);
-  wchar_t* last = wcsrchr(parent, L'\\');
-  if (last) {
-    *last = 0;
-    if (!CreateDirRecursiveW(parent)) {
-      XNSIS_LOG(L"Failed to create parent directory: %s", parent);
-      return 0;
-    }
-  }
-  if (!CreateDirectoryW(path, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
-    XNSIS_LOG(L"CreateDirectoryW failed: %s, error=%lu", path, GetLastError());
-    return 0;
-  }
-  return 1;
-}
-
 // 安全递归删除目录，防止误删根目录
 static int DeleteDirRecursiveW(const wchar_t* path) {
   if (!path || !*path || wcslen(path) < 4) {
@@ -52,13 +35,13 @@ static int DeleteDirRecursiveW(const wchar_t* path) {
     wsprintfW(sub, L"%s\\%s", path, findData.cFileName);
     if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
       if (!DeleteDirRecursiveW(sub)) {
-        XNSIS_LOG(L"Failed to delete subdir: %s", sub);
+        XNSIS_LOG_WARN(L"Failed to delete subdir: %s", sub);
         continue;
       }
     }
     else {
       if (!DeleteFileW(sub)) {
-        XNSIS_LOG(L"Failed to delete file: %s, error=%lu", sub, GetLastError());
+        XNSIS_LOG_WARN(L"Failed to delete file: %s, error=%lu", sub, GetLastError());
         continue;
       }
     }
@@ -84,17 +67,173 @@ static int DeleteDirRecursiveW(const wchar_t* path) {
   return 1;
 }
 
+#define BLOB_USE(dir, file) (((ULONGLONG)(dir) << 32) | (file))
+
+// 记录每个解压出的文件最后由哪个文件使用（fake目录序号和文件序号）：fake目录按序号依次分发，
+// 最后一个使用者可以直接拿走临时目录中的文件
+static int BuildBlobLastUse(InstallContext* ctx) {
+  for (DWORD i = 0; i < ctx->distinfo.dir_count; ++i) {
+    InstallFakeDir* fdir = &ctx->distinfo.dirs[i];
+    for (DWORD j = 0; j < fdir->file_count; ++j) {
+      ULONGLONG* last = PathMap_Insert(&ctx->blob_last_use, DistInfo_GetBlobPath(&ctx->distinfo, i, j), NULL);
+      if (!last) return 0;
+      *last = BLOB_USE(i, j);
+    }
+  }
+  return 1;
+}
+
+static void RecordFallback(InstallContext* ctx, DWORD dir_idx, DWORD file_idx, DistMethod preferred, DistMethod method, DWORD error) {
+  EnterCriticalSection(&ctx->dist_lock);
+  if (ctx->fallback_count == ctx->fallbacks_capacity) {
+    DWORD new_cap = ctx->fallbacks_capacity ? ctx->fallbacks_capacity * 2 : 16;
+    DistFallback* p = (DistFallback*)realloc(ctx->fallbacks, new_cap * sizeof(DistFallback));
+    if (!p) {
+      LeaveCriticalSection(&ctx->dist_lock);
+      return;
+    }
+    ctx->fallbacks = p;
+    ctx->fallbacks_capacity = new_cap;
+  }
+  DistFallback* fb = &ctx->fallbacks[ctx->fallback_count++];
+  fb->dir_idx = dir_idx;
+  fb->file_idx = file_idx;
+  fb->preferred = preferred;
+  fb->method = method;
+  fb->error = error;
+  LeaveCriticalSection(&ctx->dist_lock);
+}
+
+static int CompareFallback(const void* a, const void* b) {
+  const DistFallback* fa = (const DistFallback*)a;
+  const DistFallback* fb = (const DistFallback*)b;
+  if (fa->dir_idx != fb->dir_idx) return fa->dir_idx < fb->dir_idx ? -1 : 1;
+  if (fa->file_idx != fb->file_idx) return fa->file_idx < fb->file_idx ? -1 : 1;
+  return 0;
+}
+
+// 按回退原因（首选方式、实际方式、错误码）排序，用于汇总
+static int CompareFallbackReason(const void* a, const void* b) {
+  const DistFallback* fa = (const DistFallback*)a;
+  const DistFallback* fb = (const DistFallback*)b;
+  if (fa->preferred != fb->preferred) return fa->preferred < fb->preferred ? -1 : 1;
+  if (fa->method != fb->method) return fa->method < fb->method ? -1 : 1;
+  if (fa->error != fb->error) return fa->error < fb->error ? -1 : 1;
+  return CompareFallback(a, b);
+}
+
+// 输出回退记录：逐文件的明细只在DEBUG级别输出（不支持块克隆的卷上每个非最后使用者都会回退），
+// INFO级别按回退原因汇总，每种原因附一个示例文件
+static void LogFallbacks(InstallContext* ctx) {
+  static const wchar_t* names[DIST_METHOD_COUNT] = { L"move", L"hardlink", L"clone", L"copy" };
+  if (ctx->fallback_count == 0) return;
+  if (XNSIS_LOG_ENABLED(XNSIS_LOG_LEVEL_DEBUG)) {
+    for (DWORD i = 0; i < ctx->fallback_count; ++i) {
+      DistFallback* fb = &ctx->fallbacks[i];
+      XNSIS_LOG_DEBUG(L"Fallback: $%lu\\%s, preferred=%s, used=%s, error=%lu", fb->dir_idx + 1,
+        ctx->distinfo.dirs[fb->dir_idx].file_list[fb->file_idx], names[fb->preferred], names[fb->method], fb->error);
+    }
+  }
+  qsort(ctx->fallbacks, ctx->fallback_count, sizeof(DistFallback), CompareFallbackReason);
+  for (DWORD i = 0, n; i < ctx->fallback_count; i += n) {
+    DistFallback* fb = &ctx->fallbacks[i];
+    for (n = 1; i + n < ctx->fallback_count; ++n) {
+      DistFallback* next = &ctx->fallbacks[i + n];
+      if (next->preferred != fb->preferred || next->method != fb->method || next->error != fb->error) break;
+    }
+    XNSIS_LOG(L"Fallbacks: preferred=%s, used=%s, error=%lu, files=%lu, first=$%lu\\%s", names[fb->preferred],
+      names[fb->method], fb->error, n, fb->dir_idx + 1, ctx->distinfo.dirs[fb->dir_idx].file_list[fb->file_idx]);
+  }
+}
+
+// 把临时目录中的文件分发到目标位置。last_use为真时临时文件之后不再使用，
+// 依次尝试移动、硬链接、块克隆、复制；否则源文件还要给后面的目录用，
+// 不能移走，也不硬链接（两个安装位置共享同一份数据，改一处另一处跟着变）
+static int DistributeFile(InstallContext* ctx, DWORD dir_idx, DWORD file_idx,
+  const wchar_t* src, const wchar_t* dst, int last_use) {
+  DistMethod preferred = last_use ? DIST_METHOD_MOVE : DIST_METHOD_CLONE;
+  DistMethod method = preferred;
+  DWORD first_error = ERROR_SUCCESS;
+  int ok = 0;
+  if (last_use) {
+    // 不带MOVEFILE_COPY_ALLOWED：跨卷时直接失败，由后面的方式处理
+    ok = MoveFileExW(src, dst, MOVEFILE_REPLACE_EXISTING);
+    if (!ok) {
+      first_error = GetLastError();
+      method = DIST_METHOD_HARDLINK;
+      // 与CopyFileW覆盖已有文件的行为保持一致
+      DeleteFileW(dst);
+      ok = CreateHardLinkW(dst, src, NULL);
+    }
+    if (ok) FileOps_ResetInheritedSecurity(dst);
+  }
+  if (!ok) {
+    method = DIST_METHOD_CLONE;
+    ok = FileOps_CloneFile(src, dst);
+    if (!ok && first_error == ERROR_SUCCESS) first_error = GetLastError();
+  }
+  if (!ok) {
+    method = DIST_METHOD_COPY;
+    ok = CopyFileW(src, dst, FALSE);
+  }
+  if (!ok) {
+    XNSIS_LOG_ERROR(L"Failed to distribute file: %s -> %s, error=%lu", src, dst, GetLastError());
+    return 0;
+  }
+  InterlockedIncrement((LONG volatile*)&ctx->dist_counts[method]);
+  if (method != preferred) RecordFallback(ctx, dir_idx, file_idx, preferred, method, first_error);
+  return 1;
+}
+
 // 初始化InstallContext（只加载distinfo，不分配real_dirs）
 int InstallContext_Init(InstallContext* ctx, const wchar_t* distinfo_path) {
   if (!ctx) return 0;
   memset(&ctx->distinfo, 0, sizeof(ctx->distinfo));
+  PathMap_Init(&ctx->blob_last_use);
+  memset(ctx->dist_counts, 0, sizeof(ctx->dist_counts));
+  ctx->fallbacks = NULL;
+  ctx->fallback_count = ctx->fallbacks_capacity = 0;
+  ctx->dist_threads = 0;
+  ctx->archive_paths = NULL;
+  ctx->archive_count = 0;
+  ctx->extract_threads = 0;
+  ctx->extracted = 0;
+  ctx->mismatches = NULL;
+  ctx->mismatch_count = ctx->mismatches_capacity = 0;
+  InitializeCriticalSection(&ctx->dist_lock);
+  DirCache_Init(&ctx->dir_cache);
+  Trace_StartFromEnv();
+  TraceSpan span;
+  Trace_SpanBegin(&span, "install", "LoadDistInfo");
   int result = DistInfo_Load(&ctx->distinfo, distinfo_path);
+  Trace_SpanEnd(&span);
   DeleteFileW(distinfo_path);
+  if (result && !BuildBlobLastUse(ctx)) {
+    XNSIS_LOG(L"Failed to build blob usage map");
+    return 0;
+  }
   return result;
 }
 
 // 释放InstallContext
 void InstallContext_Free(InstallContext* ctx) {
+  XNSIS_LOG(L"Distributed files: moved=%lu, hardlinked=%lu, cloned=%lu, copied=%lu, fallbacks=%lu",
+    ctx->dist_counts[DIST_METHOD_MOVE], ctx->dist_counts[DIST_METHOD_HARDLINK],
+    ctx->dist_counts[DIST_METHOD_CLONE], ctx->dist_counts[DIST_METHOD_COPY], ctx->fallback_count);
+  LogFallbacks(ctx);
+  free(ctx->fallbacks);
+  ctx->fallbacks = NULL;
+  ctx->fallback_count = ctx->fallbacks_capacity = 0;
+  free(ctx->mismatches);
+  ctx->mismatches = NULL;
+  ctx->mismatch_count = ctx->mismatches_capacity = 0;
+  free(ctx->archive_paths);
+  ctx->archive_paths = NULL;
+  ctx->archive_count = 0;
+  PathMap_Free(&ctx->blob_last_use);
+  DeleteCriticalSection(&ctx->dist_lock);
+  XNSIS_LOG(L"Directory cache: created=%lu, hits=%lu", ctx->dir_cache.created, ctx->dir_cache.hits);
+  DirCache_Free(&ctx->dir_cache);
   DistInfo_Free(&ctx->distinfo);
   if (ctx->real_dirs) {
     for (DWORD i = 0; i < ctx->real_dir_count; ++i) free(ctx->real_dirs[i]);
@@ -103,11 +242,112 @@ void InstallContext_Free(InstallContext* ctx) {
   if (!DeleteDirRecursiveW(ctx->temp_dir)) {
     XNSIS_LOG(L"Failed to delete temp_dir: %s", ctx->temp_dir);
   }
+  Trace_Flush();
+}
+
+typedef struct {
+  DWORD dir_idx;
+  DWORD file_idx;
+  int last_use;
+  // 源文件位置：src_root为NULL时是临时目录中解压出的那份内容
+  const wchar_t* src_root;
+  const wchar_t* src_rel;
+} DistributeItem;
+
+typedef struct {
+  InstallContext* ctx;
+  DistributeItem* items;
+} DistributeJob;
+
+// 分发一个文件，在分发线程中执行
+static int DistributeOne(void* arg, DWORD index) {
+  DistributeJob* job = (DistributeJob*)arg;
+  InstallContext* ctx = job->ctx;
+  DistributeItem* item = &job->items[index];
+  wchar_t src[MAX_PATH], dst[MAX_PATH];
+  wsprintfW(src, L"%s\\%s", item->src_root ? item->src_root : ctx->temp_dir, item->src_rel);
+  wsprintfW(dst, L"%s\\%s", ctx->real_dirs[item->dir_idx], ctx->distinfo.dirs[item->dir_idx].file_list[item->file_idx]);
+  // 目录已由DistributeItems统一创建，这里只是查缓存
+  if (!DirCache_EnsureParent(&ctx->dir_cache, dst)) {
+    XNSIS_LOG_ERROR(L"Failed to create dir for: %s", dst);
+    return 0;
+  }
+  return DistributeFile(ctx, item->dir_idx, item->file_idx, src, dst, item->last_use);
+}
+
+// 并行分发一组文件。先分发源文件之后还要用到的项，再分发最后使用者（会把临时文件移走），
+// 内容相同的两个文件并行处理时也不会读到已被移走的源文件
+static int DistributeItems(InstallContext* ctx, DistributeItem* items, DWORD count) {
+  if (count == 0) return 1;
+  DistributeItem* order = (DistributeItem*)malloc(count * sizeof(DistributeItem));
+  if (!order) return 0;
+  DWORD keep_count = 0;
+  for (DWORD i = 0; i < count; ++i) {
+    if (!items[i].last_use) order[keep_count++] = items[i];
+  }
+  DWORD n = keep_count;
+  for (DWORD i = 0; i < count; ++i) {
+    if (items[i].last_use) order[n++] = items[i];
+  }
+  // 先算出所有目标目录，去重后一次性创建好（上级目录在前），再开始文件操作
+  const wchar_t** dirs = (const wchar_t**)malloc(count * sizeof(wchar_t*));
+  if (!dirs) {
+    free(order);
+    return 0;
+  }
+  DWORD dir_count = 0;
+  int ok = 1;
+  for (DWORD i = 0; i < count && ok; ++i) {
+    wchar_t dst[MAX_PATH];
+    wsprintfW(dst, L"%s\\%s", ctx->real_dirs[order[i].dir_idx], ctx->distinfo.dirs[order[i].dir_idx].file_list[order[i].file_idx]);
+    wchar_t* last = wcsrchr(dst, L'\\');
+    if (!last) continue;
+    *last = 0;
+    wchar_t* dir = _wcsdup(dst);
+    if (!dir) ok = 0;
+    else dirs[dir_count++] = dir;
+  }
+  TraceSpan span;
+  Trace_SpanBegin(&span, "install", "EnsureDirs");
+  if (ok) ok = DirCache_EnsureAll(&ctx->dir_cache, dirs, dir_count);
+  Trace_SpanEndArg(&span, "dirs", dir_count);
+  for (DWORD i = 0; i < dir_count; ++i) free((void*)dirs[i]);
+  free((void*)dirs);
+  if (!ok) {
+    XNSIS_LOG(L"Failed to create target directories");
+    free(order);
+    return 0;
+  }
+
+  DistributeJob job;
+  job.ctx = ctx;
+  job.items = order;
+  Trace_SpanBegin(&span, "install", "Distribute");
+  ok = TaskPool_ParallelFor(keep_count, ctx->dist_threads, DistributeOne, &job);
+  if (ok) {
+    job.items = order + keep_count;
+    ok = TaskPool_ParallelFor(count - keep_count, ctx->dist_threads, DistributeOne, &job);
+  }
+  Trace_SpanEndArg(&span, "files", count);
+  Trace_Count("distributed_files", count);
+  free(order);
+  // 并行分发时回退记录的顺序不固定，按文件顺序排好，与串行分发的结果一致
+  qsort(ctx->fallbacks, ctx->fallback_count, sizeof(DistFallback), CompareFallback);
+  return ok;
+}
+
+static int IsBlobLastUse(InstallContext* ctx, const wchar_t* blob, DWORD dir_idx, DWORD file_idx) {
+  ULONGLONG* last_use = PathMap_Find(&ctx->blob_last_use, blob);
+  return last_use && *last_use == BLOB_USE(dir_idx, file_idx);
 }
 
 // 先收集real_dirs
 int SetCurrentRealOutDir(InstallContext* ctx, const wchar_t* real_dir) {
   if (!ctx || !real_dir) return 0;
+  if (ctx->streaming && ctx->extracted) {
+    XNSIS_LOG(L"Streaming install: real dir registered after extraction: %s", real_dir);
+    return 0;
+  }
   if (ctx->real_dir_count == ctx->real_dirs_capacity) {
     DWORD new_cap = ctx->real_dirs_capacity ? ctx->real_dirs_capacity * 2 : 8;
     wchar_t** new_dirs = (wchar_t**)realloc(ctx->real_dirs, new_cap * sizeof(wchar_t*));
@@ -120,40 +360,320 @@ int SetCurrentRealOutDir(InstallContext* ctx, const wchar_t* real_dir) {
   if (!ctx->real_dirs[ctx->real_dir_count]) return 0;
   wcsncpy_s(ctx->real_dirs[ctx->real_dir_count], len + 1, real_dir, len);
 
-  // 分发对应fake目录下的文件到该real_dir
+  // 流式安装：这里只登记real_dir，由ExtractInstall7z直接解压到各real_dir
   DWORD idx = ctx->real_dir_count;
-  if (idx < ctx->distinfo.dir_count) {
+  if (ctx->streaming) {
+    ctx->real_dir_count++;
+    return 1;
+  }
+
+  // 分发对应fake目录下的文件到该real_dir
+  if (idx < ctx->distinfo.dir_count && ctx->distinfo.dirs[idx].file_count) {
     InstallFakeDir* fdir = &ctx->distinfo.dirs[idx];
+    DistributeItem* items = (DistributeItem*)malloc(fdir->file_count * sizeof(DistributeItem));
+    if (!items) return 0;
     for (DWORD j = 0; j < fdir->file_count; ++j) {
-      wchar_t src[MAX_PATH], dst[MAX_PATH];
-      wsprintfW(src, L"%s\\%s", ctx->temp_dir, fdir->file_list[j]);
-      wsprintfW(dst, L"%s\\%s", real_dir, fdir->file_list[j]);
-      wchar_t* last = wcsrchr(dst, L'\\');
-      if (last) {
-        *last = 0;
-        if (!CreateDirRecursiveW(dst)) {
-          XNSIS_LOG(L"Failed to create dir: %s", dst);
-          return 0;
-        }
-        *last = L'\\';
-      }
-      if (!CopyFileW(src, dst, FALSE)) {
-        XNSIS_LOG(L"Failed to copy file: %s -> %s, error=%lu", src, dst, GetLastError());
-        return 0;
-      }
+      // 去重的文件从唯一解压出的那份内容分发
+      const wchar_t* blob = DistInfo_GetBlobPath(&ctx->distinfo, idx, j);
+      items[j].dir_idx = idx;
+      items[j].file_idx = j;
+      items[j].last_use = IsBlobLastUse(ctx, blob, idx, j);
+      items[j].src_root = NULL;
+      items[j].src_rel = blob;
     }
+    int ok = DistributeItems(ctx, items, fdir->file_count);
+    free(items);
+    if (!ok) return 0;
   }
   ctx->real_dir_count++;
   return 1;
 }
 
-// 解压install.7z到临时目录并分发所有文件（在多次SetCurrentRealOutDir之后调用）
+// 由install.7z路径和distinfo中的分片文件名得到所有归档的路径，分片与install.7z在同一目录
+static int BuildArchivePaths(InstallContext* ctx) {
+  InstallDistInfo* info = &ctx->distinfo;
+  ctx->archive_count = 1 + info->shard_count;
+  ctx->archive_paths = (wchar_t(*)[MAX_PATH])malloc(ctx->archive_count * sizeof(*ctx->archive_paths));
+  if (!ctx->archive_paths) {
+    ctx->archive_count = 0;
+    return 0;
+  }
+  wcsncpy_s(ctx->archive_paths[0], MAX_PATH, ctx->install7z_path, _TRUNCATE);
+  const wchar_t* slash = wcsrchr(ctx->install7z_path, L'\\');
+  int dir_len = slash ? (int)(slash - ctx->install7z_path + 1) : 0;
+  for (DWORD i = 0; i < info->shard_count; ++i) {
+    _snwprintf_s(ctx->archive_paths[i + 1], MAX_PATH, _TRUNCATE, L"%.*s%s", dir_len, ctx->install7z_path, info->shard_names[i]);
+  }
+  return 1;
+}
+
+typedef struct {
+  InstallContext* ctx;
+  const wchar_t* out_dir;
+  const wchar_t* list_path;  // NULL表示解压整个归档
+} ExtractJob;
+
+// extract_threads为0时的线程数：链接的7-Zip不可重入时，进程内的7-Zip调用互斥执行（见Archive_InProcessEnter），
+// 多线程没有收益，默认逐个处理；替身每次启动独立的7z进程时按硬件线程数并行
+static DWORD DefaultExtractThreads(void) {
+  return Archive_InProcessReentrant() ? TaskPool_DefaultThreads() : 1;
+}
+
+// 解压第index个归档，在解压线程中执行。只有install.7z本身显示进度
+static int ExtractOneArchive(void* arg, DWORD index) {
+  ExtractJob* job = (ExtractJob*)arg;
+  InstallContext* ctx = job->ctx;
+  wchar_t* archive = ctx->archive_paths[index];
+  ULONGLONG start = Trace_Now();
+  int ok;
+  if (!job->list_path) {
+    Archive_InProcessEnter();
+    ok = Extract7z(archive, (LPTSTR)job->out_dir, ctx->hwnd, index == 0 ? 1 : 0) == 0;
+    Archive_InProcessLeave();
+    if (!ok) XNSIS_LOG(L"Extract7z failed: %s", archive);
+  }
+  else {
+    // 每个分片只含列表中的一部分文件，7z跳过归档中没有的项
+    ok = Archive_Extract(Archive_InProcessBackend(), archive, job->out_dir, job->list_path, L"-aoa -y");
+    if (!ok) XNSIS_LOG(L"Failed to extract: %s", archive);
+  }
+  if (TRACE_ENABLED()) {
+    ULONGLONG end = Trace_Now();
+    const wchar_t* name = wcsrchr(archive, L'\\');
+    Trace_AsyncW("7z", name ? name + 1 : archive, start, end);
+    Trace_Count("7z_wall_ms", (LONGLONG)((end - start) / 1000));
+  }
+  return ok;
+}
+
+// 并行解压所有归档到out_dir；list_path不为NULL时只解压列表中的项
+static int ExtractArchives(InstallContext* ctx, const wchar_t* out_dir, const wchar_t* list_path) {
+  ExtractJob job = { ctx, out_dir, list_path };
+  TraceSpan span;
+  Trace_SpanBegin(&span, "install", list_path ? "ExtractList" : "ExtractArchives");
+  DWORD threads = ctx->extract_threads ? ctx->extract_threads : DefaultExtractThreads();
+  int ok = TaskPool_ParallelFor(ctx->archive_count, threads, ExtractOneArchive, &job);
+  Trace_SpanEndArg(&span, "archives", ctx->archive_count);
+  return ok;
+}
+
+// 只解压列表中的项到out_dir
+static int ExtractListTo(InstallContext* ctx, const wchar_t* out_dir, const wchar_t* const* items, DWORD count) {
+  if (count == 0) return 1;
+  wchar_t list_path[MAX_PATH];
+  wsprintfW(list_path, L"%s\\install_list.txt", ctx->temp_dir);
+  if (!Archive_WriteList(list_path, items, count)) return 0;
+  int ok = ExtractArchives(ctx, out_dir, list_path);
+  DeleteFileW(list_path);
+  return ok;
+}
+
+static void DeleteArchives(InstallContext* ctx) {
+  for (DWORD i = 0; i < ctx->archive_count; ++i) DeleteFileW(ctx->archive_paths[i]);
+}
+
+typedef struct {
+  InstallContext* ctx;
+  volatile LONG done;
+} RecompressJob;
+
+// 重新压缩第index个插件，在压缩线程中执行
+static int RecompressOne(void* arg, DWORD index) {
+  RecompressJob* job = (RecompressJob*)arg;
+  InstallContext* ctx = job->ctx;
+  InstallPlugin* plugin = &ctx->distinfo.plugins[index];
+
+  // 构建.nsisbin目录路径
+  wchar_t nsisbin_dir[MAX_PATH];
+  wsprintfW(nsisbin_dir, L"%s\\%s.nsisbin", ctx->temp_dir, plugin->path);
+
+  // 检查.nsisbin目录是否存在
+  if (GetFileAttributesW(nsisbin_dir) == INVALID_FILE_ATTRIBUTES) {
+    XNSIS_LOG(L"nsisbin directory not found: %s", nsisbin_dir);
+    return 1;
+  }
+
+  // 构建原始文件路径
+  wchar_t original_file[MAX_PATH];
+  wsprintfW(original_file, L"%s\\%s", ctx->temp_dir, plugin->path);
+
+  // 使用插件指定的压缩参数重新压缩
+  ULONGLONG start = Trace_Now();
+  int ok = Archive_AddDir(Archive_InProcessBackend(), original_file, plugin->compress_param, nsisbin_dir);
+  Trace_AsyncW("recompress", plugin->path, start, Trace_Now());
+  if (!ok) {
+    XNSIS_LOG(L"Failed to recompress plugin: %s", plugin->path);
+    return 0;
+  }
+
+  InterlockedIncrement(&job->done);
+  XNSIS_LOG_DEBUG(L"Successfully recompressed plugin: %s", plugin->path);
+  return 1;
+}
+
+// 处理InstallPlugin信息：把临时目录中的.nsisbin目录并行重新压缩为插件文件。
+// 并行数受可用物理内存限制（按最耗内存的压缩参数估计），extract_threads为1时逐个压缩
+static int RecompressPlugins(InstallContext* ctx) {
+  InstallDistInfo* info = &ctx->distinfo;
+  if (info->plugin_count == 0) return 1;
+  ULONGLONG per_encoder = 0;
+  for (DWORD i = 0; i < info->plugin_count; ++i) {
+    ULONGLONG need = Archive_EstimateEncoderMemory(info->plugins[i].compress_param);
+    if (need > per_encoder) per_encoder = need;
+  }
+  DWORD threads = ctx->extract_threads ? ctx->extract_threads : DefaultExtractThreads();
+  MEMORYSTATUSEX ms;
+  ms.dwLength = sizeof(ms);
+  if (GlobalMemoryStatusEx(&ms) && per_encoder) {
+    // 只用可用内存的四分之三，给安装程序其余部分和系统留出余量
+    ULONGLONG by_memory = ms.ullAvailPhys / 4 * 3 / per_encoder;
+    if (by_memory < threads) threads = by_memory ? (DWORD)by_memory : 1;
+  }
+  if (threads > info->plugin_count) threads = info->plugin_count;
+
+  RecompressJob job = { ctx, 0 };
+  DWORD start = GetTickCount();
+  TraceSpan span;
+  Trace_SpanBegin(&span, "install", "RecompressPlugins");
+  int ok = TaskPool_ParallelFor(info->plugin_count, threads, RecompressOne, &job);
+  Trace_SpanEndArg(&span, "plugins", info->plugin_count);
+  XNSIS_LOG(L"RecompressPlugins: %ld of %lu plugins in %lu ms, threads=%lu, per_encoder=%llu MB",
+    job.done, info->plugin_count, GetTickCount() - start, threads, per_encoder >> 20);
+  return ok;
+}
+
+#define BLOB_IN_SCRATCH ((ULONGLONG)-1)
+
+// 流式安装中没有.nsisbin目录的插件（旧版打包程序把展开失败的插件也记入了distinfo）在归档中是普通文件，
+// 解压到临时目录，与其他来源在临时目录的文件一起分发
+static int ExtractPlainPlugins(InstallContext* ctx) {
+  InstallDistInfo* info = &ctx->distinfo;
+  const wchar_t** plain = (const wchar_t**)malloc((info->plugin_count + 1) * sizeof(wchar_t*));
+  if (!plain) return 0;
+  DWORD count = 0;
+  for (DWORD i = 0; i < info->plugin_count; ++i) {
+    wchar_t nsisbin_dir[MAX_PATH];
+    _snwprintf_s(nsisbin_dir, MAX_PATH, _TRUNCATE, L"%s\\%s.nsisbin", ctx->temp_dir, info->plugins[i].path);
+    if (GetFileAttributesW(nsisbin_dir) == INVALID_FILE_ATTRIBUTES) plain[count++] = info->plugins[i].path;
+  }
+  if (count) XNSIS_LOG_WARN(L"Streaming install: %lu plugins have no .nsisbin tree, extracted as plain files", count);
+  int ok = ExtractListTo(ctx, ctx->temp_dir, plain, count);
+  free(plain);
+  return ok;
+}
+
+// 流式安装：每个real_dir只解压它自己的文件，直接写到最终位置，不经过临时目录。
+// 同一份内容只解压一次（第一个按自身路径使用它的目录），其他使用者在解压后从那里克隆或复制；
+// 插件的.nsisbin目录和没有合适目录可以直接解压的去重内容仍解压到临时目录
+static int StreamExtract(InstallContext* ctx) {
+  InstallDistInfo* info = &ctx->distinfo;
+  DWORD dir_count = ctx->real_dir_count < info->dir_count ? ctx->real_dir_count : info->dir_count;
+  DWORD total = 0;
+  for (DWORD i = 0; i < dir_count; ++i) total += info->dirs[i].file_count;
+
+  PathMap plugins, primary;
+  PathMap_Init(&plugins);
+  PathMap_Init(&primary);
+  const wchar_t** list = (const wchar_t**)malloc((total + info->plugin_count + 1) * sizeof(wchar_t*));
+  DistributeItem* items = (DistributeItem*)malloc((total + 1) * sizeof(DistributeItem));
+  DWORD item_count = 0;
+  int ok = list && items;
+  for (DWORD i = 0; i < info->plugin_count && ok; ++i) {
+    ok = PathMap_Insert(&plugins, info->plugins[i].path, NULL) != NULL;
+  }
+
+  // 每个目录解压按自身路径存储、且还没有被其他目录解压的文件
+  for (DWORD i = 0; i < dir_count && ok; ++i) {
+    InstallFakeDir* fdir = &info->dirs[i];
+    DWORD list_count = 0;
+    for (DWORD j = 0; j < fdir->file_count && ok; ++j) {
+      const wchar_t* blob = DistInfo_GetBlobPath(info, i, j);
+      if (blob != fdir->file_list[j] || PathMap_Find(&plugins, blob)) continue;
+      int inserted = 0;
+      ULONGLONG* where = PathMap_Insert(&primary, blob, &inserted);
+      if (!where) {
+        ok = 0;
+        break;
+      }
+      if (inserted) {
+        *where = BLOB_USE(i, j);
+        list[list_count++] = blob;
+      }
+    }
+    if (ok) ok = ExtractListTo(ctx, ctx->real_dirs[i], list, list_count);
+  }
+
+  // 其余文件在解压后分发；来源不在任何real_dir中的内容解压到临时目录
+  DWORD scratch_count = 0;
+  for (DWORD i = 0; i < info->plugin_count && ok; ++i) {
+    wchar_t* nsisbin = (wchar_t*)malloc((wcslen(info->plugins[i].path) + 8) * sizeof(wchar_t));
+    if (!nsisbin) {
+      ok = 0;
+      break;
+    }
+    wsprintfW(nsisbin, L"%s.nsisbin", info->plugins[i].path);
+    list[scratch_count++] = nsisbin;
+  }
+  DWORD plugin_items = scratch_count;
+  for (DWORD i = 0; i < dir_count && ok; ++i) {
+    InstallFakeDir* fdir = &info->dirs[i];
+    for (DWORD j = 0; j < fdir->file_count; ++j) {
+      const wchar_t* blob = DistInfo_GetBlobPath(info, i, j);
+      ULONGLONG* where = PathMap_Find(&primary, blob);
+      if (where && *where == BLOB_USE(i, j)) continue;
+      DistributeItem* item = &items[item_count++];
+      item->dir_idx = i;
+      item->file_idx = j;
+      item->src_rel = blob;
+      if (where && *where != BLOB_IN_SCRATCH) {
+        // 从已解压到real_dir中的那一份克隆或复制
+        DWORD src_dir = (DWORD)(*where >> 32);
+        item->src_root = ctx->real_dirs[src_dir];
+        item->src_rel = info->dirs[src_dir].file_list[(DWORD)*where];
+        item->last_use = 0;
+        continue;
+      }
+      if (!where && !PathMap_Find(&plugins, blob)) {
+        where = PathMap_Insert(&primary, blob, NULL);
+        if (!where) {
+          ok = 0;
+          break;
+        }
+        *where = BLOB_IN_SCRATCH;
+        list[scratch_count++] = blob;
+      }
+      item->src_root = NULL;
+      item->last_use = IsBlobLastUse(ctx, blob, i, j);
+    }
+  }
+  if (ok) ok = ExtractListTo(ctx, ctx->temp_dir, list, scratch_count);
+  if (ok && info->plugin_count) ok = ExtractPlainPlugins(ctx);
+  if (ok) ok = RecompressPlugins(ctx);
+  if (ok) ok = DistributeItems(ctx, items, item_count);
+  if (list) {
+    for (DWORD i = 0; i < plugin_items; ++i) free((void*)list[i]);
+  }
+  free(list);
+  free(items);
+  PathMap_Free(&plugins);
+  PathMap_Free(&primary);
+  XNSIS_LOG(L"Streaming install: %lu files extracted in place, %lu distributed", total - item_count, item_count);
+  return ok;
+}
+
+// 解压install.7z并分发所有文件。
+// 普通模式下解压到临时目录，之后每次SetCurrentRealOutDir从临时目录分发；
+// 流式模式（streaming）下先用SetCurrentRealOutDir登记所有real_dir，再调用本函数直接解压到各real_dir
 int ExtractInstall7z(InstallContext* ctx, const wchar_t* install7z_path) {
   if (!ctx) {
     XNSIS_LOG(L"Invalid parameters");
     return 0;
   }
   wcsncpy_s(ctx->install7z_path, MAX_PATH, install7z_path, _TRUNCATE);
+  if (!BuildArchivePaths(ctx)) {
+    XNSIS_LOG(L"BuildArchivePaths failed");
+    return 0;
+  }
 
   // 创建临时目录
   GetTempPathW(MAX_PATH, ctx->temp_dir);
@@ -170,49 +690,32 @@ int ExtractInstall7z(InstallContext* ctx, const wchar_t* install7z_path) {
     XNSIS_LOG(L"CreateDirectoryW for temp_dir failed: %s, error=%lu", ctx->temp_dir, GetLastError());
     return 0;
   }
+  ctx->extracted = 1;
+
+  if (ctx->streaming) {
+    if (!StreamExtract(ctx)) {
+      XNSIS_LOG(L"Streaming extraction failed: %s", ctx->install7z_path);
+      return 0;
+    }
+    DeleteArchives(ctx);
+    return 1;
+  }
   
-  // 解压install.7z到临时目录
-  wchar_t cmd[1024];
-  wsprintfW(cmd, L"7z x \"%s\" -o\"%s\" -aos", ctx->install7z_path, ctx->temp_dir);
-  if (Extract7z(ctx->install7z_path, ctx->temp_dir, ctx->hwnd, 1)) {
-    XNSIS_LOG(L"SyncCall7zSync failed for: %s", cmd);
+  // 解压install.7z及其各分片到临时目录，分片之间没有重叠的文件，可以并行解压
+  DWORD start = GetTickCount();
+  if (!ExtractArchives(ctx, ctx->temp_dir, NULL)) {
+    XNSIS_LOG(L"Failed to extract %lu archives: %s", ctx->archive_count, ctx->install7z_path);
     return 0;
   }
+  XNSIS_LOG(L"Extracted %lu archives in %lu ms", ctx->archive_count, GetTickCount() - start);
   
-  // 处理InstallPlugin信息：重新压缩.nsisbin目录
-  for (DWORD i = 0; i < ctx->distinfo.plugin_count; ++i) {
-    InstallPlugin* plugin = &ctx->distinfo.plugins[i];
-    
-    // 构建.nsisbin目录路径
-    wchar_t nsisbin_dir[MAX_PATH];
-    wsprintfW(nsisbin_dir, L"%s\\%s.nsisbin", ctx->temp_dir, plugin->path);
-    
-    // 检查.nsisbin目录是否存在
-    if (GetFileAttributesW(nsisbin_dir) == INVALID_FILE_ATTRIBUTES) {
-      XNSIS_LOG(L"nsisbin directory not found: %s", nsisbin_dir);
-      continue;
-    }
-    
-    // 构建原始文件路径
-    wchar_t original_file[MAX_PATH];
-    wsprintfW(original_file, L"%s\\%s", ctx->temp_dir, plugin->path);
-    
-    // 使用插件指定的压缩参数重新压缩
-    wchar_t compress_cmd[2048];
-    wsprintfW(compress_cmd, L"7z a %s \"%s\" \"%s\\*\"", plugin->compress_param, original_file, nsisbin_dir);
-    
-    if (Main2CustomNoExcept(1, (char**)compress_cmd)) {
-      XNSIS_LOG(L"Failed to recompress plugin: %s", plugin->path);
-      return 0;
-    }
-    
-    XNSIS_LOG(L"Successfully recompressed plugin: %s", plugin->path);
-  }
+  if (!RecompressPlugins(ctx)) return 0;
   
-  DeleteFileW(ctx->install7z_path);
+  DeleteArchives(ctx);
   return 1;
 }
 
+
 // 获取install.7z文件名（从distinfo中解析）
 const wchar_t* GetInstall7zName(InstallContext* ctx) {
   if (!ctx) {
@@ -220,4 +723,129 @@ const wchar_t* GetInstall7zName(InstallContext* ctx) {
     return NULL;
   }
   return ctx->distinfo.install7z_name;
-}
\ No newline at end of file
+}
+
+typedef struct {
+  InstallContext* ctx;
+  ULONGLONG* items;               // BLOB_USE(dir, file)
+  volatile LONGLONG hashed_bytes;
+} VerifyJob;
+
+static void RecordMismatch(InstallContext* ctx, DWORD dir_idx, DWORD file_idx, VerifyFailure reason, DWORD error, ULONGLONG size) {
+  EnterCriticalSection(&ctx->dist_lock);
+  if (ctx->mismatch_count == ctx->mismatches_capacity) {
+    DWORD new_cap = ctx->mismatches_capacity ? ctx->mismatches_capacity * 2 : 16;
+    VerifyMismatch* p = (VerifyMismatch*)realloc(ctx->mismatches, new_cap * sizeof(VerifyMismatch));
+    if (!p) {
+      LeaveCriticalSection(&ctx->dist_lock);
+      return;
+    }
+    ctx->mismatches = p;
+    ctx->mismatches_capacity = new_cap;
+  }
+  VerifyMismatch* m = &ctx->mismatches[ctx->mismatch_count++];
+  m->dir_idx = dir_idx;
+  m->file_idx = file_idx;
+  m->reason = reason;
+  m->error = error;
+  m->size = size;
+  LeaveCriticalSection(&ctx->dist_lock);
+}
+
+static int CompareMismatch(const void* a, const void* b) {
+  const VerifyMismatch* ma = (const VerifyMismatch*)a;
+  const VerifyMismatch* mb = (const VerifyMismatch*)b;
+  if (ma->dir_idx != mb->dir_idx) return ma->dir_idx < mb->dir_idx ? -1 : 1;
+  if (ma->file_idx != mb->file_idx) return ma->file_idx < mb->file_idx ? -1 : 1;
+  return 0;
+}
+
+// 校验一个文件，在校验线程中执行；不一致只记录，不中断其他文件的校验
+static int VerifyOne(void* arg, DWORD index) {
+  VerifyJob* job = (VerifyJob*)arg;
+  InstallContext* ctx = job->ctx;
+  DWORD dir_idx = (DWORD)(job->items[index] >> 32);
+  DWORD file_idx = (DWORD)job->items[index];
+  const InstallFileDigest* expected = DistInfo_GetFileDigest(&ctx->distinfo, dir_idx, file_idx);
+  wchar_t path[MAX_PATH];
+  wsprintfW(path, L"%s\\%s", ctx->real_dirs[dir_idx], ctx->distinfo.dirs[dir_idx].file_list[file_idx]);
+
+  // 先比较大小，大小不同时不必读内容
+  WIN32_FILE_ATTRIBUTE_DATA attr;
+  if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attr)) {
+    RecordMismatch(ctx, dir_idx, file_idx, VERIFY_MISSING, GetLastError(), 0);
+    return 1;
+  }
+  ULONGLONG size = ((ULONGLONG)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+  if (size != expected->size) {
+    RecordMismatch(ctx, dir_idx, file_idx, VERIFY_SIZE, ERROR_SUCCESS, size);
+    return 1;
+  }
+  BYTE digest[HASH_MAX_DIGEST_SIZE] = { 0 };
+  if (!Hash_FileDigest(ctx->distinfo.file_hash_alg, path, &size, digest)) {
+    RecordMismatch(ctx, dir_idx, file_idx, VERIFY_MISSING, GetLastError(), 0);
+    return 1;
+  }
+  InterlockedExchangeAdd64(&job->hashed_bytes, (LONGLONG)size);
+  if (memcmp(digest, expected->digest, sizeof(digest)) != 0) {
+    RecordMismatch(ctx, dir_idx, file_idx, VERIFY_HASH, ERROR_SUCCESS, size);
+  }
+  return 1;
+}
+
+int VerifyInstalledFiles(InstallContext* ctx) {
+  if (!ctx) return 0;
+  InstallDistInfo* info = &ctx->distinfo;
+  if (!info->has_file_digests) {
+    XNSIS_LOG(L"No file digests in distinfo, skipping verification");
+    return 1;
+  }
+  DWORD dir_count = ctx->real_dir_count < info->dir_count ? ctx->real_dir_count : info->dir_count;
+  DWORD total = 0;
+  for (DWORD i = 0; i < dir_count; ++i) total += info->dirs[i].file_count;
+  VerifyJob job;
+  job.ctx = ctx;
+  job.hashed_bytes = 0;
+  job.items = (ULONGLONG*)malloc(((size_t)total + 1) * sizeof(ULONGLONG));
+  if (!job.items) return 0;
+  DWORD count = 0;
+  for (DWORD i = 0; i < dir_count; ++i) {
+    for (DWORD j = 0; j < info->dirs[i].file_count; ++j) {
+      if (DistInfo_GetFileDigest(info, i, j)) job.items[count++] = BLOB_USE(i, j);
+    }
+  }
+
+  ctx->mismatch_count = 0;
+  LARGE_INTEGER freq, start, end;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&start);
+  TraceSpan span;
+  Trace_SpanBegin(&span, "install", "VerifyInstalledFiles");
+  int ok = TaskPool_ParallelFor(count, ctx->dist_threads, VerifyOne, &job);
+  Trace_SpanEndArg(&span, "bytes", (ULONGLONG)job.hashed_bytes);
+  Trace_Count("verified_bytes", job.hashed_bytes);
+  QueryPerformanceCounter(&end);
+  free(job.items);
+  if (!ok) {
+    XNSIS_LOG(L"Verification tasks failed to run");
+    return 0;
+  }
+
+  double seconds = (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+  ULONGLONG bytes = (ULONGLONG)job.hashed_bytes;
+  XNSIS_LOG(L"Verified files: checked=%lu, skipped=%lu, mismatches=%lu, bytes=%llu, seconds=%.3f, throughput=%.1f MB/s, alg=%s",
+    count, total - count, ctx->mismatch_count, bytes, seconds, seconds > 0 ? bytes / 1048576.0 / seconds : 0.0,
+    Hash_AlgName(info->file_hash_alg));
+  if (ctx->mismatch_count) {
+    static const wchar_t* reasons[] = { L"missing", L"size", L"hash" };
+    qsort(ctx->mismatches, ctx->mismatch_count, sizeof(VerifyMismatch), CompareMismatch);
+    for (DWORD i = 0; i < ctx->mismatch_count; ++i) {
+      const VerifyMismatch* m = &ctx->mismatches[i];
+      const InstallFileDigest* expected = DistInfo_GetFileDigest(info, m->dir_idx, m->file_idx);
+      XNSIS_LOG(L"Verify mismatch: %s\\%s, reason=%s, expected_size=%llu, actual_size=%llu, error=%lu",
+        ctx->real_dirs[m->dir_idx], info->dirs[m->dir_idx].file_list[m->file_idx], reasons[m->reason],
+        expected->size, m->size, m->error);
+    }
+  }
+  return ctx->mismatch_count == 0;
+}
@@ -1,24 +1,78 @@
 #pragma once
-#include <windows.h>
+#include "platform.h"
 #include "distinfo.h"
+#include "pathmap.h"
+#include "dircache.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+  // 文件分发方式，按优先级排列
+  typedef enum {
+    DIST_METHOD_MOVE = 0,      // 同卷移动（该文件的最后一个使用者）
+    DIST_METHOD_HARDLINK = 1,  // 硬链接（该文件的最后一个使用者）
+    DIST_METHOD_CLONE = 2,     // ReFS块克隆
+    DIST_METHOD_COPY = 3,      // 完整复制
+    DIST_METHOD_COUNT = 4
+  } DistMethod;
+
+  // 没能使用首选方式分发的文件，用于诊断
+  typedef struct {
+    DWORD dir_idx;
+    DWORD file_idx;
+    DWORD preferred;   // 首选的DistMethod
+    DWORD method;      // 最终使用的DistMethod
+    DWORD error;       // 首选方式失败时的错误码
+  } DistFallback;
+
+  // 安装后校验不一致的原因
+  typedef enum {
+    VERIFY_MISSING = 0,  // 文件不存在或无法读取
+    VERIFY_SIZE = 1,     // 大小与打包时不同
+    VERIFY_HASH = 2,     // 内容哈希与打包时不同
+  } VerifyFailure;
+
+  typedef struct {
+    DWORD dir_idx;
+    DWORD file_idx;
+    DWORD reason;      // VerifyFailure
+    DWORD error;       // VERIFY_MISSING时的错误码
+    ULONGLONG size;    // 实际大小，VERIFY_MISSING时无意义
+  } VerifyMismatch;
+
   typedef struct {
     InstallDistInfo distinfo;
     wchar_t temp_dir[MAX_PATH];
     wchar_t install7z_path[MAX_PATH];
+    wchar_t (*archive_paths)[MAX_PATH];  // install.7z及其各分片，第0个即install7z_path
+    DWORD archive_count;
+    DWORD extract_threads;          // 并行解压分片、重新压缩插件的线程数，0为默认（7-Zip确认可重入之前为1），1为逐个处理
     wchar_t** real_dirs;
     DWORD real_dir_count;
     DWORD real_dirs_capacity;
     HWND hwnd;
+    PathMap blob_last_use;          // 解压出的文件相对路径 -> 最后使用它的文件（BLOB_USE(目录序号, 文件序号)）
+    DWORD dist_counts[DIST_METHOD_COUNT];
+    DistFallback* fallbacks;
+    DWORD fallback_count;
+    DWORD fallbacks_capacity;
+    DWORD dist_threads;             // 分发线程数，0为默认
+    CRITICAL_SECTION dist_lock;     // 保护fallbacks
+    int streaming;                  // 流式安装，在InstallContext_Init之后、SetCurrentRealOutDir之前设置
+    int extracted;                  // 已调用ExtractInstall7z
+    DirCache dir_cache;             // 已创建的目标目录
+    VerifyMismatch* mismatches;     // VerifyInstalledFiles发现的不一致文件，按目录、文件序号排序
+    DWORD mismatch_count;
+    DWORD mismatches_capacity;
   } InstallContext;
 
 int InstallContext_Init(InstallContext* ctx, const wchar_t* distinfo_path);
 void InstallContext_Free(InstallContext* ctx);
 int SetCurrentRealOutDir(InstallContext* ctx, const wchar_t* real_dir);
 int ExtractInstall7z(InstallContext* ctx, const wchar_t* install7z_path);
+// 按distinfo中记录的大小和哈希并行校验已安装到各real_dir的文件，在所有文件分发完后调用。
+// 没有记录哈希的文件（如重新压缩的插件）跳过；全部一致返回1，不一致的文件记录在ctx->mismatches中
+int VerifyInstalledFiles(InstallContext* ctx);
 
 #ifdef __cplusplus
 }
@@ -4,15 +4,338 @@
 #include <wchar.h>
 #include <stdlib.h>
 
-void XNSIS_LogW(const char* file, const char* func, int line, const wchar_t* fmt, ...) {
+// 每个线程一个单生产者单消费者的环形缓冲区：生产者是所属线程，消费者是持有g_drain_lock的线程
+// （后台输出线程，或缓冲区满、XNSIS_LogFlush时的调用线程）。记录8字节对齐，
+// 剩余的连续空间放不下一条记录时写一个size为0的记录，表示跳到缓冲区开头
+#define LOG_RING_SIZE (64 * 1024)
+#define LOG_LINE_MAX 1024
+#define LOG_DRAIN_INTERVAL_MS 20
+#define LOG_ALIGN(n) (((n) + 7) & ~(DWORD)7)
+
+typedef struct {
+  DWORD size;  // 含记录头，已对齐
+  DWORD seq;   // 全局提交序号，输出时按它合并各线程的日志
+} LogRecord;
+
+typedef struct LogRing {
+  struct LogRing* next;
+  volatile LONG in_use;  // 已分配给某个线程；线程退出后清零，由新线程复用
+  volatile LONG head;    // 生产者写入的字节数
+  volatile LONG tail;    // 消费者读出的字节数
+  DWORD drain_head;      // 本轮输出的截止位置，只由消费者使用
+  BYTE data[LOG_RING_SIZE];
+} LogRing;
+
+volatile LONG g_xnsis_log_level = XNSIS_LOG_LEVEL_DEBUG;
+
+static INIT_ONCE g_init_once = INIT_ONCE_STATIC_INIT;
+static DWORD g_fls_index = FLS_OUT_OF_INDEXES;
+static LogRing* volatile g_rings;
+static volatile LONG g_seq;
+static SRWLOCK g_drain_lock = SRWLOCK_INIT;
+static HANDLE g_wake_event;
+static HANDLE g_writer_thread;
+static volatile LONG g_stop;
+static volatile LONG g_initialized;
+static volatile LONG g_level_set;  // 已由XNSIS_LogSetLevel显式设置，重新初始化时保留
+
+static const wchar_t g_level_tags[] = L"EWID";
+
+static LONG LoadAcquire(volatile LONG* p) {
+  return InterlockedCompareExchange(p, 0, 0);
+}
+
+static PVOID LoadPointerAcquire(PVOID volatile* p) {
+  return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+#define FIRST_RING() ((LogRing*)LoadPointerAcquire((PVOID volatile*)&g_rings))
+
+// 输出一行。POSIX下stdout的宽字符输出受locale影响，且与窄字符输出混用时会失败，统一写UTF-8
+static void WriteLine(const wchar_t* text) {
+#ifdef _WIN32
+  fputws(text, stdout);
+#else
+  char buf[LOG_LINE_MAX * 4];
+  int n = WideCharToMultiByte(CP_UTF8, 0, text, -1, buf, sizeof(buf), NULL, NULL);
+  if (n > 1) fwrite(buf, 1, (size_t)n - 1, stdout);
+#endif
+}
+
+// 输出一轮：先记下各缓冲区当前的写入位置，再按序号从小到大依次输出到这些位置为止。调用前已持有g_drain_lock
+static void DrainAll(void) {
+  for (LogRing* ring = FIRST_RING(); ring; ring = ring->next) ring->drain_head = (DWORD)LoadAcquire(&ring->head);
+  int wrote = 0;
+  for (;;) {
+    LogRing* best = NULL;
+    const LogRecord* best_rec = NULL;
+    for (LogRing* ring = FIRST_RING(); ring; ring = ring->next) {
+      DWORD tail = (DWORD)ring->tail;
+      if (tail == ring->drain_head) continue;
+      const LogRecord* rec = (const LogRecord*)(ring->data + (tail & (LOG_RING_SIZE - 1)));
+      if (rec->size == 0) {
+        // 跳到开头
+        tail += LOG_RING_SIZE - (tail & (LOG_RING_SIZE - 1));
+        InterlockedExchange(&ring->tail, (LONG)tail);
+        if (tail == ring->drain_head) continue;
+        rec = (const LogRecord*)ring->data;
+      }
+      if (!best_rec || (LONG)(rec->seq - best_rec->seq) < 0) {
+        best = ring;
+        best_rec = rec;
+      }
+    }
+    if (!best) break;
+    WriteLine((const wchar_t*)(best_rec + 1));
+    InterlockedExchange(&best->tail, (LONG)((DWORD)best->tail + best_rec->size));
+    wrote = 1;
+  }
+  if (wrote) fflush(stdout);
+}
+
+// 后台输出线程。Windows下线程持有所在模块的一个引用，退出时用FreeLibraryAndExitThread释放：
+// 插件DLL被卸载时，只要线程还在运行，模块就不会被卸载，线程不会执行到已解除映射的代码
+static DWORD WINAPI WriterMain(LPVOID arg) {
+  while (!LoadAcquire(&g_stop) && WaitForSingleObject(g_wake_event, LOG_DRAIN_INTERVAL_MS) != WAIT_FAILED) {
+    AcquireSRWLockExclusive(&g_drain_lock);
+    DrainAll();
+    ReleaseSRWLockExclusive(&g_drain_lock);
+  }
+#ifdef _WIN32
+  if (arg) FreeLibraryAndExitThread((HMODULE)arg, 0);
+#else
+  (void)arg;
+#endif
+  return 0;
+}
+
+// 线程退出时归还缓冲区，未输出的内容仍由消费者按序输出
+static VOID WINAPI ReleaseRing(PVOID p) {
+  if (p) InterlockedExchange(&((LogRing*)p)->in_use, 0);
+}
+
+static int ParseLevel(const wchar_t* s) {
+  static const wchar_t* names[] = { L"error", L"warn", L"info", L"debug" };
+  for (int i = 0; i < 4; ++i) {
+    if (_wcsicmp(s, names[i]) == 0) return i;
+  }
+  if (s[0] >= L'0' && s[0] <= L'3' && s[1] == 0) return s[0] - L'0';
+  return -1;
+}
+
+static BOOL WINAPI InitLog(INIT_ONCE* once, PVOID param, PVOID* context) {
+  (void)once; (void)param; (void)context;
+  if (!LoadAcquire(&g_level_set)) {
+    int level = XNSIS_LOG_LEVEL_INFO;
+    wchar_t value[16];
+    DWORD len = GetEnvironmentVariableW(XNSIS_LOG_ENV_VAR, value, 16);
+    if (len > 0 && len < 16 && ParseLevel(value) >= 0) level = ParseLevel(value);
+    InterlockedExchange(&g_xnsis_log_level, level);
+  }
+  g_fls_index = FlsAlloc(ReleaseRing);
+  g_wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+  InterlockedExchange(&g_stop, 0);
+  // 没有后台线程时由缓冲区满和XNSIS_LogFlush输出
+#ifdef _WIN32
+  HMODULE module = NULL;
+  GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCWSTR)(void*)WriterMain, &module);
+  g_writer_thread = g_wake_event ? CreateThread(NULL, 0, WriterMain, module, 0, NULL) : NULL;
+  if (!g_writer_thread && module) FreeLibrary(module);
+#else
+  g_writer_thread = g_wake_event ? CreateThread(NULL, 0, WriterMain, NULL, 0, NULL) : NULL;
+#endif
+  InterlockedExchange(&g_initialized, 1);
+  return TRUE;
+}
+
+static void EnsureInit(void) {
+  InitOnceExecuteOnce(&g_init_once, InitLog, NULL, NULL);
+}
+
+// 取本线程的缓冲区，没有时复用已退出线程的或新建一个
+static LogRing* ThreadRing(void) {
+  if (g_fls_index == FLS_OUT_OF_INDEXES) return NULL;
+  LogRing* ring = (LogRing*)FlsGetValue(g_fls_index);
+  if (ring) return ring;
+  for (ring = FIRST_RING(); ring; ring = ring->next) {
+    if (!ring->in_use && InterlockedCompareExchange(&ring->in_use, 1, 0) == 0) break;
+  }
+  if (!ring) {
+    ring = (LogRing*)malloc(sizeof(LogRing));
+    if (!ring) return NULL;
+    ring->in_use = 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->drain_head = 0;
+    LogRing* head;
+    do {
+      head = g_rings;
+      ring->next = head;
+    } while (InterlockedCompareExchangePointer((PVOID volatile*)&g_rings, ring, head) != head);
+  }
+  if (!FlsSetValue(g_fls_index, ring)) {
+    InterlockedExchange(&ring->in_use, 0);
+    return NULL;
+  }
+  return ring;
+}
+
+static void Push(const wchar_t* text, size_t len, int level) {
+  LogRing* ring = ThreadRing();
+  if (!ring) {
+    // 没有缓冲区时同步输出，先输出已提交的保持顺序
+    AcquireSRWLockExclusive(&g_drain_lock);
+    DrainAll();
+    WriteLine(text);
+    fflush(stdout);
+    ReleaseSRWLockExclusive(&g_drain_lock);
+    return;
+  }
+  DWORD size = LOG_ALIGN((DWORD)(sizeof(LogRecord) + (len + 1) * sizeof(wchar_t)));
+  DWORD head = (DWORD)ring->head;
+  DWORD pos, contiguous;
+  for (;;) {
+    pos = head & (LOG_RING_SIZE - 1);
+    contiguous = LOG_RING_SIZE - pos;
+    DWORD need = size <= contiguous ? size : contiguous + size;
+    if (LOG_RING_SIZE - (head - (DWORD)LoadAcquire(&ring->tail)) >= need) break;
+    // 缓冲区满：自己输出，不等后台线程
+    AcquireSRWLockExclusive(&g_drain_lock);
+    DrainAll();
+    ReleaseSRWLockExclusive(&g_drain_lock);
+  }
+  if (size > contiguous) {
+    ((LogRecord*)(ring->data + pos))->size = 0;
+    head += contiguous;
+    pos = 0;
+  }
+  LogRecord* rec = (LogRecord*)(ring->data + pos);
+  rec->size = size;
+  rec->seq = (DWORD)InterlockedIncrement(&g_seq);
+  memcpy(rec + 1, text, (len + 1) * sizeof(wchar_t));
+  InterlockedExchange(&ring->head, (LONG)(head + size));
+  // 错误在调用线程同步输出（连同之前提交的日志），出错后进程随即退出或中止时也不会丢失
+  if (level == XNSIS_LOG_LEVEL_ERROR) {
+    AcquireSRWLockExclusive(&g_drain_lock);
+    DrainAll();
+    ReleaseSRWLockExclusive(&g_drain_lock);
+    return;
+  }
+  // 缓冲区过半时提前唤醒后台线程
+  if (g_wake_event && head + size - (DWORD)ring->tail > LOG_RING_SIZE / 2) SetEvent(g_wake_event);
+}
+
+// 生成调用点前缀，多个线程同时生成时只保留一份
+static const wchar_t* SitePrefix(XNSIS_LogSite* site) {
+  const wchar_t* prefix = (const wchar_t*)LoadPointerAcquire((PVOID volatile*)&site->prefix);
+  if (prefix) return prefix;
   wchar_t wfile[128] = { 0 }, wfunc[128] = { 0 };
   size_t converted = 0;
-  mbstowcs_s(&converted, wfile, 128, file, _TRUNCATE);
-  mbstowcs_s(&converted, wfunc, 128, func, _TRUNCATE);
-  wprintf(L"[XNSIS][%s][%s][%d] ", wfile, wfunc, line);
+  mbstowcs_s(&converted, wfile, 128, site->file, _TRUNCATE);
+  mbstowcs_s(&converted, wfunc, 128, site->func, _TRUNCATE);
+  wchar_t buf[300];
+  int level = site->level >= 0 && site->level <= XNSIS_LOG_LEVEL_DEBUG ? site->level : XNSIS_LOG_LEVEL_INFO;
+  _snwprintf_s(buf, 300, _TRUNCATE, L"[XNSIS][%c][%s][%s][%d] ", g_level_tags[level], wfile, wfunc, site->line);
+  wchar_t* built = _wcsdup(buf);
+  if (!built) return L"[XNSIS] ";
+  prefix = (const wchar_t*)InterlockedCompareExchangePointer((PVOID volatile*)&site->prefix, built, NULL);
+  if (prefix) {
+    free(built);
+    return prefix;
+  }
+  return built;
+}
+
+static void LogV(XNSIS_LogSite* site, const wchar_t* fmt, va_list args) {
+  EnsureInit();
+  if (site->level > g_xnsis_log_level) return;
+  wchar_t line[LOG_LINE_MAX];
+  const wchar_t* prefix = SitePrefix(site);
+  size_t len = wcslen(prefix);
+  if (len > LOG_LINE_MAX - 2) len = LOG_LINE_MAX - 2;
+  wmemcpy(line, prefix, len);
+  // 超长时截断，保留换行
+  int n = _vsnwprintf_s(line + len, LOG_LINE_MAX - 1 - len, _TRUNCATE, fmt, args);
+  len = n >= 0 ? len + (size_t)n : wcslen(line);
+  line[len++] = L'\n';
+  line[len] = 0;
+  Push(line, len, site->level);
+}
+
+void XNSIS_LogSiteW(XNSIS_LogSite* site, const wchar_t* fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  vwprintf(fmt, args);
+  LogV(site, fmt, args);
   va_end(args);
-  wprintf(L"\n");
 }
+
+void XNSIS_LogW(const char* file, const char* func, int line, const wchar_t* fmt, ...) {
+  XNSIS_LogSite site = { file, func, line, XNSIS_LOG_LEVEL_INFO, NULL };
+  va_list args;
+  va_start(args, fmt);
+  LogV(&site, fmt, args);
+  va_end(args);
+  free((void*)site.prefix);
+}
+
+void XNSIS_LogSetLevel(int level) {
+  EnsureInit();
+  if (level < XNSIS_LOG_LEVEL_ERROR) level = XNSIS_LOG_LEVEL_ERROR;
+  if (level > XNSIS_LOG_LEVEL_DEBUG) level = XNSIS_LOG_LEVEL_DEBUG;
+  InterlockedExchange(&g_level_set, 1);
+  InterlockedExchange(&g_xnsis_log_level, level);
+}
+
+int XNSIS_LogGetLevel(void) {
+  EnsureInit();
+  return (int)g_xnsis_log_level;
+}
+
+void XNSIS_LogFlush(void) {
+  AcquireSRWLockExclusive(&g_drain_lock);
+  DrainAll();
+  ReleaseSRWLockExclusive(&g_drain_lock);
+}
+
+void XNSIS_LogShutdown(void) {
+  if (!LoadAcquire(&g_initialized)) return;
+  if (g_writer_thread) {
+    InterlockedExchange(&g_stop, 1);
+    SetEvent(g_wake_event);
+    WaitForSingleObject(g_writer_thread, INFINITE);
+    CloseHandle(g_writer_thread);
+    g_writer_thread = NULL;
+  }
+  AcquireSRWLockExclusive(&g_drain_lock);
+  DrainAll();
+  // FlsFree对仍持有缓冲区的线程调用ReleaseRing，之后缓冲区不再被引用
+  if (g_fls_index != FLS_OUT_OF_INDEXES) FlsFree(g_fls_index);
+  g_fls_index = FLS_OUT_OF_INDEXES;
+  LogRing* ring = g_rings;
+  g_rings = NULL;
+  while (ring) {
+    LogRing* next = ring->next;
+    free(ring);
+    ring = next;
+  }
+  if (g_wake_event) CloseHandle(g_wake_event);
+  g_wake_event = NULL;
+  InterlockedExchange(&g_initialized, 0);
+  ReleaseSRWLockExclusive(&g_drain_lock);
+  // 之后再有日志时重新初始化
+  InitOnceInitialize(&g_init_once);
+}
+
+#if defined(_WIN32) && defined(XNSIS_LOG_DLLMAIN)
+// 宿主DLL没有自己的DllMain时定义XNSIS_LOG_DLLMAIN使用这个入口；已有DllMain的在DLL_PROCESS_DETACH中调用XNSIS_LogShutdown
+BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved) {
+  (void)instance;
+  // 进程退出时（reserved不为NULL）其他线程已被终止，可能正持有g_drain_lock，不再等待，只尽量输出
+  if (reason == DLL_PROCESS_DETACH && !reserved) XNSIS_LogShutdown();
+  else if (reason == DLL_PROCESS_DETACH && TryAcquireSRWLockExclusive(&g_drain_lock)) {
+    DrainAll();
+    ReleaseSRWLockExclusive(&g_drain_lock);
+  }
+  return TRUE;
+}
+#endif
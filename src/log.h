@@ -1,12 +1,63 @@
 #pragma once
 #include <wchar.h>
-#include <Windows.h>
+#include "platform.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// 日志级别，数值越大越详细
+#define XNSIS_LOG_LEVEL_ERROR 0
+#define XNSIS_LOG_LEVEL_WARN 1
+#define XNSIS_LOG_LEVEL_INFO 2
+#define XNSIS_LOG_LEVEL_DEBUG 3
+
+// 编译期级别：高于它的日志调用整个被编译器去掉
+#ifndef XNSIS_LOG_COMPILE_LEVEL
+#define XNSIS_LOG_COMPILE_LEVEL XNSIS_LOG_LEVEL_DEBUG
+#endif
+
+// 运行期级别默认为INFO，可由环境变量XNSIS_LOG_LEVEL（error/warn/info/debug或0-3）或XNSIS_LogSetLevel修改；
+// XNSIS_LogSetLevel设置的级别优先于环境变量，XNSIS_LogShutdown后重新初始化时保留
+#define XNSIS_LOG_ENV_VAR L"XNSIS_LOG_LEVEL"
+
+// 调用点信息，每个XNSIS_LOG_AT展开为一个静态实例；文件名、函数名和行号只在第一次输出时转换成前缀
+typedef struct {
+  const char* file;
+  const char* func;
+  int line;
+  int level;
+  const wchar_t* volatile prefix;
+} XNSIS_LogSite;
+
+// 当前运行期级别；初始化前为最大值，保证第一条日志会进入XNSIS_LogSiteW完成初始化
+extern volatile LONG g_xnsis_log_level;
+
+// 格式化后写入本线程的环形缓冲区，由后台线程按提交顺序输出到stdout，调用线程不等待输出；
+// ERROR级别例外，返回前已在调用线程输出
+void XNSIS_LogSiteW(XNSIS_LogSite* site, const wchar_t* fmt, ...);
+// 兼容旧接口，每次都转换调用点信息，按INFO级别输出
 void XNSIS_LogW(const char* file, const char* func, int line, const wchar_t* fmt, ...);
-#define XNSIS_LOG(msg, ...) XNSIS_LogW(__FILE__, __FUNCTION__, __LINE__, msg, ##__VA_ARGS__)
+void XNSIS_LogSetLevel(int level);
+int XNSIS_LogGetLevel(void);
+// 在当前线程输出所有已提交的日志后返回；退出前或需要立即看到日志时调用
+void XNSIS_LogFlush(void);
+// 停止并等待后台输出线程，输出剩余日志，释放各线程的缓冲区和FLS索引；之后再有日志时重新初始化。
+// 日志状态是进程全局的，调用时不能有其他线程正在写日志，因此只在宿主的退出路径或DLL_PROCESS_DETACH中调用，
+// 不要在PackInstall、InstallContext等实例的释放中调用。未调用时后台线程持有模块引用，DLL不会真正卸载
+void XNSIS_LogShutdown(void);
+
+#define XNSIS_LOG_ENABLED(level) ((level) <= XNSIS_LOG_COMPILE_LEVEL && (level) <= g_xnsis_log_level)
+#define XNSIS_LOG_AT(level, msg, ...) do { \
+    if (XNSIS_LOG_ENABLED(level)) { \
+      static XNSIS_LogSite xnsis_log_site_ = { __FILE__, __FUNCTION__, __LINE__, level, NULL }; \
+      XNSIS_LogSiteW(&xnsis_log_site_, msg, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define XNSIS_LOG_ERROR(msg, ...) XNSIS_LOG_AT(XNSIS_LOG_LEVEL_ERROR, msg, ##__VA_ARGS__)
+#define XNSIS_LOG_WARN(msg, ...) XNSIS_LOG_AT(XNSIS_LOG_LEVEL_WARN, msg, ##__VA_ARGS__)
+#define XNSIS_LOG_DEBUG(msg, ...) XNSIS_LOG_AT(XNSIS_LOG_LEVEL_DEBUG, msg, ##__VA_ARGS__)
+#define XNSIS_LOG(msg, ...) XNSIS_LOG_AT(XNSIS_LOG_LEVEL_INFO, msg, ##__VA_ARGS__)
 #ifdef __cplusplus
 }
-#endif 
\ No newline at end of file
+#endif
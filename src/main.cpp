@@ -1,5 +1,6 @@
 #include "pack.h"
 #include "install.h"
+#include "log.h"
 
 #define CHECK_ADDSRC_ERROR(exp) if(!(exp)) DebugBreak();
 
@@ -24,5 +25,7 @@ int main() {
   CHECK_ADDSRC_ERROR(ExtractInstall7z(&context, instance.GetInstall7zPath().c_str()));
   CHECK_ADDSRC_ERROR(SetCurrentRealOutDir(&context, L"test\\out\\$11"));
   CHECK_ADDSRC_ERROR(SetCurrentRealOutDir(&context, L"test\\out\\$12"));
+  CHECK_ADDSRC_ERROR(VerifyInstalledFiles(&context));
   InstallContext_Free(&context);
+  XNSIS_LogShutdown();
 }
\ No newline at end of file
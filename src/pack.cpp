@@ -1,16 +1,30 @@
 #include "pack.h"
 #include <string>
-#include <windows.h>
+#include "platform.h"
 #include <cstdio>
 #include <ctime>
+#include <map>
 #include <set>
 #include <functional>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <wchar.h>
 #include <stdio.h>
 #include <cwchar>
+#include <cwctype>
 #include <cstdlib>
 #include "log.h"
+#include "hash.h"
+#include "fileops.h"
+#include "dircache.h"
+#include "workpool.h"
+#include "packcache.h"
+#include "archive.h"
+#include "trace.h"
+#ifdef _WIN32
 #include "tchar.h"
+#endif
 
 #ifdef DBG_SOLUTION
 #include"fake.hpp"
@@ -25,7 +39,7 @@ void ForEachFileRecursive(const std::wstring& dir_path, const std::wstring& base
   std::wstring search = dir_path + L"\\*";
   HANDLE hFind = FindFirstFileW(search.c_str(), &findData);
   if (hFind == INVALID_HANDLE_VALUE) {
-    XNSIS_LOG(L"FindFirstFileW failed: %s, error=%lu", search.c_str(), GetLastError());
+    XNSIS_LOG_WARN(L"FindFirstFileW failed: %s, error=%lu", search.c_str(), GetLastError());
     return;
   }
   do {
@@ -47,20 +61,212 @@ bool IsDirExists(const std::wstring& path) {
   return (attr != INVALID_FILE_ATTRIBUTES) && (attr & FILE_ATTRIBUTE_DIRECTORY);
 }
 
-bool CreateDirRecursive(const std::wstring& path) {
-  if (IsDirExists(path)) return true;
-  size_t pos = path.find_last_of(L"\\/");
-  if (pos != std::wstring::npos) {
-    if (!CreateDirRecursive(path.substr(0, pos))) {
-      XNSIS_LOG(L"Failed to create parent directory: %s", path.substr(0, pos).c_str());
+std::wstring FullPath(const std::wstring& path) {
+  DWORD len = GetFullPathNameW(path.c_str(), 0, NULL, NULL);
+  if (len == 0) return path;
+  std::wstring full(len, L'\0');
+  len = GetFullPathNameW(path.c_str(), len, &full[0], NULL);
+  full.resize(len);
+  return full;
+}
+
+// 分片数上限，以及[shards]为auto时每个分片至少分到的数据量
+static const unsigned kMaxShards = 16;
+static const uint64_t kShardAutoBytes = 64ull * 1024 * 1024;
+
+// 未配置[compress_param]，或auto选参失败时使用的压缩参数
+static const wchar_t kDefaultCompressParam[] = L"-t7z -m0=lzma:fb=273 -mx=9 -md=256M -ms=4G -mmt=2";
+// [compress_param]为auto时，样本中单个文件最多取的数据量占样本总量的比例（1/n），保证样本覆盖足够多的文件
+static const uint64_t kAutoSliceDivisor = 16;
+static const uint64_t kAutoMinSliceBytes = 1024 * 1024;
+// 试压缩样本按扩展名分组的组数上限，每组一次7z调用
+static const size_t kAutoMaxSampleGroups = 8;
+
+// 写7z列表文件（UTF-16LE，每行一项，配合-scsUTF-16LE使用）
+static bool WriteListFile(const std::wstring& list_path, const std::vector<std::wstring>& items) {
+  std::vector<const wchar_t*> ptrs;
+  ptrs.reserve(items.size());
+  for (const auto& item : items) ptrs.push_back(item.c_str());
+  return Archive_WriteList(list_path.c_str(), ptrs.data(), (DWORD)ptrs.size()) != 0;
+}
+
+// 通配符匹配（不区分大小写），支持*和?
+static bool WildcardMatch(const wchar_t* pattern, const wchar_t* name) {
+  const wchar_t* star = nullptr;
+  const wchar_t* resume = nullptr;
+  while (*name) {
+    if (*pattern == L'*') {
+      star = pattern++;
+      resume = name;
+    }
+    else if (*pattern == L'?' || towlower(*pattern) == towlower(*name)) {
+      ++pattern;
+      ++name;
+    }
+    else if (star) {
+      pattern = star + 1;
+      name = ++resume;
+    }
+    else {
       return false;
     }
   }
-  if (!CreateDirectoryW(path.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
-    XNSIS_LOG(L"CreateDirectoryW failed: %s, error=%lu", path.c_str(), GetLastError());
-    return false;
+  while (*pattern == L'*') ++pattern;
+  return *pattern == L'\0';
+}
+
+// 与7z的-x!规则保持一致：不含路径分隔符的规则匹配名称（递归时匹配任意一级），
+// 含路径分隔符的规则匹配相对路径本身或其任一上级目录
+static bool IsExcludedPath(const std::wstring& rel, int recurse, const std::set<std::wstring>& excluded) {
+  for (const auto& ex : excluded) {
+    if (ex.empty()) continue;
+    if (ex.find_first_of(L"\\/") == std::wstring::npos) {
+      size_t start = 0;
+      while (start <= rel.size()) {
+        size_t end = rel.find(L'\\', start);
+        std::wstring name = rel.substr(start, end == std::wstring::npos ? std::wstring::npos : end - start);
+        if (WildcardMatch(ex.c_str(), name.c_str())) return true;
+        if (end == std::wstring::npos || !recurse) break;
+        start = end + 1;
+      }
+    }
+    else {
+      std::wstring pattern = ex;
+      for (auto& ch : pattern) {
+        if (ch == L'/') ch = L'\\';
+      }
+      size_t end = 0;
+      while (true) {
+        end = rel.find(L'\\', end);
+        std::wstring prefix = rel.substr(0, end);
+        if (WildcardMatch(pattern.c_str(), prefix.c_str())) return true;
+        if (end == std::wstring::npos) break;
+        ++end;
+      }
+    }
   }
-  return true;
+  return false;
+}
+
+static ULONGLONG FindDataSize(const WIN32_FIND_DATAW& findData) {
+  return ((ULONGLONG)findData.nFileSizeHigh << 32) | findData.nFileSizeLow;
+}
+
+// 并行收集源文件：每个子目录作为一个任务提交到暂存线程池，由空闲线程窃取执行
+class SrcCollector {
+public:
+  SrcCollector(WorkStealingPool& pool, int recurse, const std::set<std::wstring>& excluded)
+    : group_(pool), recurse_(recurse), excluded_(excluded) {}
+
+  // 按7z "a -r -x!" 的选取规则遍历源路径，归档名相对于path所在的目录；
+  // 结果按归档名排序，与线程调度无关
+  bool Collect(const std::wstring& path, std::vector<StagingEntry>& entries) {
+    std::wstring src = path;
+    while (src.size() > 1 && (src.back() == L'\\' || src.back() == L'/')) src.pop_back();
+    for (auto& ch : src) {
+      if (ch == L'/') ch = L'\\';
+    }
+    size_t pos = src.find_last_of(L'\\');
+    std::wstring dir_path = pos == std::wstring::npos ? std::wstring(L".") : src.substr(0, pos);
+    std::wstring pattern = pos == std::wstring::npos ? src : src.substr(pos + 1);
+    if (pattern.empty()) {
+      XNSIS_LOG(L"Invalid source path: %s", path.c_str());
+      return false;
+    }
+    base_dir_ = dir_path;
+    group_.Run([this, dir_path, pattern]() { CollectMatches(dir_path, std::wstring(), pattern); });
+    group_.Wait();
+    if (failed_) return false;
+    std::sort(entries_.begin(), entries_.end(), [](const StagingEntry& a, const StagingEntry& b) {
+      return _wcsicmp(a.rel.c_str(), b.rel.c_str()) < 0;
+    });
+    entries.swap(entries_);
+    return true;
+  }
+
+  // 归档名的基准目录：收集到的每个文件都满足 src == base_dir\\rel
+  const std::wstring& BaseDir() const { return base_dir_; }
+
+private:
+  void Add(const std::wstring& abs, const std::wstring& rel, const WIN32_FIND_DATAW& findData) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(StagingEntry{ abs, rel, FindDataSize(findData) });
+  }
+
+  // 收集整个目录（子项仍需经过排除规则）
+  void CollectTree(const std::wstring& dir_path, const std::wstring& rel_dir) {
+    WIN32_FIND_DATAW findData;
+    std::wstring search = dir_path + L"\\*";
+    HANDLE hFind = FindFirstFileW(search.c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+      DWORD err = GetLastError();
+      if (err == ERROR_FILE_NOT_FOUND) return; // 空目录
+      XNSIS_LOG(L"FindFirstFileW failed: %s, error=%lu", search.c_str(), err);
+      failed_ = true;
+      return;
+    }
+    do {
+      if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) continue;
+      std::wstring abs = dir_path + L"\\" + findData.cFileName;
+      std::wstring rel = rel_dir + L"\\" + findData.cFileName;
+      if (IsExcludedPath(rel, recurse_, excluded_)) continue;
+      if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        group_.Run([this, abs, rel]() { CollectTree(abs, rel); });
+      }
+      else {
+        Add(abs, rel, findData);
+      }
+    } while (!failed_ && FindNextFileW(hFind, &findData));
+    FindClose(hFind);
+  }
+
+  // 在源目录中查找匹配pattern的项；recurse时与7z -r一致，在各级子目录中继续查找
+  void CollectMatches(const std::wstring& dir_path, const std::wstring& rel_dir, const std::wstring& pattern) {
+    WIN32_FIND_DATAW findData;
+    std::wstring search = dir_path + L"\\*";
+    HANDLE hFind = FindFirstFileW(search.c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+      XNSIS_LOG(L"FindFirstFileW failed: %s, error=%lu", search.c_str(), GetLastError());
+      failed_ = true;
+      return;
+    }
+    do {
+      if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) continue;
+      std::wstring abs = dir_path + L"\\" + findData.cFileName;
+      std::wstring rel = rel_dir.empty() ? std::wstring(findData.cFileName) : rel_dir + L"\\" + findData.cFileName;
+      if (IsExcludedPath(rel, recurse_, excluded_)) continue;
+      bool is_dir = !!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+      if (WildcardMatch(pattern.c_str(), findData.cFileName)) {
+        if (is_dir) {
+          group_.Run([this, abs, rel]() { CollectTree(abs, rel); });
+        }
+        else {
+          Add(abs, rel, findData);
+        }
+      }
+      else if (is_dir && recurse_) {
+        group_.Run([this, abs, rel, pattern]() { CollectMatches(abs, rel, pattern); });
+      }
+    } while (!failed_ && FindNextFileW(hFind, &findData));
+    FindClose(hFind);
+  }
+
+  TaskGroup group_;
+  int recurse_;
+  const std::set<std::wstring>& excluded_;
+  std::mutex mutex_;
+  std::vector<StagingEntry> entries_;
+  std::wstring base_dir_;
+  std::atomic<bool> failed_{ false };
+};
+
+// 暂存索引的键：统一分隔符并忽略大小写（与NTFS的命名规则一致）
+static std::wstring StagingKey(const std::wstring& rel) {
+  std::wstring key = rel;
+  for (auto& ch : key) {
+    ch = (ch == L'/') ? L'\\' : (wchar_t)towlower(ch);
+  }
+  return key;
 }
 
 // 安全递归删除目录，防止误删根目录
@@ -81,13 +287,13 @@ static int DeleteDirRecursiveW(const std::wstring& path) {
     std::wstring sub = path + L"\\" + findData.cFileName;
     if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
       if (!DeleteDirRecursiveW(sub)) {
-        XNSIS_LOG(L"Failed to delete subdir: %s", sub.c_str());
+        XNSIS_LOG_WARN(L"Failed to delete subdir: %s", sub.c_str());
         continue;
       }
     }
     else {
       if (!DeleteFileW(sub.c_str())) {
-        XNSIS_LOG(L"Failed to delete file: %s, error=%lu", sub.c_str(), GetLastError());
+        XNSIS_LOG_WARN(L"Failed to delete file: %s, error=%lu", sub.c_str(), GetLastError());
         continue;
       }
     }
@@ -113,46 +319,87 @@ static int DeleteDirRecursiveW(const std::wstring& path) {
   return 1;
 }
 
-bool PackInstall::SyncCall7zSync(const std::wstring& szCommand) {
+ProcessExecutor& PackInstall::GetExecutor() {
+  std::lock_guard<std::mutex> lock(executor_mutex_);
+  if (!executor_) {
+    executor_.reset(new ProcessExecutor(sevenzip_jobs_));
+    XNSIS_LOG(L"7z executor started: max_concurrent=%u, timeout=%us", executor_->MaxConcurrent(), sevenzip_timeout_s_);
+  }
+  return *executor_;
+}
+
+ProcessJob PackInstall::Make7zJob(const std::wstring& szCommand, const std::wstring& work_dir) {
   XNSIS_LOG(_T("XNSIS: 7z cmd, %s"), szCommand.c_str());
-  STARTUPINFOW si = { sizeof(STARTUPINFOW) };
-  PROCESS_INFORMATION pi = { 0 };
-  BOOL bSuccess = FALSE;
-  DWORD dwExitCode = 0;
 #ifdef DBG_SOLUTION
   std::wstring sz7zPath = L"7z";
 #else
   std::wstring sz7zPath = GetCurrentModuleDir() + L"7z.exe";
 #endif
-  std::wstring cmdLine = sz7zPath + L" " + szCommand;
-
-  bSuccess = ::CreateProcessW(
-    NULL,
-    const_cast<LPWSTR>(cmdLine.c_str()),
-    NULL,
-    NULL,
-    FALSE,
-    0,
-    NULL,
-    NULL,
-    &si,
-    &pi
-  );
-
-  if (!bSuccess) {
-    XNSIS_LOG(_T("XNSIS: CreateProcess failed, %d"), GetLastError());
-    return false;
-  }
+  ProcessJob job;
+  job.command_line = L"\"" + sz7zPath + L"\" " + szCommand;
+  job.work_dir = work_dir;
+  job.timeout_ms = sevenzip_timeout_s_ * 1000;
+  return job;
+}
 
-  ::WaitForSingleObject(pi.hProcess, INFINITE);
-  ::GetExitCodeProcess(pi.hProcess, &dwExitCode);
-  ::CloseHandle(pi.hProcess);
-  ::CloseHandle(pi.hThread);
-  if (dwExitCode != 0) {
-    XNSIS_LOG(_T("XNSIS: 7z cmd failed"));
+// 提交一次7z调用，不等待其完成；可在任意线程调用
+ProcessTicket PackInstall::Submit7z(const std::wstring& szCommand, const std::wstring& work_dir) {
+  return GetExecutor().Submit(Make7zJob(szCommand, work_dir));
+}
+
+// 等待7z调用完成，失败时记录原因和7z输出的第一条错误
+bool PackInstall::Await7z(const ProcessTicket& ticket, const std::wstring& szCommand) {
+  ProcessResult result = GetExecutor().Await(ticket);
+  if (TRACE_ENABLED()) {
+    // 只记进程实际运行的时间，不含排队等待
+    ULONGLONG end = Trace_Now();
+    ULONGLONG elapsed = (ULONGLONG)result.elapsed_ms * 1000;
+    Trace_AsyncW("7z", szCommand.c_str(), end > elapsed ? end - elapsed : 0, end);
+    Trace_Count("7z_wall_ms", result.elapsed_ms);
+  }
+  if (result.Succeeded()) return true;
+  if (!result.started) {
+    XNSIS_LOG(_T("XNSIS: CreateProcess failed, %u"), result.error);
   }
+  else {
+    std::string line = result.FirstErrorLine();
+    XNSIS_LOG(_T("XNSIS: 7z cmd failed, exit=%d, timed_out=%d, cancelled=%d, elapsed=%ums, error=%S"),
+      result.exit_code, (int)result.timed_out, (int)result.cancelled, result.elapsed_ms, line.c_str());
+  }
+  return false;
+}
 
-  return (dwExitCode == 0);
+bool PackInstall::SyncCall7zSync(const std::wstring& szCommand, const std::wstring& work_dir) {
+  return backend_->run(backend_, szCommand.c_str(), work_dir.empty() ? nullptr : work_dir.c_str()) != 0;
+}
+
+// 外部进程后端：经执行器启动7z.exe
+int PackInstall::RunProcessBackend(const ArchiveBackend* backend, const wchar_t* args, const wchar_t* work_dir) {
+  PackInstall* self = (PackInstall*)backend->user;
+  return self->Await7z(self->Submit7z(args, work_dir ? work_dir : L""), args) ? 1 : 0;
+}
+
+// 外部进程后端的-si/-so命令：input经管道写入7z的stdin（Await返回前一直有效），stdout原样交给output
+int PackInstall::RunProcessStream(const ArchiveBackend* backend, const wchar_t* args, const void* input, size_t input_size,
+  Archive_OutputCallback output, void* output_arg) {
+  PackInstall* self = (PackInstall*)backend->user;
+  ProcessJob job = self->Make7zJob(args, L"");
+  job.input = input;
+  job.input_size = input_size;
+  if (output) job.on_output = [output, output_arg](const char* data, size_t size) { return output(output_arg, data, size) != 0; };
+  return self->Await7z(self->GetExecutor().Submit(std::move(job)), args) ? 1 : 0;
+}
+
+// 需要工作目录的命令（按列表打包）使用的后端：进程内的7-Zip只能通过切换整个进程的当前目录来指定工作目录，
+// 会影响其他线程对相对路径的解析，这类命令都经执行器启动7z.exe，由子进程在自己的工作目录中运行
+const ArchiveBackend* PackInstall::WorkDirBackend() const {
+  return &process_backend_;
+}
+
+// 读写stdin/stdout的命令（Archive_AddBuffer、Archive_ExtractItems）使用的后端：链接进来的7-Zip的标准输入输出是进程级的，
+// 这类命令都经执行器启动7z.exe，数据经管道传递，不落盘
+const ArchiveBackend* PackInstall::StreamBackend() const {
+  return &process_backend_;
 }
 
 std::wstring PackInstall::GetCurrentModuleDir() {
@@ -168,7 +415,10 @@ std::wstring PackInstall::GetCurrentModuleDir() {
 }
 
 PackInstall::PackInstall() {
+  process_backend_ = ArchiveBackend{ L"process", &PackInstall::RunProcessBackend, &PackInstall::RunProcessStream, this };
+  backend_ = &process_backend_;
   // MessageBox(NULL, L"", L"", MB_OK);
+  DirCache_Init(&dir_cache_);
   InitTempDir();
   ParseConfigIni();
 }
@@ -199,47 +449,222 @@ uint64_t PackInstall::AddSrcFile(const std::wstring& path, int recurse, const st
     XNSIS_LOG(L"AddSrcFile called after completed or with invalid fake dir index");
     return 0;
   }
-  std::set<std::wstring> before;
-  ForEachFileRecursive(temp_dir_, temp_dir_, [&](const std::wstring& abs, const std::wstring& rel) {
-    before.insert(rel);
-    });
-  std::wstring tar_path = temp_dir_ + L"\\addsrc_tmp.tar";
-  std::wstring cmd = L"a -ttar";
-  if (recurse) cmd += L" -r";
-  for (const auto& ex : excluded) {
-    cmd += L" -x!" + ex;
-  }
-  cmd += L" \"" + tar_path + L"\" \"" + path + L"\"";
-  if (!SyncCall7zSync(cmd.c_str())) {
-    XNSIS_LOG(L"SyncCall7zSync tar failed: %s", cmd.c_str());
+  TraceScope trace("pack", "AddSrcFile");
+  std::vector<StagingEntry> entries;
+  SrcCollector collector(GetStagingPool(), recurse, excluded);
+  if (!collector.Collect(path, entries)) {
+    XNSIS_LOG(L"Collect source files failed: %s", path.c_str());
     return 0;
   }
-  std::wstring extract_cmd = L"x -ttar \"" + tar_path + L"\" -o\"" + temp_dir_ + L"\" -aos";
-  if (!SyncCall7zSync(extract_cmd.c_str())) {
-    XNSIS_LOG(L"SyncCall7zSync extract tar failed: %s", extract_cmd.c_str());
-    return 0;
+  std::wstring root = FullPath(collector.BaseDir());
+  // 先完成冲突检查，再统一登记和提交复制任务
+  std::vector<std::pair<const StagingEntry*, int>> accepted;
+  std::vector<std::pair<const StagingEntry*, const ManifestEntry*>> shared;
+  for (const auto& entry : entries) {
+    int state = CheckStagingIndex(entry.rel);
+    if (state == 1) continue;
+    accepted.emplace_back(&entry, state);
+    if (state == 2) shared.emplace_back(&entry, FindManifestEntry(entry.rel));
   }
-  DeleteFileW(tar_path.c_str());
-  ULONGLONG total_size = 0;
-  ForEachFileRecursive(temp_dir_, temp_dir_, [&](const std::wstring& abs, const std::wstring& rel) {
-    if (before.find(rel) == before.end()) {
-      if (DistInfo_AddFile(&distinfo_, current_fake_idx_, rel.c_str()) == 0) {
-        WIN32_FILE_ATTRIBUTE_DATA fad;
-        if (GetFileAttributesExW(abs.c_str(), GetFileExInfoStandard, &fad)) {
-          ULONGLONG sz = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
-          total_size += sz ? sz : 1;
-        }
-        else {
-          XNSIS_LOG(L"GetFileAttributesExW failed: %s, error=%lu", abs.c_str(), GetLastError());
-        }
-      }
-      else {
-        XNSIS_LOG(L"DistInfo_AddFile failed: %s", rel.c_str());
+  // 其他fake目录已有的同名文件并行比较内容，相同则共享存储，不同则保留先登记的那份、当前fake目录跳过该文件。
+  // 与暂存后的文件比较，需先等之前提交的暂存完成
+  std::set<const StagingEntry*> collided;
+  if (!shared.empty()) {
+    if (!WaitStaging()) return 0;
+    std::vector<char> same(shared.size(), 0);
+    {
+      TaskGroup group(GetStagingPool());
+      for (size_t i = 0; i < shared.size(); ++i) {
+        group.Run([this, &shared, &same, i]() {
+          same[i] = IsSameContent(*shared[i].second, shared[i].first->src, shared[i].first->size);
+        });
       }
     }
-    });
+    for (size_t i = 0; i < shared.size(); ++i) {
+      if (same[i]) continue;
+      if (!ReportCollision(shared[i].first->rel, *shared[i].second)) return 0;
+      collided.insert(shared[i].first);
+    }
+  }
+  // 跳过的文件也计入返回值（按大小，空文件计1），调用方把0当作失败
+  ULONGLONG total_size = 0, skipped_size = 0;
+  for (const auto& item : accepted) {
+    const StagingEntry* entry = item.first;
+    if (collided.count(entry)) {
+      skipped_size += entry->size ? entry->size : 1;
+      continue;
+    }
+    if (DistInfo_AddFile(&distinfo_, current_fake_idx_, entry->rel.c_str()) != 0) {
+      XNSIS_LOG(L"DistInfo_AddFile failed: %s", entry->rel.c_str());
+      continue;
+    }
+    if (item.second == 0) AddManifestEntry(entry->src, entry->rel, root, entry->size);
+    total_size += entry->size ? entry->size : 1;
+  }
   need_pack_ |= (!!total_size);
-  return static_cast<int>(total_size);
+  trace.SetArg("files", accepted.size() - collided.size());
+  Trace_Count("pack_files", (LONGLONG)(accepted.size() - collided.size()));
+  Trace_Count("pack_bytes", (LONGLONG)total_size);
+  return total_size + skipped_size;
+}
+
+// 取路径所在卷的根（盘符或UNC路径的server\share部分），用于按卷缓存链接能力
+static std::wstring VolumeRootOf(const std::wstring& path) {
+  wchar_t full[MAX_PATH] = { 0 };
+  DWORD len = GetFullPathNameW(path.c_str(), MAX_PATH, full, NULL);
+  if (len == 0 || len >= MAX_PATH) return std::wstring();
+  std::wstring p(full);
+  size_t pos = 0;
+  if (p.compare(0, 2, L"\\\\") == 0) {
+    // UNC路径：跳过server和share两级
+    pos = p.find(L'\\', 2);
+    if (pos != std::wstring::npos) pos = p.find(L'\\', pos + 1);
+  }
+  else {
+    pos = p.find(L'\\');
+  }
+  return pos == std::wstring::npos ? p : p.substr(0, pos + 1);
+}
+
+// 将单个源文件放到暂存目录中的rel位置；链接模式下依次尝试块克隆、硬链接，最后才物理复制
+bool PackInstall::StageOneFile(const std::wstring& src, const std::wstring& rel) {
+  std::wstring dst = temp_dir_ + L"\\" + rel;
+  size_t pos = dst.find_last_of(L"\\/");
+  if (pos != std::wstring::npos && !DirCache_Ensure(&dir_cache_, dst.substr(0, pos).c_str())) {
+    XNSIS_LOG(L"Failed to create directory for dst: %s", dst.c_str());
+    return false;
+  }
+  if (staging_mode_ != StagingMode::kCopy) {
+    std::wstring root = VolumeRootOf(src);
+    uint32_t disabled = 0;
+    {
+      std::lock_guard<std::mutex> lock(link_mutex_);
+      disabled = volume_link_disabled_[root];
+    }
+    // 链接不会覆盖已有文件，重复暂存时先删除旧的目标
+    DeleteFileW(dst.c_str());
+    if (!(disabled & kCloneDisabled)) {
+      if (FileOps_CloneFile(src.c_str(), dst.c_str())) {
+        staging_cloned_++;
+        return true;
+      }
+      DWORD err = GetLastError();
+      if (err == ERROR_NOT_SUPPORTED || err == ERROR_INVALID_FUNCTION || err == ERROR_NOT_SAME_DEVICE) {
+        std::lock_guard<std::mutex> lock(link_mutex_);
+        volume_link_disabled_[root] |= kCloneDisabled;
+      }
+    }
+    if (!(disabled & kHardlinkDisabled)) {
+      if (CreateHardLinkW(dst.c_str(), src.c_str(), NULL)) {
+        staging_hardlinked_++;
+        return true;
+      }
+      DWORD err = GetLastError();
+      if (err == ERROR_NOT_SAME_DEVICE || err == ERROR_NOT_SUPPORTED || err == ERROR_INVALID_FUNCTION) {
+        std::lock_guard<std::mutex> lock(link_mutex_);
+        volume_link_disabled_[root] |= kHardlinkDisabled;
+      }
+    }
+  }
+  if (!CopyFileW(src.c_str(), dst.c_str(), FALSE)) {
+    XNSIS_LOG(L"CopyFileW failed: %s -> %s, error=%lu", src.c_str(), dst.c_str(), GetLastError());
+    return false;
+  }
+  staging_copied_++;
+  return true;
+}
+
+void PackInstall::SetStagingMode(StagingMode mode) {
+  if (completed_) {
+    XNSIS_LOG(L"SetStagingMode called after completed");
+    return;
+  }
+  staging_mode_ = mode;
+}
+
+StagingStats PackInstall::GetStagingStats() const {
+  return StagingStats{ staging_cloned_.load(), staging_hardlinked_.load(), staging_copied_.load() };
+}
+
+WorkStealingPool& PackInstall::GetStagingPool() {
+  if (!staging_pool_) {
+    staging_pool_.reset(new WorkStealingPool(staging_threads_));
+    XNSIS_LOG(L"Staging pool started with %u workers", staging_pool_->WorkerCount());
+  }
+  return *staging_pool_;
+}
+
+// 复制在线程池中异步完成，失败计数在WaitStaging中统一检查
+void PackInstall::QueueStaging(const std::wstring& src, const std::wstring& rel) {
+  GetStagingPool().Submit([this, src, rel]() {
+    if (!StageOneFile(src, rel)) {
+      staging_errors_++;
+    }
+  });
+}
+
+bool PackInstall::WaitStaging() {
+  if (staging_pool_) staging_pool_->Wait();
+  StagingStats stats = GetStagingStats();
+  if (stats.cloned || stats.hardlinked || stats.copied) {
+    XNSIS_LOG(L"Staging stats: cloned=%u, hardlinked=%u, copied=%u", stats.cloned, stats.hardlinked, stats.copied);
+  }
+  if (staging_errors_) {
+    XNSIS_LOG(L"Staging failed for %u files", staging_errors_.load());
+    return false;
+  }
+  return true;
+}
+
+// 查询暂存索引：0 未暂存；1 当前fake目录已暂存过（跳过）；2 已由其他fake目录暂存
+int PackInstall::CheckStagingIndex(const std::wstring& rel) {
+  const ManifestEntry* entry = FindManifestEntry(rel);
+  if (!entry) return 0;
+  return entry->fake_idx == current_fake_idx_ ? 1 : 2;
+}
+
+// 记录跨fake目录的路径冲突（同名不同内容）。返回false表示按[staging_collision]为error处理，AddSrcFile失败
+bool PackInstall::ReportCollision(const std::wstring& rel, const ManifestEntry& entry) {
+  ++staging_collisions_;
+  if (staging_collision_fatal_) {
+    XNSIS_LOG_ERROR(L"Path collision: %s already staged by fake dir %s with different content, current fake dir %s", rel.c_str(),
+      distinfo_.dirs[entry.fake_idx].fake_dir, distinfo_.dirs[current_fake_idx_].fake_dir);
+    return false;
+  }
+  XNSIS_LOG_WARN(L"Path collision: %s already staged by fake dir %s with different content, skipped in fake dir %s", rel.c_str(),
+    distinfo_.dirs[entry.fake_idx].fake_dir, distinfo_.dirs[current_fake_idx_].fake_dir);
+  return true;
+}
+
+// 比较源文件与已登记文件的内容：大小和MD5相同后再与打包用的那份逐字节比较，共享存储不只凭哈希
+bool PackInstall::IsSameContent(const ManifestEntry& entry, const std::wstring& src, uint64_t size) {
+  if (entry.size != size) return false;
+  ContentHash a, b;
+  if (!Hash_File(entry.src.c_str(), &a) || !Hash_File(src.c_str(), &b)) return false;
+  if (memcmp(a.bytes, b.bytes, sizeof(a.bytes)) != 0) return false;
+  return FileOps_SameContent(PayloadPath(entry).c_str(), src.c_str()) == 1;
+}
+
+std::wstring PackInstall::PayloadPath(const ManifestEntry& entry) const {
+  return entry.staged ? temp_dir_ + L"\\" + entry.rel : entry.src;
+}
+
+ManifestEntry* PackInstall::FindManifestEntry(const std::wstring& rel) {
+  auto it = staged_.find(StagingKey(rel));
+  return it == staged_.end() ? nullptr : &manifest_[it->second];
+}
+
+// 登记到清单；免暂存模式下能由源目录直接打包的文件不再放入临时目录
+void PackInstall::AddManifestEntry(const std::wstring& src, const std::wstring& rel, const std::wstring& root, uint64_t size) {
+  // 调用前刚通过DistInfo_AddFile添加，文件位于当前fake目录的末尾
+  DWORD file_idx = distinfo_.dirs[current_fake_idx_].file_count - 1;
+  ManifestEntry entry{ src, rel, root, size, current_fake_idx_, false, false, file_idx, -1 };
+  if (staging_mode_ != StagingMode::kVirtual || root.empty()) {
+    entry.staged = true;
+    QueueStaging(src, rel);
+  }
+  staged_[StagingKey(rel)] = manifest_.size();
+  manifest_.push_back(entry);
 }
 
 uint64_t PackInstall::AddSrcFile(const std::wstring& path, const std::wstring& oname) {
@@ -248,35 +673,82 @@ uint64_t PackInstall::AddSrcFile(const std::wstring& path, const std::wstring& o
     return 0;
   }
   std::wstring arc_path = oname;
-  std::wstring dst = temp_dir_ + L"\\" + arc_path;
-  if (!CreateDirRecursive(dst.substr(0, dst.find_last_of(L"\\/")))) {
-    XNSIS_LOG(L"Failed to create directory for dst: %s", dst.c_str());
+  int state = CheckStagingIndex(arc_path);
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fad)) {
+    XNSIS_LOG(L"GetFileAttributesExW failed: %s, error=%lu", path.c_str(), GetLastError());
     return 0;
   }
-  if (!CopyFileW(path.c_str(), dst.c_str(), FALSE)) {
-    XNSIS_LOG(L"CopyFileW failed: %s -> %s, error=%lu", path.c_str(), dst.c_str(), GetLastError());
-    return 0;
+  ULONGLONG sz = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  if (state == 2) {
+    // 其他fake目录已有同名文件：内容相同则共享存储，只记录到当前fake目录
+    const ManifestEntry* entry = FindManifestEntry(arc_path);
+    if (!WaitStaging()) return 0;
+    if (!IsSameContent(*entry, path, sz)) {
+      // 内容不同：保留先登记的那份，当前fake目录不添加（仍按已处理返回大小）
+      return ReportCollision(arc_path, *entry) ? (sz ? sz : 1) : 0;
+    }
+    if (DistInfo_AddFile(&distinfo_, current_fake_idx_, arc_path.c_str()) != 0) {
+      XNSIS_LOG(L"DistInfo_AddFile failed: %s", arc_path.c_str());
+      return 0;
+    }
+    sz = sz ? sz : 1;
+    need_pack_ |= (!!sz);
+    return sz;
   }
-  if (DistInfo_AddFile(&distinfo_, current_fake_idx_, arc_path.c_str()) != 0) {
-    XNSIS_LOG(L"DistInfo_AddFile failed: %s", arc_path.c_str());
-    return 0;
+  // 源路径以归档名结尾时，可以在其上级目录中按原名直接打包
+  std::wstring root;
+  std::wstring src_key = StagingKey(path);
+  std::wstring rel_key = L"\\" + StagingKey(arc_path);
+  if (src_key.size() > rel_key.size() && src_key.compare(src_key.size() - rel_key.size(), rel_key.size(), rel_key) == 0) {
+    root = FullPath(path.substr(0, path.size() - rel_key.size()));
   }
-  WIN32_FILE_ATTRIBUTE_DATA fad;
-  ULONGLONG sz = 0;
-  if (GetFileAttributesExW(dst.c_str(), GetFileExInfoStandard, &fad)) {
-    sz = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  if (state == 0) {
+    if (DistInfo_AddFile(&distinfo_, current_fake_idx_, arc_path.c_str()) != 0) {
+      XNSIS_LOG(L"DistInfo_AddFile failed: %s", arc_path.c_str());
+      return 0;
+    }
+    AddManifestEntry(path, arc_path, root, sz);
   }
   else {
-    XNSIS_LOG(L"GetFileAttributesExW failed: %s, error=%lu", dst.c_str(), GetLastError());
+    // 同一fake目录内重复添加时只覆盖文件内容，不重复记录；需等之前的复制完成以保证覆盖顺序
+    ManifestEntry* entry = FindManifestEntry(arc_path);
+    entry->src = path;
+    entry->root = root;
+    entry->size = sz;
+    entry->staged = (staging_mode_ != StagingMode::kVirtual || root.empty());
+    if (entry->staged && (!WaitStaging() || !StageOneFile(path, arc_path))) {
+      XNSIS_LOG(L"Failed to restage file: %s", arc_path.c_str());
+      return 0;
+    }
   }
   sz = sz ? sz : 1;
   need_pack_ |= (!!sz);
+  Trace_Count("pack_files", 1);
+  Trace_Count("pack_bytes", (LONGLONG)sz);
   return sz;
 }
 
 bool PackInstall::ParseConfigIni() {
-  compress_param_ = L"-t7z -m0=lzma:fb=273 -mx=9 -md=256M -ms=4G -mmt=2";
+  compress_param_ = kDefaultCompressParam;
+  compress_auto_ = false;
+  compress_auto_sample_mb_ = 64;
+  compress_auto_budget_s_ = 30;
+  compress_auto_max_time_s_ = 0;
+  compress_auto_min_gain_ = 1.0;
   pre_extract_plugins_.clear();
+  plugin_carry_.clear();
+  staging_threads_ = 0;
+  file_hash_alg_ = HASH_ALG_COUNT;
+  pack_cache_dir_.clear();
+  pack_cache_max_mb_ = 4096;
+  shards_ = 1;
+  shards_auto_ = false;
+  staging_collision_fatal_ = false;
+  sevenzip_jobs_ = 0;
+  sevenzip_timeout_s_ = 0;
+  // 环境变量先开启追踪，config.ini的[trace]节可另指定输出路径
+  Trace_StartFromEnv();
   #ifdef DBG_SOLUTION
   std::wstring config_path = L"config.ini";
 #else
@@ -340,8 +812,43 @@ bool PackInstall::ParseConfigIni() {
   // INI解析
   wchar_t* context = NULL;
   wchar_t* line = wcstok_s(buffer, L"\r\n", &context);
-  bool in_compress_param = false;
   bool in_pre_extract_plugins = false;
+  bool in_plugin_carry = false;
+  // 单值节：只取节内第一个非空行
+  std::wstring staging_threads;
+  std::wstring file_hash;
+  std::wstring pack_cache_size;
+  std::wstring shards;
+  std::wstring sevenzip_jobs;
+  std::wstring sevenzip_timeout;
+  std::wstring sevenzip_backend;
+  std::wstring trace_path;
+  std::wstring auto_sample;
+  std::wstring auto_budget;
+  std::wstring auto_max_time;
+  std::wstring auto_min_gain;
+  std::wstring staging_collision;
+  const struct {
+    const wchar_t* section;
+    std::wstring* value;
+  } value_sections[] = {
+    { L"compress_param", &compress_param_ },
+    { L"staging_threads", &staging_threads },
+    { L"file_hash", &file_hash },
+    { L"pack_cache", &pack_cache_dir_ },
+    { L"pack_cache_size", &pack_cache_size },
+    { L"shards", &shards },
+    { L"7z_jobs", &sevenzip_jobs },
+    { L"7z_timeout", &sevenzip_timeout },
+    { L"7z_backend", &sevenzip_backend },
+    { L"trace", &trace_path },
+    { L"compress_auto_sample", &auto_sample },
+    { L"compress_auto_budget", &auto_budget },
+    { L"compress_auto_max_time", &auto_max_time },
+    { L"compress_auto_min_gain", &auto_min_gain },
+    { L"staging_collision", &staging_collision },
+  };
+  std::wstring* current_value = nullptr;
 
   while (line) {
     // 跳过前导空白
@@ -360,31 +867,33 @@ bool PackInstall::ParseConfigIni() {
         while (*section == L' ' || *section == L'\t') ++section;
         wchar_t* section_end = section + wcslen(section) - 1;
         while (section_end > section && (*section_end == L' ' || *section_end == L'\t')) *section_end-- = L'\0';
-        if (wcscmp(section, L"compress_param") == 0) {
-          in_compress_param = true;
-          in_pre_extract_plugins = false;
-        }
-        else if (wcscmp(section, L"pre_extract_plugins") == 0) {
-          in_compress_param = false;
-          in_pre_extract_plugins = true;
-        }
-        else {
-          in_compress_param = false;
-          in_pre_extract_plugins = false;
+        current_value = nullptr;
+        in_pre_extract_plugins = (wcscmp(section, L"pre_extract_plugins") == 0);
+        in_plugin_carry = (wcscmp(section, L"plugin_carry") == 0);
+        for (const auto& vs : value_sections) {
+          if (wcscmp(section, vs.section) == 0) current_value = vs.value;
         }
       }
     }
     else {
-      if (in_compress_param) {
+      if (current_value) {
         // 只取第一个非空行
         wchar_t* value = line;
         while (*value == L' ' || *value == L'\t') ++value;
         wchar_t* value_end = value + wcslen(value) - 1;
         while (value_end > value && (*value_end == L' ' || *value_end == L'\t')) *value_end-- = L'\0';
         if (*value) {
-          compress_param_ = value;
-          in_compress_param = false; // 只取一行
+          *current_value = value;
+          current_value = nullptr; // 只取一行
+        }
+      }
+      else if (in_plugin_carry) {
+        std::wstring pattern(line);
+        while (!pattern.empty() && (pattern.back() == L' ' || pattern.back() == L'\t')) pattern.pop_back();
+        for (auto& ch : pattern) {
+          if (ch == L'/') ch = L'\\';
         }
+        plugin_carry_.push_back(pattern);
       }
       else if (in_pre_extract_plugins) {
         wchar_t* colon = wcschr(line, L':');
@@ -415,7 +924,48 @@ bool PackInstall::ParseConfigIni() {
     line = wcstok_s(NULL, L"\r\n", &context);
   }
   free(buffer);
-  XNSIS_LOG(L"ParseConfigIni completed: compress_param=%s, pre_extract_plugins_count=%zu", compress_param_.c_str(), pre_extract_plugins_.size());
+  if (!staging_threads.empty()) {
+    staging_threads_ = (unsigned)wcstoul(staging_threads.c_str(), nullptr, 10);
+  }
+  if (!file_hash.empty() && _wcsicmp(file_hash.c_str(), L"none") != 0) {
+    file_hash_alg_ = Hash_AlgFromName(file_hash.c_str());
+    if (file_hash_alg_ == HASH_ALG_COUNT) XNSIS_LOG(L"Unknown file_hash algorithm: %s, file digests disabled", file_hash.c_str());
+  }
+  if (!pack_cache_size.empty()) {
+    pack_cache_max_mb_ = wcstoull(pack_cache_size.c_str(), nullptr, 10);
+  }
+  if (!sevenzip_jobs.empty()) {
+    sevenzip_jobs_ = (unsigned)wcstoul(sevenzip_jobs.c_str(), nullptr, 10);
+  }
+  if (!sevenzip_timeout.empty()) {
+    sevenzip_timeout_s_ = (uint32_t)wcstoul(sevenzip_timeout.c_str(), nullptr, 10);
+  }
+  backend_ = &process_backend_;
+  if (_wcsicmp(sevenzip_backend.c_str(), L"inproc") == 0) {
+#ifdef XNSIS_INPROC_7Z
+    backend_ = Archive_InProcessBackend();
+#else
+    XNSIS_LOG(L"In-process 7z backend not built in, falling back to 7z.exe");
+#endif
+  }
+  if (!trace_path.empty()) Trace_Start(FullPath(trace_path).c_str());
+  staging_collision_fatal_ = _wcsicmp(staging_collision.c_str(), L"error") == 0;
+  compress_auto_ = _wcsicmp(compress_param_.c_str(), L"auto") == 0;
+  if (!auto_sample.empty()) compress_auto_sample_mb_ = (std::max)(1ull, wcstoull(auto_sample.c_str(), nullptr, 10));
+  if (!auto_budget.empty()) compress_auto_budget_s_ = (uint32_t)wcstoul(auto_budget.c_str(), nullptr, 10);
+  if (!auto_max_time.empty()) compress_auto_max_time_s_ = (uint32_t)wcstoul(auto_max_time.c_str(), nullptr, 10);
+  if (!auto_min_gain.empty()) compress_auto_min_gain_ = (std::max)(0.0, wcstod(auto_min_gain.c_str(), nullptr));
+  if (!shards.empty()) {
+    shards_auto_ = _wcsicmp(shards.c_str(), L"auto") == 0;
+    if (!shards_auto_) shards_ = (std::max)(1u, (std::min)(kMaxShards, (unsigned)wcstoul(shards.c_str(), nullptr, 10)));
+  }
+  XNSIS_LOG(L"ParseConfigIni completed: compress_param=%s%s, pre_extract_plugins_count=%zu, plugin_carry_count=%zu, staging_threads=%u, file_hash=%s, pack_cache=%s (%llu MB), shards=%s, backend=%s",
+    compress_param_.c_str(), compress_auto_ ? (L" (sample=" + std::to_wstring(compress_auto_sample_mb_) + L"MB, budget=" +
+      std::to_wstring(compress_auto_budget_s_) + L"s)").c_str() : L"",
+    pre_extract_plugins_.size(), plugin_carry_.size(), staging_threads_,
+    file_hash_alg_ == HASH_ALG_COUNT ? L"none" : Hash_AlgName(file_hash_alg_),
+    pack_cache_dir_.empty() ? L"none" : pack_cache_dir_.c_str(), pack_cache_max_mb_,
+    shards_auto_ ? L"auto" : std::to_wstring(shards_).c_str(), backend_->name);
   return true;
 }
 
@@ -472,56 +1022,203 @@ BOOL WaitForDeleteFile(const LPCTSTR lpFileName, DWORD dwMilliseconds)
   return bSuccess;
 }
 
+// 批量删除：每轮尝试删除所有剩余文件，全部删除或共用的超时到期后返回，失败的文件留在pending中
+static bool WaitForDeleteFiles(std::vector<std::wstring>& pending, DWORD dwMilliseconds) {
+  const DWORD dwStartTick = GetTickCount();
+  DWORD dwRetryInterval = 100;
+  while (true) {
+    std::vector<std::wstring> remaining;
+    for (const auto& path : pending) {
+      if (!DeleteFileW(path.c_str()) && GetLastError() != ERROR_FILE_NOT_FOUND) remaining.push_back(path);
+    }
+    pending.swap(remaining);
+    if (pending.empty()) return true;
+    if (GetTickCount() - dwStartTick > dwMilliseconds) return false;
+    if (dwRetryInterval < 1000) dwRetryInterval *= 2;
+    Sleep(dwRetryInterval);
+  }
+}
+
+bool PackInstall::IsCarriedPlugin(const std::wstring& path) const {
+  for (const auto& pattern : plugin_carry_) {
+    if (WildcardMatch(pattern.c_str(), path.c_str())) return true;
+  }
+  return false;
+}
+
+// 把pre_extract_plugins_中的插件解压到各自的.nsisbin目录。各插件由7z执行器并发解压，
+// 结果按配置顺序汇总；解压失败的插件照常作为普通文件打包，暂存的插件文件最后统一删除
+bool PackInstall::ExpandPlugins() {
+  TRACE_SCOPE("pack", "ExpandPlugins");
+  struct PluginJob {
+    std::wstring src;          // 解压来源：暂存目录中的插件，免暂存时为源文件
+    std::wstring nsisbin_dir;
+    std::wstring cmd;
+    ManifestEntry* entry;
+    bool from_source;
+    bool skipped;              // 不存在或与前面的插件重复
+    bool ok;
+  };
+  std::vector<PluginJob> jobs(pre_extract_plugins_.size());
+  std::set<std::wstring> seen;
+  for (size_t i = 0; i < pre_extract_plugins_.size(); ++i) {
+    const PreExtractPlugin& plugin = pre_extract_plugins_[i];
+    PluginJob& job = jobs[i];
+    // 检查插件文件是否存在于临时目录中；免暂存的插件直接从源位置解压
+    job.src = temp_dir_ + L"\\" + plugin.path;
+    job.nsisbin_dir = job.src + L".nsisbin";
+    job.entry = FindManifestEntry(plugin.path);
+    job.from_source = job.entry && !job.entry->staged;
+    job.ok = false;
+    if (job.from_source) job.src = job.entry->src;
+    job.skipped = !seen.insert(StagingKey(plugin.path)).second;
+    if (job.skipped) {
+      XNSIS_LOG(L"Duplicate pre_extract_plugins entry ignored: %s", plugin.path.c_str());
+      continue;
+    }
+    // 原样打包的插件不展开，安装时也就不用重新压缩
+    job.skipped = IsCarriedPlugin(plugin.path);
+    if (job.skipped) {
+      XNSIS_LOG(L"Plugin carried as is: %s", plugin.path.c_str());
+      continue;
+    }
+    // 不在清单中的插件无处标记已展开，不展开
+    job.skipped = !job.entry || (!IsDirExists(job.src) && GetFileAttributesW(job.src.c_str()) == INVALID_FILE_ATTRIBUTES);
+    if (job.skipped) XNSIS_LOG(L"Plugin file not found: %s", job.src.c_str());
+  }
+
+  // 创建.nsisbin文件夹后提交7z解压，全部提交后再按顺序等待
+  std::vector<ProcessTicket> tickets(jobs.size());
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    PluginJob& job = jobs[i];
+    if (job.skipped) continue;
+    if (!DirCache_Ensure(&dir_cache_, job.nsisbin_dir.c_str())) {
+      XNSIS_LOG(L"Failed to create nsisbin directory: %s", job.nsisbin_dir.c_str());
+      continue;
+    }
+    job.cmd = L"x ";
+    job.cmd += pre_extract_plugins_[i].compress_param;
+    job.cmd += L" \"" + job.src + L"\" -o\"" + job.nsisbin_dir + L"\" -aos";
+    // 进程内后端没有进程启动开销，直接逐个解压
+    if (backend_ == &process_backend_) tickets[i] = Submit7z(job.cmd);
+    else job.ok = SyncCall7zSync(job.cmd);
+  }
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (tickets[i]) jobs[i].ok = Await7z(tickets[i], jobs[i].cmd);
+  }
+
+  uint32_t failed = 0, expanded = 0;
+  std::vector<std::wstring> to_delete;
+  for (auto& job : jobs) {
+    if (job.skipped) continue;
+    if (!job.ok) {
+      XNSIS_LOG(L"Failed to extract plugin: %s", job.src.c_str());
+      ++failed;
+      continue;
+    }
+    if (job.entry) job.entry->expanded = true;
+    if (!job.from_source) to_delete.push_back(job.src);
+    ++expanded;
+    XNSIS_LOG_DEBUG(L"Successfully extracted plugin: %s to %s", job.src.c_str(), job.nsisbin_dir.c_str());
+  }
+
+  // 已展开的插件不再单独打包，从暂存目录删除
+  if (!WaitForDeleteFiles(to_delete, 5000)) {
+    for (const auto& path : to_delete) XNSIS_LOG(L"Failed to delete plugin: %s", path.c_str());
+    return false;
+  }
+  XNSIS_LOG(L"ExpandPlugins completed: expanded=%u, failed=%u, skipped=%zu",
+    expanded, failed, jobs.size() - expanded - failed);
+  return true;
+}
+
 bool PackInstall::GenerateInstall7z(CEXEBuild* build, int& build_compress) {
   if (completed_) {
     XNSIS_LOG(L"GenerateInstall7z called after completed");
     return false;
   }
   completed_ = true;
+  TRACE_SCOPE("pack", "GenerateInstall7z");
   GetInstall7zPath();
 
-  // 先处理pre_extract_plugins_列表中的文件
-  for (const auto& plugin : pre_extract_plugins_) {
-    // 检查插件文件是否存在于临时目录中
-    std::wstring plugin_path = temp_dir_ + L"\\" + plugin.path;
-    if (!IsDirExists(plugin_path) && GetFileAttributesW(plugin_path.c_str()) == INVALID_FILE_ATTRIBUTES) {
-      XNSIS_LOG(L"Plugin file not found: %s", plugin_path.c_str());
-      continue;
-    }
+  // 等待所有暂存复制完成
+  bool staged;
+  {
+    TRACE_SCOPE("pack", "WaitStaging");
+    staged = WaitStaging();
+  }
+  if (!staged) {
+    XNSIS_LOG(L"WaitStaging failed");
+    return false;
+  }
 
-    // 创建.nsisbin文件夹
-    std::wstring nsisbin_dir = temp_dir_ + L"\\" + plugin.path + L".nsisbin";
-    if (!CreateDirRecursive(nsisbin_dir)) {
-      XNSIS_LOG(L"Failed to create nsisbin directory: %s", nsisbin_dir.c_str());
-      continue;
-    }
+  // 先处理pre_extract_plugins_列表中的文件
+  if (!ExpandPlugins()) {
+    XNSIS_LOG(L"ExpandPlugins failed");
+    return false;
+  }
 
-    // 使用7z解压插件文件到.nsisbin文件夹
-    std::wstring extract_cmd = L"x ";
-    extract_cmd += plugin.compress_param;
-    extract_cmd += L" \"" + plugin_path + L"\" -o\"" + nsisbin_dir + L"\" -aos";
+  // 记录逐文件哈希，须在去重删除重复的暂存文件之前
+  if (!RecordFileDigests()) {
+    XNSIS_LOG(L"RecordFileDigests failed");
+    return false;
+  }
 
-    if (!SyncCall7zSync(extract_cmd.c_str())) {
-      XNSIS_LOG(L"Failed to extract plugin: %s", plugin_path.c_str());
-      continue;
-    }
+  // 相同内容的文件只打包一份
+  if (!DeduplicateManifest()) {
+    XNSIS_LOG(L"DeduplicateManifest failed");
+    return false;
+  }
 
-    if (!WaitForDeleteFile((LPCTSTR)plugin_path.c_str(), 5000)) {
-      XNSIS_LOG(L"Failed to delete plugin: %s", plugin_path.c_str());
+  // 按大小把待打包文件分到各分片；分片k（k>0）与install.7z同目录，名为install_xxx_k.7z
+  std::vector<PackItem> items = CollectPackItems();
+  std::vector<std::vector<PackItem>> shards = PartitionShards(items, ResolveShardCount(items));
+  std::wstring stem = install7z_path_.substr(0, install7z_path_.size() - 3);  // 去掉".7z"
+  std::wstring name_stem = install7z_name_.substr(0, install7z_name_.size() - 3);
+  shard_paths_.assign(1, install7z_path_);
+  for (size_t k = 1; k < shards.size(); ++k) {
+    shard_paths_.push_back(stem + L"_" + std::to_wstring(k) + L".7z");
+    if (DistInfo_AddShard(&distinfo_, (name_stem + L"_" + std::to_wstring(k) + L".7z").c_str()) < 0) {
+      XNSIS_LOG(L"DistInfo_AddShard failed: %zu", k);
       return false;
     }
-
-    XNSIS_LOG(L"Successfully extracted plugin: %s to %s", plugin_path.c_str(), nsisbin_dir.c_str());
   }
 
-  // 打包所有文件到install.7z
-  std::wstring param = GetConfig7zParam();
-  std::wstring cmd = L"a ";
-  cmd += param;
-  cmd += L" \"" + install7z_path_ + L"\" \"" + temp_dir_ + L"\\*\"";
-  if (!SyncCall7zSync(cmd.c_str())) {
-    XNSIS_LOG(L"SyncCall7zSync 7z failed: %s", cmd.c_str());
-    return false;
+  // 打包所有文件到install.7z及其分片；内容和压缩参数都没变时直接复用缓存中上次的结果
+  if (pack_cache_dir_.empty()) {
+    if (!CompressInstall7z(shards)) return false;
+  }
+  else {
+    TRACE_SCOPE("pack", "PackCache");
+    PackCache cache;
+    BYTE key[PACKCACHE_KEY_SIZE];
+    bool use_cache = PackCache_Init(&cache, FullPath(pack_cache_dir_).c_str(), pack_cache_max_mb_ * 1024 * 1024) &&
+      ComputePackKey(items, shards.size(), key);
+    // 分片k的缓存键为hash(key, k)，所有分片都命中才算命中
+    std::vector<std::vector<BYTE>> shard_keys(shards.size(), std::vector<BYTE>(PACKCACHE_KEY_SIZE));
+    for (size_t k = 0; k < shards.size() && use_cache; ++k) {
+      BYTE buf[PACKCACHE_KEY_SIZE + sizeof(uint64_t)];
+      uint64_t index = k;
+      memcpy(buf, key, PACKCACHE_KEY_SIZE);
+      memcpy(buf + PACKCACHE_KEY_SIZE, &index, sizeof(index));
+      if (k == 0) memcpy(shard_keys[k].data(), key, PACKCACHE_KEY_SIZE);
+      else use_cache = Hash_Buffer(HASH_ALG_FAST128, buf, sizeof(buf), shard_keys[k].data()) != 0;
+    }
+    bool hit = use_cache;
+    for (size_t k = 0; k < shards.size() && hit; ++k) {
+      hit = PackCache_Fetch(&cache, shard_keys[k].data(), shard_paths_[k].c_str()) != 0;
+    }
+    if (!hit) {
+      // 部分命中时已取出的分片作废，7z a会往已有归档里追加
+      for (const auto& path : shard_paths_) DeleteFileW(path.c_str());
+      if (!CompressInstall7z(shards)) return false;
+      for (size_t k = 0; k < shards.size() && use_cache; ++k) {
+        PackCache_Store(&cache, shard_keys[k].data(), shard_paths_[k].c_str());
+      }
+    }
+    XNSIS_LOG(L"Pack cache %s: dir=%s, shards=%zu, entries=%lu, bytes=%llu, evicted=%lu (%llu bytes)",
+      !use_cache ? L"unavailable" : hit ? L"hit" : L"miss", cache.dir, shards.size(), cache.entry_count, cache.total_bytes,
+      cache.evicted, cache.evicted_bytes);
   }
   // 写分发信息
   std::wstring distinfo_path = GetDistInfoPath();
@@ -532,15 +1229,22 @@ bool PackInstall::GenerateInstall7z(CEXEBuild* build, int& build_compress) {
     return false;
   }
 
-  // 将pre_extract_plugins_信息添加到distinfo中
+  // 将pre_extract_plugins_信息添加到distinfo中：只记录确实展开了的插件，展开失败或不存在的插件按普通文件打包，
+  // 安装时也按普通文件处理
   for (const auto& plugin : pre_extract_plugins_) {
+    const ManifestEntry* entry = FindManifestEntry(plugin.path);
+    if (!entry || !entry->expanded) continue;
     if (DistInfo_AddPlugin(&distinfo_, plugin.path.c_str(), plugin.compress_param.c_str()) < 0) {
       XNSIS_LOG(L"DistInfo_AddPlugin failed: %s", plugin.path.c_str());
       return false;
     }
   }
 
-  if (!DistInfo_Save(&distinfo_, distinfo_path.c_str())) {
+  TraceSpan span;
+  Trace_SpanBegin(&span, "pack", "DistInfo_Save");
+  int saved = DistInfo_Save(&distinfo_, distinfo_path.c_str());
+  Trace_SpanEnd(&span);
+  if (!saved) {
     XNSIS_LOG(L"DistInfo_Save failed");
     return false;
   }
@@ -553,7 +1257,7 @@ bool PackInstall::GenerateInstall7z(CEXEBuild* build, int& build_compress) {
     return build->doParse((TCHAR*)linedata.get());
     };
   static const int cmd_count = 10;
-  std::wstring cmd_list[cmd_count];
+  std::vector<std::wstring> cmd_list(cmd_count);
   cmd_list[0] = _T("Section \"xnsis_sec\"");
   cmd_list[1] = _T("SetCompress off");
   cmd_list[2] = _T("SetOutPath \"$INSTDIR\"");
@@ -572,7 +1276,12 @@ bool PackInstall::GenerateInstall7z(CEXEBuild* build, int& build_compress) {
   } break;
   }
   cmd_list[9] = _T("SectionEnd");
-  for (int i = 0; i < cmd_count; ++i) {
+  // 其余分片与install.7z一样只保留在安装包数据中，安装时释放到同一目录
+  for (size_t k = 1; k < shard_paths_.size(); ++k) {
+    cmd_list.insert(cmd_list.begin() + 4 + k, std::wstring(_T("ReserveFile ")) + shard_paths_[k]);
+  }
+  TRACE_SCOPE("pack", "InjectScript");
+  for (size_t i = 0; i < cmd_list.size(); ++i) {
     if (cmd_list[i].empty()) {
       continue;
     }
@@ -584,6 +1293,564 @@ bool PackInstall::GenerateInstall7z(CEXEBuild* build, int& build_compress) {
   return true;
 }
 
+// 并行计算所有待打包文件的大小和哈希，写入distinfo供安装后校验。
+// 跨fake目录共享同一份暂存文件的同名文件也记录同一个哈希；展开的插件安装时会重新压缩，不记录
+bool PackInstall::RecordFileDigests() {
+  if (file_hash_alg_ == HASH_ALG_COUNT) return true;
+  TRACE_SCOPE("pack", "RecordFileDigests");
+  std::vector<InstallFileDigest> digests(manifest_.size());
+  std::atomic<uint32_t> failed{ 0 };
+  {
+    TaskGroup group(GetStagingPool());
+    for (size_t i = 0; i < manifest_.size(); ++i) {
+      if (manifest_[i].expanded) continue;
+      group.Run([this, &digests, &failed, i]() {
+        memset(digests[i].digest, 0, sizeof(digests[i].digest));
+        if (!Hash_FileDigest(file_hash_alg_, PayloadPath(manifest_[i]).c_str(), &digests[i].size, digests[i].digest)) failed++;
+      });
+    }
+  }
+  if (failed) {
+    XNSIS_LOG(L"Hash_FileDigest failed for %u files", failed.load());
+    return false;
+  }
+  uint64_t recorded = 0;
+  for (DWORD i = 0; i < distinfo_.dir_count; ++i) {
+    const InstallFakeDir& dir = distinfo_.dirs[i];
+    for (DWORD j = 0; j < dir.file_count; ++j) {
+      const ManifestEntry* entry = FindManifestEntry(dir.file_list[j]);
+      if (!entry || entry->expanded) continue;
+      const InstallFileDigest& digest = digests[entry - manifest_.data()];
+      if (DistInfo_SetFileDigest(&distinfo_, i, j, file_hash_alg_, digest.size, digest.digest) != 0) {
+        XNSIS_LOG(L"DistInfo_SetFileDigest failed: %s", dir.file_list[j]);
+        return false;
+      }
+      ++recorded;
+    }
+  }
+  XNSIS_LOG(L"RecordFileDigests completed: alg=%s, files=%llu", Hash_AlgName(file_hash_alg_), recorded);
+  return true;
+}
+
+// 内容去重：只对大小相同的文件并行计算哈希，内容相同的文件只保留清单中最靠前的一份，
+// 其余在distinfo中引用该份，安装时由它复制出来。已记录128位逐文件哈希时直接复用
+bool PackInstall::DeduplicateManifest() {
+  TRACE_SCOPE("pack", "DeduplicateManifest");
+  std::unordered_map<uint64_t, std::vector<size_t>> by_size;
+  for (size_t i = 0; i < manifest_.size(); ++i) {
+    const ManifestEntry& entry = manifest_[i];
+    if (entry.expanded || entry.size == 0) continue;
+    by_size[entry.size].push_back(i);
+  }
+  std::vector<size_t> candidates;
+  for (const auto& item : by_size) {
+    if (item.second.size() > 1) candidates.insert(candidates.end(), item.second.begin(), item.second.end());
+  }
+  if (candidates.empty()) return true;
+  std::sort(candidates.begin(), candidates.end());
+
+  std::vector<ContentHash> hashes(candidates.size());
+  std::atomic<uint32_t> failed{ 0 };
+  bool reuse = file_hash_alg_ != HASH_ALG_COUNT && Hash_DigestSize(file_hash_alg_) == CONTENT_HASH_SIZE;
+  {
+    TaskGroup group(GetStagingPool());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      const ManifestEntry& entry = manifest_[candidates[i]];
+      const InstallFileDigest* digest = reuse ? DistInfo_GetFileDigest(&distinfo_, entry.fake_idx, entry.file_idx) : nullptr;
+      if (digest) {
+        memcpy(hashes[i].bytes, digest->digest, CONTENT_HASH_SIZE);
+        continue;
+      }
+      group.Run([this, &candidates, &hashes, &failed, i]() {
+        if (!Hash_File(PayloadPath(manifest_[candidates[i]]).c_str(), &hashes[i])) failed++;
+      });
+    }
+  }
+  if (failed) {
+    XNSIS_LOG(L"Hash_File failed for %u files", failed.load());
+    return false;
+  }
+
+  // 大小和哈希相同的先作为候选：哈希可能是非加密的FAST128，也可能复用了distinfo中记录的摘要，
+  // 删除重复文件之前逐字节确认与保留的那份相同，哈希碰撞时两份都打包
+  std::unordered_map<std::string, size_t> blobs;
+  std::vector<std::pair<size_t, size_t>> matches;  // (清单下标, 保留的清单下标)
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const ManifestEntry& entry = manifest_[candidates[i]];
+    std::string key((const char*)&entry.size, sizeof(entry.size));
+    key.append((const char*)hashes[i].bytes, sizeof(hashes[i].bytes));
+    auto it = blobs.find(key);
+    if (it == blobs.end()) blobs.emplace(key, candidates[i]);
+    else matches.emplace_back(candidates[i], it->second);
+  }
+  std::vector<int> same(matches.size());
+  std::vector<DWORD> errors(matches.size());
+  {
+    TaskGroup group(GetStagingPool());
+    for (size_t i = 0; i < matches.size(); ++i) {
+      group.Run([this, &matches, &same, &errors, i]() {
+        same[i] = FileOps_SameContent(PayloadPath(manifest_[matches[i].first]).c_str(),
+          PayloadPath(manifest_[matches[i].second]).c_str());
+        errors[i] = same[i] < 0 ? GetLastError() : ERROR_SUCCESS;
+      });
+    }
+  }
+
+  uint32_t dup_count = 0, collisions = 0;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    ManifestEntry& entry = manifest_[matches[i].first];
+    if (same[i] < 0) {
+      XNSIS_LOG(L"Failed to compare duplicate candidate: %s, error=%lu", entry.rel.c_str(), errors[i]);
+      return false;
+    }
+    if (!same[i]) {
+      XNSIS_LOG_WARN(L"Hash collision, packing both: %s, %s", entry.rel.c_str(), manifest_[matches[i].second].rel.c_str());
+      ++collisions;
+      continue;
+    }
+    const ManifestEntry& blob = manifest_[matches[i].second];
+    if (DistInfo_SetFileBlob(&distinfo_, entry.fake_idx, entry.file_idx, blob.fake_idx, blob.file_idx) != 0) {
+      XNSIS_LOG(L"DistInfo_SetFileBlob failed: %s", entry.rel.c_str());
+      return false;
+    }
+    entry.dup_of = (long long)matches[i].second;
+    if (entry.staged && !DeleteFileW(PayloadPath(entry).c_str())) {
+      XNSIS_LOG(L"Failed to delete duplicate: %s, error=%lu", entry.rel.c_str(), GetLastError());
+    }
+    dedup_saved_bytes_ += entry.size;
+    ++dup_count;
+  }
+  XNSIS_LOG(L"DeduplicateManifest completed: hashed=%zu, duplicates=%u, collisions=%u, saved_bytes=%llu",
+    candidates.size(), dup_count, collisions, dedup_saved_bytes_);
+  return true;
+}
+
+// 收集待打包的文件：清单中未展开、非重复的文件，加上插件展开出的.nsisbin目录
+std::vector<PackItem> PackInstall::CollectPackItems() {
+  std::vector<PackItem> items;
+  for (size_t i = 0; i < manifest_.size(); ++i) {
+    const ManifestEntry& entry = manifest_[i];
+    if (entry.expanded || entry.dup_of >= 0) continue;
+    items.push_back(PackItem{ entry.rel, entry.staged ? temp_dir_ : entry.root, entry.size, i, items.size() });
+  }
+  for (const auto& plugin : pre_extract_plugins_) {
+    std::wstring nsisbin_dir = temp_dir_ + L"\\" + plugin.path + L".nsisbin";
+    if (!IsDirExists(nsisbin_dir)) continue;
+    size_t unit = items.size();
+    ForEachFileRecursive(nsisbin_dir, temp_dir_, [&](const std::wstring& abs, const std::wstring& rel) {
+      WIN32_FILE_ATTRIBUTE_DATA fad;
+      uint64_t size = 0;
+      if (GetFileAttributesExW(abs.c_str(), GetFileExInfoStandard, &fad)) {
+        size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+      }
+      items.push_back(PackItem{ rel, temp_dir_, size, SIZE_MAX, unit });
+      });
+  }
+  return items;
+}
+
+// 分片数：配置为auto时按CPU核数的一半和数据量（每片至少kShardAutoBytes）取较小者
+unsigned PackInstall::ResolveShardCount(const std::vector<PackItem>& items) const {
+  if (!shards_auto_) return shards_;
+  uint64_t total = 0;
+  for (const auto& item : items) total += item.size;
+  uint64_t by_size = total / kShardAutoBytes;
+  unsigned by_cpu = WorkStealingPool::DefaultWorkerCount() / 2;
+  unsigned count = (unsigned)(std::min)((uint64_t)by_cpu, by_size);
+  return (std::max)(1u, (std::min)(kMaxShards, count));
+}
+
+// 按大小均衡分片（LPT）：单位按大小降序、归档名升序依次放入当前最小的分片，
+// 结果只取决于文件内容，与线程调度和文件添加顺序无关；单位数少于分片数时相应减少分片
+std::vector<std::vector<PackItem>> PackInstall::PartitionShards(const std::vector<PackItem>& items, unsigned count) {
+  struct Unit {
+    std::wstring rel;
+    uint64_t size;
+    std::vector<size_t> members;
+  };
+  std::vector<Unit> units;
+  std::unordered_map<size_t, size_t> unit_index;
+  for (size_t i = 0; i < items.size(); ++i) {
+    auto it = unit_index.find(items[i].unit);
+    if (it == unit_index.end()) {
+      it = unit_index.emplace(items[i].unit, units.size()).first;
+      units.push_back(Unit{ items[i].rel, 0, {} });
+    }
+    Unit& unit = units[it->second];
+    unit.size += items[i].size;
+    if (items[i].rel < unit.rel) unit.rel = items[i].rel;
+    unit.members.push_back(i);
+  }
+  count = (unsigned)(std::max)((size_t)1, (std::min)((size_t)count, units.size()));
+  std::sort(units.begin(), units.end(), [](const Unit& a, const Unit& b) {
+    return a.size != b.size ? a.size > b.size : a.rel < b.rel;
+    });
+
+  std::vector<std::vector<PackItem>> shards(count);
+  std::vector<uint64_t> loads(count, 0);
+  for (const auto& unit : units) {
+    size_t k = std::min_element(loads.begin(), loads.end()) - loads.begin();
+    loads[k] += unit.size;
+    for (size_t i : unit.members) shards[k].push_back(items[i]);
+  }
+  if (count > 1) {
+    uint64_t max_load = *std::max_element(loads.begin(), loads.end());
+    uint64_t min_load = *std::min_element(loads.begin(), loads.end());
+    XNSIS_LOG(L"PartitionShards: %zu files in %zu units -> %u shards, max=%llu, min=%llu bytes",
+      items.size(), units.size(), count, max_load, min_load);
+  }
+  return shards;
+}
+
+// 读取src中从offset开始的bytes字节追加到dst，作为试压缩的样本
+static bool ReadFileSlice(const std::wstring& src, uint64_t offset, uint64_t bytes, std::vector<BYTE>& dst) {
+  HANDLE hSrc = CreateFileW(src.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hSrc == INVALID_HANDLE_VALUE) return false;
+  size_t base = dst.size();
+  dst.resize(base + (size_t)bytes);
+  LARGE_INTEGER pos;
+  pos.QuadPart = (LONGLONG)offset;
+  bool ok = SetFilePointerEx(hSrc, pos, NULL, FILE_BEGIN) != 0;
+  BYTE* p = dst.data() + base;
+  while (ok && bytes) {
+    DWORD want = (DWORD)(std::min)((uint64_t)(1u << 30), bytes);
+    DWORD read = 0;
+    ok = ReadFile(hSrc, p, want, &read, NULL) && read == want;
+    p += read;
+    bytes -= read;
+  }
+  CloseHandle(hSrc);
+  if (!ok) dst.resize(base);
+  return ok;
+}
+
+// 试压缩结果的校验：7z -so解压出的数据逐段与内存中的样本比对
+struct SampleCheck {
+  std::vector<const std::vector<BYTE>*> expect;
+  std::vector<size_t> offsets;
+};
+
+static int CheckSampleChunk(void* arg, DWORD index, const void* data, size_t size) {
+  SampleCheck* check = (SampleCheck*)arg;
+  const std::vector<BYTE>& expect = *check->expect[index];
+  size_t& offset = check->offsets[index];
+  if (!data) return offset == expect.size();
+  if (size > expect.size() - offset || memcmp(expect.data() + offset, data, size) != 0) return 0;
+  offset += size;
+  return 1;
+}
+
+static double PerfSeconds() {
+  LARGE_INTEGER now, freq;
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&freq);
+  return (double)now.QuadPart / (double)freq.QuadPart;
+}
+
+// auto选参的候选压缩参数，大致按从快到慢排列。每个7z进程的线程数为硬件线程数按分片均分；
+// 线程数受可用内存限制，按参数估算的内存与安装端、分片并行压缩相同（Archive_EstimateEncoderMemory）
+std::vector<std::wstring> PackInstall::AutoCandidates(size_t shard_count) const {
+  unsigned threads = (std::max)(1u, WorkStealingPool::DefaultWorkerCount() / (unsigned)(std::max)((size_t)1, shard_count));
+  uint64_t budget = UINT64_MAX;
+  MEMORYSTATUSEX ms;
+  ms.dwLength = sizeof(ms);
+  if (GlobalMemoryStatusEx(&ms)) budget = ms.ullAvailPhys / 4 * 3 / (std::max)((size_t)1, shard_count);
+  const struct {
+    int level;
+    unsigned dict_mb;  // 0表示用该级别的默认字典
+  } levels[] = { { 1, 0 }, { 5, 16 }, { 7, 64 }, { 9, 256 } };
+  std::vector<std::wstring> candidates;
+  for (const auto& lv : levels) {
+    std::wstring base = L"-t7z -m0=lzma2 -mx=" + std::to_wstring(lv.level);
+    if (lv.dict_mb) base += L" -md=" + std::to_wstring(lv.dict_mb) + L"m";
+    std::wstring param;
+    for (unsigned t = threads; t >= 1; --t) {
+      param = base + L" -mmt=" + std::to_wstring(t);
+      if (Archive_EstimateEncoderMemory(param.c_str()) <= budget) break;
+      param.clear();
+    }
+    if (!param.empty()) candidates.push_back(param);
+  }
+  // 原来的固定参数（单流LZMA，压缩率最高、最慢）也参与比较
+  if (Archive_EstimateEncoderMemory(kDefaultCompressParam) <= budget) candidates.push_back(kDefaultCompressParam);
+  return candidates;
+}
+
+// [compress_param]为auto：从待打包文件中取一份样本（按归档名哈希打乱后依次取各文件中间的一段，
+// 共约[compress_auto_sample]MB），按从快到慢的顺序逐个试压缩候选参数，累计耗时超出预算后不再尝试更慢的。
+// 选择时按实测耗时从快到慢比较：更慢的参数须比当前选中的再小[compress_auto_min_gain]%才换用，
+// 按样本耗时估算的整体压缩时间超过[compress_auto_max_time]的不选。任何一步失败都回退到默认参数
+void PackInstall::TuneCompressParam(const std::vector<std::vector<PackItem>>& shards) {
+  TRACE_SCOPE("pack", "TuneCompressParam");
+  double start = PerfSeconds();
+  compress_param_ = kDefaultCompressParam;
+
+  uint64_t total = 0;
+  std::vector<const PackItem*> order;
+  for (const auto& shard : shards) {
+    for (const auto& item : shard) {
+      total += item.size;
+      if (item.size) order.push_back(&item);
+    }
+  }
+  uint64_t sample_limit = compress_auto_sample_mb_ * 1024 * 1024;
+  uint64_t slice = total <= sample_limit ? sample_limit : (std::max)(kAutoMinSliceBytes, sample_limit / kAutoSliceDivisor);
+  auto rank = [](const PackItem* item) { return Hash_Fast64(item->rel.data(), item->rel.size() * sizeof(wchar_t)); };
+  std::sort(order.begin(), order.end(), [&rank](const PackItem* a, const PackItem* b) {
+    uint64_t ra = rank(a), rb = rank(b);
+    return ra != rb ? ra < rb : a->rel < b->rel;
+    });
+
+  // 样本在内存中按扩展名分组拼接，每组以"sample"加扩展名为归档名经stdin交给7z（Archive_AddBuffer），
+  // 7z选择过滤器时仍能看到扩展名；扩展名超过kAutoMaxSampleGroups种时其余的并入无扩展名的一组
+  std::map<std::wstring, std::vector<BYTE>> groups;
+  uint64_t sample = 0;
+  for (const PackItem* item : order) {
+    if (sample >= sample_limit) break;
+    uint64_t take = (std::min)((std::min)(item->size, slice), sample_limit - sample);
+    size_t dot = item->rel.find_last_of(L".\\");
+    std::wstring ext = dot != std::wstring::npos && item->rel[dot] == L'.' ? item->rel.substr(dot) : L"";
+    for (auto& ch : ext) ch = (wchar_t)towlower(ch);
+    if (!groups.count(ext) && groups.size() >= kAutoMaxSampleGroups) ext.clear();
+    if (!ReadFileSlice(item->root + L"\\" + item->rel, (item->size - take) / 2, take, groups[ext])) {
+      XNSIS_LOG_WARN(L"Auto compress: failed to sample %s, error=%lu", item->rel.c_str(), GetLastError());
+      continue;
+    }
+    sample += take;
+  }
+  std::vector<std::wstring> names;
+  SampleCheck check;
+  for (const auto& group : groups) {
+    if (group.second.empty()) continue;
+    names.push_back(L"sample" + group.first);
+    check.expect.push_back(&group.second);
+  }
+  std::vector<const wchar_t*> name_ptrs;
+  for (const auto& name : names) name_ptrs.push_back(name.c_str());
+  std::wstring dir = temp_dir_ + L"_tune";
+  if (GetFileAttributesW(dir.c_str()) != INVALID_FILE_ATTRIBUTES) DeleteDirRecursiveW(dir);
+  if (names.empty()) {
+    XNSIS_LOG(L"Auto compress: no sample, using default param");
+    return;
+  }
+  if (!CreateDirectoryW(dir.c_str(), NULL)) {
+    XNSIS_LOG(L"Auto compress: CreateDirectoryW failed: %s, error=%lu, using default param", dir.c_str(), GetLastError());
+    return;
+  }
+
+  struct Trial {
+    std::wstring param;
+    double seconds;
+    uint64_t packed;
+  };
+  std::vector<std::wstring> candidates = AutoCandidates(shards.size());
+  std::vector<Trial> trials;
+  std::wstring archive = dir + L"\\sample.7z";
+  double budget = (double)compress_auto_budget_s_;
+  double last = 0;
+  for (const auto& param : candidates) {
+    double elapsed = PerfSeconds() - start;
+    // 候选从快到慢排列，下一个至少与上一个一样慢
+    if (!trials.empty() && elapsed + last > budget) {
+      XNSIS_LOG(L"Auto compress: time budget %us reached after %zu of %zu candidates", compress_auto_budget_s_, trials.size(), candidates.size());
+      break;
+    }
+    DeleteFileW(archive.c_str());
+    double t0 = PerfSeconds();
+    bool ok = true;
+    for (size_t g = 0; g < names.size() && ok; ++g) {
+      ok = Archive_AddBuffer(StreamBackend(), archive.c_str(), param.c_str(), names[g].c_str(),
+        check.expect[g]->data(), check.expect[g]->size()) != 0;
+    }
+    last = PerfSeconds() - t0;
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!ok || !GetFileAttributesExW(archive.c_str(), GetFileExInfoStandard, &fad)) {
+      XNSIS_LOG_WARN(L"Auto compress: trial failed: %s", param.c_str());
+      continue;
+    }
+    // 解压到内存与样本比对，还原不出样本的参数不参与选择；同时得到安装端的解压速度
+    check.offsets.assign(names.size(), 0);
+    double t1 = PerfSeconds();
+    if (!Archive_ExtractItems(StreamBackend(), archive.c_str(), name_ptrs.data(), (DWORD)names.size(), CheckSampleChunk, &check)) {
+      XNSIS_LOG_WARN(L"Auto compress: trial rejected, sample does not round-trip: %s", param.c_str());
+      continue;
+    }
+    double decode = (std::max)(PerfSeconds() - t1, 0.001);
+    Trial trial{ param, (std::max)(last, 0.001), ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow };
+    trials.push_back(trial);
+    XNSIS_LOG(L"Auto compress trial: %s, sample=%llu bytes, packed=%llu bytes (%.1f%%), %.2fs, %.1f MB/s, decode %.1f MB/s, est_total=%.0fs",
+      param.c_str(), sample, trial.packed, trial.packed * 100.0 / sample, trial.seconds,
+      sample / trial.seconds / (1024 * 1024), sample / decode / (1024 * 1024), trial.seconds * total / shards.size() / sample);
+  }
+  DeleteDirRecursiveW(dir);
+  if (trials.empty()) {
+    XNSIS_LOG(L"Auto compress: all trials failed, using default param");
+    return;
+  }
+
+  std::sort(trials.begin(), trials.end(), [](const Trial& a, const Trial& b) { return a.seconds < b.seconds; });
+  const Trial* pick = nullptr;
+  for (const auto& trial : trials) {
+    double estimate = trial.seconds * total / shards.size() / sample;
+    if (compress_auto_max_time_s_ && estimate > compress_auto_max_time_s_) continue;
+    if (!pick || trial.packed <= pick->packed * (1.0 - compress_auto_min_gain_ / 100)) pick = &trial;
+  }
+  // 都超出时间上限时选最快的
+  if (!pick) pick = &trials[0];
+  compress_param_ = pick->param;
+  XNSIS_LOG(L"Auto compress param: %s (packed %.1f%% of sample, est_total=%.0fs), payload=%llu bytes, shards=%zu, hw_threads=%u, trials=%zu/%zu, tuning=%.2fs",
+    compress_param_.c_str(), pick->packed * 100.0 / sample, pick->seconds * total / shards.size() / sample, total,
+    shards.size(), WorkStealingPool::DefaultWorkerCount(), trials.size(), candidates.size(), PerfSeconds() - start);
+}
+
+// 只有一个分片时沿用原来的打包方式；多个分片各自用列表文件打包，并行调用7z
+bool PackInstall::CompressInstall7z(const std::vector<std::vector<PackItem>>& shards) {
+  TRACE_SCOPE("pack", "CompressInstall7z");
+  if (compress_auto_) TuneCompressParam(shards);
+  if (shards.size() > 1) {
+    // 同时压缩的分片数受可用物理内存限制（与安装端重新压缩插件相同的估算，只用可用内存的四分之三），
+    // 每个压缩任务依次领取下一个分片
+    size_t workers = shards.size();
+    ULONGLONG per_encoder = Archive_EstimateEncoderMemory(compress_param_.c_str());
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof(ms);
+    if (GlobalMemoryStatusEx(&ms) && per_encoder) {
+      ULONGLONG by_memory = ms.ullAvailPhys / 4 * 3 / per_encoder;
+      if (by_memory < workers) workers = by_memory ? (size_t)by_memory : 1;
+    }
+    XNSIS_LOG(L"CompressInstall7z: %zu shards, %zu concurrent, per_encoder=%llu MB", shards.size(), workers, per_encoder >> 20);
+    std::atomic<uint32_t> failed{ 0 };
+    std::atomic<size_t> next{ 0 };
+    {
+      TaskGroup group(GetStagingPool());
+      for (size_t w = 0; w < workers; ++w) {
+        group.Run([this, &shards, &failed, &next]() {
+          for (size_t k; (k = next++) < shards.size();) {
+            if (!CompressItems(shard_paths_[k], shards[k], k)) failed++;
+          }
+        });
+      }
+    }
+    if (failed) {
+      XNSIS_LOG(L"CompressInstall7z: %u of %zu shards failed", failed.load(), shards.size());
+      return false;
+    }
+    return true;
+  }
+  if (staging_mode_ == StagingMode::kVirtual) {
+    if (!CompressItems(install7z_path_, shards[0], 0)) {
+      XNSIS_LOG(L"CompressItems failed: %s", install7z_path_.c_str());
+      return false;
+    }
+    return true;
+  }
+  if (!Archive_AddDir(backend_, install7z_path_.c_str(), compress_param_.c_str(), temp_dir_.c_str())) {
+    XNSIS_LOG(L"Archive_AddDir failed: %s, backend=%s", install7z_path_.c_str(), backend_->name);
+    return false;
+  }
+  return true;
+}
+
+// 打包缓存键：install.7z的全部内容（按归档名排序的{归档名, 大小, 内容哈希}）加上压缩参数和分片数，
+// 与文件加入的先后和暂存方式无关。已记录128位逐文件哈希的文件直接复用，其余并行计算
+bool PackInstall::ComputePackKey(const std::vector<PackItem>& pack_items, size_t shard_count, BYTE* key) {
+  TRACE_SCOPE("pack", "ComputePackKey");
+  struct KeyItem {
+    std::wstring rel;
+    std::wstring path;
+    ULONGLONG size;
+    BYTE digest[HASH_MAX_DIGEST_SIZE];
+    bool hashed;
+  };
+  DWORD alg = (file_hash_alg_ != HASH_ALG_COUNT && Hash_DigestSize(file_hash_alg_) == CONTENT_HASH_SIZE) ? file_hash_alg_ : HASH_ALG_FAST128;
+  std::vector<KeyItem> items;
+  for (const auto& pack_item : pack_items) {
+    KeyItem item{ pack_item.rel, pack_item.root + L"\\" + pack_item.rel, 0, { 0 }, false };
+    if (pack_item.manifest_idx != SIZE_MAX) {
+      const ManifestEntry& entry = manifest_[pack_item.manifest_idx];
+      item.path = PayloadPath(entry);
+      const InstallFileDigest* recorded = alg == file_hash_alg_ ? DistInfo_GetFileDigest(&distinfo_, entry.fake_idx, entry.file_idx) : nullptr;
+      if (recorded) {
+        item.size = recorded->size;
+        memcpy(item.digest, recorded->digest, sizeof(item.digest));
+        item.hashed = true;
+      }
+    }
+    items.push_back(item);
+  }
+  std::sort(items.begin(), items.end(), [](const KeyItem& a, const KeyItem& b) { return a.rel < b.rel; });
+
+  std::atomic<uint32_t> failed{ 0 };
+  {
+    TaskGroup group(GetStagingPool());
+    for (auto& item : items) {
+      if (item.hashed) continue;
+      KeyItem* p = &item;
+      group.Run([p, alg, &failed]() {
+        if (!Hash_FileDigest(alg, p->path.c_str(), &p->size, p->digest)) failed++;
+      });
+    }
+  }
+  if (failed) {
+    XNSIS_LOG(L"ComputePackKey: Hash_FileDigest failed for %u files", failed.load());
+    return false;
+  }
+
+  // 序列化后整体取哈希；格式变化时修改版本串，旧条目自然失效
+  std::vector<BYTE> buf;
+  auto append = [&buf](const void* data, size_t len) {
+    buf.insert(buf.end(), (const BYTE*)data, (const BYTE*)data + len);
+  };
+  static const char kVersion[] = "xnsis-pack-cache-2";
+  uint64_t shards = shard_count;
+  append(kVersion, sizeof(kVersion));
+  append(compress_param_.c_str(), (compress_param_.size() + 1) * sizeof(wchar_t));
+  append(&alg, sizeof(alg));
+  append(&shards, sizeof(shards));
+  for (const auto& item : items) {
+    append(item.rel.c_str(), (item.rel.size() + 1) * sizeof(wchar_t));
+    append(&item.size, sizeof(item.size));
+    append(item.digest, sizeof(item.digest));
+  }
+  if (!Hash_Buffer(HASH_ALG_FAST128, buf.data(), buf.size(), key)) return false;
+  XNSIS_LOG(L"ComputePackKey completed: items=%zu, shards=%zu, alg=%s", items.size(), shard_count, Hash_AlgName(alg));
+  return true;
+}
+
+// 按列表打包：按工作目录把文件分组，每组生成一个列表文件，7z在该目录下按相对路径读取，
+// 归档名即相对路径；需改名的文件和插件展开的.nsisbin目录都在临时目录这一组中。
+// tag区分并行打包的各分片的列表文件
+bool PackInstall::CompressItems(const std::wstring& archive, const std::vector<PackItem>& items, size_t tag) {
+  TraceScope trace("pack", "CompressItems");
+  trace.SetArg("files", items.size());
+  std::vector<std::pair<std::wstring, std::vector<std::wstring>>> groups;
+  std::unordered_map<std::wstring, size_t> group_index;
+  for (const auto& item : items) {
+    auto it = group_index.find(StagingKey(item.root));
+    if (it == group_index.end()) {
+      it = group_index.emplace(StagingKey(item.root), groups.size()).first;
+      groups.emplace_back(item.root, std::vector<std::wstring>());
+    }
+    groups[it->second].second.push_back(item.rel);
+  }
+
+  std::wstring full_archive = FullPath(archive);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    // 列表按归档名排序，同样的输入总是生成同样的归档
+    std::sort(groups[i].second.begin(), groups[i].second.end());
+    std::wstring list_path = temp_dir_ + L"\\install_list" + std::to_wstring(tag) + L"_" + std::to_wstring(i) + L".txt";
+    if (!WriteListFile(list_path, groups[i].second)) return false;
+    bool ok = Archive_Create(WorkDirBackend(), full_archive.c_str(), compress_param_.c_str(), groups[i].first.c_str(), list_path.c_str()) != 0;
+    DeleteFileW(list_path.c_str());
+    if (!ok) {
+      XNSIS_LOG(L"Archive_Create failed: %s, work_dir=%s, backend=%s", full_archive.c_str(), groups[i].first.c_str(), WorkDirBackend()->name);
+      return false;
+    }
+  }
+  XNSIS_LOG(L"CompressItems completed: %s, %zu files in %zu groups", archive.c_str(), items.size(), groups.size());
+  return true;
+}
+
 const std::wstring& PackInstall::GetInstall7zPath() {
   if (install7z_path_.empty()) {
     // 生成带随机数的install.7z文件名
@@ -611,6 +1878,9 @@ const std::wstring& PackInstall::GetDistInfoPath() {
 }
 
 PackInstall::~PackInstall() {
+  WaitStaging();
+  Trace_Flush();
   DistInfo_Free(&distinfo_);
   DeleteDirRecursiveW(temp_dir_);
+  DirCache_Free(&dir_cache_);
 }
\ No newline at end of file
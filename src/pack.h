@@ -2,9 +2,60 @@
 #include <string>
 #include <set>
 #include <vector>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
 #include "distinfo.h"
+#include "dircache.h"
+#include "procexec.h"
+#include "archive.h"
 
 class CEXEBuild;
+class WorkStealingPool;
+// 待暂存的源文件
+struct StagingEntry {
+    std::wstring src;   // 源文件路径
+    std::wstring rel;   // 暂存目录中的相对路径（即归档名）
+    uint64_t size;      // 文件大小
+};
+
+// 打包清单项：一个待打包文件的来源、归档名及所属fake目录
+struct ManifestEntry {
+    std::wstring src;   // 源文件路径
+    std::wstring rel;   // 归档名
+    std::wstring root;  // 免暂存时7z的工作目录（src即root\rel），为空表示只能从临时目录打包
+    uint64_t size;      // 文件大小
+    int fake_idx;       // 所属fake目录
+    bool staged;        // 是否已放入临时目录
+    bool expanded;      // 已作为插件展开到.nsisbin目录，不再单独打包
+    DWORD file_idx;     // 在所属fake目录file_list中的下标
+    long long dup_of;   // 内容相同的清单项下标（只打包那一份），-1表示自身需要打包
+};
+
+// 文件放入暂存目录的方式
+enum class StagingMode {
+    kCopy,  // 物理复制
+    kLink,  // 依次尝试块克隆、硬链接，都不可用时才复制
+    kVirtual,  // 免暂存：只记录清单，打包时7z直接读取源文件；需改名的文件按kLink方式暂存
+};
+
+// 各暂存方式实际处理的文件数
+struct StagingStats {
+    uint32_t cloned;
+    uint32_t hardlinked;
+    uint32_t copied;
+};
+
+// 待压缩进install.7z（或其分片）的一个文件
+struct PackItem {
+    std::wstring rel;     // 归档名
+    std::wstring root;    // 7z的工作目录，文件即root\rel
+    uint64_t size;        // 文件大小
+    size_t manifest_idx;  // 对应的清单项下标，插件展开出的文件为SIZE_MAX
+    size_t unit;          // 分片的最小单位：同一插件展开的.nsisbin目录整体放入同一分片
+};
+
 // pre_extract_plugins配置项结构
 struct PreExtractPlugin {
     std::wstring path;      // 路径名
@@ -29,6 +80,19 @@ public:
   // 获取压缩参数
   std::wstring GetConfig7zParam() const { return compress_param_; }
 
+  // 获取跨fake目录的路径冲突（同名不同内容）次数
+  uint32_t GetStagingCollisions() const { return staging_collisions_; }
+
+  // 去重节省的字节数（GenerateInstall7z之后有效）
+  uint64_t GetDedupSavedBytes() const { return dedup_saved_bytes_; }
+
+  // 设置暂存方式，需在AddSrcFile之前调用
+  void SetStagingMode(StagingMode mode);
+  StagingStats GetStagingStats() const;
+
+  // 按大小把待打包文件均衡地分成count个分片，同一unit的文件在同一分片；单位数少于count时分片相应减少
+  static std::vector<std::vector<PackItem>> PartitionShards(const std::vector<PackItem>& items, unsigned count);
+
 private:
   InstallDistInfo distinfo_{};
   int current_fake_idx_ = -1;
@@ -38,13 +102,103 @@ private:
   std::wstring distinfo_path_;
   bool completed_ = false;
   bool need_pack_ = false;
+
+  // 打包清单及其索引：相对路径（小写）-> 清单下标，随文件添加增量更新
+  std::vector<ManifestEntry> manifest_;
+  std::unordered_map<std::wstring, size_t> staged_;
+  uint32_t staging_collisions_ = 0;
+  // 跨fake目录同名不同内容时的处理（[staging_collision]节）：默认记警告、保留先登记的那份，
+  // 当前fake目录跳过该文件；为error时AddSrcFile失败
+  bool staging_collision_fatal_ = false;
+
+  // 暂存线程池：并行遍历源目录和复制文件
+  std::unique_ptr<WorkStealingPool> staging_pool_;
+  unsigned staging_threads_ = 0;  // 0表示按硬件线程数
+  std::atomic<uint32_t> staging_errors_{ 0 };
+
+  // 暂存方式及统计；某个卷上不支持的链接方式记录后不再尝试
+  enum : uint32_t { kCloneDisabled = 1, kHardlinkDisabled = 2 };
+  StagingMode staging_mode_ = StagingMode::kCopy;
+  std::atomic<uint32_t> staging_cloned_{ 0 };
+  std::atomic<uint32_t> staging_hardlinked_{ 0 };
+  std::atomic<uint32_t> staging_copied_{ 0 };
+  std::mutex link_mutex_;
+  std::unordered_map<std::wstring, uint32_t> volume_link_disabled_;
+
+  // 7z进程执行器，同时运行的7z进程数（[7z_jobs]节，0为硬件线程数）及单个进程的超时（[7z_timeout]节，秒，0不限时）
+  std::unique_ptr<ProcessExecutor> executor_;
+  std::mutex executor_mutex_;
+  unsigned sevenzip_jobs_ = 0;
+  uint32_t sevenzip_timeout_s_ = 0;
+  // 7-Zip调用后端（[7z_backend]节：process或inproc）。inproc需要构建时定义XNSIS_INPROC_7Z并链接nsis7z，
+  // 否则回退为经执行器启动7z.exe。inproc不支持工作目录，需要工作目录的命令总是经执行器启动7z.exe（见WorkDirBackend），
+  // 读写stdin/stdout的命令同样如此（见StreamBackend）
+  ArchiveBackend process_backend_{};
+  const ArchiveBackend* backend_ = nullptr;
+
+  // 暂存目录下已创建的子目录，暂存线程共用
+  DirCache dir_cache_;
+
+  uint64_t dedup_saved_bytes_ = 0;
+
+  // 逐文件哈希算法（config.ini的[file_hash]节），HASH_ALG_COUNT表示不记录
+  DWORD file_hash_alg_ = HASH_ALG_COUNT;
+
+  // 打包结果缓存目录（[pack_cache]节，为空时不使用）及容量上限（[pack_cache_size]节，MB）
+  std::wstring pack_cache_dir_;
+  uint64_t pack_cache_max_mb_ = 4096;
+
+  // install.7z分片数（[shards]节，数字或auto），各分片并行压缩、安装时并行解压
+  unsigned shards_ = 1;
+  bool shards_auto_ = false;
+  std::vector<std::wstring> shard_paths_;  // 各分片路径，第0个即install7z_path_
   
   // config.ini相关
   std::wstring compress_param_;  // install7z压缩参数
+  // [compress_param]为auto时按样本试压缩选定参数（见TuneCompressParam）：样本大小（[compress_auto_sample]节，MB）、
+  // 试压缩的时间预算（[compress_auto_budget]节，秒）、按样本估算的整体压缩时间上限（[compress_auto_max_time]节，秒，0不限）、
+  // 换用更慢参数所要求的最小体积收益（[compress_auto_min_gain]节，百分比）
+  bool compress_auto_ = false;
+  uint64_t compress_auto_sample_mb_ = 64;
+  uint32_t compress_auto_budget_s_ = 30;
+  uint32_t compress_auto_max_time_s_ = 0;
+  double compress_auto_min_gain_ = 1.0;
   std::vector<PreExtractPlugin> pre_extract_plugins_;  // pre_extract_plugins列表
+  // 原样打包、不展开的插件（[plugin_carry]节，每行一个通配符），安装时无需重新压缩
+  std::vector<std::wstring> plugin_carry_;
 
   bool InitTempDir();
   bool ParseConfigIni();  // 解析config.ini文件
   std::wstring GetCurrentModuleDir();
-  bool SyncCall7zSync(const std::wstring& szCommand);
+  ProcessExecutor& GetExecutor();
+  ProcessJob Make7zJob(const std::wstring& szCommand, const std::wstring& work_dir);
+  ProcessTicket Submit7z(const std::wstring& szCommand, const std::wstring& work_dir = std::wstring());
+  bool Await7z(const ProcessTicket& ticket, const std::wstring& szCommand);
+  bool SyncCall7zSync(const std::wstring& szCommand, const std::wstring& work_dir = std::wstring());
+  static int RunProcessBackend(const ArchiveBackend* backend, const wchar_t* args, const wchar_t* work_dir);
+  static int RunProcessStream(const ArchiveBackend* backend, const wchar_t* args, const void* input, size_t input_size,
+    Archive_OutputCallback output, void* output_arg);
+  const ArchiveBackend* WorkDirBackend() const;
+  const ArchiveBackend* StreamBackend() const;
+  int CheckStagingIndex(const std::wstring& rel);
+  WorkStealingPool& GetStagingPool();
+  void QueueStaging(const std::wstring& src, const std::wstring& rel);
+  bool WaitStaging();
+  bool StageOneFile(const std::wstring& src, const std::wstring& rel);
+  void AddManifestEntry(const std::wstring& src, const std::wstring& rel, const std::wstring& root, uint64_t size);
+  ManifestEntry* FindManifestEntry(const std::wstring& rel);
+  std::vector<PackItem> CollectPackItems();
+  unsigned ResolveShardCount(const std::vector<PackItem>& items) const;
+  bool CompressItems(const std::wstring& archive, const std::vector<PackItem>& items, size_t tag);
+  std::wstring PayloadPath(const ManifestEntry& entry) const;
+  bool IsSameContent(const ManifestEntry& entry, const std::wstring& src, uint64_t size);
+  bool ReportCollision(const std::wstring& rel, const ManifestEntry& entry);
+  bool IsCarriedPlugin(const std::wstring& path) const;
+  bool ExpandPlugins();
+  bool RecordFileDigests();
+  bool DeduplicateManifest();
+  bool ComputePackKey(const std::vector<PackItem>& items, size_t shard_count, BYTE* key);
+  std::vector<std::wstring> AutoCandidates(size_t shard_count) const;
+  void TuneCompressParam(const std::vector<std::vector<PackItem>>& shards);
+  bool CompressInstall7z(const std::vector<std::vector<PackItem>>& shards);
 };
\ No newline at end of file
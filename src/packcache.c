@@ -0,0 +1,142 @@
+#include "packcache.h"
+#include "fileops.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// 条目文件名：键的十六进制 + .7z
+#define PACKCACHE_EXT L".7z"
+
+typedef struct {
+  wchar_t name[MAX_PATH];
+  ULONGLONG size;
+  ULONGLONG used;  // 最后写入时间
+} CacheEntry;
+
+static void EntryPath(const PackCache* cache, const BYTE* key, const wchar_t* ext, wchar_t* path) {
+  wchar_t hex[PACKCACHE_KEY_SIZE * 2 + 1];
+  for (int i = 0; i < PACKCACHE_KEY_SIZE; ++i) wsprintfW(hex + i * 2, L"%02x", key[i]);
+  wsprintfW(path, L"%s\\%s%s", cache->dir, hex, ext);
+}
+
+// 刷新使用时间：访问时间在很多卷上不更新，用修改时间记录
+static void Touch(const wchar_t* path) {
+  HANDLE hFile = CreateFileW(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) return;
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  SetFileTime(hFile, NULL, NULL, &now);
+  CloseHandle(hFile);
+}
+
+static int CompareEntryUsed(const void* a, const void* b) {
+  const CacheEntry* ea = (const CacheEntry*)a;
+  const CacheEntry* eb = (const CacheEntry*)b;
+  if (ea->used != eb->used) return ea->used < eb->used ? -1 : 1;
+  return wcscmp(ea->name, eb->name);
+}
+
+// 按最后使用时间从旧到新删除，直到总大小不超过max_bytes
+static void Evict(PackCache* cache, const wchar_t* keep_name) {
+  wchar_t search[MAX_PATH];
+  wsprintfW(search, L"%s\\*%s", cache->dir, PACKCACHE_EXT);
+  WIN32_FIND_DATAW fd;
+  HANDLE hFind = FindFirstFileW(search, &fd);
+  if (hFind == INVALID_HANDLE_VALUE) return;
+  CacheEntry* entries = NULL;
+  DWORD count = 0, capacity = 0;
+  ULONGLONG total = 0;
+  do {
+    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+    if (count == capacity) {
+      DWORD new_cap = capacity ? capacity * 2 : 64;
+      CacheEntry* p = (CacheEntry*)realloc(entries, new_cap * sizeof(CacheEntry));
+      if (!p) break;
+      entries = p;
+      capacity = new_cap;
+    }
+    CacheEntry* e = &entries[count++];
+    wcsncpy_s(e->name, MAX_PATH, fd.cFileName, _TRUNCATE);
+    e->size = ((ULONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+    e->used = ((ULONGLONG)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime;
+    total += e->size;
+  } while (FindNextFileW(hFind, &fd));
+  FindClose(hFind);
+
+  qsort(entries, count, sizeof(CacheEntry), CompareEntryUsed);
+  DWORD remaining = count;
+  for (DWORD i = 0; i < count && total > cache->max_bytes; ++i) {
+    if (_wcsicmp(entries[i].name, keep_name) == 0) continue;
+    wchar_t path[MAX_PATH];
+    wsprintfW(path, L"%s\\%s", cache->dir, entries[i].name);
+    // 其他构建正在复制的条目删除失败时留到下次
+    if (!DeleteFileW(path)) {
+      XNSIS_LOG(L"Pack cache: failed to evict %s, error=%lu", path, GetLastError());
+      continue;
+    }
+    total -= entries[i].size;
+    cache->evicted++;
+    cache->evicted_bytes += entries[i].size;
+    --remaining;
+  }
+  free(entries);
+  cache->entry_count = remaining;
+  cache->total_bytes = total;
+}
+
+int PackCache_Init(PackCache* cache, const wchar_t* dir, ULONGLONG max_bytes) {
+  memset(cache, 0, sizeof(PackCache));
+  if (!dir || !*dir || wcslen(dir) + PACKCACHE_KEY_SIZE * 2 + 16 >= MAX_PATH) {
+    XNSIS_LOG(L"Pack cache: invalid directory");
+    return 0;
+  }
+  wcsncpy_s(cache->dir, MAX_PATH, dir, _TRUNCATE);
+  cache->max_bytes = max_bytes;
+  if (!CreateDirectoryW(cache->dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+    XNSIS_LOG(L"Pack cache: CreateDirectoryW failed: %s, error=%lu", cache->dir, GetLastError());
+    cache->dir[0] = 0;
+    return 0;
+  }
+  return 1;
+}
+
+int PackCache_Fetch(PackCache* cache, const BYTE* key, const wchar_t* dst) {
+  if (!cache->dir[0]) return 0;
+  wchar_t path[MAX_PATH];
+  EntryPath(cache, key, PACKCACHE_EXT, path);
+  if (GetFileAttributesW(path) == INVALID_FILE_ATTRIBUTES) {
+    cache->misses++;
+    return 0;
+  }
+  if (!FileOps_CloneFile(path, dst) && !CopyFileW(path, dst, FALSE)) {
+    XNSIS_LOG(L"Pack cache: failed to copy %s -> %s, error=%lu", path, dst, GetLastError());
+    cache->misses++;
+    return 0;
+  }
+  Touch(path);
+  cache->hits++;
+  return 1;
+}
+
+int PackCache_Store(PackCache* cache, const BYTE* key, const wchar_t* src) {
+  if (!cache->dir[0]) return 0;
+  wchar_t path[MAX_PATH], temp[MAX_PATH], ext[32];
+  EntryPath(cache, key, PACKCACHE_EXT, path);
+  // 先写到临时名再改名，并发构建不会读到写了一半的条目
+  wsprintfW(ext, L".%lu.tmp", GetCurrentProcessId());
+  EntryPath(cache, key, ext, temp);
+  if (!FileOps_CloneFile(src, temp) && !CopyFileW(src, temp, FALSE)) {
+    XNSIS_LOG(L"Pack cache: failed to copy %s -> %s, error=%lu", src, temp, GetLastError());
+    return 0;
+  }
+  if (!MoveFileExW(temp, path, MOVEFILE_REPLACE_EXISTING)) {
+    XNSIS_LOG(L"Pack cache: failed to rename %s, error=%lu", temp, GetLastError());
+    DeleteFileW(temp);
+    return 0;
+  }
+  Touch(path);
+  const wchar_t* name = wcsrchr(path, L'\\');
+  Evict(cache, name ? name + 1 : path);
+  return 1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACKCACHE_KEY_SIZE 16
+
+  // 打包结果缓存：以内容键（打包清单和压缩参数的哈希）命名保存install.7z，
+  // 内容没有变化时直接复用上次的压缩结果。按最近使用时间（文件修改时间）淘汰，总大小不超过max_bytes
+  typedef struct {
+    wchar_t dir[MAX_PATH];
+    ULONGLONG max_bytes;
+    DWORD hits;
+    DWORD misses;
+    DWORD evicted;             // 淘汰的条目数
+    ULONGLONG evicted_bytes;
+    DWORD entry_count;         // 最近一次淘汰后剩余的条目数和总大小
+    ULONGLONG total_bytes;
+  } PackCache;
+
+  // 缓存目录不存在时创建
+  int PackCache_Init(PackCache* cache, const wchar_t* dir, ULONGLONG max_bytes);
+  // 命中时把缓存的归档复制（能克隆时克隆）到dst并刷新使用时间，返回1；未命中或复制失败返回0
+  int PackCache_Fetch(PackCache* cache, const BYTE* key, const wchar_t* dst);
+  // 保存新生成的归档，再淘汰超出容量的最久未使用条目（不会淘汰刚保存的条目）
+  int PackCache_Store(PackCache* cache, const BYTE* key, const wchar_t* src);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,78 @@
+#include "pathmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+static wchar_t FoldPathChar(wchar_t ch) {
+  return ch == L'/' ? L'\\' : (wchar_t)towlower(ch);
+}
+
+// FNV-1a
+static DWORD HashPath(const wchar_t* key) {
+  DWORD h = 2166136261u;
+  for (; *key; ++key) {
+    h ^= (DWORD)FoldPathChar(*key);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static int PathEquals(const wchar_t* a, const wchar_t* b) {
+  for (; *a && *b; ++a, ++b) {
+    if (FoldPathChar(*a) != FoldPathChar(*b)) return 0;
+  }
+  return *a == *b;
+}
+
+void PathMap_Init(PathMap* map) {
+  memset(map, 0, sizeof(PathMap));
+}
+
+void PathMap_Free(PathMap* map) {
+  if (!map) return;
+  for (DWORD i = 0; i < map->capacity; ++i) free(map->slots[i].key);
+  free(map->slots);
+  memset(map, 0, sizeof(PathMap));
+}
+
+static PathMapSlot* FindSlot(PathMapSlot* slots, DWORD capacity, const wchar_t* key) {
+  DWORD mask = capacity - 1;
+  for (DWORD i = HashPath(key) & mask;; i = (i + 1) & mask) {
+    if (!slots[i].key || PathEquals(slots[i].key, key)) return &slots[i];
+  }
+}
+
+ULONGLONG* PathMap_Find(const PathMap* map, const wchar_t* key) {
+  if (!map->capacity) return NULL;
+  PathMapSlot* slot = FindSlot(map->slots, map->capacity, key);
+  return slot->key ? &slot->value : NULL;
+}
+
+static int Grow(PathMap* map) {
+  DWORD new_cap = map->capacity ? map->capacity * 2 : 64;
+  PathMapSlot* slots = (PathMapSlot*)calloc(new_cap, sizeof(PathMapSlot));
+  if (!slots) return 0;
+  for (DWORD i = 0; i < map->capacity; ++i) {
+    if (map->slots[i].key) *FindSlot(slots, new_cap, map->slots[i].key) = map->slots[i];
+  }
+  free(map->slots);
+  map->slots = slots;
+  map->capacity = new_cap;
+  return 1;
+}
+
+ULONGLONG* PathMap_Insert(PathMap* map, const wchar_t* key, int* inserted) {
+  if (inserted) *inserted = 0;
+  // 负载因子不超过1/2
+  if ((map->count + 1) * 2 > map->capacity && !Grow(map)) return NULL;
+  PathMapSlot* slot = FindSlot(map->slots, map->capacity, key);
+  if (slot->key) return &slot->value;
+  size_t len = wcslen(key);
+  slot->key = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
+  if (!slot->key) return NULL;
+  memcpy(slot->key, key, (len + 1) * sizeof(wchar_t));
+  slot->value = 0;
+  map->count++;
+  if (inserted) *inserted = 1;
+  return &slot->value;
+}
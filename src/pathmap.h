@@ -0,0 +1,29 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 路径哈希表：键不区分大小写，'/'与'\'视为相同；键由表自行复制保存
+  typedef struct {
+    wchar_t* key;
+    ULONGLONG value;
+  } PathMapSlot;
+
+  typedef struct {
+    PathMapSlot* slots;
+    DWORD capacity;
+    DWORD count;
+  } PathMap;
+
+  void PathMap_Init(PathMap* map);
+  void PathMap_Free(PathMap* map);
+  // 查找键，返回值的地址；不存在时返回NULL
+  ULONGLONG* PathMap_Find(const PathMap* map, const wchar_t* key);
+  // 查找或插入键（新插入的值为0），inserted返回是否为新插入；内存不足时返回NULL
+  ULONGLONG* PathMap_Insert(PathMap* map, const wchar_t* key, int* inserted);
+
+#ifdef __cplusplus
+}
+#endif
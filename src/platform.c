@@ -0,0 +1,72 @@
+#include "platform.h"
+#include <string.h>
+#include <wchar.h>
+
+// wchar_t为2字节时已经是UTF-16（本项目只面向小端平台），否则按UTF-32处理
+#define PLATFORM_WCHAR_UTF16 (WCHAR_MAX <= 0xFFFF)
+
+size_t Platform_Utf16Length(const wchar_t* s, size_t len) {
+#if PLATFORM_WCHAR_UTF16
+  (void)s;
+  return len;
+#else
+  size_t units = len;
+  for (size_t i = 0; i < len; ++i) {
+    if ((unsigned)s[i] >= 0x10000 && (unsigned)s[i] <= 0x10FFFF) ++units;
+  }
+  return units;
+#endif
+}
+
+size_t Platform_ToUtf16LE(BYTE* dst, const wchar_t* s, size_t len) {
+#if PLATFORM_WCHAR_UTF16
+  memcpy(dst, s, len * sizeof(wchar_t));
+  return len;
+#else
+  size_t n = 0;
+  for (size_t i = 0; i < len; ++i) {
+    unsigned c = (unsigned)s[i];
+    WORD units[2];
+    int count = 1;
+    if (c >= 0x10000 && c <= 0x10FFFF) {
+      c -= 0x10000;
+      units[0] = (WORD)(0xD800 | (c >> 10));
+      units[1] = (WORD)(0xDC00 | (c & 0x3FF));
+      count = 2;
+    }
+    else {
+      // 超出Unicode范围的值无法表示，用替换字符
+      units[0] = c > 0x10FFFF ? 0xFFFD : (WORD)c;
+    }
+    for (int k = 0; k < count; ++k, ++n) {
+      dst[n * 2] = (BYTE)units[k];
+      dst[n * 2 + 1] = (BYTE)(units[k] >> 8);
+    }
+  }
+  return n;
+#endif
+}
+
+size_t Platform_FromUtf16LE(wchar_t* dst, const BYTE* src, size_t units) {
+#if PLATFORM_WCHAR_UTF16
+  memcpy(dst, src, units * sizeof(wchar_t));
+  dst[units] = 0;
+  return units;
+#else
+  size_t n = 0;
+  for (size_t i = 0; i < units; ++i) {
+    unsigned c = src[i * 2] | ((unsigned)src[i * 2 + 1] << 8);
+    if (c >= 0xD800 && c <= 0xDBFF && i + 1 < units) {
+      unsigned low = src[i * 2 + 2] | ((unsigned)src[i * 2 + 3] << 8);
+      if (low >= 0xDC00 && low <= 0xDFFF) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        ++i;
+      }
+    }
+    // 不成对的代理项原样保留，与Windows下的行为一致
+    dst[n++] = (wchar_t)c;
+  }
+  dst[n] = 0;
+  return n;
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+// 平台层：Windows下直接使用Win32；其他平台由platform_posix.c按POSIX实现本项目用到的Win32子集
+// （目录遍历、文件复制和链接、文件映射、临时目录、线程和同步等），上层模块不区分平台。
+// 程序内的路径统一以'\'分隔，POSIX实现在调用系统接口时换成'/'
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "platform_posix.h"
+#endif
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 本平台的路径分隔符，用于交给外部程序（如7z列表文件）的路径
+#ifdef _WIN32
+#define PLATFORM_PATH_SEP L'\\'
+#else
+#define PLATFORM_PATH_SEP L'/'
+#endif
+
+  // 磁盘格式中的字符串统一为UTF-16LE。Windows下wchar_t即UTF-16，直接复制；
+  // POSIX下wchar_t为4字节的UTF-32，读写时转换
+  // s的前len个字符编码为UTF-16后的单元数
+  size_t Platform_Utf16Length(const wchar_t* s, size_t len);
+  // 编码为UTF-16LE写到dst（不要求对齐），返回写入的单元数
+  size_t Platform_ToUtf16LE(BYTE* dst, const wchar_t* s, size_t len);
+  // 解码units个UTF-16LE单元到dst（至少units + 1个字符）并补结尾NUL，返回字符数
+  size_t Platform_FromUtf16LE(wchar_t* dst, const BYTE* src, size_t units);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1386 @@
+// 平台层的POSIX实现，只在非Windows平台编译（见platform_posix.h）
+#ifndef _WIN32
+#define _GNU_SOURCE
+#include "platform.h"
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// UTF-8路径的缓冲区大小：每个宽字符最多4字节
+#define NATIVE_PATH_SIZE PLATFORM_NATIVE_PATH_SIZE
+// 格式串转换的缓冲区大小，更长的格式串原样使用
+#define FORMAT_BUF_SIZE 1024
+// 1601-01-01到1970-01-01的秒数，FILETIME与Unix时间互转
+#define FILETIME_UNIX_EPOCH 11644473600ULL
+// 没有对应Win32错误码的errno加上客户位，日志中仍能看出原值
+#define ERROR_FROM_ERRNO_FLAG 0x20000000u
+
+// ---------------- 错误码 ----------------
+
+static __thread DWORD g_last_error;
+
+DWORD GetLastError(void) {
+  return g_last_error;
+}
+
+void SetLastError(DWORD error) {
+  g_last_error = error;
+}
+
+DWORD Platform_ErrorFromErrno(int err) {
+  switch (err) {
+  case 0: return ERROR_SUCCESS;
+  case ENOENT: return ERROR_FILE_NOT_FOUND;
+  case ENOTDIR: return ERROR_PATH_NOT_FOUND;
+  case EACCES:
+  case EPERM:
+  case EISDIR: return ERROR_ACCESS_DENIED;
+  case EBADF: return ERROR_INVALID_HANDLE;
+  case ENOMEM: return ERROR_NOT_ENOUGH_MEMORY;
+  case EMFILE:
+  case ENFILE: return ERROR_TOO_MANY_OPEN_FILES;
+  case EXDEV: return ERROR_NOT_SAME_DEVICE;
+  case EROFS: return ERROR_WRITE_PROTECT;
+  case ENOSPC: return ERROR_DISK_FULL;
+  case EOPNOTSUPP:
+#if ENOTSUP != EOPNOTSUPP
+  case ENOTSUP:
+#endif
+  case ENOSYS: return ERROR_NOT_SUPPORTED;
+  case EEXIST: return ERROR_ALREADY_EXISTS;
+  case EINVAL: return ERROR_INVALID_PARAMETER;
+  case EPIPE: return ERROR_BROKEN_PIPE;
+  case ENOTEMPTY: return ERROR_DIR_NOT_EMPTY;
+  case EBUSY: return ERROR_BUSY;
+  case ENAMETOOLONG: return ERROR_FILENAME_EXCED_RANGE;
+  case EILSEQ: return ERROR_NO_UNICODE_TRANSLATION;
+  case EMLINK: return ERROR_TOO_MANY_LINKS;
+  }
+  return ERROR_FROM_ERRNO_FLAG | (DWORD)err;
+}
+
+static void SetErrorFromErrno(void) {
+  g_last_error = Platform_ErrorFromErrno(errno);
+}
+
+// 创建文件或目录时ENOENT说明上级目录不存在，Win32对应ERROR_PATH_NOT_FOUND
+static void SetCreateErrorFromErrno(void) {
+  g_last_error = errno == ENOENT ? ERROR_PATH_NOT_FOUND : errno == EEXIST ? ERROR_ALREADY_EXISTS : Platform_ErrorFromErrno(errno);
+}
+
+// ---------------- 编码和路径 ----------------
+
+// 编码为UTF-8，不超过size - 1字节并补NUL；返回字节数，放不下时返回(size_t)-1
+static size_t Utf8FromWide(const wchar_t* src, size_t len, char* dst, size_t size, int native_path) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; ++i) {
+    unsigned c = (unsigned)src[i];
+    char buf[4];
+    size_t count;
+    if (native_path && c == L'\\') c = L'/';
+    if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+    if (c < 0x80) {
+      buf[0] = (char)c;
+      count = 1;
+    }
+    else if (c < 0x800) {
+      buf[0] = (char)(0xC0 | (c >> 6));
+      buf[1] = (char)(0x80 | (c & 0x3F));
+      count = 2;
+    }
+    else if (c < 0x10000) {
+      buf[0] = (char)(0xE0 | (c >> 12));
+      buf[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+      buf[2] = (char)(0x80 | (c & 0x3F));
+      count = 3;
+    }
+    else {
+      buf[0] = (char)(0xF0 | (c >> 18));
+      buf[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+      buf[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+      buf[3] = (char)(0x80 | (c & 0x3F));
+      count = 4;
+    }
+    if (dst) {
+      if (n + count >= size) return (size_t)-1;
+      memcpy(dst + n, buf, count);
+    }
+    n += count;
+  }
+  if (dst) dst[n] = 0;
+  return n;
+}
+
+// 解码UTF-8，非法序列解码为U+FFFD；dst为NULL时只计数。返回字符数，放不下时返回(size_t)-1
+static size_t WideFromUtf8(const char* src, size_t len, wchar_t* dst, size_t size, int native_path) {
+  const unsigned char* s = (const unsigned char*)src;
+  size_t n = 0;
+  for (size_t i = 0; i < len;) {
+    unsigned c = s[i];
+    size_t extra = c >= 0xF0 && c < 0xF8 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    if ((c >= 0x80 && c < 0xC0) || c >= 0xF8 || i + extra >= len + (extra ? 0 : 1)) {
+      extra = 0;
+      c = c < 0x80 ? c : 0xFFFD;
+    }
+    else if (extra) {
+      unsigned value = c & (0x3F >> extra);
+      size_t k = 1;
+      for (; k <= extra && (s[i + k] & 0xC0) == 0x80; ++k) value = (value << 6) | (s[i + k] & 0x3F);
+      if (k <= extra) {
+        extra = k - 1;
+        value = 0xFFFD;
+      }
+      c = value;
+    }
+    i += extra + 1;
+    if (native_path && c == L'/') c = L'\\';
+    if (dst) {
+      if (n + 1 >= size) return (size_t)-1;
+      dst[n] = (wchar_t)c;
+    }
+    ++n;
+  }
+  if (dst) dst[n] = 0;
+  return n;
+}
+
+int Platform_NativePath(LPCWSTR path, char* out) {
+  if (!path) {
+    g_last_error = ERROR_INVALID_PARAMETER;
+    return 0;
+  }
+  if (Utf8FromWide(path, wcslen(path), out, NATIVE_PATH_SIZE, 1) == (size_t)-1) {
+    g_last_error = ERROR_FILENAME_EXCED_RANGE;
+    return 0;
+  }
+  return 1;
+}
+
+// 系统路径转回宽字符路径（'\'分隔）。按Win32的约定：放得下时返回字符数（不含NUL），
+// 放不下时返回所需的缓冲区大小（含NUL）
+static DWORD FromNative(const char* path, LPWSTR buffer, DWORD size) {
+  size_t len = WideFromUtf8(path, strlen(path), NULL, 0, 1);
+  if (!buffer || len + 1 > size) return (DWORD)len + 1;
+  WideFromUtf8(path, strlen(path), buffer, size, 1);
+  return (DWORD)len;
+}
+
+static void FileTimeFromTimespec(const struct timespec* ts, FILETIME* ft) {
+  ULONGLONG t = ((ULONGLONG)ts->tv_sec + FILETIME_UNIX_EPOCH) * 10000000ULL + (ULONGLONG)ts->tv_nsec / 100;
+  ft->dwLowDateTime = (DWORD)t;
+  ft->dwHighDateTime = (DWORD)(t >> 32);
+}
+
+static void TimespecFromFileTime(const FILETIME* ft, struct timespec* ts) {
+  ULONGLONG t = ((ULONGLONG)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+  ts->tv_sec = (time_t)(t / 10000000ULL - FILETIME_UNIX_EPOCH);
+  ts->tv_nsec = (long)(t % 10000000ULL * 100);
+}
+
+static DWORD AttributesFromStat(const struct stat* st) {
+  DWORD attr = 0;
+  if (S_ISDIR(st->st_mode)) attr |= FILE_ATTRIBUTE_DIRECTORY;
+  if (!(st->st_mode & (S_IWUSR | S_IWGRP | S_IWOTH))) attr |= FILE_ATTRIBUTE_READONLY;
+  return attr ? attr : FILE_ATTRIBUTE_NORMAL;
+}
+
+static void FillAttributeData(const struct stat* st, WIN32_FILE_ATTRIBUTE_DATA* data) {
+  data->dwFileAttributes = AttributesFromStat(st);
+  FileTimeFromTimespec(&st->st_ctim, &data->ftCreationTime);
+  FileTimeFromTimespec(&st->st_atim, &data->ftLastAccessTime);
+  FileTimeFromTimespec(&st->st_mtim, &data->ftLastWriteTime);
+  ULONGLONG size = S_ISDIR(st->st_mode) ? 0 : (ULONGLONG)st->st_size;
+  data->nFileSizeHigh = (DWORD)(size >> 32);
+  data->nFileSizeLow = (DWORD)size;
+}
+
+// ---------------- 句柄 ----------------
+
+enum {
+  HANDLE_KIND_FILE = 1,
+  HANDLE_KIND_FIND,
+  HANDLE_KIND_MAPPING,
+  HANDLE_KIND_EVENT,
+  HANDLE_KIND_THREAD,
+};
+
+typedef struct {
+  int kind;
+  int fd;
+} FileObject;
+
+typedef struct {
+  int kind;
+  DIR* dir;
+  char pattern[NATIVE_PATH_SIZE];
+} FindObject;
+
+typedef struct {
+  int kind;
+  int fd;
+  DWORD protect;
+  ULONGLONG size;
+} MappingObject;
+
+// 事件和线程共用：线程结束即置位的手动重置事件
+typedef struct {
+  int kind;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int manual_reset;
+  int signaled;
+  // 线程：由线程本身和句柄各持有一个引用
+  volatile LONG refs;
+  LPTHREAD_START_ROUTINE start;
+  LPVOID param;
+} WaitObject;
+
+static HANDLE NewFileObject(int fd) {
+  FileObject* obj = (FileObject*)malloc(sizeof(FileObject));
+  if (!obj) {
+    close(fd);
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return INVALID_HANDLE_VALUE;
+  }
+  obj->kind = HANDLE_KIND_FILE;
+  obj->fd = fd;
+  return obj;
+}
+
+static int HandleKind(HANDLE handle) {
+  return handle && handle != INVALID_HANDLE_VALUE ? *(int*)handle : 0;
+}
+
+static int FileFd(HANDLE handle) {
+  if (HandleKind(handle) != HANDLE_KIND_FILE) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return -1;
+  }
+  return ((FileObject*)handle)->fd;
+}
+
+static WaitObject* NewWaitObject(int kind, int manual_reset, int signaled) {
+  WaitObject* obj = (WaitObject*)calloc(1, sizeof(WaitObject));
+  if (!obj) {
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return NULL;
+  }
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+#ifdef __linux__
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_mutex_init(&obj->mutex, NULL);
+  pthread_cond_init(&obj->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  obj->kind = kind;
+  obj->manual_reset = manual_reset;
+  obj->signaled = signaled;
+  obj->refs = 1;
+  return obj;
+}
+
+static void ReleaseWaitObject(WaitObject* obj) {
+  if (InterlockedDecrement(&obj->refs) != 0) return;
+  pthread_cond_destroy(&obj->cond);
+  pthread_mutex_destroy(&obj->mutex);
+  free(obj);
+}
+
+BOOL CloseHandle(HANDLE handle) {
+  switch (HandleKind(handle)) {
+  case HANDLE_KIND_FILE:
+    close(((FileObject*)handle)->fd);
+    free(handle);
+    return TRUE;
+  case HANDLE_KIND_FIND:
+    return FindClose(handle);
+  case HANDLE_KIND_MAPPING:
+    close(((MappingObject*)handle)->fd);
+    free(handle);
+    return TRUE;
+  case HANDLE_KIND_EVENT:
+  case HANDLE_KIND_THREAD:
+    ReleaseWaitObject((WaitObject*)handle);
+    return TRUE;
+  }
+  g_last_error = ERROR_INVALID_HANDLE;
+  return FALSE;
+}
+
+// ---------------- 文件 ----------------
+
+HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD share, LPSECURITY_ATTRIBUTES sa, DWORD disposition, DWORD flags, HANDLE templ) {
+  (void)share; (void)sa; (void)templ;
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(path, native)) return INVALID_HANDLE_VALUE;
+  int oflags = O_CLOEXEC;
+  if ((access & GENERIC_READ) && (access & GENERIC_WRITE)) oflags |= O_RDWR;
+  else if (access & GENERIC_WRITE) oflags |= O_WRONLY;
+  else oflags |= O_RDONLY;
+  switch (disposition) {
+  case CREATE_NEW: oflags |= O_CREAT | O_EXCL; break;
+  case CREATE_ALWAYS: oflags |= O_CREAT | O_TRUNC; break;
+  case OPEN_ALWAYS: oflags |= O_CREAT; break;
+  case TRUNCATE_EXISTING: oflags |= O_TRUNC; break;
+  }
+  int fd = open(native, oflags, 0666);
+  if (fd < 0) {
+    if (errno == EEXIST) g_last_error = ERROR_FILE_EXISTS;
+    else if (oflags & O_CREAT) SetCreateErrorFromErrno();
+    else SetErrorFromErrno();
+    return INVALID_HANDLE_VALUE;
+  }
+  // Win32不带FILE_FLAG_BACKUP_SEMANTICS时不能打开目录
+  struct stat st;
+  if (!(flags & FILE_FLAG_BACKUP_SEMANTICS) && fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+    close(fd);
+    g_last_error = ERROR_ACCESS_DENIED;
+    return INVALID_HANDLE_VALUE;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (flags & FILE_FLAG_SEQUENTIAL_SCAN) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  return NewFileObject(fd);
+}
+
+BOOL ReadFile(HANDLE file, LPVOID buffer, DWORD size, LPDWORD read_out, void* overlapped) {
+  (void)overlapped;
+  int fd = FileFd(file);
+  if (fd < 0) return FALSE;
+  DWORD done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, (BYTE*)buffer + done, size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      SetErrorFromErrno();
+      if (read_out) *read_out = done;
+      return FALSE;
+    }
+    if (n == 0) break;
+    done += (DWORD)n;
+  }
+  if (read_out) *read_out = done;
+  return TRUE;
+}
+
+BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD size, LPDWORD written, void* overlapped) {
+  (void)overlapped;
+  int fd = FileFd(file);
+  if (fd < 0) return FALSE;
+  DWORD done = 0;
+  while (done < size) {
+    ssize_t n = write(fd, (const BYTE*)buffer + done, size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      SetErrorFromErrno();
+      if (written) *written = done;
+      return FALSE;
+    }
+    done += (DWORD)n;
+  }
+  if (written) *written = done;
+  return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size) {
+  int fd = FileFd(file);
+  struct stat st;
+  if (fd < 0) return FALSE;
+  if (fstat(fd, &st) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  size->QuadPart = (LONGLONG)st.st_size;
+  return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* new_pos, DWORD method) {
+  int fd = FileFd(file);
+  if (fd < 0) return FALSE;
+  int whence = method == FILE_END ? SEEK_END : method == FILE_CURRENT ? SEEK_CUR : SEEK_SET;
+  off_t pos = lseek(fd, (off_t)distance.QuadPart, whence);
+  if (pos < 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  if (new_pos) new_pos->QuadPart = (LONGLONG)pos;
+  return TRUE;
+}
+
+BOOL SetEndOfFile(HANDLE file) {
+  int fd = FileFd(file);
+  if (fd < 0) return FALSE;
+  off_t pos = lseek(fd, 0, SEEK_CUR);
+  if (pos < 0 || ftruncate(fd, pos) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL SetFileTime(HANDLE file, const FILETIME* creation, const FILETIME* access, const FILETIME* write) {
+  (void)creation;
+  int fd = FileFd(file);
+  if (fd < 0) return FALSE;
+  struct timespec times[2];
+  times[0].tv_nsec = times[1].tv_nsec = UTIME_OMIT;
+  if (access) TimespecFromFileTime(access, &times[0]);
+  if (write) TimespecFromFileTime(write, &times[1]);
+  if (futimens(fd, times) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL DeleteFileW(LPCWSTR path) {
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(path, native)) return FALSE;
+  if (unlink(native) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// 复制src_fd的全部内容到dst_fd；同一文件系统上copy_file_range可在内核中完成，支持的文件系统上直接共享数据块
+static int CopyContent(int src_fd, int dst_fd, off_t size) {
+  off_t done = 0;
+#ifdef __linux__
+  while (done < size) {
+    ssize_t n = copy_file_range(src_fd, NULL, dst_fd, NULL, (size_t)(size - done), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += n;
+  }
+  // 跨文件系统或不支持时从已复制的位置改用read/write
+  if (done == size) return 1;
+  if (lseek(src_fd, done, SEEK_SET) < 0 || lseek(dst_fd, done, SEEK_SET) < 0) return 0;
+#endif
+  char buf[256 * 1024];
+  for (;;) {
+    ssize_t n = read(src_fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return 0;
+    if (n == 0) return 1;
+    for (ssize_t off = 0; off < n;) {
+      ssize_t w = write(dst_fd, buf + off, (size_t)(n - off));
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return 0;
+      off += w;
+    }
+  }
+  (void)done;
+}
+
+BOOL CopyFileW(LPCWSTR src, LPCWSTR dst, BOOL fail_if_exists) {
+  char native_src[NATIVE_PATH_SIZE], native_dst[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(src, native_src) || !Platform_NativePath(dst, native_dst)) return FALSE;
+  int src_fd = open(native_src, O_RDONLY | O_CLOEXEC);
+  if (src_fd < 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  struct stat st;
+  if (fstat(src_fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+    g_last_error = S_ISDIR(st.st_mode) ? ERROR_ACCESS_DENIED : Platform_ErrorFromErrno(errno);
+    close(src_fd);
+    return FALSE;
+  }
+  int dst_fd = open(native_dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (fail_if_exists ? O_EXCL : 0), st.st_mode & 0777);
+  if (dst_fd < 0) {
+    g_last_error = errno == EEXIST ? ERROR_FILE_EXISTS : Platform_ErrorFromErrno(errno);
+    close(src_fd);
+    return FALSE;
+  }
+  posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  int ok = CopyContent(src_fd, dst_fd, st.st_size);
+  DWORD err = ok ? 0 : Platform_ErrorFromErrno(errno);
+  if (ok) {
+    // 与Win32一样保留修改时间
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    futimens(dst_fd, times);
+  }
+  if (close(dst_fd) != 0 && ok) {
+    ok = 0;
+    err = Platform_ErrorFromErrno(errno);
+  }
+  close(src_fd);
+  if (!ok) {
+    unlink(native_dst);
+    g_last_error = err;
+  }
+  return ok;
+}
+
+BOOL CreateHardLinkW(LPCWSTR link_path, LPCWSTR target, LPSECURITY_ATTRIBUTES sa) {
+  (void)sa;
+  char native_link[NATIVE_PATH_SIZE], native_target[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(link_path, native_link) || !Platform_NativePath(target, native_target)) return FALSE;
+  if (link(native_target, native_link) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL MoveFileExW(LPCWSTR src, LPCWSTR dst, DWORD flags) {
+  char native_src[NATIVE_PATH_SIZE], native_dst[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(src, native_src) || !Platform_NativePath(dst, native_dst)) return FALSE;
+  struct stat st;
+  if (!(flags & MOVEFILE_REPLACE_EXISTING) && lstat(native_dst, &st) == 0) {
+    g_last_error = ERROR_ALREADY_EXISTS;
+    return FALSE;
+  }
+  if (rename(native_src, native_dst) == 0) return TRUE;
+  if (errno == EXDEV && (flags & MOVEFILE_COPY_ALLOWED)) {
+    if (!CopyFileW(src, dst, FALSE)) return FALSE;
+    unlink(native_src);
+    return TRUE;
+  }
+  SetErrorFromErrno();
+  return FALSE;
+}
+
+BOOL CreateDirectoryW(LPCWSTR path, LPSECURITY_ATTRIBUTES sa) {
+  (void)sa;
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(path, native)) return FALSE;
+  if (mkdir(native, 0777) != 0) {
+    SetCreateErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL RemoveDirectoryW(LPCWSTR path) {
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(path, native)) return FALSE;
+  if (rmdir(native) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+DWORD GetFileAttributesW(LPCWSTR path) {
+  char native[NATIVE_PATH_SIZE];
+  struct stat st;
+  if (!Platform_NativePath(path, native)) return INVALID_FILE_ATTRIBUTES;
+  if (stat(native, &st) != 0) {
+    SetErrorFromErrno();
+    return INVALID_FILE_ATTRIBUTES;
+  }
+  return AttributesFromStat(&st);
+}
+
+BOOL GetFileAttributesExW(LPCWSTR path, GET_FILEEX_INFO_LEVELS level, LPVOID info) {
+  (void)level;
+  char native[NATIVE_PATH_SIZE];
+  struct stat st;
+  if (!Platform_NativePath(path, native)) return FALSE;
+  if (stat(native, &st) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  FillAttributeData(&st, (WIN32_FILE_ATTRIBUTE_DATA*)info);
+  return TRUE;
+}
+
+// ---------------- 目录遍历 ----------------
+
+// 取下一个匹配项，没有时返回0并设置ERROR_NO_MORE_FILES
+static int NextMatch(FindObject* find, WIN32_FIND_DATAW* data) {
+  for (;;) {
+    errno = 0;
+    struct dirent* entry = readdir(find->dir);
+    if (!entry) {
+      g_last_error = errno ? Platform_ErrorFromErrno(errno) : ERROR_NO_MORE_FILES;
+      return 0;
+    }
+    if (fnmatch(find->pattern, entry->d_name, FNM_CASEFOLD) != 0) continue;
+    struct stat st;
+    // 失效的符号链接按普通文件返回
+    if (fstatat(dirfd(find->dir), entry->d_name, &st, 0) != 0 &&
+      fstatat(dirfd(find->dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+    memset(data, 0, sizeof(*data));
+    FillAttributeData(&st, (WIN32_FILE_ATTRIBUTE_DATA*)data);
+    if (WideFromUtf8(entry->d_name, strlen(entry->d_name), data->cFileName, MAX_PATH, 0) == (size_t)-1) continue;
+    return 1;
+  }
+}
+
+HANDLE FindFirstFileW(LPCWSTR pattern, WIN32_FIND_DATAW* data) {
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(pattern, native)) return INVALID_HANDLE_VALUE;
+  FindObject* find = (FindObject*)malloc(sizeof(FindObject));
+  if (!find) {
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return INVALID_HANDLE_VALUE;
+  }
+  find->kind = HANDLE_KIND_FIND;
+  char* slash = strrchr(native, '/');
+  const char* name = slash ? slash + 1 : native;
+  // Win32的"*.*"也匹配没有扩展名的文件
+  strcpy(find->pattern, strcmp(name, "*.*") == 0 ? "*" : name);
+  if (slash == native) slash[1] = 0;
+  else if (slash) *slash = 0;
+  find->dir = opendir(slash ? native : ".");
+  if (!find->dir) {
+    g_last_error = errno == ENOENT ? ERROR_PATH_NOT_FOUND : Platform_ErrorFromErrno(errno);
+    free(find);
+    return INVALID_HANDLE_VALUE;
+  }
+  if (!NextMatch(find, data)) {
+    if (g_last_error == ERROR_NO_MORE_FILES) g_last_error = ERROR_FILE_NOT_FOUND;
+    closedir(find->dir);
+    free(find);
+    return INVALID_HANDLE_VALUE;
+  }
+  return find;
+}
+
+BOOL FindNextFileW(HANDLE find, WIN32_FIND_DATAW* data) {
+  if (HandleKind(find) != HANDLE_KIND_FIND) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  return NextMatch((FindObject*)find, data);
+}
+
+BOOL FindClose(HANDLE find) {
+  if (HandleKind(find) != HANDLE_KIND_FIND) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  closedir(((FindObject*)find)->dir);
+  free(find);
+  return TRUE;
+}
+
+// ---------------- 路径 ----------------
+
+DWORD GetFullPathNameW(LPCWSTR path, DWORD size, LPWSTR buffer, LPWSTR* file_part) {
+  wchar_t full[MAX_PATH * 2];
+  size_t len = 0;
+  if (path[0] != L'\\' && path[0] != L'/') {
+    char cwd[NATIVE_PATH_SIZE];
+    if (!getcwd(cwd, sizeof(cwd))) {
+      SetErrorFromErrno();
+      return 0;
+    }
+    len = FromNative(cwd, full, MAX_PATH);
+    if (len >= MAX_PATH) {
+      g_last_error = ERROR_FILENAME_EXCED_RANGE;
+      return 0;
+    }
+  }
+  // 逐级拼接，"."跳过，".."回到上一级
+  for (const wchar_t* p = path; *p;) {
+    while (*p == L'\\' || *p == L'/') ++p;
+    const wchar_t* end = p;
+    while (*end && *end != L'\\' && *end != L'/') ++end;
+    size_t n = (size_t)(end - p);
+    if (n == 0 || (n == 1 && p[0] == L'.')) {
+    }
+    else if (n == 2 && p[0] == L'.' && p[1] == L'.') {
+      while (len > 0 && full[len - 1] != L'\\') --len;
+      if (len > 0) --len;
+    }
+    else {
+      if (len + 1 + n >= MAX_PATH * 2) {
+        g_last_error = ERROR_FILENAME_EXCED_RANGE;
+        return 0;
+      }
+      full[len++] = L'\\';
+      wmemcpy(full + len, p, n);
+      len += n;
+    }
+    p = end;
+  }
+  size_t in_len = wcslen(path);
+  int trailing = in_len > 0 && (path[in_len - 1] == L'\\' || path[in_len - 1] == L'/');
+  if (len == 0 || trailing) full[len++] = L'\\';
+  full[len] = 0;
+  if (!buffer || len + 1 > size) return (DWORD)len + 1;
+  wmemcpy(buffer, full, len + 1);
+  if (file_part) {
+    wchar_t* last = wcsrchr(buffer, L'\\');
+    *file_part = last && last[1] ? last + 1 : NULL;
+  }
+  return (DWORD)len;
+}
+
+DWORD GetTempPathW(DWORD size, LPWSTR buffer) {
+  const char* dir = getenv("TMPDIR");
+  if (!dir || !*dir) dir = "/tmp";
+  char tmp[NATIVE_PATH_SIZE];
+  size_t n = strlen(dir);
+  if (n + 2 > sizeof(tmp)) {
+    g_last_error = ERROR_FILENAME_EXCED_RANGE;
+    return 0;
+  }
+  memcpy(tmp, dir, n);
+  if (tmp[n - 1] != '/') tmp[n++] = '/';
+  tmp[n] = 0;
+  return FromNative(tmp, buffer, size);
+}
+
+DWORD GetCurrentDirectoryW(DWORD size, LPWSTR buffer) {
+  char cwd[NATIVE_PATH_SIZE];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    SetErrorFromErrno();
+    return 0;
+  }
+  return FromNative(cwd, buffer, size);
+}
+
+BOOL SetCurrentDirectoryW(LPCWSTR path) {
+  char native[NATIVE_PATH_SIZE];
+  if (!Platform_NativePath(path, native)) return FALSE;
+  if (chdir(native) != 0) {
+    SetErrorFromErrno();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+DWORD GetModuleFileNameW(HANDLE module, LPWSTR buffer, DWORD size) {
+  if (module) {
+    g_last_error = ERROR_NOT_SUPPORTED;
+    return 0;
+  }
+  char exe[NATIVE_PATH_SIZE];
+  ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (n <= 0) {
+    SetErrorFromErrno();
+    return 0;
+  }
+  exe[n] = 0;
+  DWORD len = FromNative(exe, buffer, size);
+  // 与Win32一样截断并返回size
+  if (len >= size && size > 0) {
+    FromNative("", buffer, size);
+    g_last_error = ERROR_INSUFFICIENT_BUFFER;
+    return size;
+  }
+  return len;
+}
+
+// ---------------- 文件映射 ----------------
+
+// 视图的大小，munmap时需要
+typedef struct MappedView {
+  struct MappedView* next;
+  void* addr;
+  size_t size;
+} MappedView;
+
+static MappedView* g_views;
+static pthread_mutex_t g_views_lock = PTHREAD_MUTEX_INITIALIZER;
+
+HANDLE CreateFileMappingW(HANDLE file, LPSECURITY_ATTRIBUTES sa, DWORD protect, DWORD size_high, DWORD size_low, LPCWSTR name) {
+  (void)sa; (void)name;
+  int fd = FileFd(file);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    SetErrorFromErrno();
+    return NULL;
+  }
+  ULONGLONG size = ((ULONGLONG)size_high << 32) | size_low;
+  if (!size) size = (ULONGLONG)st.st_size;
+  // 与Win32一致：不能映射空文件
+  if (!size) {
+    g_last_error = ERROR_INVALID_PARAMETER;
+    return NULL;
+  }
+  MappingObject* mapping = (MappingObject*)malloc(sizeof(MappingObject));
+  int dup_fd = mapping ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1;
+  if (dup_fd < 0) {
+    g_last_error = mapping ? Platform_ErrorFromErrno(errno) : ERROR_NOT_ENOUGH_MEMORY;
+    free(mapping);
+    return NULL;
+  }
+  mapping->kind = HANDLE_KIND_MAPPING;
+  mapping->fd = dup_fd;
+  mapping->protect = protect;
+  mapping->size = size;
+  return mapping;
+}
+
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, SIZE_T size) {
+  if (HandleKind(mapping) != HANDLE_KIND_MAPPING) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return NULL;
+  }
+  MappingObject* m = (MappingObject*)mapping;
+  ULONGLONG offset = ((ULONGLONG)offset_high << 32) | offset_low;
+  if (offset >= m->size) {
+    g_last_error = ERROR_INVALID_PARAMETER;
+    return NULL;
+  }
+  if (!size) size = (SIZE_T)(m->size - offset);
+  MappedView* view = (MappedView*)malloc(sizeof(MappedView));
+  if (!view) {
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return NULL;
+  }
+  int prot = PROT_READ;
+  int flags = MAP_SHARED;
+  if (access & FILE_MAP_COPY) {
+    // 写时复制：改写只影响本进程
+    prot |= PROT_WRITE;
+    flags = MAP_PRIVATE;
+  }
+  else if (access & FILE_MAP_WRITE) {
+    prot |= PROT_WRITE;
+  }
+  void* addr = mmap(NULL, size, prot, flags, m->fd, (off_t)offset);
+  if (addr == MAP_FAILED) {
+    SetErrorFromErrno();
+    free(view);
+    return NULL;
+  }
+  view->addr = addr;
+  view->size = size;
+  pthread_mutex_lock(&g_views_lock);
+  view->next = g_views;
+  g_views = view;
+  pthread_mutex_unlock(&g_views_lock);
+  return addr;
+}
+
+BOOL UnmapViewOfFile(LPCVOID addr) {
+  MappedView* found = NULL;
+  pthread_mutex_lock(&g_views_lock);
+  for (MappedView** link = &g_views; *link; link = &(*link)->next) {
+    if ((*link)->addr == addr) {
+      found = *link;
+      *link = found->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_views_lock);
+  if (!found) {
+    g_last_error = ERROR_INVALID_PARAMETER;
+    return FALSE;
+  }
+  munmap(found->addr, found->size);
+  free(found);
+  return TRUE;
+}
+
+// ---------------- 线程和同步 ----------------
+
+static void* ThreadMain(void* arg) {
+  WaitObject* obj = (WaitObject*)arg;
+  obj->start(obj->param);
+  pthread_mutex_lock(&obj->mutex);
+  obj->signaled = 1;
+  pthread_cond_broadcast(&obj->cond);
+  pthread_mutex_unlock(&obj->mutex);
+  ReleaseWaitObject(obj);
+  return NULL;
+}
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES sa, SIZE_T stack_size, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags, LPDWORD thread_id) {
+  (void)sa; (void)flags;
+  WaitObject* obj = NewWaitObject(HANDLE_KIND_THREAD, 1, 0);
+  if (!obj) return NULL;
+  obj->start = start;
+  obj->param = param;
+  obj->refs = 2;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (stack_size) pthread_attr_setstacksize(&attr, stack_size);
+  pthread_t thread;
+  int err = pthread_create(&thread, &attr, ThreadMain, obj);
+  pthread_attr_destroy(&attr);
+  if (err) {
+    obj->refs = 1;
+    ReleaseWaitObject(obj);
+    g_last_error = Platform_ErrorFromErrno(err);
+    return NULL;
+  }
+  if (thread_id) *thread_id = 0;
+  return obj;
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES sa, BOOL manual_reset, BOOL initial_state, LPCWSTR name) {
+  (void)sa; (void)name;
+  return NewWaitObject(HANDLE_KIND_EVENT, manual_reset, initial_state);
+}
+
+static BOOL SetEventState(HANDLE event, int signaled) {
+  if (HandleKind(event) != HANDLE_KIND_EVENT) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  WaitObject* obj = (WaitObject*)event;
+  pthread_mutex_lock(&obj->mutex);
+  obj->signaled = signaled;
+  if (signaled) {
+    if (obj->manual_reset) pthread_cond_broadcast(&obj->cond);
+    else pthread_cond_signal(&obj->cond);
+  }
+  pthread_mutex_unlock(&obj->mutex);
+  return TRUE;
+}
+
+BOOL SetEvent(HANDLE event) {
+  return SetEventState(event, 1);
+}
+
+BOOL ResetEvent(HANDLE event) {
+  return SetEventState(event, 0);
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD ms) {
+  int kind = HandleKind(handle);
+  if (kind != HANDLE_KIND_EVENT && kind != HANDLE_KIND_THREAD) {
+    g_last_error = ERROR_INVALID_HANDLE;
+    return WAIT_FAILED;
+  }
+  WaitObject* obj = (WaitObject*)handle;
+  struct timespec deadline;
+  if (ms != INFINITE) {
+#ifdef __linux__
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+    clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+  DWORD result = WAIT_OBJECT_0;
+  pthread_mutex_lock(&obj->mutex);
+  while (!obj->signaled) {
+    if (ms == INFINITE) {
+      pthread_cond_wait(&obj->cond, &obj->mutex);
+    }
+    else if (pthread_cond_timedwait(&obj->cond, &obj->mutex, &deadline) == ETIMEDOUT) {
+      result = WAIT_TIMEOUT;
+      break;
+    }
+  }
+  if (result == WAIT_OBJECT_0 && !obj->manual_reset) obj->signaled = 0;
+  pthread_mutex_unlock(&obj->mutex);
+  return result;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all, DWORD ms) {
+  if (!wait_all || count == 0 || count > MAXIMUM_WAIT_OBJECTS) {
+    g_last_error = ERROR_INVALID_PARAMETER;
+    return WAIT_FAILED;
+  }
+  ULONGLONG start = GetTickCount64();
+  for (DWORD i = 0; i < count; ++i) {
+    DWORD left = INFINITE;
+    if (ms != INFINITE) {
+      ULONGLONG elapsed = GetTickCount64() - start;
+      left = elapsed >= ms ? 0 : (DWORD)(ms - elapsed);
+    }
+    DWORD result = WaitForSingleObject(handles[i], left);
+    if (result != WAIT_OBJECT_0) return result;
+  }
+  return WAIT_OBJECT_0;
+}
+
+void Sleep(DWORD ms) {
+  struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+DWORD GetCurrentThreadId(void) {
+#ifdef __linux__
+  return (DWORD)syscall(SYS_gettid);
+#else
+  return (DWORD)(uintptr_t)pthread_self();
+#endif
+}
+
+DWORD GetCurrentProcessId(void) {
+  return (DWORD)getpid();
+}
+
+DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION callback) {
+  pthread_key_t key;
+  int err = pthread_key_create(&key, callback);
+  if (err) {
+    g_last_error = Platform_ErrorFromErrno(err);
+    return FLS_OUT_OF_INDEXES;
+  }
+  return (DWORD)key;
+}
+
+PVOID FlsGetValue(DWORD index) {
+  return pthread_getspecific((pthread_key_t)index);
+}
+
+BOOL FlsSetValue(DWORD index, PVOID value) {
+  int err = pthread_setspecific((pthread_key_t)index, value);
+  if (err) {
+    g_last_error = Platform_ErrorFromErrno(err);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// 与Win32不同，不会对仍持有值的线程调用回调
+BOOL FlsFree(DWORD index) {
+  int err = pthread_key_delete((pthread_key_t)index);
+  if (err) {
+    g_last_error = Platform_ErrorFromErrno(err);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void InitializeCriticalSection(LPCRITICAL_SECTION cs) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&cs->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+BOOL InitOnceExecuteOnce(PINIT_ONCE once, PINIT_ONCE_FN fn, PVOID param, LPVOID* context) {
+  for (;;) {
+    LONG state = InterlockedCompareExchange(&once->state, 1, 0);
+    if (state == 2) return TRUE;
+    if (state == 0) break;
+    // 其他线程正在执行
+    sched_yield();
+  }
+  BOOL ok = fn(once, param, context);
+  // 失败时允许下次重试
+  InterlockedExchange(&once->state, ok ? 2 : 0);
+  return ok;
+}
+
+// ---------------- 系统信息和时间 ----------------
+
+void GetSystemInfo(SYSTEM_INFO* info) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  long page = sysconf(_SC_PAGESIZE);
+  info->dwNumberOfProcessors = cpus > 0 ? (DWORD)cpus : 1;
+  info->dwPageSize = page > 0 ? (DWORD)page : 4096;
+  info->dwAllocationGranularity = 64 * 1024;
+}
+
+BOOL GlobalMemoryStatusEx(MEMORYSTATUSEX* status) {
+  long page = sysconf(_SC_PAGESIZE);
+  long total = sysconf(_SC_PHYS_PAGES);
+  long avail = sysconf(_SC_AVPHYS_PAGES);
+  if (page <= 0 || total <= 0 || avail < 0) {
+    g_last_error = ERROR_NOT_SUPPORTED;
+    return FALSE;
+  }
+  status->ullTotalPhys = (ULONGLONG)total * (ULONGLONG)page;
+  status->ullAvailPhys = (ULONGLONG)avail * (ULONGLONG)page;
+  status->dwMemoryLoad = (DWORD)(100 - status->ullAvailPhys * 100 / status->ullTotalPhys);
+  return TRUE;
+}
+
+void DebugBreak(void) {
+  raise(SIGTRAP);
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  counter->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+  frequency->QuadPart = 1000000000LL;
+  return TRUE;
+}
+
+ULONGLONG GetTickCount64(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ULONGLONG)ts.tv_sec * 1000 + (ULONGLONG)ts.tv_nsec / 1000000;
+}
+
+DWORD GetTickCount(void) {
+  return (DWORD)GetTickCount64();
+}
+
+void GetSystemTimeAsFileTime(FILETIME* time) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  FileTimeFromTimespec(&ts, time);
+}
+
+DWORD GetEnvironmentVariableW(LPCWSTR name, LPWSTR buffer, DWORD size) {
+  char native_name[256];
+  if (Utf8FromWide(name, wcslen(name), native_name, sizeof(native_name), 0) == (size_t)-1) {
+    g_last_error = ERROR_ENVVAR_NOT_FOUND;
+    return 0;
+  }
+  const char* value = getenv(native_name);
+  if (!value) {
+    g_last_error = ERROR_ENVVAR_NOT_FOUND;
+    return 0;
+  }
+  size_t len = WideFromUtf8(value, strlen(value), NULL, 0, 0);
+  if (!buffer || len + 1 > size) return (DWORD)len + 1;
+  WideFromUtf8(value, strlen(value), buffer, size, 0);
+  return (DWORD)len;
+}
+
+// ---------------- 编码转换 ----------------
+
+int MultiByteToWideChar(UINT code_page, DWORD flags, LPCSTR src, int src_len, LPWSTR dst, int dst_len) {
+  (void)code_page; (void)flags;
+  // 长度为-1时连同结尾NUL一起转换
+  size_t len = src_len < 0 ? strlen(src) + 1 : (size_t)src_len;
+  size_t n = WideFromUtf8(src, len, NULL, 0, 0);
+  if (dst_len == 0) return (int)n;
+  if (n > (size_t)dst_len) {
+    g_last_error = ERROR_INSUFFICIENT_BUFFER;
+    return 0;
+  }
+  // WideFromUtf8补NUL需要多一个位置，结果含NUL时它与补上的NUL重合
+  wchar_t* tmp = n + 1 > (size_t)dst_len ? (wchar_t*)malloc((n + 1) * sizeof(wchar_t)) : dst;
+  if (!tmp) {
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return 0;
+  }
+  WideFromUtf8(src, len, tmp, n + 1, 0);
+  if (tmp != dst) {
+    wmemcpy(dst, tmp, n);
+    free(tmp);
+  }
+  return (int)n;
+}
+
+int WideCharToMultiByte(UINT code_page, DWORD flags, LPCWSTR src, int src_len, LPSTR dst, int dst_len, LPCSTR default_char, BOOL* used_default) {
+  (void)code_page; (void)flags; (void)default_char;
+  if (used_default) *used_default = FALSE;
+  size_t len = src_len < 0 ? wcslen(src) + 1 : (size_t)src_len;
+  size_t n = Utf8FromWide(src, len, NULL, 0, 0);
+  if (dst_len == 0) return (int)n;
+  if (n > (size_t)dst_len) {
+    g_last_error = ERROR_INSUFFICIENT_BUFFER;
+    return 0;
+  }
+  char* tmp = n + 1 > (size_t)dst_len ? (char*)malloc(n + 1) : dst;
+  if (!tmp) {
+    g_last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return 0;
+  }
+  Utf8FromWide(src, len, tmp, n + 1, 0);
+  if (tmp != dst) {
+    memcpy(dst, tmp, n);
+    free(tmp);
+  }
+  return (int)n;
+}
+
+// ---------------- MSVC运行库 ----------------
+
+#define STRUNCATE_RESULT 80
+
+int _wcsicmp(const wchar_t* a, const wchar_t* b) {
+  return _wcsnicmp(a, b, (size_t)-1);
+}
+
+int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    wint_t ca = towlower((wint_t)a[i]), cb = towlower((wint_t)b[i]);
+    if (ca != cb) return ca < cb ? -1 : 1;
+    if (!ca) break;
+  }
+  return 0;
+}
+
+wchar_t* _wcsdup(const wchar_t* s) {
+  return wcsdup(s);
+}
+
+char* _strdup(const char* s) {
+  return strdup(s);
+}
+
+int wcsncpy_s(wchar_t* dst, size_t size, const wchar_t* src, size_t count) {
+  if (!dst || !size) return EINVAL;
+  size_t len = 0;
+  while (len < count && src[len]) ++len;
+  if (len >= size) {
+    if (count != _TRUNCATE) {
+      dst[0] = 0;
+      return ERANGE;
+    }
+    len = size - 1;
+    wmemcpy(dst, src, len);
+    dst[len] = 0;
+    return STRUNCATE_RESULT;
+  }
+  wmemcpy(dst, src, len);
+  dst[len] = 0;
+  return 0;
+}
+
+int wcscpy_s(wchar_t* dst, size_t size, const wchar_t* src) {
+  size_t len = wcslen(src);
+  if (!dst || len >= size) {
+    if (dst && size) dst[0] = 0;
+    return ERANGE;
+  }
+  wmemcpy(dst, src, len + 1);
+  return 0;
+}
+
+int wcscat_s(wchar_t* dst, size_t size, const wchar_t* src) {
+  size_t len = wcsnlen(dst, size);
+  if (len == size) return EINVAL;
+  return wcscpy_s(dst + len, size - len, src);
+}
+
+wchar_t* wcstok_s(wchar_t* str, const wchar_t* delim, wchar_t** context) {
+  return wcstok(str, delim, context);
+}
+
+int mbstowcs_s(size_t* converted, wchar_t* dst, size_t size, const char* src, size_t count) {
+  size_t len = strlen(src);
+  if (count != _TRUNCATE && count < len) len = count;
+  size_t n = WideFromUtf8(src, len, NULL, 0, 0);
+  if (n >= size) {
+    if (count != _TRUNCATE) {
+      if (size) dst[0] = 0;
+      if (converted) *converted = 0;
+      return ERANGE;
+    }
+    // 逐个缩短直到放得下
+    while (len > 0 && WideFromUtf8(src, len, NULL, 0, 0) >= size) --len;
+  }
+  n = WideFromUtf8(src, len, dst, size, 0);
+  if (converted) *converted = n + 1;
+  return 0;
+}
+
+// 把MSVC约定的格式串转换为glibc的约定：
+// 宽字符函数中%s/%c为宽字符、%S/%hs为窄字符；整数的l修饰为32位（与DWORD/LONG一致）；I64为64位
+#define DEFINE_FORMAT_TRANSLATOR(NAME, CHAR, WIDE)                                            \
+  static const CHAR* NAME(const CHAR* fmt, CHAR* buf, size_t size) {                          \
+    size_t n = 0;                                                                             \
+    for (const CHAR* p = fmt; *p; ++p) {                                                      \
+      if (n + 8 >= size) return fmt;                                                          \
+      buf[n++] = *p;                                                                          \
+      if (*p != '%') continue;                                                                \
+      ++p;                                                                                    \
+      while (*p && strchr("-+ #0123456789.*", (char)*p) && n + 8 < size) buf[n++] = *p++;     \
+      int narrow = 0, wide = 0;                                                               \
+      if (p[0] == 'I' && p[1] == '6' && p[2] == '4') { buf[n++] = 'l'; buf[n++] = 'l'; p += 3; } \
+      else if (p[0] == 'I' && p[1] == '3' && p[2] == '2') p += 3;                             \
+      else if (p[0] == 'I') { buf[n++] = 'z'; ++p; }                                          \
+      else if (p[0] == 'l' && p[1] == 'l') { buf[n++] = 'l'; buf[n++] = 'l'; p += 2; }        \
+      else if (p[0] == 'l' || p[0] == 'w') { wide = 1; ++p; }                                 \
+      else if (p[0] == 'h' && (p[1] == 's' || p[1] == 'c' || p[1] == 'S' || p[1] == 'C')) { narrow = 1; ++p; } \
+      if (!*p) break;                                                                         \
+      CHAR c = *p;                                                                            \
+      if (c == 's' || c == 'c' || c == 'S' || c == 'C') {                                     \
+        int is_wide = wide || (!narrow && ((c == 's' || c == 'c') == (WIDE)));                \
+        if (is_wide) buf[n++] = 'l';                                                          \
+        buf[n++] = (CHAR)(c == 'S' ? 's' : c == 'C' ? 'c' : c);                               \
+      }                                                                                       \
+      else {                                                                                  \
+        buf[n++] = c;                                                                         \
+      }                                                                                       \
+    }                                                                                         \
+    buf[n] = 0;                                                                               \
+    return buf;                                                                               \
+  }
+
+DEFINE_FORMAT_TRANSLATOR(TranslateFormatW, wchar_t, 1)
+DEFINE_FORMAT_TRANSLATOR(TranslateFormatA, char, 0)
+
+int _vsnwprintf_s(wchar_t* dst, size_t size, size_t count, const wchar_t* fmt, va_list args) {
+  if (!dst || !size) return -1;
+  wchar_t buf[FORMAT_BUF_SIZE];
+  size_t limit = count == _TRUNCATE || count + 1 > size ? size : count + 1;
+  int n = vswprintf(dst, limit, TranslateFormatW(fmt, buf, FORMAT_BUF_SIZE), args);
+  if (n < 0) {
+    // 放不下：_TRUNCATE时保留截断的结果，否则清空
+    if (count == _TRUNCATE) dst[limit - 1] = 0;
+    else dst[0] = 0;
+    return -1;
+  }
+  return n;
+}
+
+int _snwprintf_s(wchar_t* dst, size_t size, size_t count, const wchar_t* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = _vsnwprintf_s(dst, size, count, fmt, args);
+  va_end(args);
+  return n;
+}
+
+int swprintf_s(wchar_t* dst, size_t size, const wchar_t* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = _vsnwprintf_s(dst, size, size - 1, fmt, args);
+  va_end(args);
+  return n;
+}
+
+int wsprintfW(wchar_t* dst, const wchar_t* fmt, ...) {
+  // Win32限定输出最多1024个字符
+  va_list args;
+  va_start(args, fmt);
+  int n = _vsnwprintf_s(dst, 1024, _TRUNCATE, fmt, args);
+  va_end(args);
+  return n < 0 ? (int)wcslen(dst) : n;
+}
+
+int sprintf_s(char* dst, size_t size, const char* fmt, ...) {
+  char buf[FORMAT_BUF_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(dst, size, TranslateFormatA(fmt, buf, FORMAT_BUF_SIZE), args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= size) {
+    if (size) dst[0] = 0;
+    return -1;
+  }
+  return n;
+}
+
+int _wsystem(const wchar_t* command) {
+  size_t len = wcslen(command);
+  char* native = (char*)malloc(len * 4 + 1);
+  if (!native) return -1;
+  Utf8FromWide(command, len, native, len * 4 + 1, 1);
+  int ret = system(native);
+  free(native);
+  if (ret != -1 && WIFEXITED(ret)) ret = WEXITSTATUS(ret);
+  return ret;
+}
+
+#endif
@@ -0,0 +1,345 @@
+#pragma once
+// 由platform.h在非Windows平台包含：本项目用到的Win32类型、常量和接口，实现见platform_posix.c。
+// 只覆盖实际用到的部分，语义以这些调用点的需要为准：
+// - 路径为宽字符串，'\'视为分隔符，调用系统接口前转为UTF-8并换成'/'；文件名区分大小写
+// - HANDLE指向内部对象（文件、目录遍历、映射、事件、线程），共享模式和安全属性被忽略
+// - GetLastError返回按errno换算的Win32错误码
+// - 宽字符格式化函数按MSVC的约定解释格式串：%s/%c为宽字符，%S为窄字符，l修饰的整数为32位
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <wchar.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // ---------------- 基本类型 ----------------
+  typedef unsigned char BYTE;
+  typedef unsigned short WORD;
+  typedef unsigned int DWORD;
+  typedef int LONG;
+  typedef unsigned int ULONG;
+  typedef int INT;
+  typedef unsigned int UINT;
+  typedef int BOOL;
+  typedef unsigned char BOOLEAN;
+  typedef long long LONGLONG;
+  typedef unsigned long long ULONGLONG;
+  typedef uintptr_t ULONG_PTR;
+  typedef uintptr_t DWORD_PTR;
+  typedef size_t SIZE_T;
+  typedef void VOID;
+  typedef void* PVOID;
+  typedef void* LPVOID;
+  typedef const void* LPCVOID;
+  typedef void* HANDLE;
+  typedef void* HWND;
+  typedef DWORD* LPDWORD;
+  typedef wchar_t WCHAR;
+  typedef wchar_t* LPWSTR;
+  typedef const wchar_t* LPCWSTR;
+  typedef wchar_t TCHAR;
+  typedef wchar_t* LPTSTR;
+  typedef const wchar_t* LPCTSTR;
+  typedef char* LPSTR;
+  typedef const char* LPCSTR;
+
+  typedef union {
+    struct {
+      DWORD LowPart;
+      LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+  } LARGE_INTEGER;
+
+  typedef struct {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+  } FILETIME;
+
+  typedef struct SECURITY_ATTRIBUTES SECURITY_ATTRIBUTES, * LPSECURITY_ATTRIBUTES;
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 1024
+#define MAXDWORD 0xFFFFFFFFu
+#define INFINITE 0xFFFFFFFFu
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define _TRUNCATE ((size_t)-1)
+#define _T(x) L##x
+#define TEXT(x) L##x
+#define UNREFERENCED_PARAMETER(x) (void)(x)
+
+  // ---------------- 错误码 ----------------
+#define ERROR_SUCCESS 0
+#define ERROR_INVALID_FUNCTION 1
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_PATH_NOT_FOUND 3
+#define ERROR_TOO_MANY_OPEN_FILES 4
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_OUTOFMEMORY 14
+#define ERROR_NOT_SAME_DEVICE 17
+#define ERROR_NO_MORE_FILES 18
+#define ERROR_WRITE_PROTECT 19
+#define ERROR_SHARING_VIOLATION 32
+#define ERROR_HANDLE_DISK_FULL 39
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_FILE_EXISTS 80
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_BROKEN_PIPE 109
+#define ERROR_DISK_FULL 112
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_DIR_NOT_EMPTY 145
+#define ERROR_BUSY 170
+#define ERROR_ALREADY_EXISTS 183
+#define ERROR_FILENAME_EXCED_RANGE 206
+#define ERROR_ENVVAR_NOT_FOUND 203
+#define ERROR_NO_UNICODE_TRANSLATION 1113
+#define ERROR_TOO_MANY_LINKS 1142
+
+  DWORD GetLastError(void);
+  void SetLastError(DWORD error);
+
+  // 直接调用系统接口的模块使用：路径转为系统路径（UTF-8，'/'分隔），errno换算为Win32错误码
+#define PLATFORM_NATIVE_PATH_SIZE (MAX_PATH * 4)
+  int Platform_NativePath(LPCWSTR path, char* out);
+  DWORD Platform_ErrorFromErrno(int err);
+
+  // ---------------- 文件 ----------------
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_WRITE_ATTRIBUTES 0x0100u
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_READONLY 0x1
+#define FILE_ATTRIBUTE_HIDDEN 0x2
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_ARCHIVE 0x20
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_ATTRIBUTE_TEMPORARY 0x100
+#define FILE_ATTRIBUTE_SPARSE_FILE 0x200
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000u
+#define FILE_FLAG_BACKUP_SEMANTICS 0x02000000u
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define MOVEFILE_COPY_ALLOWED 0x2
+
+  typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+  } WIN32_FILE_ATTRIBUTE_DATA;
+
+  typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    WCHAR cFileName[MAX_PATH];
+    WCHAR cAlternateFileName[14];
+  } WIN32_FIND_DATAW;
+
+  typedef enum { GetFileExInfoStandard } GET_FILEEX_INFO_LEVELS;
+
+  HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD share, LPSECURITY_ATTRIBUTES sa, DWORD disposition, DWORD flags, HANDLE templ);
+  BOOL ReadFile(HANDLE file, LPVOID buffer, DWORD size, LPDWORD read, void* overlapped);
+  BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD size, LPDWORD written, void* overlapped);
+  BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size);
+  BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* new_pos, DWORD method);
+  BOOL SetEndOfFile(HANDLE file);
+  BOOL SetFileTime(HANDLE file, const FILETIME* creation, const FILETIME* access, const FILETIME* write);
+  BOOL CloseHandle(HANDLE handle);
+
+  BOOL DeleteFileW(LPCWSTR path);
+  // 目标已存在且fail_if_exists时失败；优先在内核中复制（copy_file_range），保留权限位和修改时间
+  BOOL CopyFileW(LPCWSTR src, LPCWSTR dst, BOOL fail_if_exists);
+  BOOL CreateHardLinkW(LPCWSTR link, LPCWSTR target, LPSECURITY_ATTRIBUTES sa);
+  BOOL MoveFileExW(LPCWSTR src, LPCWSTR dst, DWORD flags);
+  BOOL CreateDirectoryW(LPCWSTR path, LPSECURITY_ATTRIBUTES sa);
+  BOOL RemoveDirectoryW(LPCWSTR path);
+  DWORD GetFileAttributesW(LPCWSTR path);
+  BOOL GetFileAttributesExW(LPCWSTR path, GET_FILEEX_INFO_LEVELS level, LPVOID info);
+
+  // 模式为“目录\通配符”，通配符只作用于最后一级，按不区分大小写匹配；结果包含"."和".."
+  HANDLE FindFirstFileW(LPCWSTR pattern, WIN32_FIND_DATAW* data);
+  BOOL FindNextFileW(HANDLE find, WIN32_FIND_DATAW* data);
+  BOOL FindClose(HANDLE find);
+
+  // 只有Unicode版本，TCHAR名称直接对应
+#define WIN32_FIND_DATA WIN32_FIND_DATAW
+#define CreateFile CreateFileW
+#define DeleteFile DeleteFileW
+#define FindFirstFile FindFirstFileW
+#define FindNextFile FindNextFileW
+
+  // 不要求路径存在，只做词法上的规整（去掉"."和".."）；结果以'\'分隔，绝对路径以'\'开头
+  DWORD GetFullPathNameW(LPCWSTR path, DWORD size, LPWSTR buffer, LPWSTR* file_part);
+  // $TMPDIR，未设置时为/tmp，结尾带分隔符
+  DWORD GetTempPathW(DWORD size, LPWSTR buffer);
+  DWORD GetCurrentDirectoryW(DWORD size, LPWSTR buffer);
+  BOOL SetCurrentDirectoryW(LPCWSTR path);
+  // 只支持module为NULL（当前可执行文件）
+  DWORD GetModuleFileNameW(HANDLE module, LPWSTR buffer, DWORD size);
+
+  // ---------------- 文件映射 ----------------
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_WRITECOPY 0x08
+#define FILE_MAP_COPY 0x1
+#define FILE_MAP_WRITE 0x2
+#define FILE_MAP_READ 0x4
+
+  HANDLE CreateFileMappingW(HANDLE file, LPSECURITY_ATTRIBUTES sa, DWORD protect, DWORD size_high, DWORD size_low, LPCWSTR name);
+  LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, SIZE_T size);
+  BOOL UnmapViewOfFile(LPCVOID view);
+
+  // ---------------- 线程和同步 ----------------
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED ((DWORD)0xFFFFFFFF)
+#define MAXIMUM_WAIT_OBJECTS 64
+#define FLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+
+  typedef DWORD(WINAPI* LPTHREAD_START_ROUTINE)(LPVOID param);
+  typedef VOID(WINAPI* PFLS_CALLBACK_FUNCTION)(PVOID data);
+
+  HANDLE CreateThread(LPSECURITY_ATTRIBUTES sa, SIZE_T stack_size, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags, LPDWORD thread_id);
+  HANDLE CreateEventW(LPSECURITY_ATTRIBUTES sa, BOOL manual_reset, BOOL initial_state, LPCWSTR name);
+  BOOL SetEvent(HANDLE event);
+  BOOL ResetEvent(HANDLE event);
+  // 可等待事件和线程
+  DWORD WaitForSingleObject(HANDLE handle, DWORD ms);
+  // 只支持wait_all为TRUE
+  DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all, DWORD ms);
+  void Sleep(DWORD ms);
+
+  DWORD GetCurrentThreadId(void);
+  DWORD GetCurrentProcessId(void);
+
+  DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION callback);
+  PVOID FlsGetValue(DWORD index);
+  BOOL FlsSetValue(DWORD index, PVOID value);
+  BOOL FlsFree(DWORD index);
+
+  typedef struct {
+    pthread_rwlock_t lock;
+  } SRWLOCK, * PSRWLOCK;
+#define SRWLOCK_INIT { PTHREAD_RWLOCK_INITIALIZER }
+
+  static inline void InitializeSRWLock(PSRWLOCK lock) { pthread_rwlock_init(&lock->lock, NULL); }
+  static inline void AcquireSRWLockExclusive(PSRWLOCK lock) { pthread_rwlock_wrlock(&lock->lock); }
+  static inline void ReleaseSRWLockExclusive(PSRWLOCK lock) { pthread_rwlock_unlock(&lock->lock); }
+  static inline void AcquireSRWLockShared(PSRWLOCK lock) { pthread_rwlock_rdlock(&lock->lock); }
+  static inline void ReleaseSRWLockShared(PSRWLOCK lock) { pthread_rwlock_unlock(&lock->lock); }
+  static inline BOOLEAN TryAcquireSRWLockExclusive(PSRWLOCK lock) { return pthread_rwlock_trywrlock(&lock->lock) == 0; }
+
+  // 可重入，与Win32一致
+  typedef struct {
+    pthread_mutex_t mutex;
+  } CRITICAL_SECTION, * LPCRITICAL_SECTION;
+
+  void InitializeCriticalSection(LPCRITICAL_SECTION cs);
+  static inline void EnterCriticalSection(LPCRITICAL_SECTION cs) { pthread_mutex_lock(&cs->mutex); }
+  static inline void LeaveCriticalSection(LPCRITICAL_SECTION cs) { pthread_mutex_unlock(&cs->mutex); }
+  static inline void DeleteCriticalSection(LPCRITICAL_SECTION cs) { pthread_mutex_destroy(&cs->mutex); }
+
+  typedef struct {
+    volatile LONG state;  // 0：未执行，1：执行中，2：已完成
+  } INIT_ONCE, * PINIT_ONCE;
+#define INIT_ONCE_STATIC_INIT { 0 }
+  typedef BOOL(WINAPI* PINIT_ONCE_FN)(PINIT_ONCE once, PVOID param, PVOID* context);
+  BOOL InitOnceExecuteOnce(PINIT_ONCE once, PINIT_ONCE_FN fn, PVOID param, LPVOID* context);
+  static inline void InitOnceInitialize(PINIT_ONCE once) { once->state = 0; }
+
+  // 与Win32相同，都是完整内存屏障
+  static inline LONG InterlockedIncrement(LONG volatile* p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+  static inline LONG InterlockedDecrement(LONG volatile* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+  static inline LONG InterlockedExchange(LONG volatile* p, LONG value) { return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST); }
+  static inline LONG InterlockedExchangeAdd(LONG volatile* p, LONG value) { return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST); }
+  static inline LONGLONG InterlockedExchangeAdd64(LONGLONG volatile* p, LONGLONG value) { return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST); }
+  static inline LONG InterlockedCompareExchange(LONG volatile* p, LONG value, LONG comparand) {
+    __atomic_compare_exchange_n(p, &comparand, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+  }
+  static inline PVOID InterlockedCompareExchangePointer(PVOID volatile* p, PVOID value, PVOID comparand) {
+    __atomic_compare_exchange_n(p, &comparand, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+  }
+
+  // ---------------- 系统信息和时间 ----------------
+  typedef struct {
+    DWORD dwPageSize;
+    DWORD dwNumberOfProcessors;
+    DWORD dwAllocationGranularity;
+  } SYSTEM_INFO;
+
+  void GetSystemInfo(SYSTEM_INFO* info);
+
+  typedef struct {
+    DWORD dwLength;
+    DWORD dwMemoryLoad;
+    ULONGLONG ullTotalPhys;
+    ULONGLONG ullAvailPhys;
+  } MEMORYSTATUSEX;
+  BOOL GlobalMemoryStatusEx(MEMORYSTATUSEX* status);
+  // 产生SIGTRAP，调试器中断在调用处
+  void DebugBreak(void);
+  BOOL QueryPerformanceCounter(LARGE_INTEGER* counter);
+  BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+  ULONGLONG GetTickCount64(void);
+  DWORD GetTickCount(void);
+  void GetSystemTimeAsFileTime(FILETIME* time);
+  DWORD GetEnvironmentVariableW(LPCWSTR name, LPWSTR buffer, DWORD size);
+
+  // ---------------- 编码转换 ----------------
+#define CP_ACP 0
+#define CP_UTF8 65001
+
+  // 两种代码页都按UTF-8处理
+  int MultiByteToWideChar(UINT code_page, DWORD flags, LPCSTR src, int src_len, LPWSTR dst, int dst_len);
+  int WideCharToMultiByte(UINT code_page, DWORD flags, LPCWSTR src, int src_len, LPSTR dst, int dst_len, LPCSTR default_char, BOOL* used_default);
+
+  // ---------------- MSVC运行库 ----------------
+  int _wcsicmp(const wchar_t* a, const wchar_t* b);
+  int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t count);
+  wchar_t* _wcsdup(const wchar_t* s);
+  char* _strdup(const char* s);
+  int wcsncpy_s(wchar_t* dst, size_t size, const wchar_t* src, size_t count);
+  int wcscpy_s(wchar_t* dst, size_t size, const wchar_t* src);
+  int wcscat_s(wchar_t* dst, size_t size, const wchar_t* src);
+  wchar_t* wcstok_s(wchar_t* str, const wchar_t* delim, wchar_t** context);
+  int mbstowcs_s(size_t* converted, wchar_t* dst, size_t size, const char* src, size_t count);
+  int _vsnwprintf_s(wchar_t* dst, size_t size, size_t count, const wchar_t* fmt, va_list args);
+  int _snwprintf_s(wchar_t* dst, size_t size, size_t count, const wchar_t* fmt, ...);
+  int swprintf_s(wchar_t* dst, size_t size, const wchar_t* fmt, ...);
+  int wsprintfW(wchar_t* dst, const wchar_t* fmt, ...);
+  int sprintf_s(char* dst, size_t size, const char* fmt, ...);
+  // 命令行中的'\'换成'/'后交给/bin/sh执行
+  int _wsystem(const wchar_t* command);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,564 @@
+#include "procexec.h"
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+struct ProcessJobState {
+  ProcessJob job;
+  ProcessResult result;
+  std::atomic<bool> cancel{ false };
+  bool done = false;
+  std::mutex mutex;
+  std::condition_variable cv;
+#ifdef _WIN32
+  HANDLE cancel_event = NULL;  // 手动重置事件，Cancel时置位
+#else
+  int cancel_pipe[2] = { -1, -1 };  // Cancel时向写端写一个字节
+#endif
+
+  ~ProcessJobState() {
+#ifdef _WIN32
+    if (cancel_event) CloseHandle(cancel_event);
+#else
+    if (cancel_pipe[0] >= 0) close(cancel_pipe[0]);
+    if (cancel_pipe[1] >= 0) close(cancel_pipe[1]);
+#endif
+  }
+};
+
+namespace {
+  // 追加输出，超出上限时只保留最后PROCEXEC_OUTPUT_LIMIT字节
+  void AppendCapped(std::string& dst, const char* data, size_t len) {
+    dst.append(data, len);
+    if (dst.size() > PROCEXEC_OUTPUT_LIMIT) dst.erase(0, dst.size() - PROCEXEC_OUTPUT_LIMIT);
+  }
+
+  // 从stdout中解析百分比：1到3位数字紧跟'%'。7z用退格覆盖进度，不依赖换行
+  class ProgressParser {
+  public:
+    explicit ProgressParser(ProcessJobState& state) : state_(state) {}
+
+    void Feed(const char* data, size_t len) {
+      for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c >= '0' && c <= '9') {
+          if (digits_ < 4) value_ = value_ * 10 + (c - '0');
+          ++digits_;
+          continue;
+        }
+        if (c == '%' && digits_ >= 1 && digits_ <= 3 && value_ <= 100 && value_ != state_.result.last_percent) {
+          state_.result.last_percent = value_;
+          if (state_.job.on_progress) state_.job.on_progress(value_);
+        }
+        digits_ = 0;
+        value_ = 0;
+      }
+    }
+
+  private:
+    ProcessJobState& state_;
+    int digits_ = 0;
+    int value_ = 0;
+  };
+
+  uint32_t ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // 收到的stdout数据：设置了on_output时原样交出，否则保存并解析进度。on_output返回false时返回false
+  bool DeliverOutput(ProcessJobState& state, ProgressParser& parser, const char* data, size_t len) {
+    if (state.job.on_output) return state.job.on_output(data, len);
+    AppendCapped(state.result.output, data, len);
+    parser.Feed(data, len);
+    return true;
+  }
+
+#ifdef _WIN32
+  void ReadPipe(HANDLE pipe, std::string& dst) {
+    char buf[4096];
+    DWORD read = 0;
+    while (ReadFile(pipe, buf, sizeof(buf), &read, NULL) && read > 0) AppendCapped(dst, buf, read);
+  }
+
+  // on_output拒绝数据时像Cancel一样置位取消事件，等待子进程的线程随即结束进程树；之后的数据读出后丢弃
+  void ReadOutput(HANDLE pipe, ProcessJobState& state, ProgressParser& parser) {
+    char buf[64 * 1024];
+    DWORD read = 0;
+    bool accept = true;
+    while (ReadFile(pipe, buf, sizeof(buf), &read, NULL) && read > 0) {
+      if (!accept || DeliverOutput(state, parser, buf, read)) continue;
+      accept = false;
+      state.cancel = true;
+      if (state.cancel_event) SetEvent(state.cancel_event);
+    }
+  }
+
+  // 子进程不再读取（已退出或被结束）时WriteFile失败，写线程随之结束
+  void WriteInput(HANDLE pipe, const BYTE* data, size_t size) {
+    while (size > 0) {
+      DWORD chunk = size > (1u << 20) ? (1u << 20) : (DWORD)size;
+      DWORD written = 0;
+      if (!WriteFile(pipe, data, chunk, &written, NULL) || written == 0) break;
+      data += written;
+      size -= written;
+    }
+    CloseHandle(pipe);
+  }
+
+  // 启动进程并等待其结束、超时或被取消。子进程放入作业对象，关闭作业对象时它派生的进程也一并结束；
+  // 只继承为它创建的三个句柄，并发启动的其他任务的管道不会漏给它
+  void RunProcess(ProcessJobState& state) {
+    ProcessResult& result = state.result;
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE out_read = NULL, out_write = NULL, err_read = NULL, err_write = NULL, in_write = NULL;
+    if (!CreatePipe(&out_read, &out_write, &sa, 0) || !CreatePipe(&err_read, &err_write, &sa, 0)) {
+      result.error = GetLastError();
+      if (out_read) CloseHandle(out_read);
+      if (out_write) CloseHandle(out_write);
+      return;
+    }
+    SetHandleInformation(out_read, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(err_read, HANDLE_FLAG_INHERIT, 0);
+    // 没有输入数据时stdin为NUL，7z需要确认时读到EOF而不是一直等待
+    HANDLE null_in = INVALID_HANDLE_VALUE;
+    if (state.job.input) {
+      if (CreatePipe(&null_in, &in_write, &sa, 0)) SetHandleInformation(in_write, HANDLE_FLAG_INHERIT, 0);
+      else null_in = INVALID_HANDLE_VALUE;
+    }
+    else {
+      null_in = CreateFileW(L"NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+    }
+
+    SIZE_T attr_size = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attr_size);
+    std::vector<BYTE> attr_buf(attr_size);
+    LPPROC_THREAD_ATTRIBUTE_LIST attrs = (LPPROC_THREAD_ATTRIBUTE_LIST)attr_buf.data();
+    HANDLE inherit[3] = { null_in, out_write, err_write };
+    BOOL attrs_ok = null_in != INVALID_HANDLE_VALUE && InitializeProcThreadAttributeList(attrs, 1, 0, &attr_size) &&
+      UpdateProcThreadAttribute(attrs, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherit, sizeof(inherit), NULL, NULL);
+
+    STARTUPINFOEXW si = {};
+    si.StartupInfo.cb = sizeof(si);
+    si.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    si.StartupInfo.hStdInput = null_in;
+    si.StartupInfo.hStdOutput = out_write;
+    si.StartupInfo.hStdError = err_write;
+    si.lpAttributeList = attrs;
+    PROCESS_INFORMATION pi = {};
+    std::wstring cmd = state.job.command_line;
+    BOOL started = attrs_ok && CreateProcessW(NULL, &cmd[0], NULL, NULL, TRUE,
+      CREATE_SUSPENDED | CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, NULL,
+      state.job.work_dir.empty() ? NULL : state.job.work_dir.c_str(), &si.StartupInfo, &pi);
+    if (!started) result.error = GetLastError();
+    if (attrs_ok) DeleteProcThreadAttributeList(attrs);
+    CloseHandle(out_write);
+    CloseHandle(err_write);
+    if (null_in != INVALID_HANDLE_VALUE) CloseHandle(null_in);
+    if (!started) {
+      if (in_write) CloseHandle(in_write);
+      CloseHandle(out_read);
+      CloseHandle(err_read);
+      return;
+    }
+
+    HANDLE job_object = CreateJobObjectW(NULL, NULL);
+    if (job_object) {
+      JOBOBJECT_EXTENDED_LIMIT_INFORMATION limit = {};
+      limit.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+      if (!SetInformationJobObject(job_object, JobObjectExtendedLimitInformation, &limit, sizeof(limit)) ||
+        !AssignProcessToJobObject(job_object, pi.hProcess)) {
+        CloseHandle(job_object);
+        job_object = NULL;
+      }
+    }
+    result.started = true;
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+
+    ProgressParser parser(state);
+    std::thread err_reader(ReadPipe, err_read, std::ref(result.errors));
+    std::thread out_reader(ReadOutput, out_read, std::ref(state), std::ref(parser));
+    std::thread in_writer;
+    if (in_write) in_writer = std::thread(WriteInput, in_write, (const BYTE*)state.job.input, state.job.input_size);
+
+    HANDLE waits[2] = { pi.hProcess, state.cancel_event };
+    DWORD wait = WaitForMultipleObjects(state.cancel_event ? 2 : 1, waits, FALSE, state.job.timeout_ms ? state.job.timeout_ms : INFINITE);
+    if (wait != WAIT_OBJECT_0) {
+      result.timed_out = wait == WAIT_TIMEOUT;
+      result.cancelled = wait == WAIT_OBJECT_0 + 1;
+      if (job_object) TerminateJobObject(job_object, 1);
+      else TerminateProcess(pi.hProcess, 1);
+      WaitForSingleObject(pi.hProcess, INFINITE);
+    }
+    DWORD exit_code = 0;
+    GetExitCodeProcess(pi.hProcess, &exit_code);
+    result.exit_code = (int)exit_code;
+    // 结束子进程留下的进程，它们可能还持有管道写端，之后读线程才能读到EOF
+    if (job_object) CloseHandle(job_object);
+    if (in_writer.joinable()) in_writer.join();
+    out_reader.join();
+    err_reader.join();
+    CloseHandle(out_read);
+    CloseHandle(err_read);
+    CloseHandle(pi.hProcess);
+  }
+#else
+  // 创建管道到fork之间持有，并发启动的子进程不会在FD_CLOEXEC设置之前继承其他任务的管道
+  std::mutex g_spawn_mutex;
+
+  bool MakePipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+  }
+
+  std::string ToUtf8(const std::wstring& s) {
+    std::string out;
+    for (wchar_t wc : s) {
+      // 程序内的路径以'\\'分隔（见platform.h），交给子进程前换成'/'
+      uint32_t c = wc == L'\\' ? (uint32_t)L'/' : (uint32_t)wc;
+      if (c < 0x80) {
+        out += (char)c;
+      }
+      else if (c < 0x800) {
+        out += (char)(0xC0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+      else if (c < 0x10000) {
+        out += (char)(0xE0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+      else {
+        out += (char)(0xF0 | (c >> 18));
+        out += (char)(0x80 | ((c >> 12) & 0x3F));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+    }
+    return out;
+  }
+
+  // 启动进程并等待其结束、超时或被取消。子进程自成进程组，结束时连同它派生的进程一起SIGKILL
+  void RunProcess(ProcessJobState& state) {
+    ProcessResult& result = state.result;
+    std::vector<std::string> args;
+    for (const auto& arg : ProcessExecutor::SplitCommandLine(state.job.command_line)) args.push_back(ToUtf8(arg));
+    if (args.empty()) {
+      result.error = EINVAL;
+      return;
+    }
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    std::string work_dir = ToUtf8(state.job.work_dir);
+
+    int out_pipe[2] = { -1, -1 }, err_pipe[2] = { -1, -1 }, in_pipe[2] = { -1, -1 };
+    pid_t pid = -1;
+    {
+      std::lock_guard<std::mutex> lock(g_spawn_mutex);
+      // 有输入数据时stdin为管道，否则为/dev/null
+      int null_in = -1;
+      if (state.job.input) {
+        if (MakePipe(in_pipe)) null_in = in_pipe[0];
+      }
+      else {
+        null_in = open("/dev/null", O_RDONLY | O_CLOEXEC);
+      }
+      if (null_in >= 0 && MakePipe(out_pipe) && MakePipe(err_pipe)) pid = fork();
+      if (pid == 0) {
+        // 子进程：fork之后只调用异步信号安全的函数；执行线程屏蔽了SIGPIPE，恢复后再exec
+        sigset_t pipe_set;
+        sigemptyset(&pipe_set);
+        sigaddset(&pipe_set, SIGPIPE);
+        sigprocmask(SIG_UNBLOCK, &pipe_set, NULL);
+        setpgid(0, 0);
+        dup2(null_in, 0);
+        dup2(out_pipe[1], 1);
+        dup2(err_pipe[1], 2);
+        if (!work_dir.empty() && chdir(work_dir.c_str()) != 0) _exit(127);
+        execvp(argv[0], argv.data());
+        _exit(127);
+      }
+      if (pid < 0) result.error = errno;
+      if (null_in >= 0) close(null_in);
+      if (out_pipe[1] >= 0) close(out_pipe[1]);
+      if (err_pipe[1] >= 0) close(err_pipe[1]);
+    }
+    if (pid < 0) {
+      if (in_pipe[1] >= 0) close(in_pipe[1]);
+      if (out_pipe[0] >= 0) close(out_pipe[0]);
+      if (err_pipe[0] >= 0) close(err_pipe[0]);
+      return;
+    }
+    // 输入在轮询中分段写入，写端非阻塞；子进程不再读取时write返回EPIPE（SIGPIPE已屏蔽）
+    int in_fd = in_pipe[1];
+    const char* input = (const char*)state.job.input;
+    size_t input_left = state.job.input_size;
+    if (in_fd >= 0) {
+      fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+      if (input_left == 0) {
+        close(in_fd);
+        in_fd = -1;
+      }
+    }
+    // 与子进程中的调用互为保证，无论哪个先执行，之后kill(-pid)都能覆盖整个进程组
+    setpgid(pid, pid);
+    result.started = true;
+
+    ProgressParser parser(state);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(state.job.timeout_ms);
+    int fds[2] = { out_pipe[0], err_pipe[0] };
+    bool exited = false;
+    while (!exited || fds[0] >= 0 || fds[1] >= 0) {
+      int wait_ms = 100;
+      if (state.job.timeout_ms) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+          result.timed_out = true;
+          break;
+        }
+        wait_ms = (int)(std::min)((long long)wait_ms, (long long)left);
+      }
+      pollfd pfds[4];
+      int slots[4];
+      nfds_t count = 0;
+      for (int i = 0; i < 2; ++i) {
+        if (fds[i] < 0) continue;
+        pfds[count] = { fds[i], POLLIN, 0 };
+        slots[count++] = i;
+      }
+      if (in_fd >= 0) {
+        pfds[count] = { in_fd, POLLOUT, 0 };
+        slots[count++] = 2;
+      }
+      pfds[count] = { state.cancel_pipe[0], POLLIN, 0 };
+      slots[count++] = -1;
+      if (poll(pfds, count, wait_ms) < 0 && errno != EINTR) break;
+      if (state.cancel) {
+        result.cancelled = true;
+        break;
+      }
+      bool rejected = false;
+      for (nfds_t i = 0; i < count; ++i) {
+        int slot = slots[i];
+        if (slot == 2) {
+          if (!(pfds[i].revents & (POLLOUT | POLLHUP | POLLERR))) continue;
+          ssize_t n = write(in_fd, input, (std::min)(input_left, (size_t)(1 << 20)));
+          if (n > 0) {
+            input += n;
+            input_left -= (size_t)n;
+          }
+          if (input_left == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+            close(in_fd);
+            in_fd = -1;
+          }
+          continue;
+        }
+        if (slot < 0 || !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        char buf[64 * 1024];
+        ssize_t n = read(fds[slot], buf, sizeof(buf));
+        if (n > 0) {
+          if (slot == 1) AppendCapped(result.errors, buf, (size_t)n);
+          else if (!DeliverOutput(state, parser, buf, (size_t)n)) rejected = true;
+        }
+        else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+          close(fds[slot]);
+          fds[slot] = -1;
+        }
+      }
+      if (rejected) {
+        result.cancelled = true;
+        break;
+      }
+      // 只查看不回收：主进程成为僵尸前pid不会被复用，此时结束整个进程组是安全的，
+      // 它留下的进程可能还持有管道写端
+      siginfo_t info = {};
+      if (!exited && waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid) {
+        exited = true;
+        kill(-pid, SIGKILL);
+      }
+    }
+    if (!exited) kill(-pid, SIGKILL);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (WIFEXITED(status)) result.exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) result.exit_code = 128 + WTERMSIG(status);
+    for (int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+    if (in_fd >= 0) close(in_fd);
+  }
+#endif
+}
+
+std::string ProcessResult::FirstErrorLine() const {
+  auto first_line = [](const std::string& text, const char* must_contain) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find_first_of("\r\n", pos);
+      if (end == std::string::npos) end = text.size();
+      std::string line = text.substr(pos, end - pos);
+      if (line.find_first_not_of(" \t") != std::string::npos && (!must_contain || line.find(must_contain) != std::string::npos)) {
+        return line;
+      }
+      pos = end + 1;
+    }
+    return std::string();
+  };
+  std::string line = first_line(errors, nullptr);
+  return line.empty() ? first_line(output, "ERROR") : line;
+}
+
+std::vector<std::wstring> ProcessExecutor::SplitCommandLine(const std::wstring& command_line) {
+  std::vector<std::wstring> args;
+  size_t i = 0, n = command_line.size();
+  while (true) {
+    while (i < n && (command_line[i] == L' ' || command_line[i] == L'\t')) ++i;
+    if (i >= n) break;
+    std::wstring arg;
+    bool quoted = false;
+    while (i < n && (quoted || (command_line[i] != L' ' && command_line[i] != L'\t'))) {
+      // 2n个反斜杠加引号为n个反斜杠并切换引号状态，2n+1个为n个反斜杠加字面引号，其余反斜杠原样保留
+      size_t slashes = 0;
+      while (i < n && command_line[i] == L'\\') {
+        ++slashes;
+        ++i;
+      }
+      if (i < n && command_line[i] == L'"') {
+        arg.append(slashes / 2, L'\\');
+        if (slashes % 2) {
+          arg += L'"';
+        }
+        else if (quoted && i + 1 < n && command_line[i + 1] == L'"') {
+          arg += L'"';  // 引号内的""为字面引号
+          ++i;
+        }
+        else {
+          quoted = !quoted;
+        }
+        ++i;
+        continue;
+      }
+      arg.append(slashes, L'\\');
+      if (i < n && (quoted || (command_line[i] != L' ' && command_line[i] != L'\t'))) arg += command_line[i++];
+    }
+    args.push_back(arg);
+  }
+  return args;
+}
+
+ProcessExecutor::ProcessExecutor(unsigned max_concurrent) {
+  if (max_concurrent == 0) max_concurrent = std::thread::hardware_concurrency();
+  if (max_concurrent == 0) max_concurrent = 1;
+  for (unsigned i = 0; i < max_concurrent; ++i) {
+    runners_.emplace_back(&ProcessExecutor::RunnerMain, this);
+  }
+}
+
+ProcessExecutor::~ProcessExecutor() {
+  CancelAll();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_all();
+  for (auto& runner : runners_) {
+    if (runner.joinable()) runner.join();
+  }
+}
+
+ProcessTicket ProcessExecutor::Submit(ProcessJob job) {
+  ProcessTicket ticket = std::make_shared<ProcessJobState>();
+  ticket->job = std::move(job);
+#ifdef _WIN32
+  ticket->cancel_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+#else
+  {
+    std::lock_guard<std::mutex> lock(g_spawn_mutex);
+    if (!MakePipe(ticket->cancel_pipe)) ticket->cancel_pipe[0] = ticket->cancel_pipe[1] = -1;
+  }
+#endif
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(ticket);
+  }
+  queue_cv_.notify_one();
+  return ticket;
+}
+
+ProcessResult ProcessExecutor::Await(const ProcessTicket& ticket) {
+  std::unique_lock<std::mutex> lock(ticket->mutex);
+  ticket->cv.wait(lock, [&ticket] { return ticket->done; });
+  return ticket->result;
+}
+
+bool ProcessExecutor::Done(const ProcessTicket& ticket) const {
+  std::lock_guard<std::mutex> lock(ticket->mutex);
+  return ticket->done;
+}
+
+void ProcessExecutor::Cancel(const ProcessTicket& ticket) {
+  if (ticket->cancel.exchange(true)) return;
+#ifdef _WIN32
+  if (ticket->cancel_event) SetEvent(ticket->cancel_event);
+#else
+  if (ticket->cancel_pipe[1] >= 0) {
+    char c = 1;
+    ssize_t ignored = write(ticket->cancel_pipe[1], &c, 1);
+    (void)ignored;
+  }
+#endif
+}
+
+void ProcessExecutor::CancelAll() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& ticket : queue_) Cancel(ticket);
+  for (const auto& ticket : running_) Cancel(ticket);
+}
+
+void ProcessExecutor::RunnerMain() {
+#ifndef _WIN32
+  // 向已退出的子进程的stdin写入时由write返回EPIPE，而不是让SIGPIPE结束整个进程
+  sigset_t pipe_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+#endif
+  while (true) {
+    ProcessTicket ticket;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      ticket = queue_.front();
+      queue_.pop_front();
+      running_.push_back(ticket);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (ticket->cancel) ticket->result.cancelled = true;
+    else RunProcess(*ticket);
+    ticket->result.elapsed_ms = ElapsedMs(start);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_.erase(std::find(running_.begin(), running_.end(), ticket));
+    }
+    {
+      std::lock_guard<std::mutex> lock(ticket->mutex);
+      ticket->done = true;
+    }
+    ticket->cv.notify_all();
+  }
+}
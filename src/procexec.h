@@ -0,0 +1,90 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 异步进程执行器：提交外部命令（主要是7z）后立即返回，由固定数量的执行线程并发运行，
+// 调用方在需要结果时等待。子进程的stdout/stderr经管道收集，可按任务设置超时并随时取消；
+// 超时、取消或执行器析构时子进程及其派生的进程一并结束。
+// Windows下用作业对象管理子进程，POSIX下用进程组，后者便于在Linux构建机上用脚本代替7z测试
+
+// 一次进程调用
+struct ProcessJob {
+  // 完整命令行（含程序路径），按Windows规则引号转义；POSIX后端按同样规则拆分为argv
+  std::wstring command_line;
+  std::wstring work_dir;      // 为空时使用当前目录
+  uint32_t timeout_ms = 0;    // 0表示不限时
+  // 从stdout解析出新的百分比（如7z -bsp1输出的" 42%"）时回调，在执行线程中调用
+  std::function<void(int percent)> on_progress;
+  // 写入子进程stdin的数据（如7z -si），写完后关闭stdin；为NULL时stdin为空设备。
+  // 只引用不复制，须在Await返回前保持有效
+  const void* input = nullptr;
+  size_t input_size = 0;
+  // 设置后stdout的原始数据按到达顺序交给它（如7z -so），不再保存到ProcessResult::output，也不解析进度；
+  // 在执行线程中调用，返回false时按取消处理
+  std::function<bool(const char* data, size_t size)> on_output;
+};
+
+// 进程调用结果
+struct ProcessResult {
+  bool started = false;       // 进程是否启动成功
+  bool timed_out = false;
+  bool cancelled = false;
+  int exit_code = -1;         // 被信号结束时为128+信号值
+  uint32_t error = 0;         // 启动失败时的系统错误码
+  int last_percent = -1;      // 最后一次解析出的百分比，-1表示没有
+  uint32_t elapsed_ms = 0;
+  std::string output;         // stdout，只保留最后PROCEXEC_OUTPUT_LIMIT字节
+  std::string errors;         // stderr，同上
+
+  bool Succeeded() const { return started && !timed_out && !cancelled && exit_code == 0; }
+  // stderr中第一条非空行，没有时取stdout中第一条含"ERROR"的行，用于日志
+  std::string FirstErrorLine() const;
+};
+
+#define PROCEXEC_OUTPUT_LIMIT (64 * 1024)
+
+struct ProcessJobState;
+using ProcessTicket = std::shared_ptr<ProcessJobState>;
+
+class ProcessExecutor {
+public:
+  // max_concurrent为同时运行的进程数上限，0表示按硬件线程数
+  explicit ProcessExecutor(unsigned max_concurrent = 0);
+  // 取消所有未完成的任务并等待子进程结束
+  ~ProcessExecutor();
+
+  ProcessExecutor(const ProcessExecutor&) = delete;
+  ProcessExecutor& operator=(const ProcessExecutor&) = delete;
+
+  // 提交任务，排队等待空闲的执行线程
+  ProcessTicket Submit(ProcessJob job);
+  // 等待任务完成并返回结果，可多次调用
+  ProcessResult Await(const ProcessTicket& ticket);
+  // 任务是否已完成（不阻塞）
+  bool Done(const ProcessTicket& ticket) const;
+  // 取消任务：排队中的不再启动，运行中的结束其进程树
+  void Cancel(const ProcessTicket& ticket);
+  void CancelAll();
+
+  unsigned MaxConcurrent() const { return (unsigned)runners_.size(); }
+
+  // 按Windows命令行规则（CommandLineToArgvW）拆分
+  static std::vector<std::wstring> SplitCommandLine(const std::wstring& command_line);
+
+private:
+  void RunnerMain();
+
+  std::vector<std::thread> runners_;
+  mutable std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<ProcessTicket> queue_;
+  std::vector<ProcessTicket> running_;
+  bool stop_ = false;
+};
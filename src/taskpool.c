@@ -0,0 +1,64 @@
+#include "taskpool.h"
+#include "log.h"
+#include <stdlib.h>
+
+typedef struct {
+  TaskPool_Func func;
+  void* arg;
+  LONG count;
+  volatile LONG next;
+  volatile LONG failed;
+} ParallelForState;
+
+static DWORD WINAPI ParallelForWorker(LPVOID param) {
+  ParallelForState* state = (ParallelForState*)param;
+  while (!state->failed) {
+    LONG idx = InterlockedIncrement(&state->next) - 1;
+    if (idx >= state->count) break;
+    if (!state->func(state->arg, (DWORD)idx)) {
+      InterlockedExchange(&state->failed, 1);
+      break;
+    }
+  }
+  return 0;
+}
+
+DWORD TaskPool_DefaultThreads(void) {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  DWORD n = si.dwNumberOfProcessors;
+  if (n == 0) n = 1;
+  return n > TASKPOOL_MAX_THREADS ? TASKPOOL_MAX_THREADS : n;
+}
+
+int TaskPool_ParallelFor(DWORD count, DWORD max_threads, TaskPool_Func func, void* arg) {
+  if (count == 0) return 1;
+  ParallelForState state;
+  state.func = func;
+  state.arg = arg;
+  state.count = (LONG)count;
+  state.next = 0;
+  state.failed = 0;
+
+  DWORD threads = max_threads ? max_threads : TaskPool_DefaultThreads();
+  if (threads > count) threads = count;
+  if (threads > MAXIMUM_WAIT_OBJECTS) threads = MAXIMUM_WAIT_OBJECTS;
+  // 当前线程也参与处理，只需额外创建threads-1个线程
+  HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+  DWORD started = 0;
+  for (DWORD i = 1; i < threads; ++i) {
+    HANDLE h = CreateThread(NULL, 0, ParallelForWorker, &state, 0, NULL);
+    if (!h) {
+      // 创建线程失败时用已有的线程继续处理
+      XNSIS_LOG(L"CreateThread failed, error=%lu", GetLastError());
+      break;
+    }
+    handles[started++] = h;
+  }
+  ParallelForWorker(&state);
+  if (started) {
+    WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+    for (DWORD i = 0; i < started; ++i) CloseHandle(handles[i]);
+  }
+  return state.failed ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 处理第index项，成功返回非0
+  typedef int (*TaskPool_Func)(void* arg, DWORD index);
+
+  // 默认线程数：处理器数，最多TASKPOOL_MAX_THREADS
+#define TASKPOOL_MAX_THREADS 16
+  DWORD TaskPool_DefaultThreads(void);
+
+  // 用至多max_threads个线程（0为默认）处理[0, count)。
+  // 任意一项失败后不再开始新的项，等已开始的项结束后返回0；全部成功返回1
+  int TaskPool_ParallelFor(DWORD count, DWORD max_threads, TaskPool_Func func, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
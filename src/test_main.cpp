@@ -0,0 +1,1011 @@
+// 自检测试：各模块可以独立检查的行为（日志级别、distinfo的序列化往返及损坏文件的拒绝、校验算法的已知向量等），
+// 以及完整的打包安装（含分片、流式）后的逐文件校验。
+// 按DBG_SOLUTION构建，在临时工作目录中运行，打包安装经PATH中的7z完成；全部通过返回0，失败的检查逐条输出到stderr
+// 用法：test_xnsis
+#include "pack.h"
+#include "install.h"
+#include "archive.h"
+#include "procexec.h"
+#include "distinfo.h"
+#include "dircache.h"
+#include "fileops.h"
+#include "hash.h"
+#include "packcache.h"
+#include "log.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+  int g_checks = 0;
+  int g_failures = 0;
+
+#define CHECK(exp) do { \
+    ++g_checks; \
+    if (!(exp)) { \
+      ++g_failures; \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #exp); \
+    } \
+  } while (0)
+
+  bool ReadAll(const wchar_t* path, std::vector<BYTE>& data) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    bool ok = GetFileSizeEx(file, &size) != 0;
+    data.resize(ok ? (size_t)size.QuadPart : 0);
+    DWORD read = 0;
+    ok = ok && (data.empty() || (ReadFile(file, data.data(), (DWORD)data.size(), &read, NULL) && read == data.size()));
+    CloseHandle(file);
+    return ok;
+  }
+
+  bool WriteAll(const wchar_t* path, const BYTE* data, size_t size) {
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    DWORD written = 0;
+    bool ok = size == 0 || (WriteFile(file, data, (DWORD)size, &written, NULL) && written == size);
+    CloseHandle(file);
+    return ok;
+  }
+
+  bool WriteText(const wchar_t* path, const std::string& text) {
+    return WriteAll(path, (const BYTE*)text.data(), text.size());
+  }
+
+  bool MakeDirs(const std::wstring& path) {
+    for (size_t pos = path.find(L'\\'); pos != std::wstring::npos; pos = path.find(L'\\', pos + 1)) {
+      CreateDirectoryW(path.substr(0, pos).c_str(), NULL);
+    }
+    return CreateDirectoryW(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+  }
+
+  void RemoveTree(const std::wstring& path) {
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileW((path + L"\\*").c_str(), &fd);
+    if (hFind != INVALID_HANDLE_VALUE) {
+      do {
+        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+        std::wstring sub = path + L"\\" + fd.cFileName;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) RemoveTree(sub);
+        else DeleteFileW(sub.c_str());
+      } while (FindNextFileW(hFind, &fd));
+      FindClose(hFind);
+    }
+    RemoveDirectoryW(path.c_str());
+  }
+
+  // 按文件头中记录的算法重新计算v3尾部校验值，用于构造校验通过但结构损坏的文件
+  void ResignV3(std::vector<BYTE>& data) {
+    const size_t trailer = 16;
+    DWORD alg;
+    memcpy(&alg, data.data() + 8, sizeof(alg));
+    BYTE digest[HASH_MAX_DIGEST_SIZE] = { 0 };
+    Hash_Buffer(alg, data.data(), data.size() - trailer, digest);
+    memcpy(data.data() + data.size() - trailer, digest, trailer);
+  }
+
+  // 两个fake目录，路径有公共前缀和跨目录重复，外加插件和install.7z文件名
+  void BuildSample(InstallDistInfo* info) {
+    memset(info, 0, sizeof(InstallDistInfo));
+    DistInfo_AddFakeDir(info, L"$1");
+    DistInfo_AddFakeDir(info, L"$2");
+    DistInfo_AddFile(info, 0, L"app\\bin\\main.exe");
+    DistInfo_AddFile(info, 0, L"app\\res\\a.dat");
+    DistInfo_AddFile(info, 0, L"app\\res\\b.dat");
+    DistInfo_AddFile(info, 1, L"app\\res\\a.dat");
+    DistInfo_AddFile(info, 1, L"data\\\x4e2d\x6587.txt");
+    DistInfo_AddPlugin(info, L"app\\bin\\plugin.dll", L"-mx9");
+    DistInfo_SetInstall7zName(info, L"install_12345.7z");
+    // $2\app\res\a.dat和$1\app\res\b.dat只存储$1\app\res\a.dat一份
+    DistInfo_SetFileBlob(info, 1, 0, 0, 1);
+    DistInfo_SetFileBlob(info, 0, 2, 0, 1);
+  }
+
+  void CheckSameInfo(const InstallDistInfo* a, const InstallDistInfo* b) {
+    CHECK(a->dir_count == b->dir_count);
+    for (DWORD i = 0; i < a->dir_count && i < b->dir_count; ++i) {
+      CHECK(wcscmp(a->dirs[i].fake_dir, b->dirs[i].fake_dir) == 0);
+      CHECK(a->dirs[i].file_count == b->dirs[i].file_count);
+      for (DWORD j = 0; j < a->dirs[i].file_count && j < b->dirs[i].file_count; ++j) {
+        CHECK(wcscmp(a->dirs[i].file_list[j], b->dirs[i].file_list[j]) == 0);
+        CHECK(wcscmp(DistInfo_GetBlobPath(a, i, j), DistInfo_GetBlobPath(b, i, j)) == 0);
+      }
+    }
+    CHECK(a->plugin_count == b->plugin_count);
+    for (DWORD i = 0; i < a->plugin_count && i < b->plugin_count; ++i) {
+      CHECK(wcscmp(a->plugins[i].path, b->plugins[i].path) == 0);
+      CHECK(wcscmp(a->plugins[i].compress_param, b->plugins[i].compress_param) == 0);
+    }
+    CHECK(a->install7z_name && b->install7z_name && wcscmp(a->install7z_name, b->install7z_name) == 0);
+  }
+
+  void TestDistInfoRoundTrip() {
+    InstallDistInfo info;
+    BuildSample(&info);
+    const DWORD versions[] = { DISTINFO_VERSION_2, DISTINFO_VERSION_3 };
+    for (DWORD version : versions) {
+      CHECK(DistInfo_SaveVersion(&info, L"test.distinfo", version));
+      InstallDistInfo loaded;
+      CHECK(DistInfo_Load(&loaded, L"test.distinfo"));
+      CheckSameInfo(&info, &loaded);
+      CHECK(wcscmp(DistInfo_GetBlobPath(&loaded, 1, 0), L"app\\res\\a.dat") == 0);
+      CHECK(wcscmp(DistInfo_GetBlobPath(&loaded, 0, 2), L"app\\res\\a.dat") == 0);
+      DistInfo_Free(&loaded);
+    }
+    // v3的各校验算法
+    for (DWORD alg = 0; alg < HASH_ALG_COUNT; ++alg) {
+      CHECK(DistInfo_SaveEx(&info, L"test.distinfo", DISTINFO_VERSION_3, alg));
+      InstallDistInfo loaded;
+      CHECK(DistInfo_Load(&loaded, L"test.distinfo"));
+      CheckSameInfo(&info, &loaded);
+      DistInfo_Free(&loaded);
+    }
+    CHECK(!DistInfo_SaveEx(&info, L"test.distinfo", DISTINFO_VERSION_2, HASH_ALG_FAST64));
+    DistInfo_Free(&info);
+    DeleteFileW(L"test.distinfo");
+  }
+
+  void CheckRejected(const std::vector<BYTE>& data) {
+    CHECK(WriteAll(L"bad.distinfo", data.data(), data.size()));
+    InstallDistInfo loaded;
+    CHECK(!DistInfo_Load(&loaded, L"bad.distinfo"));
+  }
+
+  void TestDistInfoCorrupted() {
+    InstallDistInfo info;
+    BuildSample(&info);
+    const DWORD versions[] = { DISTINFO_VERSION_2, DISTINFO_VERSION_3 };
+    for (DWORD version : versions) {
+      std::vector<BYTE> good;
+      CHECK(DistInfo_SaveVersion(&info, L"test.distinfo", version));
+      CHECK(ReadAll(L"test.distinfo", good));
+      if (good.size() < 64) continue;
+      // 截断到任意长度
+      for (size_t len = 0; len < good.size(); len += (len < 64 ? 1 : 7)) {
+        CheckRejected(std::vector<BYTE>(good.begin(), good.begin() + len));
+      }
+      // 逐字节翻转，校验值不再匹配
+      for (size_t pos = 0; pos < good.size(); pos += 5) {
+        std::vector<BYTE> bad = good;
+        bad[pos] ^= 0x5A;
+        CheckRejected(bad);
+      }
+    }
+
+    // 校验值正确但结构损坏：第一个块长度超出文件、字符串表不在最前
+    std::vector<BYTE> good;
+    CHECK(DistInfo_SaveVersion(&info, L"test.distinfo", DISTINFO_VERSION_3));
+    CHECK(ReadAll(L"test.distinfo", good));
+    std::vector<BYTE> bad = good;
+    memset(bad.data() + 16 + 8, 0x7F, 8);
+    ResignV3(bad);
+    CheckRejected(bad);
+    bad = good;
+    bad[16] = DISTINFO_BLOCK_TYPE_DIRS;
+    ResignV3(bad);
+    CheckRejected(bad);
+    // 未知版本
+    bad = good;
+    bad[4] = 9;
+    CheckRejected(bad);
+    DistInfo_Free(&info);
+    DeleteFileW(L"test.distinfo");
+    DeleteFileW(L"bad.distinfo");
+  }
+
+  std::string Hex(const BYTE* data, size_t size) {
+    std::string out;
+    char buf[3];
+    for (size_t i = 0; i < size; ++i) {
+      snprintf(buf, sizeof(buf), "%02x", data[i]);
+      out += buf;
+    }
+    return out;
+  }
+
+  std::string DigestHex(DWORD alg, const void* data, size_t size) {
+    BYTE digest[HASH_MAX_DIGEST_SIZE] = { 0 };
+    if (!Hash_Buffer(alg, (const BYTE*)data, size, digest)) return std::string();
+    return Hex(digest, Hash_DigestSize(alg));
+  }
+
+  void TestHashVectors() {
+    // MD5和CRC32C为标准向量（摘要中的整数按小端序）；FAST64/FAST128是自有算法，数值写入distinfo，
+    // 以下为当前实现的结果，任何改变都会使已发布的安装包校验失败
+    CHECK(DigestHex(HASH_ALG_MD5, "", 0) == "d41d8cd98f00b204e9800998ecf8427e");
+    CHECK(DigestHex(HASH_ALG_MD5, "abc", 3) == "900150983cd24fb0d6963f7d28e17f72");
+    CHECK(DigestHex(HASH_ALG_MD5, "The quick brown fox jumps over the lazy dog", 43) == "9e107d9d372bb6826bd81d3542a419d6");
+    CHECK(DigestHex(HASH_ALG_CRC32C, "123456789", 9) == "839206e3");
+    CHECK(Hash_Crc32c(0, "123456789", 9) == 0xE3069283u);
+    CHECK(Hash_Crc32c(Hash_Crc32c(0, "1234", 4), "56789", 5) == 0xE3069283u);
+
+    std::vector<BYTE> data(5000);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (BYTE)(i * 2654435761u >> 13);
+    for (int simd = 1; simd >= 0; --simd) {
+      Hash_SetSimdEnabled(simd);
+      uint64_t h128[2];
+      CHECK(Hash_Fast64("", 0) == 0xe69f3aec68406c51ull);
+      Hash_Fast128("", 0, h128);
+      CHECK(h128[0] == 0xe69f3aec68406c51ull && h128[1] == 0xeecd426032f7816full);
+      CHECK(Hash_Fast64("abc", 3) == 0x9fc400ea0ff84ccaull);
+      Hash_Fast128("abc", 3, h128);
+      CHECK(h128[0] == 0x9fc400ea0ff84ccaull && h128[1] == 0x95cd9d146d5450d8ull);
+      CHECK(Hash_Fast64(data.data(), data.size()) == 0xbf16e2107df0230aull);
+      Hash_Fast128(data.data(), data.size(), h128);
+      CHECK(h128[0] == 0xbf16e2107df0230aull && h128[1] == 0x662a7dfc3710ab32ull);
+    }
+    Hash_SetSimdEnabled(1);
+
+    // 流式计算在条带、块边界前后切分，结果与一次性计算相同
+    const size_t splits[] = { 0, 1, 63, 64, 65, 1023, 1024, 1025, 1088, 2048, 4999 };
+    for (size_t len : { (size_t)0, (size_t)17, (size_t)64, (size_t)1024, (size_t)1088, (size_t)5000 }) {
+      for (size_t split : splits) {
+        if (split > len) continue;
+        for (DWORD alg = 0; alg < HASH_ALG_COUNT; ++alg) {
+          BYTE one_shot[HASH_MAX_DIGEST_SIZE] = { 0 }, streamed[HASH_MAX_DIGEST_SIZE] = { 0 };
+          HashState state;
+          CHECK(Hash_Buffer(alg, data.data(), len, one_shot));
+          CHECK(Hash_Init(&state, alg));
+          CHECK(Hash_Update(&state, data.data(), split));
+          CHECK(Hash_Update(&state, data.data() + split, len - split));
+          CHECK(Hash_Final(&state, streamed));
+          CHECK(memcmp(one_shot, streamed, HASH_MAX_DIGEST_SIZE) == 0);
+        }
+      }
+    }
+
+    // 文件摘要与缓冲区摘要相同
+    CHECK(WriteAll(L"hash.bin", data.data(), data.size()));
+    for (DWORD alg = 0; alg < HASH_ALG_COUNT; ++alg) {
+      BYTE expected[HASH_MAX_DIGEST_SIZE] = { 0 }, actual[HASH_MAX_DIGEST_SIZE] = { 0 };
+      ULONGLONG size = 0;
+      CHECK(Hash_Buffer(alg, data.data(), data.size(), expected));
+      CHECK(Hash_FileDigest(alg, L"hash.bin", &size, actual));
+      CHECK(size == data.size());
+      CHECK(memcmp(expected, actual, HASH_MAX_DIGEST_SIZE) == 0);
+    }
+    DeleteFileW(L"hash.bin");
+  }
+
+  void TestDistInfoFileHash() {
+    InstallDistInfo info;
+    BuildSample(&info);
+    BYTE digest[HASH_MAX_DIGEST_SIZE];
+    for (DWORD i = 0; i < info.dir_count; ++i) {
+      for (DWORD j = 0; j < info.dirs[i].file_count; ++j) {
+        // 第一个目录的最后一个文件不记录
+        if (i == 0 && j + 1 == info.dirs[i].file_count) continue;
+        memset(digest, (int)(i * 16 + j + 1), sizeof(digest));
+        CHECK(DistInfo_SetFileDigest(&info, i, j, HASH_ALG_FAST128, 1000 * i + j, digest) == 0);
+      }
+    }
+    CHECK(DistInfo_SetFileDigest(&info, 0, 0, HASH_ALG_CRC32C, 1, digest) != 0);
+    CHECK(DistInfo_SaveVersion(&info, L"test.distinfo", DISTINFO_VERSION_3));
+    InstallDistInfo loaded;
+    CHECK(DistInfo_Load(&loaded, L"test.distinfo"));
+    CheckSameInfo(&info, &loaded);
+    CHECK(loaded.has_file_digests && loaded.file_hash_alg == HASH_ALG_FAST128);
+    for (DWORD i = 0; i < loaded.dir_count; ++i) {
+      for (DWORD j = 0; j < loaded.dirs[i].file_count; ++j) {
+        const InstallFileDigest* d = DistInfo_GetFileDigest(&loaded, i, j);
+        if (i == 0 && j + 1 == loaded.dirs[i].file_count) {
+          CHECK(d == NULL);
+          continue;
+        }
+        memset(digest, (int)(i * 16 + j + 1), sizeof(digest));
+        CHECK(d && d->size == 1000 * i + j && memcmp(d->digest, digest, Hash_DigestSize(HASH_ALG_FAST128)) == 0);
+      }
+    }
+    DistInfo_Free(&loaded);
+    DistInfo_Free(&info);
+    DeleteFileW(L"test.distinfo");
+  }
+
+  // 合成的源文件：fake_dir为fake目录序号，内容由size和seed决定，两者相同的文件内容相同
+  struct SourceFile {
+    int fake_dir;
+    const wchar_t* path;
+    size_t size;
+    unsigned seed;
+  };
+
+  const SourceFile kSources[] = {
+    { 0, L"bin\\main.exe", 300 * 1024, 1 },
+    { 0, L"res\\empty.txt", 0, 2 },
+    { 0, L"res\\a.dat", 4096, 3 },
+    { 0, L"res\\deep\\er\\b.dat", 70000, 4 },
+    { 1, L"res\\a.dat", 4096, 3 },  // 与$1\res\a.dat相同，打包时去重
+    { 1, L"doc\\readme.txt", 1234, 5 },
+    { 1, L"doc\\c.dat", 4096, 6 },
+  };
+  const int kFakeDirs = 2;
+
+  std::string SourceContent(const SourceFile& f) {
+    std::string text;
+    text.reserve(f.size);
+    unsigned x = f.seed * 2654435761u + 1;
+    for (size_t i = 0; i < f.size; ++i) {
+      // 前半可压缩，后半近似随机
+      x = x * 1103515245u + 12345u;
+      text += i < f.size / 2 ? (char)('a' + i % 26) : (char)(x >> 16);
+    }
+    return text;
+  }
+
+  std::wstring SourcePath(const SourceFile& f) {
+    return L"src\\fake" + std::to_wstring(f.fake_dir) + L"\\" + f.path;
+  }
+
+  // AddSrcFile递归添加目录时保留目录名本身
+  std::wstring InstalledPath(const SourceFile& f) {
+    std::wstring dir = L"fake" + std::to_wstring(f.fake_dir);
+    return L"out\\" + dir + L"\\" + dir + L"\\" + f.path;
+  }
+
+  bool WriteSources() {
+    for (const SourceFile& f : kSources) {
+      std::wstring path = SourcePath(f);
+      if (!MakeDirs(path.substr(0, path.rfind(L'\\'))) || !WriteText(path.c_str(), SourceContent(f))) return false;
+    }
+    return true;
+  }
+
+  // 一次完整的打包和安装，config为config.ini的内容；streaming为流式安装。
+  // 成功时ctx已完成分发，由调用者校验并InstallContext_Free；失败时ctx已释放（或从未初始化），调用者不能再使用
+  // legacy_plugin不为NULL时，打包后把它补记为插件，模拟旧版打包程序记下了展开失败的插件；
+  // mode为暂存方式，stats不为NULL时取回打包完成后的暂存统计；dist_threads为安装时的分发线程数
+  bool PackAndInstall(const std::string& config, bool streaming, InstallContext* ctx, const wchar_t* legacy_plugin = nullptr,
+    StagingMode mode = StagingMode::kCopy, StagingStats* stats = nullptr, DWORD dist_threads = 0) {
+    *ctx = InstallContext{};
+    RemoveTree(L"out");
+    if (!WriteText(L"config.ini", config)) return false;
+    std::wstring install7z;
+    {
+      PackInstall pack;
+      pack.SetStagingMode(mode);
+      for (int k = 0; k < kFakeDirs; ++k) {
+        pack.SetCurrentFakeOutDir(L"$" + std::to_wstring(k + 1));
+        if (!pack.AddSrcFile(L"src\\fake" + std::to_wstring(k), 1, std::set<std::wstring>())) return false;
+      }
+      int build_compress = 0;
+      if (!pack.GenerateInstall7z(nullptr, build_compress)) return false;
+      install7z = pack.GetInstall7zPath();
+      if (stats) *stats = pack.GetStagingStats();
+    }
+    if (legacy_plugin) {
+      InstallDistInfo info;
+      bool patched = DistInfo_Load(&info, g_dist_info_name) && DistInfo_AddPlugin(&info, legacy_plugin, L"-t7z") >= 0 &&
+        DistInfo_Save(&info, L"patched.distinfo");
+      DistInfo_Free(&info);
+      if (!patched || !MoveFileExW(L"patched.distinfo", g_dist_info_name, MOVEFILE_REPLACE_EXISTING)) return false;
+    }
+
+    // InstallContext_Init失败时也已分配了部分状态，同样需要释放
+    bool ok = InstallContext_Init(ctx, g_dist_info_name) != 0;
+    ctx->streaming = streaming;
+    ctx->dist_threads = dist_threads;
+    if (ok && streaming) {
+      for (int k = 0; k < kFakeDirs && ok; ++k) ok = SetCurrentRealOutDir(ctx, (L"out\\fake" + std::to_wstring(k)).c_str()) != 0;
+    }
+    ok = ok && ExtractInstall7z(ctx, install7z.c_str());
+    if (!streaming) {
+      for (int k = 0; k < kFakeDirs && ok; ++k) ok = SetCurrentRealOutDir(ctx, (L"out\\fake" + std::to_wstring(k)).c_str()) != 0;
+    }
+    if (!ok) {
+      InstallContext_Free(ctx);
+      *ctx = InstallContext{};
+    }
+    return ok;
+  }
+
+  // 安装结果与源文件逐字节相同，且通过VerifyInstalledFiles
+  void CheckInstalled(InstallContext* ctx) {
+    for (const SourceFile& f : kSources) {
+      int same = FileOps_SameContent(SourcePath(f).c_str(), InstalledPath(f).c_str());
+      CHECK(same == 1);
+      if (same != 1) fprintf(stderr, "  installed file differs: %ls\n", InstalledPath(f).c_str());
+    }
+    CHECK(ctx->distinfo.has_file_digests);
+    CHECK(VerifyInstalledFiles(ctx));
+    CHECK(ctx->mismatch_count == 0);
+  }
+
+  void TestInstallVerify() {
+    InstallContext ctx{};
+    bool ok = PackAndInstall("[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast128\r\n", false, &ctx);
+    CHECK(ok);
+    if (!ok) return;
+    CheckInstalled(&ctx);
+    // 改写一个文件（大小不变）、截短一个文件、删除一个文件
+    std::string content = SourceContent(kSources[2]);
+    content[100] ^= 1;
+    CHECK(WriteText(InstalledPath(kSources[2]).c_str(), content));
+    CHECK(WriteText(InstalledPath(kSources[5]).c_str(), "short"));
+    CHECK(DeleteFileW(InstalledPath(kSources[6]).c_str()));
+    CHECK(!VerifyInstalledFiles(&ctx));
+    CHECK(ctx.mismatch_count == 3);
+    if (ctx.mismatch_count == 3) {
+      // 按目录、文件序号排序
+      CHECK(ctx.mismatches[0].dir_idx == 0 && ctx.mismatches[0].reason == VERIFY_HASH);
+      CHECK(ctx.mismatches[1].dir_idx == 1 && ctx.mismatches[2].dir_idx == 1);
+      DWORD reasons = (1u << ctx.mismatches[1].reason) | (1u << ctx.mismatches[2].reason);
+      CHECK(reasons == ((1u << VERIFY_SIZE) | (1u << VERIFY_MISSING)));
+    }
+    InstallContext_Free(&ctx);
+    DeleteFileW(g_dist_info_name);
+  }
+
+  void TestDistInfoShards() {
+    InstallDistInfo info;
+    BuildSample(&info);
+    CHECK(DistInfo_AddShard(&info, L"install_12345_1.7z") == 0);
+    CHECK(DistInfo_AddShard(&info, L"install_12345_2.7z") == 1);
+    CHECK(DistInfo_SaveVersion(&info, L"test.distinfo", DISTINFO_VERSION_3));
+    InstallDistInfo loaded;
+    CHECK(DistInfo_Load(&loaded, L"test.distinfo"));
+    CheckSameInfo(&info, &loaded);
+    CHECK(loaded.shard_count == 2);
+    if (loaded.shard_count == 2) {
+      CHECK(wcscmp(loaded.shard_names[0], L"install_12345_1.7z") == 0);
+      CHECK(wcscmp(loaded.shard_names[1], L"install_12345_2.7z") == 0);
+    }
+    DistInfo_Free(&loaded);
+    DistInfo_Free(&info);
+    DeleteFileW(L"test.distinfo");
+  }
+
+  // 分片、流式安装及两者组合，安装结果均与源文件相同
+  void TestShardedAndStreamingInstall() {
+    const struct {
+      const char* config;
+      bool streaming;
+      DWORD min_archives;
+    } cases[] = {
+      { "[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast64\r\n[shards]\r\n3\r\n", false, 2 },
+      { "[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\ncrc32c\r\n", true, 1 },
+      { "[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast128\r\n[shards]\r\n3\r\n", true, 2 },
+      // 试压缩样本经stdin交给7z、解压到内存比对
+      { "[compress_param]\r\nauto\r\n[compress_auto_budget]\r\n10\r\n[file_hash]\r\nfast64\r\n[shards]\r\n2\r\n", false, 2 },
+    };
+    for (const auto& c : cases) {
+      InstallContext ctx{};
+      bool ok = PackAndInstall(c.config, c.streaming, &ctx);
+      CHECK(ok);
+      if (!ok) continue;
+      CHECK(ctx.archive_count >= c.min_archives);
+      CHECK(ctx.distinfo.shard_count + 1 == ctx.archive_count);
+      CheckInstalled(&ctx);
+      InstallContext_Free(&ctx);
+      DeleteFileW(g_dist_info_name);
+    }
+  }
+
+  // 各暂存方式的统计：复制模式全部复制（多线程暂存），链接模式在同一卷上不复制，
+  // 免暂存模式不放入临时目录，只有改名的文件按链接方式暂存；安装结果都与源文件相同
+  void TestStagingModes() {
+    const std::string base = "[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast64\r\n";
+    const uint32_t count = (uint32_t)(sizeof(kSources) / sizeof(kSources[0]));
+    const struct {
+      StagingMode mode;
+      std::string config;
+    } cases[] = {
+      { StagingMode::kCopy, base + "[staging_threads]\r\n4\r\n" },
+      { StagingMode::kLink, base },
+      { StagingMode::kVirtual, base },
+    };
+    for (const auto& c : cases) {
+      InstallContext ctx{};
+      StagingStats stats{};
+      bool ok = PackAndInstall(c.config, false, &ctx, nullptr, c.mode, &stats);
+      CHECK(ok);
+      if (!ok) continue;
+      if (c.mode == StagingMode::kCopy) CHECK(stats.copied == count && stats.cloned == 0 && stats.hardlinked == 0);
+      if (c.mode == StagingMode::kLink) CHECK(stats.copied == 0 && stats.cloned + stats.hardlinked == count);
+      if (c.mode == StagingMode::kVirtual) CHECK(stats.copied == 0 && stats.cloned == 0 && stats.hardlinked == 0);
+      CheckInstalled(&ctx);
+      InstallContext_Free(&ctx);
+      DeleteFileW(g_dist_info_name);
+    }
+
+    CHECK(WriteText(L"config.ini", base));
+    PackInstall pack;
+    pack.SetStagingMode(StagingMode::kVirtual);
+    pack.SetCurrentFakeOutDir(L"$1");
+    CHECK(pack.AddSrcFile(L"src\\fake0\\res\\a.dat", L"res\\a.dat") == 4096);
+    CHECK(pack.AddSrcFile(L"src\\fake0\\res\\a.dat", L"renamed.dat") == 4096);
+    int build_compress = 0;
+    CHECK(pack.GenerateInstall7z(nullptr, build_compress));
+    StagingStats stats = pack.GetStagingStats();
+    CHECK(stats.copied == 0 && stats.cloned + stats.hardlinked == 1);
+    DeleteFileW(g_dist_info_name);
+  }
+
+  // 分发方式：临时文件的最后一个使用者移动过去；fake0\res\a.dat还要给fake1用，只能克隆或复制，
+  // 首选的克隆不可用时记为回退。两处安装的内容互不影响（没有硬链接到同一份数据）
+  void TestDistributionMethods() {
+    InstallContext ctx{};
+    bool ok = PackAndInstall("[compress_param]\r\n-t7z -mx=1\r\n", false, &ctx);
+    CHECK(ok);
+    if (!ok) return;
+    const DWORD count = (DWORD)(sizeof(kSources) / sizeof(kSources[0]));
+    CHECK(ctx.dist_counts[DIST_METHOD_MOVE] == count - 1);
+    CHECK(ctx.dist_counts[DIST_METHOD_HARDLINK] == 0);
+    CHECK(ctx.dist_counts[DIST_METHOD_CLONE] + ctx.dist_counts[DIST_METHOD_COPY] == 1);
+    CHECK(ctx.fallback_count == ctx.dist_counts[DIST_METHOD_COPY]);
+    if (ctx.fallback_count == 1) {
+      const DistFallback& fb = ctx.fallbacks[0];
+      CHECK(fb.dir_idx == 0 && wcscmp(ctx.distinfo.dirs[0].file_list[fb.file_idx], L"fake0\\res\\a.dat") == 0);
+      CHECK(fb.preferred == DIST_METHOD_CLONE && fb.method == DIST_METHOD_COPY);
+    }
+    for (const SourceFile& f : kSources) {
+      CHECK(FileOps_SameContent(SourcePath(f).c_str(), InstalledPath(f).c_str()) == 1);
+    }
+    CHECK(WriteText(InstalledPath(kSources[2]).c_str(), "changed"));
+    CHECK(FileOps_SameContent(SourcePath(kSources[4]).c_str(), InstalledPath(kSources[4]).c_str()) == 1);
+    InstallContext_Free(&ctx);
+    DeleteFileW(g_dist_info_name);
+  }
+
+  // 并行分发与逐个分发的结果相同：各方式的计数、按文件顺序排好的回退记录以及安装的内容
+  void TestParallelDistribution() {
+    const DWORD threads[] = { 1, 8 };
+    std::vector<DWORD> counts[2];
+    std::vector<std::pair<DWORD, DWORD>> fallbacks[2];
+    for (int t = 0; t < 2; ++t) {
+      for (int streaming = 0; streaming < 2; ++streaming) {
+        InstallContext ctx{};
+        bool ok = PackAndInstall("[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast64\r\n", streaming != 0, &ctx,
+          nullptr, StagingMode::kCopy, nullptr, threads[t]);
+        CHECK(ok);
+        if (!ok) continue;
+        CheckInstalled(&ctx);
+        if (!streaming) {
+          counts[t].assign(ctx.dist_counts, ctx.dist_counts + DIST_METHOD_COUNT);
+          for (DWORD i = 0; i < ctx.fallback_count; ++i) fallbacks[t].emplace_back(ctx.fallbacks[i].dir_idx, ctx.fallbacks[i].file_idx);
+        }
+        InstallContext_Free(&ctx);
+        DeleteFileW(g_dist_info_name);
+      }
+    }
+    CHECK(!counts[0].empty() && counts[0] == counts[1]);
+    CHECK(fallbacks[0] == fallbacks[1]);
+  }
+
+  bool IsDir(const wchar_t* path) {
+    DWORD attr = GetFileAttributesW(path);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+  }
+
+  // 目录缓存：逐级创建缺少的上级目录，创建过或探测过的目录再次请求时命中缓存而不再调用系统
+  void TestDirCache() {
+    RemoveTree(L"dc");
+    DirCache cache;
+    DirCache_Init(&cache);
+    CHECK(DirCache_Ensure(&cache, L"dc\\a\\b\\c"));
+    CHECK(IsDir(L"dc\\a\\b\\c"));
+    CHECK(cache.created == 4 && cache.hits == 0);
+    // 末尾的分隔符不影响命中，上级目录在递归创建时也已记录
+    CHECK(DirCache_Ensure(&cache, L"dc\\a\\b\\c\\"));
+    CHECK(DirCache_Ensure(&cache, L"dc\\a"));
+    CHECK(cache.created == 4 && cache.hits == 2);
+    // 上级目录已存在时直接创建
+    CHECK(DirCache_EnsureParent(&cache, L"dc\\a\\x\\f.txt"));
+    CHECK(IsDir(L"dc\\a\\x") && !IsDir(L"dc\\a\\x\\f.txt"));
+    CHECK(cache.created == 5 && cache.hits == 2);
+    CHECK(DirCache_EnsureParent(&cache, L"f.txt"));
+    CHECK(cache.created == 5 && cache.hits == 2);
+
+    // 批量创建：重复的只处理一次，上级先于下级
+    const wchar_t* dirs[] = { L"dc\\m\\n", L"dc\\m", L"dc\\m\\n", L"dc\\m\\o" };
+    CHECK(DirCache_EnsureAll(&cache, dirs, 4));
+    CHECK(IsDir(L"dc\\m\\n") && IsDir(L"dc\\m\\o"));
+    CHECK(cache.created == 8 && cache.hits == 2);
+    DirCache_Free(&cache);
+
+    // 新的缓存遇到已存在的目录：不计为创建，之后命中
+    DirCache_Init(&cache);
+    CHECK(DirCache_Ensure(&cache, L"dc\\a\\b"));
+    CHECK(DirCache_Ensure(&cache, L"dc\\a\\b"));
+    CHECK(cache.created == 0 && cache.hits == 1);
+    // 路径中有同名文件时失败
+    CHECK(WriteText(L"dc\\file", "x"));
+    CHECK(!DirCache_Ensure(&cache, L"dc\\file"));
+    CHECK(!DirCache_Ensure(&cache, L"dc\\file\\sub"));
+    DirCache_Free(&cache);
+    RemoveTree(L"dc");
+  }
+
+  // 命令行按CommandLineToArgvW的规则拆分：引号、""、以及反斜杠只在引号前转义
+  void TestSplitCommandLine() {
+    const struct {
+      const wchar_t* line;
+      std::vector<std::wstring> args;
+    } cases[] = {
+      { L"", {} },
+      { L"  \t ", {} },
+      { L" a  b\tc ", { L"a", L"b", L"c" } },
+      { L"\"C:\\Program Files\\7-Zip\\7z.exe\" x \"a b.7z\" -o\"out dir\" -y",
+        { L"C:\\Program Files\\7-Zip\\7z.exe", L"x", L"a b.7z", L"-oout dir", L"-y" } },
+      { L"C:\\dir\\file \\\\server\\share", { L"C:\\dir\\file", L"\\\\server\\share" } },
+      { L"\"\"", { L"" } },
+      { L"a \"\" b", { L"a", L"", L"b" } },
+      { L"\\\"a", { L"\"a" } },  // \"：字面引号
+      { L"a\\\\\"b c\"", { L"a\\b c" } },  // \\"：一个反斜杠，引号开始
+      { L"a\\\\\\\"b", { L"a\\\"b" } },  // \\\"：一个反斜杠加字面引号
+      { L"\"dir\\\\\" next", { L"dir\\", L"next" } },  // 引号内以反斜杠结尾的目录
+      { L"\"a\"\"b\" c", { L"a\"b", L"c" } },  // 引号内的""为字面引号
+      { L"\"unterminated arg", { L"unterminated arg" } },
+    };
+    for (const auto& c : cases) {
+      std::vector<std::wstring> args = ProcessExecutor::SplitCommandLine(c.line);
+      CHECK(args == c.args);
+      if (args != c.args) fprintf(stderr, "  split mismatch: %ls\n", c.line);
+    }
+  }
+
+  // 分片按大小均衡（LPT），同一单位的文件在同一分片，结果与输入顺序无关
+  void TestPartitionShards() {
+    // 第6、7项是同一插件展开出的文件（unit相同），合计60
+    const struct {
+      const wchar_t* rel;
+      uint64_t size;
+      size_t unit;
+    } files[] = {
+      { L"a", 100, 0 }, { L"b", 90, 1 }, { L"c", 80, 2 }, { L"d", 70, 3 }, { L"e", 50, 4 },
+      { L"p.nsisbin\\x", 35, 5 }, { L"p.nsisbin\\y", 25, 5 }, { L"f", 40, 6 }, { L"g", 30, 7 }, { L"h", 20, 8 },
+    };
+    std::vector<PackItem> items;
+    for (const auto& f : files) items.push_back(PackItem{ f.rel, L"root", f.size, 0, f.unit });
+    auto shard_of = [](const std::vector<std::vector<PackItem>>& shards, const std::wstring& rel) {
+      for (size_t k = 0; k < shards.size(); ++k) {
+        for (const auto& item : shards[k]) {
+          if (item.rel == rel) return (int)k;
+        }
+      }
+      return -1;
+    };
+
+    std::vector<std::vector<PackItem>> shards = PackInstall::PartitionShards(items, 3);
+    CHECK(shards.size() == 3);
+    std::vector<uint64_t> loads;
+    size_t count = 0;
+    for (const auto& shard : shards) {
+      uint64_t load = 0;
+      for (const auto& item : shard) load += item.size;
+      loads.push_back(load);
+      count += shard.size();
+    }
+    // 降序依次放入最小的分片：100|90|80，70->3，60->2，50->1，40->1，30->2，20->3
+    std::sort(loads.begin(), loads.end());
+    CHECK(count == items.size());
+    CHECK(loads.size() == 3 && loads[0] == 170 && loads[1] == 180 && loads[2] == 190);
+    CHECK(shard_of(shards, L"p.nsisbin\\x") == shard_of(shards, L"p.nsisbin\\y"));
+
+    // 输入顺序不影响结果
+    std::vector<PackItem> reversed(items.rbegin(), items.rend());
+    std::vector<std::vector<PackItem>> again = PackInstall::PartitionShards(reversed, 3);
+    CHECK(again.size() == shards.size());
+    for (const auto& f : files) CHECK(shard_of(again, f.rel) == shard_of(shards, f.rel));
+
+    // 单位数少于分片数时减少分片，不产生空分片
+    std::vector<PackItem> few(items.begin() + 5, items.begin() + 8);
+    shards = PackInstall::PartitionShards(few, 4);
+    CHECK(shards.size() == 2);
+    for (const auto& shard : shards) CHECK(!shard.empty());
+    CHECK(PackInstall::PartitionShards(items, 1).size() == 1);
+    CHECK(PackInstall::PartitionShards(items, 1)[0].size() == items.size());
+  }
+
+  // 记录命令的假归档后端：run_stream保存stdin数据，对每条命令按chunk分段回放output
+  struct FakeArchive {
+    std::vector<std::wstring> commands;
+    std::string input;
+    std::string output;
+    size_t chunk = 3;
+  };
+
+  int FakeRun(const ArchiveBackend* backend, const wchar_t* args, const wchar_t* work_dir) {
+    (void)work_dir;
+    ((FakeArchive*)backend->user)->commands.push_back(args);
+    return 1;
+  }
+
+  int FakeRunStream(const ArchiveBackend* backend, const wchar_t* args, const void* input, size_t input_size,
+    Archive_OutputCallback output, void* output_arg) {
+    FakeArchive* fake = (FakeArchive*)backend->user;
+    fake->commands.push_back(args);
+    if (input) fake->input.assign((const char*)input, input_size);
+    for (size_t pos = 0; output && pos < fake->output.size(); pos += fake->chunk) {
+      if (!output(output_arg, fake->output.data() + pos, (std::min)(fake->chunk, fake->output.size() - pos))) return 0;
+    }
+    return 1;
+  }
+
+  struct CollectedItems {
+    std::vector<std::string> data;
+    std::vector<int> ends;
+    DWORD abort_index = (DWORD)-1;
+  };
+
+  int CollectItem(void* arg, DWORD index, const void* data, size_t size) {
+    CollectedItems* got = (CollectedItems*)arg;
+    if (index == got->abort_index) return 0;
+    if (got->data.size() <= index) {
+      got->data.resize(index + 1);
+      got->ends.resize(index + 1);
+    }
+    if (data) got->data[index].append((const char*)data, size);
+    else ++got->ends[index];
+    return 1;
+  }
+
+  // Archive_AddBuffer/Archive_ExtractItems生成的命令及数据流向，以及超长命令被拒绝而不是截断后执行
+  void TestArchiveCommands() {
+    FakeArchive fake;
+    ArchiveBackend backend = { L"fake", FakeRun, FakeRunStream, &fake };
+    CHECK(Archive_AddBuffer(&backend, L"s.7z", L"-t7z -mx=1", L"sample.txt", "hello", 5));
+    CHECK(fake.commands.size() == 1 && fake.commands.back() == L"a -t7z -mx=1 \"s.7z\" \"-sisample.txt\"");
+    CHECK(fake.input == "hello");
+    // 空数据也经stdin传入，7z读到EOF
+    fake.input = "x";
+    CHECK(Archive_AddBuffer(&backend, L"s.7z", L"-t7z", L"empty", NULL, 0));
+    CHECK(fake.input.empty());
+
+    fake.output = "0123456789";
+    const wchar_t* items[] = { L"a.txt", L"dir\\b.txt" };
+    CollectedItems got;
+    CHECK(Archive_ExtractItems(&backend, L"s.7z", items, 2, CollectItem, &got));
+    CHECK(fake.commands.size() == 4);
+    CHECK(fake.commands[2] == L"x \"s.7z\" -so \"a.txt\"");
+    CHECK(fake.commands[3] == L"x \"s.7z\" -so \"dir\\b.txt\"");
+    CHECK(got.data.size() == 2 && got.data[0] == fake.output && got.data[1] == fake.output);
+    CHECK(got.ends.size() == 2 && got.ends[0] == 1 && got.ends[1] == 1);
+    // 回调返回0时中止，不再执行后面的命令
+    CollectedItems aborted;
+    aborted.abort_index = 0;
+    CHECK(!Archive_ExtractItems(&backend, L"s.7z", items, 2, CollectItem, &aborted));
+    CHECK(fake.commands.size() == 5);
+
+    // 不支持stdin/stdout的后端（如进程内后端）明确失败
+    ArchiveBackend plain = { L"plain", FakeRun, NULL, &fake };
+    CHECK(!Archive_AddBuffer(&plain, L"s.7z", L"-t7z", L"sample.txt", "hello", 5));
+    CHECK(GetLastError() == ERROR_NOT_SUPPORTED);
+    CHECK(!Archive_ExtractItems(&plain, L"s.7z", items, 2, CollectItem, &got));
+    CHECK(fake.commands.size() == 5);
+
+    // 命令恰好放得下时照常执行，多一个字符即拒绝
+    const size_t limit = 4095;
+    std::wstring param(limit - wcslen(L"a  \"s.7z\" \"dir\\*\""), L'x');
+    CHECK(Archive_AddDir(&backend, L"s.7z", param.c_str(), L"dir"));
+    CHECK(fake.commands.size() == 6 && fake.commands.back().size() == limit);
+    param += L'x';
+    CHECK(!Archive_AddDir(&backend, L"s.7z", param.c_str(), L"dir"));
+    CHECK(GetLastError() == ERROR_INSUFFICIENT_BUFFER);
+    std::wstring out_dir(limit, L'o');
+    CHECK(!Archive_Extract(&backend, L"s.7z", out_dir.c_str(), NULL, L"-y"));
+    CHECK(!Archive_Create(&backend, L"s.7z", param.c_str(), L"work", L"list.lst"));
+    CHECK(!Archive_AddBuffer(&backend, L"s.7z", param.c_str(), L"sample", "x", 1));
+    CHECK(fake.commands.size() == 6);
+  }
+
+  // 打包缓存：未命中、保存后命中且内容一致；超出容量时淘汰最久未使用的条目，刚保存的条目不淘汰
+  void TestPackCache() {
+    RemoveTree(L"pcache");
+    BYTE keys[3][PACKCACHE_KEY_SIZE];
+    for (int k = 0; k < 3; ++k) memset(keys[k], k + 1, PACKCACHE_KEY_SIZE);
+    const std::string contents[3] = { std::string(100, 'a'), std::string(100, 'b'), std::string(100, 'c') };
+    PackCache cache;
+    CHECK(PackCache_Init(&cache, L"pcache", 250));
+    CHECK(!PackCache_Fetch(&cache, keys[0], L"got.7z"));
+    CHECK(cache.misses == 1 && cache.hits == 0);
+
+    CHECK(WriteText(L"new.7z", contents[0]));
+    CHECK(PackCache_Store(&cache, keys[0], L"new.7z"));
+    CHECK(PackCache_Fetch(&cache, keys[0], L"got.7z"));
+    CHECK(cache.hits == 1 && cache.misses == 1);
+    std::vector<BYTE> got;
+    CHECK(ReadAll(L"got.7z", got) && std::string(got.begin(), got.end()) == contents[0]);
+
+    // 使用时间取自文件修改时间，两步之间留出时钟粒度
+    Sleep(50);
+    CHECK(WriteText(L"new.7z", contents[1]));
+    CHECK(PackCache_Store(&cache, keys[1], L"new.7z"));
+    CHECK(cache.evicted == 0 && cache.entry_count == 2 && cache.total_bytes == 200);
+    // 命中刷新使用时间，之后最久未使用的是keys[1]
+    Sleep(50);
+    CHECK(PackCache_Fetch(&cache, keys[0], L"got.7z"));
+    Sleep(50);
+    CHECK(WriteText(L"new.7z", contents[2]));
+    CHECK(PackCache_Store(&cache, keys[2], L"new.7z"));
+    CHECK(cache.evicted == 1 && cache.evicted_bytes == 100);
+    CHECK(cache.entry_count == 2 && cache.total_bytes == 200);
+    CHECK(!PackCache_Fetch(&cache, keys[1], L"got.7z"));
+    CHECK(PackCache_Fetch(&cache, keys[0], L"got.7z"));
+    CHECK(PackCache_Fetch(&cache, keys[2], L"got.7z"));
+    CHECK(ReadAll(L"got.7z", got) && std::string(got.begin(), got.end()) == contents[2]);
+
+    // 总大小仍超过容量时只保留刚保存（覆盖）的这一个
+    PackCache small;
+    CHECK(PackCache_Init(&small, L"pcache", 50));
+    CHECK(WriteText(L"new.7z", contents[0]));
+    CHECK(PackCache_Store(&small, keys[0], L"new.7z"));
+    CHECK(small.evicted == 1 && small.evicted_bytes == 100);
+    CHECK(small.entry_count == 1 && small.total_bytes == 100);
+    CHECK(PackCache_Fetch(&small, keys[0], L"got.7z"));
+    RemoveTree(L"pcache");
+  }
+
+  bool HasFile(const InstallFakeDir& dir, const wchar_t* rel) {
+    for (DWORD j = 0; j < dir.file_count; ++j) {
+      if (wcscmp(dir.file_list[j], rel) == 0) return true;
+    }
+    return false;
+  }
+
+  // 跨fake目录同名不同内容：默认计数并保留先登记的那份，后来的目录跳过该文件；[staging_collision]为error时AddSrcFile失败
+  void TestStagingCollision() {
+    // z.txt两边相同，共享存储；x.txt同名同大小、内容不同
+    bool written = MakeDirs(L"coll1\\d") && MakeDirs(L"coll2\\d") &&
+      WriteText(L"coll1\\d\\x.txt", "first") && WriteText(L"coll1\\d\\z.txt", "same") &&
+      WriteText(L"coll2\\d\\x.txt", "other") && WriteText(L"coll2\\d\\y.txt", "only") &&
+      WriteText(L"coll2\\d\\z.txt", "same") && WriteText(L"single.txt", "single");
+    CHECK(written);
+    if (!written) return;
+
+    CHECK(WriteText(L"config.ini", "[compress_param]\r\n-t7z -mx=1\r\n"));
+    {
+      PackInstall pack;
+      pack.SetCurrentFakeOutDir(L"$1");
+      CHECK(pack.AddSrcFile(L"coll1\\d", 1, std::set<std::wstring>()) == 9);
+      pack.SetCurrentFakeOutDir(L"$2");
+      // 跳过的x.txt也计入返回值
+      CHECK(pack.AddSrcFile(L"coll2\\d", 1, std::set<std::wstring>()) == 13);
+      CHECK(pack.GetStagingCollisions() == 1);
+      CHECK(pack.AddSrcFile(L"single.txt", L"d\\x.txt") == 6);
+      CHECK(pack.GetStagingCollisions() == 2);
+      int build_compress = 0;
+      bool packed = pack.GenerateInstall7z(nullptr, build_compress);
+      CHECK(packed);
+      InstallDistInfo info;
+      if (packed && DistInfo_Load(&info, g_dist_info_name)) {
+        CHECK(info.dir_count == 2);
+        CHECK(HasFile(info.dirs[0], L"d\\x.txt") && HasFile(info.dirs[0], L"d\\z.txt"));
+        CHECK(!HasFile(info.dirs[1], L"d\\x.txt"));
+        CHECK(HasFile(info.dirs[1], L"d\\y.txt") && HasFile(info.dirs[1], L"d\\z.txt"));
+        DistInfo_Free(&info);
+      }
+    }
+    DeleteFileW(g_dist_info_name);
+
+    CHECK(WriteText(L"config.ini", "[compress_param]\r\n-t7z -mx=1\r\n[staging_collision]\r\nerror\r\n"));
+    {
+      PackInstall pack;
+      pack.SetCurrentFakeOutDir(L"$1");
+      CHECK(pack.AddSrcFile(L"coll1\\d", 1, std::set<std::wstring>()) == 9);
+      pack.SetCurrentFakeOutDir(L"$2");
+      CHECK(pack.AddSrcFile(L"coll2\\d", 1, std::set<std::wstring>()) == 0);
+      CHECK(pack.AddSrcFile(L"single.txt", L"d\\x.txt") == 0);
+      CHECK(pack.GetStagingCollisions() == 2);
+    }
+  }
+
+  // 打包端去重：fake1\res\a.dat与fake0\res\a.dat内容相同，distinfo中引用后者且只打包一份；
+  // 同大小不同内容的fake1\doc\c.dat和空文件仍各自存储
+  void TestDedupBlobRefs() {
+    CHECK(WriteText(L"config.ini", "[compress_param]\r\n-t7z -mx=1\r\n"));
+    PackInstall pack;
+    for (int k = 0; k < kFakeDirs; ++k) {
+      pack.SetCurrentFakeOutDir(L"$" + std::to_wstring(k + 1));
+      CHECK(pack.AddSrcFile(L"src\\fake" + std::to_wstring(k), 1, std::set<std::wstring>()) != 0);
+    }
+    int build_compress = 0;
+    bool packed = pack.GenerateInstall7z(nullptr, build_compress);
+    CHECK(packed);
+    CHECK(pack.GetDedupSavedBytes() == 4096);
+    InstallDistInfo info;
+    if (!packed || !DistInfo_Load(&info, g_dist_info_name)) {
+      CHECK(false);
+      return;
+    }
+    auto blob_of = [&info](DWORD dir_idx, const wchar_t* rel) -> std::wstring {
+      for (DWORD j = 0; dir_idx < info.dir_count && j < info.dirs[dir_idx].file_count; ++j) {
+        if (wcscmp(info.dirs[dir_idx].file_list[j], rel) == 0) return DistInfo_GetBlobPath(&info, dir_idx, j);
+      }
+      return std::wstring();
+    };
+    CHECK(blob_of(1, L"fake1\\res\\a.dat") == L"fake0\\res\\a.dat");
+    CHECK(blob_of(0, L"fake0\\res\\a.dat") == L"fake0\\res\\a.dat");
+    CHECK(blob_of(1, L"fake1\\doc\\c.dat") == L"fake1\\doc\\c.dat");
+    CHECK(blob_of(0, L"fake0\\res\\empty.txt") == L"fake0\\res\\empty.txt");
+    DistInfo_Free(&info);
+    DeleteFileW(g_dist_info_name);
+  }
+
+  // 流式安装中的插件：展开失败的插件不记入distinfo，按普通文件安装；
+  // distinfo中记有、归档中却没有.nsisbin目录的插件（旧版打包程序）也按普通文件解压
+  void TestStreamingPlugins() {
+    const std::string base = "[compress_param]\r\n-t7z -mx=1\r\n[file_hash]\r\nfast64\r\n";
+    InstallContext ctx{};
+    // c.dat不是归档，展开失败
+    bool ok = PackAndInstall(base + "[pre_extract_plugins]\r\nfake1\\doc\\c.dat: -t7z\r\n", true, &ctx);
+    CHECK(ok);
+    if (ok) {
+      CHECK(ctx.distinfo.plugin_count == 0);
+      CheckInstalled(&ctx);
+      InstallContext_Free(&ctx);
+    }
+    DeleteFileW(g_dist_info_name);
+
+    ok = PackAndInstall(base, true, &ctx, L"fake1\\doc\\c.dat");
+    CHECK(ok);
+    if (ok) {
+      CHECK(ctx.distinfo.plugin_count == 1);
+      CheckInstalled(&ctx);
+      InstallContext_Free(&ctx);
+    }
+    DeleteFileW(g_dist_info_name);
+  }
+
+  // XNSIS_LogSetLevel设置的级别在XNSIS_LogShutdown和重新初始化后保留
+  void TestLogLevelAcrossShutdown() {
+    int saved = XNSIS_LogGetLevel();
+    for (int level = XNSIS_LOG_LEVEL_ERROR; level <= XNSIS_LOG_LEVEL_DEBUG; ++level) {
+      XNSIS_LogSetLevel(level);
+      XNSIS_LogShutdown();
+      CHECK(XNSIS_LogGetLevel() == level);
+      CHECK(XNSIS_LOG_ENABLED(level));
+      CHECK(level == XNSIS_LOG_LEVEL_DEBUG || !XNSIS_LOG_ENABLED(level + 1));
+    }
+    // 重复关闭和未初始化时关闭都是安全的
+    XNSIS_LogShutdown();
+    XNSIS_LogShutdown();
+    CHECK(XNSIS_LogGetLevel() == XNSIS_LOG_LEVEL_DEBUG);
+    XNSIS_LogSetLevel(saved);
+  }
+}
+
+int main() {
+  // 损坏文件的诊断日志不是失败
+  XNSIS_LogSetLevel(XNSIS_LOG_LEVEL_ERROR);
+  wchar_t old_dir[MAX_PATH] = { 0 };
+  GetCurrentDirectoryW(MAX_PATH, old_dir);
+  CreateDirectoryW(L"test_work", NULL);
+  if (!SetCurrentDirectoryW(L"test_work")) {
+    fprintf(stderr, "cannot enter test_work\n");
+    return 2;
+  }
+
+  TestLogLevelAcrossShutdown();
+  TestDistInfoRoundTrip();
+  TestDistInfoCorrupted();
+  TestHashVectors();
+  TestDistInfoFileHash();
+  TestDistInfoShards();
+  TestSplitCommandLine();
+  TestPartitionShards();
+  TestArchiveCommands();
+  TestPackCache();
+  TestDirCache();
+  if (!WriteSources()) {
+    fprintf(stderr, "cannot write source files\n");
+    return 2;
+  }
+  TestInstallVerify();
+  TestShardedAndStreamingInstall();
+  TestStagingModes();
+  TestDistributionMethods();
+  TestParallelDistribution();
+  TestStreamingPlugins();
+  TestStagingCollision();
+  TestDedupBlobRefs();
+
+  XNSIS_LogShutdown();
+  SetCurrentDirectoryW(old_dir);
+  RemoveTree(L"test_work");
+  printf("%d checks, %d failed\n", g_checks, g_failures);
+  return g_failures ? 1 : 0;
+}
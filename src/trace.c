@@ -0,0 +1,260 @@
+#include "trace.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+volatile LONG g_trace_enabled = 0;
+
+typedef struct {
+  char ph;               // X：区间，b/e：异步区间开始/结束，C：计数器
+  const char* cat;
+  const char* name;
+  char* dyn_name;        // 动态名称（UTF-8），不为NULL时代替name
+  ULONGLONG ts;
+  ULONGLONG dur;
+  ULONGLONG id;          // 异步区间的序号
+  DWORD tid;
+  const char* arg_name;  // 可选的数值参数
+  LONGLONG value;
+} TraceEvent;
+
+typedef struct {
+  const char* name;
+  LONGLONG value;
+} TraceCounter;
+
+#define TRACE_MAX_COUNTERS 32
+#define TRACE_MAX_NAME 200
+
+static SRWLOCK g_lock = SRWLOCK_INIT;
+static TraceEvent* g_events;
+static size_t g_event_count;
+static size_t g_event_capacity;
+static TraceCounter g_counters[TRACE_MAX_COUNTERS];
+static DWORD g_counter_count;
+static ULONGLONG g_next_id;
+static wchar_t g_path[MAX_PATH];
+static LARGE_INTEGER g_freq;
+static LARGE_INTEGER g_origin;
+
+void Trace_Start(const wchar_t* path) {
+  if (!path || !*path) return;
+  AcquireSRWLockExclusive(&g_lock);
+  wcsncpy_s(g_path, MAX_PATH, path, _TRUNCATE);
+  if (!g_trace_enabled) {
+    QueryPerformanceFrequency(&g_freq);
+    QueryPerformanceCounter(&g_origin);
+    InterlockedExchange(&g_trace_enabled, 1);
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+  XNSIS_LOG(L"Tracing enabled: %s", path);
+}
+
+int Trace_StartFromEnv(void) {
+  wchar_t path[MAX_PATH];
+  DWORD len = GetEnvironmentVariableW(TRACE_ENV_VAR, path, MAX_PATH);
+  if (len == 0 || len >= MAX_PATH) return 0;
+  Trace_Start(path);
+  return 1;
+}
+
+ULONGLONG Trace_Now(void) {
+  if (!TRACE_ENABLED()) return 0;
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  ULONGLONG ticks = (ULONGLONG)(now.QuadPart - g_origin.QuadPart);
+  ULONGLONG freq = (ULONGLONG)g_freq.QuadPart;
+  return ticks / freq * 1000000 + ticks % freq * 1000000 / freq;
+}
+
+// 调用前已持有g_lock
+static TraceEvent* AppendEvent(char ph, const char* cat, const char* name) {
+  if (g_event_count == g_event_capacity) {
+    size_t capacity = g_event_capacity ? g_event_capacity * 2 : 1024;
+    TraceEvent* events = (TraceEvent*)realloc(g_events, capacity * sizeof(TraceEvent));
+    if (!events) return NULL;
+    g_events = events;
+    g_event_capacity = capacity;
+  }
+  TraceEvent* ev = &g_events[g_event_count++];
+  memset(ev, 0, sizeof(*ev));
+  ev->ph = ph;
+  ev->cat = cat;
+  ev->name = name;
+  ev->tid = GetCurrentThreadId();
+  return ev;
+}
+
+void Trace_SpanBegin(TraceSpan* span, const char* cat, const char* name) {
+  span->cat = cat;
+  span->name = name;
+  span->start = TRACE_ENABLED() ? Trace_Now() : 0;
+}
+
+void Trace_SpanEndArg(TraceSpan* span, const char* arg_name, ULONGLONG value) {
+  if (!TRACE_ENABLED()) return;
+  ULONGLONG end = Trace_Now();
+  AcquireSRWLockExclusive(&g_lock);
+  TraceEvent* ev = AppendEvent('X', span->cat, span->name);
+  if (ev) {
+    ev->ts = span->start;
+    ev->dur = end > span->start ? end - span->start : 0;
+    ev->arg_name = arg_name;
+    ev->value = (LONGLONG)value;
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+}
+
+void Trace_SpanEnd(TraceSpan* span) {
+  Trace_SpanEndArg(span, NULL, 0);
+}
+
+void Trace_AsyncW(const char* cat, const wchar_t* name, ULONGLONG start, ULONGLONG end) {
+  if (!TRACE_ENABLED()) return;
+  char utf8[TRACE_MAX_NAME + 1];
+  int len = WideCharToMultiByte(CP_UTF8, 0, name, -1, utf8, TRACE_MAX_NAME, NULL, NULL);
+  if (len <= 0) len = 1;
+  utf8[len - 1] = '\0';
+  AcquireSRWLockExclusive(&g_lock);
+  ULONGLONG id = ++g_next_id;
+  TraceEvent* begin = AppendEvent('b', cat, NULL);
+  if (begin) {
+    begin->dyn_name = _strdup(utf8);
+    begin->ts = start;
+    begin->id = id;
+  }
+  TraceEvent* finish = AppendEvent('e', cat, NULL);
+  if (finish) {
+    finish->dyn_name = _strdup(utf8);
+    finish->ts = end;
+    finish->id = id;
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+}
+
+void Trace_Count(const char* name, LONGLONG delta) {
+  if (!TRACE_ENABLED()) return;
+  ULONGLONG now = Trace_Now();
+  AcquireSRWLockExclusive(&g_lock);
+  TraceCounter* counter = NULL;
+  for (DWORD i = 0; i < g_counter_count; ++i) {
+    if (strcmp(g_counters[i].name, name) == 0) counter = &g_counters[i];
+  }
+  if (!counter && g_counter_count < TRACE_MAX_COUNTERS) {
+    counter = &g_counters[g_counter_count++];
+    counter->name = name;
+    counter->value = 0;
+  }
+  if (counter) {
+    counter->value += delta;
+    TraceEvent* ev = AppendEvent('C', "counter", name);
+    if (ev) {
+      ev->ts = now;
+      ev->arg_name = "value";
+      ev->value = counter->value;
+    }
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+}
+
+typedef struct {
+  char* data;
+  size_t size;
+  size_t capacity;
+  int failed;
+} JsonBuf;
+
+static void Put(JsonBuf* buf, const char* s, size_t len) {
+  if (buf->failed) return;
+  if (buf->size + len > buf->capacity) {
+    size_t capacity = buf->capacity ? buf->capacity * 2 : 65536;
+    while (capacity < buf->size + len) capacity *= 2;
+    char* data = (char*)realloc(buf->data, capacity);
+    if (!data) {
+      buf->failed = 1;
+      return;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+  memcpy(buf->data + buf->size, s, len);
+  buf->size += len;
+}
+
+#define PUT_LITERAL(buf, s) Put(buf, s, sizeof(s) - 1)
+
+static void PutString(JsonBuf* buf, const char* s) {
+  PUT_LITERAL(buf, "\"");
+  for (; *s; ++s) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      char esc[2] = { '\\', (char)c };
+      Put(buf, esc, 2);
+    }
+    else if (c < 0x20) {
+      char esc[8];
+      int n = sprintf_s(esc, sizeof(esc), "\\u%04x", c);
+      Put(buf, esc, (size_t)n);
+    }
+    else {
+      Put(buf, (const char*)&c, 1);
+    }
+  }
+  PUT_LITERAL(buf, "\"");
+}
+
+static void PutEvent(JsonBuf* buf, const TraceEvent* ev, DWORD pid) {
+  char num[160];
+  int n;
+  PUT_LITERAL(buf, "{\"name\":");
+  PutString(buf, ev->dyn_name ? ev->dyn_name : ev->name);
+  PUT_LITERAL(buf, ",\"cat\":");
+  PutString(buf, ev->cat);
+  n = sprintf_s(num, sizeof(num), ",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%lu,\"tid\":%lu", ev->ph, ev->ts, pid, ev->tid);
+  Put(buf, num, (size_t)n);
+  if (ev->ph == 'X') {
+    n = sprintf_s(num, sizeof(num), ",\"dur\":%llu", ev->dur);
+    Put(buf, num, (size_t)n);
+  }
+  if (ev->ph == 'b' || ev->ph == 'e') {
+    n = sprintf_s(num, sizeof(num), ",\"id\":%llu", ev->id);
+    Put(buf, num, (size_t)n);
+  }
+  if (ev->arg_name) {
+    PUT_LITERAL(buf, ",\"args\":{");
+    PutString(buf, ev->arg_name);
+    n = sprintf_s(num, sizeof(num), ":%lld}", ev->value);
+    Put(buf, num, (size_t)n);
+  }
+  PUT_LITERAL(buf, "}");
+}
+
+int Trace_Flush(void) {
+  if (!TRACE_ENABLED()) return 1;
+  JsonBuf buf = { NULL, 0, 0, 0 };
+  DWORD pid = GetCurrentProcessId();
+  wchar_t path[MAX_PATH];
+  AcquireSRWLockExclusive(&g_lock);
+  wcsncpy_s(path, MAX_PATH, g_path, _TRUNCATE);
+  size_t count = g_event_count;
+  PUT_LITERAL(&buf, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (size_t i = 0; i < g_event_count; ++i) {
+    if (i) PUT_LITERAL(&buf, ",\n");
+    PutEvent(&buf, &g_events[i], pid);
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+  PUT_LITERAL(&buf, "\n]}\n");
+
+  int ok = !buf.failed;
+  if (ok) {
+    HANDLE hFile = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD written = 0;
+    ok = hFile != INVALID_HANDLE_VALUE && WriteFile(hFile, buf.data, (DWORD)buf.size, &written, NULL) && written == buf.size;
+    if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+  }
+  if (ok) XNSIS_LOG(L"Trace written: %s, events=%zu", path, count);
+  else XNSIS_LOG(L"Failed to write trace: %s, error=%lu", path, GetLastError());
+  free(buf.data);
+  return ok;
+}
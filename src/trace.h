@@ -0,0 +1,69 @@
+#pragma once
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 阶段耗时追踪，输出Chrome trace-event格式的JSON（chrome://tracing或Perfetto打开）。
+  // 由环境变量XNSIS_TRACE（输出路径）或打包端config.ini的[trace]节开启；
+  // 未开启时每个埋点只读一次全局标志
+#define TRACE_ENV_VAR L"XNSIS_TRACE"
+
+  extern volatile LONG g_trace_enabled;
+#define TRACE_ENABLED() (g_trace_enabled != 0)
+
+  typedef struct {
+    ULONGLONG start;    // 微秒，相对于开启追踪的时刻
+    const char* cat;
+    const char* name;
+  } TraceSpan;
+
+  // 开启追踪，事件保存在内存中，Trace_Flush时写到path；重复调用只更新路径
+  void Trace_Start(const wchar_t* path);
+  // 环境变量XNSIS_TRACE非空时开启，返回是否开启
+  int Trace_StartFromEnv(void);
+  // 把目前为止的所有事件写到输出文件（覆盖），可多次调用
+  int Trace_Flush(void);
+  // 当前时间（微秒）
+  ULONGLONG Trace_Now(void);
+
+  // 同一线程内的嵌套区间，cat和name须为字符串常量
+  void Trace_SpanBegin(TraceSpan* span, const char* cat, const char* name);
+  void Trace_SpanEnd(TraceSpan* span);
+  // 结束区间并附带一个数值参数（如字节数、文件数）
+  void Trace_SpanEndArg(TraceSpan* span, const char* arg_name, ULONGLONG value);
+  // 跨线程的异步区间（如7z进程），在单独的轨道上显示；name可以是任意字符串
+  void Trace_AsyncW(const char* cat, const wchar_t* name, ULONGLONG start, ULONGLONG end);
+  // 累加计数器并记录新的总值
+  void Trace_Count(const char* name, LONGLONG delta);
+
+#ifdef __cplusplus
+}
+
+// 作用域区间：构造时开始，析构时结束
+class TraceScope {
+public:
+  TraceScope(const char* cat, const char* name) : arg_name_(nullptr), arg_(0) { Trace_SpanBegin(&span_, cat, name); }
+  ~TraceScope() {
+    if (arg_name_) Trace_SpanEndArg(&span_, arg_name_, arg_);
+    else Trace_SpanEnd(&span_);
+  }
+  void SetArg(const char* name, ULONGLONG value) {
+    arg_name_ = name;
+    arg_ = value;
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  TraceSpan span_;
+  const char* arg_name_;
+  ULONGLONG arg_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(cat, name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(cat, name)
+#endif
@@ -0,0 +1,113 @@
+#include "workpool.h"
+
+namespace {
+  // 当前线程所属的线程池及其工作线程序号
+  thread_local WorkStealingPool* t_pool = nullptr;
+  thread_local unsigned t_worker_idx = 0;
+}
+
+unsigned WorkStealingPool::DefaultWorkerCount() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned worker_count) {
+  if (worker_count == 0) worker_count = DefaultWorkerCount();
+  for (unsigned i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  for (unsigned i = 0; i < worker_count; ++i) {
+    workers_[i]->thread = std::thread(&WorkStealingPool::WorkerMain, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stop_ = true;
+  }
+  idle_cv_.notify_all();
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) worker->thread.join();
+  }
+}
+
+void WorkStealingPool::Submit(Task task) {
+  unsigned idx = (t_pool == this) ? t_worker_idx : next_++ % (unsigned)workers_.size();
+  pending_++;
+  {
+    std::lock_guard<std::mutex> lock(workers_[idx]->mutex);
+    workers_[idx]->tasks.push_back(std::move(task));
+  }
+  queued_++;
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+  }
+  idle_cv_.notify_one();
+}
+
+void WorkStealingPool::Wait() {
+  std::unique_lock<std::mutex> lock(idle_mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool WorkStealingPool::PopLocal(unsigned idx, Task& task) {
+  Worker& worker = *workers_[idx];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if (worker.tasks.empty()) return false;
+  task = std::move(worker.tasks.back());
+  worker.tasks.pop_back();
+  queued_--;
+  return true;
+}
+
+bool WorkStealingPool::Steal(unsigned idx, Task& task) {
+  unsigned count = (unsigned)workers_.size();
+  for (unsigned i = 1; i < count; ++i) {
+    Worker& victim = *workers_[(idx + i) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.tasks.empty()) continue;
+    task = std::move(victim.tasks.front());
+    victim.tasks.pop_front();
+    queued_--;
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingPool::WorkerMain(unsigned idx) {
+  t_pool = this;
+  t_worker_idx = idx;
+  while (true) {
+    Task task;
+    if (PopLocal(idx, task) || Steal(idx, task)) {
+      task();
+      if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        done_cv_.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0) return;
+  }
+}
+
+void TaskGroup::Run(WorkStealingPool::Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++outstanding_;
+  }
+  pool_.Submit([this, task]() {
+    task();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--outstanding_ == 0) cv_.notify_all();
+  });
+}
+
+void TaskGroup::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return outstanding_ == 0; });
+}
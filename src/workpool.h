@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池：每个工作线程维护自己的任务队列，本线程从队尾取任务（LIFO），
+// 空闲线程从其他线程的队首窃取（FIFO），避免一个很深的子树拖住其他线程
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(unsigned worker_count);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // 提交任务；在工作线程内提交时放入该线程自己的队列
+  void Submit(Task task);
+  // 等待所有已提交的任务（包括任务中派生的任务）完成，不能在工作线程内调用
+  void Wait();
+  unsigned WorkerCount() const { return (unsigned)workers_.size(); }
+
+  // 默认线程数：硬件线程数，至少为1
+  static unsigned DefaultWorkerCount();
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  bool PopLocal(unsigned idx, Task& task);
+  bool Steal(unsigned idx, Task& task);
+  void WorkerMain(unsigned idx);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::condition_variable done_cv_;
+  std::atomic<size_t> pending_{ 0 };  // 已提交但未执行完的任务数
+  std::atomic<size_t> queued_{ 0 };   // 仍在队列中的任务数
+  std::atomic<unsigned> next_{ 0 };   // 外部提交时轮询选择队列
+  bool stop_ = false;
+};
+
+// 任务组：在共享线程池中等待一组任务完成，而不必等待池中的其他任务
+class TaskGroup {
+public:
+  explicit TaskGroup(WorkStealingPool& pool) : pool_(pool) {}
+  ~TaskGroup() { Wait(); }
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  // 提交属于本组的任务；任务内可以继续向本组提交
+  void Run(WorkStealingPool::Task task);
+  void Wait();
+
+private:
+  WorkStealingPool& pool_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t outstanding_ = 0;
+};